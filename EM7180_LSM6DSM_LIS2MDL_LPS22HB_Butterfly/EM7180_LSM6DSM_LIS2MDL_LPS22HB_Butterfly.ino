@@ -2,7 +2,12 @@
 #include "LIS2MDL.h"
 #include "LPS22HB.h"
 #include "USFS.h"
+#include "Altitude.h"
+#include "VerticalFilter.h"
+#include "TempBias.h"
+#include "MagCal.h"
 #include <RTC.h>
+#include <EEPROM.h>
 
 bool SerialDebug = true;  // set to true to get Serial output for debugging
 bool passThru  = false;
@@ -45,12 +50,29 @@ float eInt[3] = {0.0f, 0.0f, 0.0f};       // vector to hold integral error for M
       GODR_12_5Hz, GODR_26Hz, GODR_52Hz, GODR_104Hz, GODR_208Hz, GODR_416Hz, GODR_833Hz, GODR_1660Hz, GODR_3330Hz, GODR_6660Hz
 */ 
 uint8_t Ascale = AFS_2G, Gscale = GFS_245DPS, AODR = AODR_208Hz, GODR = GODR_416Hz;
+uint8_t LSM6DSM_watermark = 0;  // 0 reads every sample on data ready; 1 - 64 FIFO periods per wakeup from the FIFO
+uint8_t GFIFO_DEC = FIFO_DEC_1, AFIFO_DEC = FIFO_DEC_2, TFIFO_DEC = FIFO_DEC_32; // FIFO runs at GODR, accel at AODR
+bool LSM6DSM_timestamps = true; // FIFO dt from the chip's 25 us timestamp counter, it takes TFIFO_DEC from the temperature
+bool LSM6DSM_sensorHub = false; // LIS2MDL on the LSM6DSM auxiliary bus, read by the LSM6DSM into its FIFO; needs the FIFO
+uint8_t MFIFO_DEC = FIFO_DEC_4; // sensor hub words at GODR/4, the hub reads the mag every other 208 Hz accel sample
+lsm6dsm_fifo_t LSM6DSMfifo;
 
 float aRes, gRes;              // scale resolutions per LSB for the accel and gyro sensor2
 float accelBias[3] = {-0.00499, 0.01540, 0.02902}, gyroBias[3] = {-0.50, 0.14, 0.28}; // offset biases for the accel and gyro
 int16_t LSM6DSMData[7];        // Stores the 16-bit signed sensor output
 float   Gtemperature;           // Stores the real internal gyro temperature in degrees Celsius
 float ax, ay, az, gx, gy, gz;  // variables to hold latest accel/gyro data values 
+TempBias gyroTempBias(0.001f); // whole gyro bias against Gtemperature (dps), learned whenever the board is still
+bool gyroTempBiasReady = false; // the model is fitted and replaces the power-up gyroBias
+uint16_t gyroStill = 0;        // consecutive samples that look stationary
+float gyroMean[3] = {0.0f, 0.0f, 0.0f}, gyroSpread[3] = {1.0f, 1.0f, 1.0f}; // running mean (dps) and variance (dps^2) per axis
+const float gyroStillSpread = 0.15f; // rms about the running mean (dps) below which the gyro reads only noise and bias
+const float gyroBiasStep = 1.0f;     // largest believable change of bias from the known one (dps), more is a steady turn
+uint32_t gyroTempBiasSaved = 0;      // observations at the last save
+uint32_t gyroTempBiasSaveTime = 0;   // millis() at the last save
+#define GYRO_TEMPBIAS_EEPROM   0       // emulated EEPROM address of the gyro bias record
+#define GYRO_TEMPBIAS_MAGIC    0x47    // 'G'
+#define GYRO_TEMPBIAS_SAVE_MS  600000  // save at most every 10 minutes, the emulated EEPROM sits in flash
 
 bool newLSM6DSMData = false;
 bool newLSM6DSMTap  = false;
@@ -68,6 +90,8 @@ uint8_t MODR = MODR_100Hz;
 
 float mRes = 0.0015f;            // mag sensitivity
 float magBias[3] = {0,0,0}, magScale[3]  = {0,0,0}; // Bias corrections for magnetometer
+bool magCalBackground = true;    // fit hard and soft iron while running instead of the blocking min/max sweep
+MagCal magCal;                   // ellipsoid fit, full 3x3 soft iron matrix plus offset
 int16_t LIS2MDLData[4];          // Stores the 16-bit signed sensor output
 float Mtemperature;              // Stores the real internal chip temperature in degrees Celsius
 float mx, my, mz;                // variables to hold latest mag data values 
@@ -85,8 +109,13 @@ uint8_t LPS22H_intPin = 5;
    Choices are P_1Hz, P_10Hz P_25 Hz, P_50Hz, and P_75Hz
  */
 uint8_t PODR = P_25Hz;     // set pressure amd temperature output data rate
+uint8_t LPS22H_watermark = 0;  // 0 reads every sample on data ready; 1 - 31 buffers in the FIFO and wakes once per watermark
+lps22h_sample_t LPS22Hsamples[LPS22H_FIFO_DEPTH];
 uint8_t LPS22Hstatus;
 float temperature, pressure, altitude;
+Altitude altimeter;        // pressure to altitude in feet, altimeter.setQNH() sets the sea level reference
+VerticalFilter vertical;   // baro-inertial altitude (m) and climb rate (m/s) at the accel/gyro rate
+uint32_t lastVertical = 0;
 
 bool newLPS22HData = false;
 
@@ -174,6 +203,7 @@ void setup() {
 
   // Read the LIS2MDL Chip ID register, this is a good test of communication
   Serial.println("LIS2MDL mag...");
+  if(LSM6DSM_sensorHub) LSM6DSM.passThrough(true); // the LIS2MDL sits behind the LSM6DSM
   byte d = LIS2MDL.getChipID();  // Read CHIP_ID register for LSM6DSM
   Serial.print("LIS2MDL "); Serial.print("I AM "); Serial.print(d, HEX); Serial.print(" I should be "); Serial.println(0x40, HEX);
   Serial.println(" ");
@@ -204,8 +234,18 @@ void setup() {
    LSM6DSM.offsetBias(gyroBias, accelBias);
    Serial.println("accel biases (mg)"); Serial.println(1000.0f * accelBias[0]); Serial.println(1000.0f * accelBias[1]); Serial.println(1000.0f * accelBias[2]);
    Serial.println("gyro biases (dps)"); Serial.println(gyroBias[0]); Serial.println(gyroBias[1]); Serial.println(gyroBias[2]);
+   if(loadGyroTempBias()) {
+     LSM6DSM.readData(LSM6DSMData);
+     gyroTempBias.setTemperature(((float) LSM6DSMData[0]) / 256.0f + 25.0f);
+     Serial.print("gyro bias model restored, "); Serial.print(gyroTempBias.bias[0]); Serial.print(" ");
+     Serial.print(gyroTempBias.bias[1]); Serial.print(" "); Serial.print(gyroTempBias.bias[2]); Serial.println(" dps here");
+   }
+   if(LSM6DSM_watermark && LSM6DSM_timestamps) LSM6DSM.initTimestamp();
+   if(LSM6DSM_watermark) LSM6DSM.initFIFO(GODR, LSM6DSM_FIFO_CONTINUOUS, GFIFO_DEC, AFIFO_DEC,
+                                          LSM6DSM_sensorHub ? MFIFO_DEC : FIFO_DEC_OFF, TFIFO_DEC, LSM6DSM_watermark);
    delay(1000); 
 
+   if(LSM6DSM_sensorHub) LSM6DSM.passThrough(true); // the reset above dropped pass through
    LIS2MDL.reset(); // software reset LIS2MDL to default registers
 
    mRes = 0.0015f;  // fixed sensitivity and full scale (+/- 49.152 Gauss); 
@@ -214,12 +254,22 @@ void setup() {
 
    LIS2MDL.selfTest();
 
+   if(!magCalBackground) {
    LIS2MDL.offsetBias(magBias, magScale);
    Serial.println("mag biases (mG)"); Serial.println(1000.0f * magBias[0]); Serial.println(1000.0f * magBias[1]); Serial.println(1000.0f * magBias[2]); 
    Serial.println("mag scale (mG)"); Serial.println(magScale[0]); Serial.println(magScale[1]); Serial.println(magScale[2]); 
+   }
+   else Serial.println("mag calibration runs in the background: turn the board through all orientations");
    delay(2000); // add delay to see results before serial spew of data
 
-   LPS22H.Init(PODR);  // Initialize LPS22H altimeter
+   if(LSM6DSM_sensorHub) {
+     // From here on the LSM6DSM reads the mag itself and the host never addresses the LIS2MDL
+     LSM6DSM.passThrough(false);
+     LSM6DSM.initSensorHub(LIS2MDL_ADDRESS, LIS2MDL_OUTX_L_REG, 6, HUB_EVERY_2);
+   }
+
+   if(LPS22H_watermark) LPS22H.initFIFO(PODR, LPS22H_FIFO_STREAM, LPS22H_watermark);
+   else                 LPS22H.Init(PODR);  // Initialize LPS22H altimeter
    delay(1000);
 
    digitalWrite(myLed, HIGH);
@@ -253,10 +303,10 @@ void setup() {
   if(passThru)
   {
   attachInterrupt(LSM6DSM_intPin2, myinthandler1, RISING);  // define interrupt for intPin2 output of LSM6DSM
-  attachInterrupt(LIS2MDL_intPin , myinthandler2, RISING);  // define interrupt for intPin  output of LIS2MDL
+  if(!LSM6DSM_sensorHub) attachInterrupt(LIS2MDL_intPin , myinthandler2, RISING);  // define interrupt for intPin  output of LIS2MDL
   attachInterrupt(LPS22H_intPin  , myinthandler3, RISING);  // define interrupt for intPin  output of LPS22HB
 
-  LIS2MDLstatus = LIS2MDL.status();  // read status register to clear interrupt before main loop
+  if(!LSM6DSM_sensorHub) LIS2MDLstatus = LIS2MDL.status();  // read status register to clear interrupt before main loop
   }
 
 }
@@ -271,17 +321,32 @@ void loop() {
    if(newLSM6DSMData == true) {   // On interrupt, read data
       newLSM6DSMData = false;     // reset newData flag
 
+     if(LSM6DSM_watermark) {
+     // Drain the FIFO in bursts and run every period through the filters at the FIFO's own rate
+     uint8_t n = LSM6DSM.readFIFO(&LSM6DSMfifo, micros());
+     for(uint8_t k = 0; k < n; k++) {
+       LSM6DSMData[0] = LSM6DSMfifo.temperature[k];
+       LSM6DSMData[1] = LSM6DSMfifo.gx[k]; LSM6DSMData[2] = LSM6DSMfifo.gy[k]; LSM6DSMData[3] = LSM6DSMfifo.gz[k];
+       LSM6DSMData[4] = LSM6DSMfifo.ax[k]; LSM6DSMData[5] = LSM6DSMfifo.ay[k]; LSM6DSMData[6] = LSM6DSMfifo.az[k];
+       scaleLSM6DSM();
+       if(LSM6DSMfifo.fresh[k] & LSM6DSM_DS_HUB) {
+         LIS2MDLData[0] = LSM6DSMfifo.mx[k]; LIS2MDLData[1] = LSM6DSMfifo.my[k]; LIS2MDLData[2] = LSM6DSMfifo.mz[k];
+         scaleLIS2MDL();
+       }
+
+       deltat = LSM6DSMfifo.dt[k];
+       sum += deltat; // sum for averaging filter update rate
+       sumCount++;
+       MadgwickQuaternionUpdate(-ax, ay, az, gx*pi/180.0f, -gy*pi/180.0f, -gz*pi/180.0f,  mx,  my, -mz);
+       predictVertical(deltat);
+     }
+     Now = micros();
+     lastUpdate = lastVertical = Now;
+     if(digitalRead(LSM6DSM_intPin2)) newLSM6DSMData = true; // more than one buffer full, the threshold never fell
+     }
+     else {
      LSM6DSM.readData(LSM6DSMData); // INT2 cleared on any read
-   
-   // Now we'll calculate the accleration value into actual g's
-     ax = (float)LSM6DSMData[4]*aRes - accelBias[0];  // get actual g value, this depends on scale being set
-     ay = (float)LSM6DSMData[5]*aRes - accelBias[1];   
-     az = (float)LSM6DSMData[6]*aRes - accelBias[2];  
-
-   // Calculate the gyro value into actual degrees per second
-     gx = (float)LSM6DSMData[1]*gRes - gyroBias[0];  // get actual gyro value, this depends on scale being set
-     gy = (float)LSM6DSMData[2]*gRes - gyroBias[1];  
-     gz = (float)LSM6DSMData[3]*gRes - gyroBias[2]; 
+     scaleLSM6DSM();
 
     for(uint8_t i = 0; i < 10; i++) { // iterate a fixed number of times per data read cycle
     Now = micros();
@@ -293,7 +358,16 @@ void loop() {
 
     MadgwickQuaternionUpdate(-ax, ay, az, gx*pi/180.0f, -gy*pi/180.0f, -gz*pi/180.0f,  mx,  my, -mz);
     }
-    
+
+    predictVertical((Now - lastVertical) / 1000000.0f);
+    lastVertical = Now;
+     }
+   }
+
+   // If intPin goes high, new pressure data are ready
+   if(newLPS22HData == true) {   // On interrupt, read data
+      newLPS22HData = false;     // reset newData flag
+      readLPS22H();
    }
 
     // If intPin goes high, either all data registers have new data
@@ -305,14 +379,7 @@ void loop() {
      if(LIS2MDLstatus & 0x08) // if all axes have new data ready
      {
       LIS2MDL.readData(LIS2MDLData);  
-   
-   // Now we'll calculate the accleration value into actual G's
-     mx = (float)LIS2MDLData[0]*mRes - magBias[0];  // get actual G value 
-     my = (float)LIS2MDLData[1]*mRes - magBias[1];   
-     mz = (float)LIS2MDLData[2]*mRes - magBias[2]; 
-     mx *= magScale[0];
-     my *= magScale[1];
-     mz *= magScale[2];  
+      scaleLIS2MDL();
      }
    }
    }  // end of "if(passThru)" handling
@@ -436,34 +503,44 @@ void loop() {
     Serial.print(" qz = "); Serial.println(q[3]); 
     }
 
-    // get pressure and temperature from the LPS22HB
-    LPS22Hstatus = LPS22H.status();
-
-    if(LPS22Hstatus & 0x01) { // if new pressure data available
-    pressure = (float) LPS22H.readAltimeterPressure()/4096.0f;
-    temperature = (float) LPS22H.readAltimeterTemperature()/100.0f; 
-    
-    altitude = 145366.45f*(1.0f - pow((pressure/1013.25f), 0.190284f)); 
+    // pressure and temperature from the LPS22HB are read on its data ready or FIFO watermark interrupt,
+    // poll here as well in case an edge was missed and the interrupt line is stuck high
+    if(LPS22H_watermark) {
+      LPS22Hstatus = LPS22H.fifoStatus();
+      if(LPS22Hstatus & LPS22H_FIFO_FTH) readLPS22H();
+    }
+    else {
+      LPS22Hstatus = LPS22H.status();
+      if(LPS22Hstatus & 0x01) readLPS22H();
+    }
+    altitude = altimeter.feet(pressure);
 
       if(SerialDebug) {
       Serial.print("Altimeter temperature = "); Serial.print( temperature, 2); Serial.println(" C"); // temperature in degrees Celsius  
       Serial.print("Altimeter temperature = "); Serial.print(9.0f*temperature/5.0f + 32.0f, 2); Serial.println(" F"); // temperature in degrees Fahrenheit
       Serial.print("Altimeter pressure = "); Serial.print(pressure, 2);  Serial.println(" mbar");// pressure in millibar
       Serial.print("Altitude = "); Serial.print(altitude, 2); Serial.println(" feet");
+      Serial.print("Fused altitude = "); Serial.print(vertical.altitude, 2); Serial.print(" m, climb rate = ");
+      Serial.print(vertical.velocity, 2); Serial.println(" m/s");
       }
-    }
 
     Gtemperature = ((float) LSM6DSMData[0]) / 256.0f + 25.0f; // Gyro chip temperature in degrees Centigrade
+    gyroTempBias.setTemperature(Gtemperature);
+    if(gyroTempBiasReady && gyroTempBias.observations - gyroTempBiasSaved >= gyroTempBias.refitInterval &&
+       millis() - gyroTempBiasSaveTime >= GYRO_TEMPBIAS_SAVE_MS) saveGyroTempBias();
     // Print temperature in degrees Centigrade      
     if(SerialDebug) {
       Serial.print("Gyro temperature is ");  Serial.print(Gtemperature, 1);  Serial.println(" degrees C"); // Print T values to tenths of s degree C
     }
 
-    LIS2MDLData[3] = LIS2MDL.readTemperature();
-    Mtemperature = ((float) LIS2MDLData[3]) / 8.0f + 25.0f; // Mag chip temperature in degrees Centigrade
-    // Print temperature in degrees Centigrade      
-    if(SerialDebug) {
-      Serial.print("Mag temperature is ");  Serial.print(Mtemperature, 1);  Serial.println(" degrees C"); // Print T values to tenths of s degree C
+    // In sensor hub mode the LIS2MDL is off the host bus and the hub slot holds only OUTX..OUTZ, no temperature
+    if(!LSM6DSM_sensorHub) {
+      LIS2MDLData[3] = LIS2MDL.readTemperature();
+      Mtemperature = ((float) LIS2MDLData[3]) / 8.0f + 25.0f; // Mag chip temperature in degrees Centigrade
+      // Print temperature in degrees Centigrade      
+      if(SerialDebug) {
+        Serial.print("Mag temperature is ");  Serial.print(Mtemperature, 1);  Serial.println(" degrees C"); // Print T values to tenths of s degree C
+      }
     }
 
     a12 =   2.0f * (q[1] * q[2] + q[0] * q[3]);
@@ -585,7 +662,7 @@ void loop() {
       Serial.print("Altimeter pressure = ");
       Serial.print(Pressure, 2);
       Serial.println(" mbar");// pressure in millibar
-      Altitude = 145366.45f * (1.0f - pow(((Pressure) / 1013.25f), 0.190284f));
+      Altitude = altimeter.feet(Pressure);
       Serial.print("Altitude = ");
       Serial.print(Altitude, 2);
       Serial.println(" feet");
@@ -618,6 +695,135 @@ void myinthandler3()
   newLPS22HData = true;
 }
 
+void scaleLSM6DSM()
+{
+   // Now we'll calculate the accleration value into actual g's
+     ax = (float)LSM6DSMData[4]*aRes - accelBias[0];  // get actual g value, this depends on scale being set
+     ay = (float)LSM6DSMData[5]*aRes - accelBias[1];   
+     az = (float)LSM6DSMData[6]*aRes - accelBias[2];  
+
+   // Calculate the gyro value into actual degrees per second, bias still in
+     float g[3] = {(float)LSM6DSMData[1]*gRes, (float)LSM6DSMData[2]*gRes, (float)LSM6DSMData[3]*gRes};
+
+   // Still board: the gyro reads its own bias, file it by temperature. Still is judged on the spread of each
+   // axis about its running mean (about 128 samples), which is sensor noise alone at rest whatever the bias;
+   // any hand held turn, even a slow one, starts and stops and wobbles well above that. A turn held dead
+   // steady looks like noise too, so the mean must also sit near the bias already known
+     float a2 = ax*ax + ay*ay + az*az;
+     bool still = a2 > 0.96f && a2 < 1.04f;
+     for(uint8_t i = 0; i < 3; i++) {
+       float d = g[i] - gyroMean[i];
+       gyroMean[i] += d * 0.0078125f;
+       gyroSpread[i] += (d * d - gyroSpread[i]) * 0.0078125f;
+       if(gyroSpread[i] > gyroStillSpread * gyroStillSpread) still = false;
+       if(fabsf(gyroMean[i] - (gyroTempBiasReady ? gyroTempBias.bias[i] : gyroBias[i])) > gyroBiasStep) still = false;
+     }
+     if(still) {
+       if(gyroStill < 1000) gyroStill++;
+     } else gyroStill = 0;
+     if(gyroStill >= 200) {
+       gyroTempBias.observe(((float) LSM6DSMData[0]) / 256.0f + 25.0f, g);
+       if(gyroTempBias.observations >= gyroTempBias.refitInterval) gyroTempBiasReady = true;
+     }
+
+   // The model holds the whole bias, so it is kept across resets; until it has a fit the power-up one stands in
+     if(gyroTempBiasReady) gyroTempBias.correct(g);
+     else for(uint8_t i = 0; i < 3; i++) g[i] -= gyroBias[i];
+     gx = g[0]; gy = g[1]; gz = g[2];
+}
+
+// Gyro bias record in the emulated EEPROM: magic, length (2 bytes), Fletcher-16 of the TempBias::save() bytes
+// that follow (2 bytes)
+bool loadGyroTempBias()
+{
+  uint8_t buf[TEMPBIAS_RECORD_MAX];
+  if(EEPROM.read(GYRO_TEMPBIAS_EEPROM) != GYRO_TEMPBIAS_MAGIC) return false;
+  uint16_t len = EEPROM.read(GYRO_TEMPBIAS_EEPROM + 1) | EEPROM.read(GYRO_TEMPBIAS_EEPROM + 2) << 8;
+  uint16_t check = EEPROM.read(GYRO_TEMPBIAS_EEPROM + 3) | EEPROM.read(GYRO_TEMPBIAS_EEPROM + 4) << 8;
+  if(len > TEMPBIAS_RECORD_MAX) return false;
+  for(uint16_t i = 0; i < len; i++) buf[i] = EEPROM.read(GYRO_TEMPBIAS_EEPROM + 5 + i);
+  if(fletcher16(buf, len) != check || !gyroTempBias.load(buf, len)) return false;
+  gyroTempBiasReady = true;
+  return true;
+}
+
+void saveGyroTempBias()
+{
+  uint8_t buf[TEMPBIAS_RECORD_MAX];
+  uint16_t len = gyroTempBias.save(buf);
+  uint16_t check = fletcher16(buf, len);
+  EEPROM.update(GYRO_TEMPBIAS_EEPROM, 0xFF);  // an interrupted write leaves no valid record
+  EEPROM.update(GYRO_TEMPBIAS_EEPROM + 1, len & 0xFF);
+  EEPROM.update(GYRO_TEMPBIAS_EEPROM + 2, len >> 8);
+  EEPROM.update(GYRO_TEMPBIAS_EEPROM + 3, check & 0xFF);
+  EEPROM.update(GYRO_TEMPBIAS_EEPROM + 4, check >> 8);
+  for(uint16_t i = 0; i < len; i++) EEPROM.update(GYRO_TEMPBIAS_EEPROM + 5 + i, buf[i]);
+  EEPROM.update(GYRO_TEMPBIAS_EEPROM, GYRO_TEMPBIAS_MAGIC);
+  gyroTempBiasSaved = gyroTempBias.observations;
+  gyroTempBiasSaveTime = millis();
+}
+
+uint16_t fletcher16(const uint8_t * data, uint16_t len)
+{
+  uint16_t a = 0, b = 0;
+  for(uint16_t i = 0; i < len; i++) {
+    a = (a + data[i]) % 255;
+    b = (b + a) % 255;
+  }
+  return b << 8 | a;
+}
+
+void scaleLIS2MDL()
+{
+  if(magCalBackground) {
+     float m[3] = {(float)LIS2MDLData[0]*mRes, (float)LIS2MDLData[1]*mRes, (float)LIS2MDLData[2]*mRes};
+     if(magCal.add(m) && SerialDebug) {
+       Serial.print("mag calibration updated, fit error "); Serial.println(magCal.fitError, 4);
+     }
+     float c[3];
+     magCal.apply(m, c);  // raw field until the first fit is accepted
+     mx = c[0]; my = c[1]; mz = c[2];
+     return;
+  }
+
+   // Now we'll calculate the accleration value into actual G's
+     mx = (float)LIS2MDLData[0]*mRes - magBias[0];  // get actual G value 
+     my = (float)LIS2MDLData[1]*mRes - magBias[1];   
+     mz = (float)LIS2MDLData[2]*mRes - magBias[2]; 
+     mx *= magScale[0];
+     my *= magScale[1];
+     mz *= magScale[2];  
+}
+
+void predictVertical(float dt)
+{
+    // Vertical channel: specific force along gravity less 1 g, up positive. The filter is fed (-ax, ay, az), so in
+    // that frame gravity lies along (a32, a31, a33), the same terms as for yaw, pitch and roll below
+    a31 = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+    a32 = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    a33 = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+    float accUp = -a32 * ax + a31 * ay + a33 * az;
+    vertical.predict((accUp - 1.0f) * 9.80665f, dt);
+}
+
+void readLPS22H()
+{
+  if(LPS22H_watermark) {
+    // drain the FIFO and correct the vertical filter with every sample, oldest first; the newest is the current one
+    uint8_t n = LPS22H.readFIFO(LPS22Hsamples, LPS22H_FIFO_DEPTH, micros());
+    for(uint8_t i = 0; i < n; i++) {
+      pressure = (float) LPS22Hsamples[i].pressure/4096.0f;
+      vertical.correct(altimeter.metres(pressure));
+    }
+    if(n) temperature = (float) LPS22Hsamples[n - 1].temperature/100.0f;
+  }
+  else {
+    pressure = (float) LPS22H.readAltimeterPressure()/4096.0f;
+    temperature = (float) LPS22H.readAltimeterTemperature()/100.0f;
+    vertical.correct(altimeter.metres(pressure));
+  }
+}
+
 void EM7180intHandler()
 {
   newEM7180Data = true;
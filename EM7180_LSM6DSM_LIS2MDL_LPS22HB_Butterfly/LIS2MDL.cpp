@@ -61,7 +61,7 @@ uint8_t LIS2MDL::status()
 void LIS2MDL::readData(int16_t * destination)
 {
   uint8_t rawData[6];  // x/y/z mag register data stored here
-  readBytes(LIS2MDL_ADDRESS, (0x80 | LIS2MDL_OUTX_L_REG), 8, &rawData[0]);  // Read the 6 raw data registers into data array
+  readBytes(LIS2MDL_ADDRESS, (0x80 | LIS2MDL_OUTX_L_REG), 6, &rawData[0]);  // Read the 6 raw data registers into data array
 
   destination[0] = ((int16_t)rawData[1] << 8) | rawData[0] ;       // Turn the MSB and LSB into a signed 16-bit value
   destination[1] = ((int16_t)rawData[3] << 8) | rawData[2] ;  
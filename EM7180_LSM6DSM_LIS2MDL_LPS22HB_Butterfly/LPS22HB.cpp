@@ -16,6 +16,10 @@ LPS22H::LPS22H(uint8_t intPin)
 {
   pinMode(intPin, INPUT);
   _intPin = intPin; 
+  _period_us = 0;
+  _haveTimestamp = false;
+  _restarted = false;
+  fifoOverruns = 0;
 }
 
 uint8_t LPS22H::getChipID()
@@ -57,6 +61,82 @@ void LPS22H::Init(uint8_t PODR)
     writeByte(LPS22H_ADDRESS, LPS22H_CTRL_REG3, 0x04);  // enable data ready as interrupt source
 }
 
+// FIFO with the watermark as interrupt source, so the host wakes once per watermark samples instead of
+// once per sample. In stream mode the FIFO keeps the newest 32 samples if the host falls behind.
+void LPS22H::initFIFO(uint8_t PODR, uint8_t mode, uint8_t watermark)
+{
+  static const uint32_t period[8] = {0, 1000000, 100000, 40000, 20000, 13333, 0, 0};
+  _period_us = period[PODR & 0x07];
+  _period = (float)_period_us;
+  _haveTimestamp = false;
+  fifoOverruns = 0;
+  if (watermark < 1) watermark = 1;
+  if (watermark > LPS22H_FIFO_DEPTH - 1) watermark = LPS22H_FIFO_DEPTH - 1;   // 5-bit level
+
+  writeByte(LPS22H_ADDRESS, LPS22H_CTRL_REG1, PODR << 4 | 0x08 | 0x02);
+  writeByte(LPS22H_ADDRESS, LPS22H_FIFO_CTRL, LPS22H_FIFO_BYPASS << 5);  // bypass first to empty the FIFO
+  writeByte(LPS22H_ADDRESS, LPS22H_CTRL_REG2, 0x40 | 0x10);              // FIFO_EN, keep register auto-increment
+  writeByte(LPS22H_ADDRESS, LPS22H_FIFO_CTRL, mode << 5 | watermark);
+  writeByte(LPS22H_ADDRESS, LPS22H_CTRL_REG3, 0x10);                     // FIFO watermark as interrupt source
+}
+
+uint8_t LPS22H::fifoStatus()
+{
+  return readByte(LPS22H_ADDRESS, LPS22H_FIFO_STATUS);
+}
+
+uint8_t LPS22H::fifoCount()
+{
+  return fifoStatus() & LPS22H_FIFO_LEVEL;
+}
+
+// Drain up to maxSamples, oldest first, in bursts of I2C_BURST_BYTES. With the FIFO enabled the register
+// pointer wraps from TEMP_OUT_H back to PRESS_OUT_XL, so consecutive 5 byte slots come out of each read.
+// now_us is the time of the watermark interrupt (or of the call). The samples continue from the last
+// drain at the tracked period, pulled gently towards now_us, and the period is trimmed from the same
+// error to follow the sensor's clock. A sample can't be newer than the wake-up, so a prediction past
+// now_us is cut back to it at once: after an overrun the sequence restarts at now_us, which can be up
+// to a period after the newest sample was made, and the next timely watermark puts that right.
+uint8_t LPS22H::readFIFO(lps22h_sample_t * dest, uint8_t maxSamples, uint32_t now_us)
+{
+  uint8_t fifoStatus = readByte(LPS22H_ADDRESS, LPS22H_FIFO_STATUS);
+  uint8_t count = fifoStatus & LPS22H_FIFO_LEVEL;
+  if (fifoStatus & LPS22H_FIFO_OVR) {
+    fifoOverruns++;
+    _haveTimestamp = false;   // samples were lost, the sequence restarts at now_us
+  }
+  if (count > maxSamples) count = maxSamples;
+  if (count > LPS22H_FIFO_DEPTH) count = LPS22H_FIFO_DEPTH;
+  if (count == 0) return 0;
+
+  uint8_t rawData[LPS22H_FIFO_DEPTH * 5];
+  for (uint8_t done = 0; done < count; ) {
+    uint8_t n = count - done < I2C_BURST_BYTES / 5 ? count - done : I2C_BURST_BYTES / 5;
+    readBytes(LPS22H_ADDRESS, (LPS22H_PRESS_OUT_XL | 0x80), 5 * n, &rawData[5 * done]);
+    done += n;
+  }
+
+  uint32_t newest = now_us;
+  if (_haveTimestamp) {
+    float predicted = (float)count * _period;
+    float error = (float)(int32_t)(now_us - _lastTimestamp) - predicted;
+    bool trim = !_restarted && error < (float)_period_us && error > -(float)_period_us;
+    if (trim) _period += 0.125f * error / (float)count;   // the sensor clock is only good to a few %
+    if (error > 0.0f) newest = _lastTimestamp + (uint32_t)(predicted + (trim ? 0.125f * error : 0.0f));
+  }
+  _restarted = !_haveTimestamp;
+  _lastTimestamp = newest;
+  _haveTimestamp = true;
+
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t * slot = &rawData[5 * i];
+    dest[i].pressure = (int32_t) ((int32_t) slot[2] << 16 | (int32_t) slot[1] << 8 | slot[0]);
+    dest[i].temperature = (int16_t)((int16_t) slot[4] << 8 | slot[3]);
+    dest[i].timestamp = newest - (uint32_t)((float)(count - 1 - i) * _period);
+  }
+  return count;
+}
+
 // I2C scan function
 void LPS22H::I2Cscan()
 {
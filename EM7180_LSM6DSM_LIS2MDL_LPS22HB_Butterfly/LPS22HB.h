@@ -51,11 +51,44 @@
 #define    P_50Hz   0x04;
 #define    P_75Hz   0x05;
 
+// FIFO modes, FIFO_CTRL bits 7:5
+#define LPS22H_FIFO_BYPASS           0x00
+#define LPS22H_FIFO_FIFO             0x01  // stop when full
+#define LPS22H_FIFO_STREAM           0x02  // overwrite the oldest sample when full
+#define LPS22H_FIFO_STREAM_TO_FIFO   0x03
+#define LPS22H_FIFO_BYPASS_TO_STREAM 0x04
+#define LPS22H_FIFO_DYNAMIC_STREAM   0x06
+#define LPS22H_FIFO_BYPASS_TO_FIFO   0x07
+
+#define LPS22H_FIFO_DEPTH            32    // 40-bit slots, pressure + temperature
+
+// FIFO_STATUS
+#define LPS22H_FIFO_FTH              0x80  // level at or above the watermark
+#define LPS22H_FIFO_OVR              0x40  // full, a sample has been overwritten
+#define LPS22H_FIFO_LEVEL            0x3F
+
+// Burst reads out of the LSM6DSM and LPS22HB FIFOs share one size, within the STM32L4 core's 32 byte
+// Wire buffer and a whole number of both 6 byte LSM6DSM data sets and 5 byte LPS22HB slots
+#ifndef I2C_BURST_BYTES
+#define I2C_BURST_BYTES      30
+#endif
+
+typedef struct {
+  int32_t pressure;      // 4096 LSB/hPa
+  int16_t temperature;   // 0.01 C
+  uint32_t timestamp;    // micros(), reconstructed from the ODR
+} lps22h_sample_t;
+
 class LPS22H
 {
   public: 
   LPS22H(uint8_t intPin);
   void Init(uint8_t PODR);
+  void initFIFO(uint8_t PODR, uint8_t mode, uint8_t watermark);   // FIFO watermark as the interrupt source
+  uint8_t fifoStatus();
+  uint8_t fifoCount();
+  uint8_t readFIFO(lps22h_sample_t * dest, uint8_t maxSamples, uint32_t now_us);
+  uint32_t fifoOverruns;
   uint8_t getChipID();
   uint8_t status();
   int32_t readAltimeterPressure();
@@ -66,6 +99,11 @@ class LPS22H
   void readBytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest);
   private:
   uint8_t   _intPin;
+  uint32_t  _period_us;       // nominal sample period from the ODR
+  float     _period;          // tracked sample period, us
+  uint32_t  _lastTimestamp;   // timestamp of the newest sample handed out
+  bool      _haveTimestamp;
+  bool      _restarted;       // the newest timestamp is only a wake-up time
 };
 
 #endif
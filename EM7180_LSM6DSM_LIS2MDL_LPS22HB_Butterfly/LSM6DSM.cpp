@@ -17,6 +17,26 @@ LSM6DSM::LSM6DSM(uint8_t intPin1, uint8_t intPin2)
   _intPin1 = intPin1;
   pinMode(intPin2, INPUT);
   _intPin2 = intPin2;   
+  _patternSets = 0;
+  fifoOverruns = 0;
+  fifoPeriod = 0.0f;
+  memset(_held, 0, sizeof(_held));
+  _timestamps = _haveTimestamp = _contiguous = _anchored = false;
+  timestamp = 0;
+  tickLength_us = LSM6DSM_TICK_US;
+  _tickSamples = 0;
+}
+
+
+void LSM6DSM::initTimestamp()
+{
+  uint8_t temp = readByte(LSM6DSM_ADDRESS, LSM6DSM_WAKE_UP_DUR);
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_WAKE_UP_DUR, temp | 0x10);   // TIMER_HR (bit 4), 25 us per tick
+  temp = readByte(LSM6DSM_ADDRESS, LSM6DSM_CTRL10_C);
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_CTRL10_C, temp | 0x20);      // TIMER_EN (bit 5)
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_TIMESTAMP2_REG, 0xAA);        // reset the counter
+  _timestamps = true;
+  _haveTimestamp = _contiguous = _anchored = false;
 }
 
 
@@ -225,6 +245,210 @@ void LSM6DSM::readData(int16_t * destination)
   destination[6] = ((int16_t)rawData[13] << 8) | rawData[12] ; 
 }
 
+// Connects the auxiliary bus to the host bus so the host can set up the slaves itself
+void LSM6DSM::passThrough(bool enable)
+{
+  // START_CONFIG (bit 4) keeps the master from triggering, PASS_THROUGH_MODE (bit 2)
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_MASTER_CONFIG, enable ? 0x10 | 0x04 : 0x00);
+  delay(10);
+}
+
+
+// Sensor hub master: read count bytes (up to 6, the third FIFO data set) from one slave on the auxiliary
+// bus every rate accel data-ready triggers, into SENSORHUB1_REG onwards
+void LSM6DSM::initSensorHub(uint8_t slaveAddress, uint8_t subAddress, uint8_t count, uint8_t rate)
+{
+  if (count > 6) count = 6;
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_MASTER_CONFIG, 0x00);           // master off while it is set up
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_FUNC_CFG_ACCESS, 0x80);         // embedded functions bank A
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_SLV0_ADD, slaveAddress << 1 | 0x01);   // bit 0 = 1 read
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_SLV0_SUBADD, subAddress);
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_SLAVE0_CONFIG, (rate & 0x03) << 6 | count);   // one external sensor
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_FUNC_CFG_ACCESS, 0x00);
+  uint8_t temp = readByte(LSM6DSM_ADDRESS, LSM6DSM_CTRL10_C);
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_CTRL10_C, temp | 0x04);        // FUNC_EN (bit 2)
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_MASTER_CONFIG, 0x01);           // MASTER_ON, triggered by accel data ready
+}
+
+
+static const uint8_t fifoDecimation[8] = {0, 1, 2, 3, 4, 8, 16, 32};
+static const float fifoODR[11] = {0.0f, 12.5f, 26.0f, 52.0f, 104.0f, 208.0f, 416.0f, 833.0f, 1666.0f, 3333.0f, 6666.0f};
+
+// The third data set is the sensor hub, the fourth the temperature or, once initTimestamp() has run,
+// the timestamp
+void LSM6DSM::initFIFO(uint8_t FIFO_ODR, uint8_t mode, uint8_t gyroDec, uint8_t accelDec, uint8_t hubDec, uint8_t ds4Dec, uint8_t watermark)
+{
+  // Lay out one FIFO pattern: within each FIFO ODR period the data sets due in it, in FIFO order
+  uint8_t dec[4] = {fifoDecimation[gyroDec & 0x07], fifoDecimation[accelDec & 0x07], fifoDecimation[hubDec & 0x07], fifoDecimation[ds4Dec & 0x07]};
+  uint8_t ids[4] = {LSM6DSM_DS_GYRO, LSM6DSM_DS_ACCEL, LSM6DSM_DS_HUB, (uint8_t)(_timestamps ? LSM6DSM_DS_TIME : LSM6DSM_DS_TEMP)};
+  uint8_t periods = 1;
+  for (uint8_t i = 0; i < 4; i++) {
+    if (!dec[i]) continue;
+    uint8_t a = periods, b = dec[i];
+    while (b) { uint8_t t = a % b; a = b; b = t; }
+    periods = periods / a * dec[i];
+  }
+  _patternSets = 0;
+  uint8_t starts = 0;
+  for (uint8_t k = 0; k < periods; k++) {
+    uint8_t first = LSM6DSM_DS_START;
+    for (uint8_t i = 0; i < 4; i++) {
+      if (!dec[i] || k % dec[i]) continue;
+      _pattern[_patternSets++] = ids[i] | first;
+      if (first) starts++;
+      first = 0;
+    }
+  }
+  fifoPeriod = starts ? (float)periods / (float)starts / fifoODR[FIFO_ODR] : 0.0f;
+  _dt = fifoPeriod;
+  _contiguous = _anchored = false;
+  _sinceTimestamp = 0;
+
+  // Watermark in words for the requested number of periods
+  if (watermark < 1) watermark = 1;
+  if (watermark > LSM6DSM_FIFO_SLOTS) watermark = LSM6DSM_FIFO_SLOTS;
+  uint16_t fth = starts ? (uint16_t)((3UL * _patternSets * watermark + starts - 1) / starts) : 3;
+  if (fth > LSM6DSM_FIFO_WORDS - 1) fth = LSM6DSM_FIFO_WORDS - 1;
+
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_FIFO_CTRL5, LSM6DSM_FIFO_BYPASS);   // empties the FIFO
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_FIFO_CTRL1, fth & 0xFF);
+  uint8_t ds4 = dec[3] ? (_timestamps ? 0x80 : 0x08) : 0x00;   // TIMER_PEDO_FIFO_EN (bit 7) or FIFO_TEMP_EN (bit 3)
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_FIFO_CTRL2, (fth >> 8) & 0x07 | ds4);
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_FIFO_CTRL3, (gyroDec & 0x07) << 3 | (accelDec & 0x07));
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_FIFO_CTRL4, (ds4Dec & 0x07) << 3 | (hubDec & 0x07));   // fourth, third data set
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_FIFO_CTRL5, (FIFO_ODR & 0x0F) << 3 | (mode & 0x07));
+  writeByte(LSM6DSM_ADDRESS, LSM6DSM_INT2_CTRL, 0x08);   // FIFO threshold instead of data ready on INT2
+}
+
+
+uint8_t LSM6DSM::readFIFO(lsm6dsm_fifo_t * dest, uint32_t now_us)
+{
+  if (_patternSets == 0) return 0;
+
+  uint8_t status[4];
+  readBytes(LSM6DSM_ADDRESS, LSM6DSM_FIFO_STATUS1, 4, status);
+  uint16_t words = ((uint16_t)(status[1] & 0x07) << 8) | status[0];
+  if (status[1] & 0x40) {
+    fifoOverruns++;
+    _contiguous = _anchored = false;   // periods were lost, the next timestamp pair spans an unknown count
+    if (words == 0) words = LSM6DSM_FIFO_WORDS;   // the 11-bit count cannot show a full FIFO
+  }
+  uint16_t word = ((uint16_t)(status[3] & 0x03) << 8) | status[2];   // pattern position of the next word
+
+  // After an overrun the oldest words may start part way into a data set, drop them
+  if (word % 3) {
+    uint8_t skip = 3 - word % 3;
+    if (words < skip) return 0;
+    uint8_t rawData[4];
+    readBytes(LSM6DSM_ADDRESS, LSM6DSM_FIFO_DATA_OUT_L, 2 * skip, rawData);
+    words -= skip;
+    word += skip;
+  }
+  uint16_t first = (word / 3) % _patternSets;
+
+  // Take whole periods only: a period is complete once the set after it starts a new one
+  uint16_t sets = words / 3, take = 0, s = first;
+  uint8_t slots = 0;
+  for (uint16_t i = 1; i <= sets; i++) {
+    s = (s + 1 == _patternSets) ? 0 : s + 1;
+    if (_pattern[s] & LSM6DSM_DS_START) {
+      take = i;
+      if (++slots == LSM6DSM_FIFO_SLOTS) break;
+    }
+  }
+  if (slots == 0) return 0;
+
+  if (_timestamps) {
+    // The timestamp took the temperature's place in the FIFO, read it once per drain instead
+    uint8_t t[2];
+    readBytes(LSM6DSM_ADDRESS, LSM6DSM_OUT_TEMP_L, 2, t);
+    _held[0] = (int16_t)((int16_t)t[1] << 8 | t[0]);
+  }
+
+  uint8_t rawData[I2C_BURST_BYTES];
+  int16_t slot = -1;
+  s = first;
+  while (take) {
+    uint16_t n = take < I2C_BURST_BYTES / 6 ? take : I2C_BURST_BYTES / 6;
+    readBytes(LSM6DSM_ADDRESS, LSM6DSM_FIFO_DATA_OUT_L, 6 * n, rawData);   // address rolls over at DATA_OUT_H
+    for (uint16_t j = 0; j < n; j++) {
+      uint8_t id = _pattern[s];
+      s = (s + 1 == _patternSets) ? 0 : s + 1;
+      if (slot < 0 || (id & LSM6DSM_DS_START)) {
+        slot++;
+        dest->temperature[slot] = _held[0];
+        dest->gx[slot] = _held[1]; dest->gy[slot] = _held[2]; dest->gz[slot] = _held[3];
+        dest->ax[slot] = _held[4]; dest->ay[slot] = _held[5]; dest->az[slot] = _held[6];
+        dest->mx[slot] = _held[7]; dest->my[slot] = _held[8]; dest->mz[slot] = _held[9];
+        dest->fresh[slot] = 0;
+        dest->dt[slot] = _dt;
+        if (_sinceTimestamp < 0xFFFF) _sinceTimestamp++;
+      }
+      const uint8_t * w = &rawData[6 * j];
+      int16_t x = (int16_t)((int16_t)w[1] << 8 | w[0]);
+      int16_t y = (int16_t)((int16_t)w[3] << 8 | w[2]);
+      int16_t z = (int16_t)((int16_t)w[5] << 8 | w[4]);
+      switch (id & ~LSM6DSM_DS_START)
+      {
+        case LSM6DSM_DS_GYRO:
+          dest->gx[slot] = _held[1] = x; dest->gy[slot] = _held[2] = y; dest->gz[slot] = _held[3] = z;
+          break;
+        case LSM6DSM_DS_ACCEL:
+          dest->ax[slot] = _held[4] = x; dest->ay[slot] = _held[5] = y; dest->az[slot] = _held[6] = z;
+          break;
+        case LSM6DSM_DS_HUB:
+          dest->mx[slot] = _held[7] = x; dest->my[slot] = _held[8] = y; dest->mz[slot] = _held[9] = z;
+          break;
+        case LSM6DSM_DS_TEMP:
+          dest->temperature[slot] = _held[0] = x;
+          break;
+        case LSM6DSM_DS_TIME:
+        {
+          // TIMESTAMP[15:8], TIMESTAMP[23:16], unused, TIMESTAMP[7:0], step count
+          uint32_t tick = (uint32_t)w[1] << 16 | (uint32_t)w[0] << 8 | w[3];
+          if (!_haveTimestamp) {
+            timestamp = tick;
+          } else {
+            uint32_t delta = (tick - _lastTick) & 0xFFFFFF;   // wraps every 419 s
+            timestamp += delta;
+            if (_contiguous && _sinceTimestamp) {
+              // Every period since the previous timestamp gets the measured spacing
+              _dt = (float)delta * tickLength_us * 1.0e-6f / (float)_sinceTimestamp;
+              for (int16_t k = slot; k > slot - (int16_t)_sinceTimestamp && k >= 0; k--) dest->dt[k] = _dt;
+            }
+          }
+          _lastTick = tick;
+          _sinceTimestamp = 0;
+          _haveTimestamp = _contiguous = true;
+          break;
+        }
+      }
+      dest->fresh[slot] |= id & ~LSM6DSM_DS_START;
+    }
+    take -= n;
+  }
+
+  // Scale the ticks against micros() over 10 s baselines, the read latency is small next to that. The
+  // newest period drained, not the newest timestamp, is the one that just raised the threshold.
+  if (_haveTimestamp) {
+    uint64_t newest = timestamp + (uint32_t)((float)_sinceTimestamp * _dt * 1.0e6f / tickLength_us + 0.5f);
+    if (!_anchored) {
+      _anchorTicks = newest;
+      _anchor_us = now_us;
+      _anchored = true;
+    } else if (newest - _anchorTicks >= 400000) {
+      float measured = (float)(now_us - _anchor_us) / (float)(newest - _anchorTicks);
+      if (measured > 0.9f * LSM6DSM_TICK_US && measured < 1.1f * LSM6DSM_TICK_US) {
+        if (_tickSamples < 4) _tickSamples++;                  // averages the first few, then a 1/4 low pass
+        tickLength_us += (measured - tickLength_us) / (float)_tickSamples;
+      }
+      _anchorTicks = newest;
+      _anchor_us = now_us;
+    }
+  }
+  return slots;
+}
+
 // I2C scan function
 void LSM6DSM::I2Cscan()
 {
@@ -119,6 +119,11 @@
 
 #define LSM6DSM_ADDRESS           0x6A   // Address of LSM6DSM accel/gyro when ADO = 0
 
+// Embedded functions bank A, with FUNC_CFG_ACCESS bit 7 set
+#define LSM6DSM_SLV0_ADD                  0x02
+#define LSM6DSM_SLV0_SUBADD               0x03
+#define LSM6DSM_SLAVE0_CONFIG             0x04
+
 
 #define AFS_2G  0x00
 #define AFS_4G  0x02
@@ -152,6 +157,59 @@
 #define GODR_3330Hz  0x09
 #define GODR_6660Hz  0x0A
 
+// FIFO_CTRL5 FIFO_MODE, bits 2:0
+#define LSM6DSM_FIFO_BYPASS          0x00
+#define LSM6DSM_FIFO_FIFO            0x01  // stop when full
+#define LSM6DSM_FIFO_CONT_TO_FIFO    0x03
+#define LSM6DSM_FIFO_BYPASS_TO_CONT  0x04
+#define LSM6DSM_FIFO_CONTINUOUS      0x06  // overwrite the oldest data when full
+
+// FIFO_CTRL3/4 decimation of a data set relative to the FIFO ODR
+#define FIFO_DEC_OFF  0x00  // data set not stored
+#define FIFO_DEC_1    0x01
+#define FIFO_DEC_2    0x02
+#define FIFO_DEC_3    0x03
+#define FIFO_DEC_4    0x04
+#define FIFO_DEC_8    0x05
+#define FIFO_DEC_16   0x06
+#define FIFO_DEC_32   0x07
+
+// FIFO data sets in pattern order, three words each
+#define LSM6DSM_DS_GYRO     0x01
+#define LSM6DSM_DS_ACCEL    0x02
+#define LSM6DSM_DS_HUB      0x04  // third data set, SENSORHUB1..6 from the sensor hub slave 0
+#define LSM6DSM_DS_TEMP     0x08  // fourth data set, temperature in its first word
+#define LSM6DSM_DS_TIME     0x10  // fourth data set after initTimestamp(), 24-bit timestamp and step count
+#define LSM6DSM_DS_START    0x80  // first data set of a FIFO ODR period
+
+#define LSM6DSM_FIFO_WORDS   2048  // 4 kbyte of 16-bit words
+#define LSM6DSM_FIFO_SLOTS   64    // FIFO ODR periods held by one lsm6dsm_fifo_t
+#define LSM6DSM_PATTERN_MAX  384   // data sets in one FIFO pattern, up to 4 sets over 96 periods
+#define LSM6DSM_TICK_US      25.0f // timestamp LSB with TIMER_HR set, nominal
+
+// Burst reads out of the LSM6DSM and LPS22HB FIFOs share one size, within the STM32L4 core's 32 byte
+// Wire buffer and a whole number of both 6 byte LSM6DSM data sets and 5 byte LPS22HB slots
+#ifndef I2C_BURST_BYTES
+#define I2C_BURST_BYTES      30
+#endif
+
+// SLAVE0_CONFIG Slave0_rate, sensor hub reads per accel data-ready trigger
+#define HUB_EVERY_1   0x00
+#define HUB_EVERY_2   0x01
+#define HUB_EVERY_4   0x02
+#define HUB_EVERY_8   0x03
+
+// One drain of the FIFO, a column per axis so the fusion loop walks contiguous arrays. Every period has
+// every column: a data set decimated out of a period holds its previous value, fresh says which are new.
+typedef struct {
+  int16_t temperature[LSM6DSM_FIFO_SLOTS];
+  int16_t gx[LSM6DSM_FIFO_SLOTS], gy[LSM6DSM_FIFO_SLOTS], gz[LSM6DSM_FIFO_SLOTS];
+  int16_t ax[LSM6DSM_FIFO_SLOTS], ay[LSM6DSM_FIFO_SLOTS], az[LSM6DSM_FIFO_SLOTS];
+  int16_t mx[LSM6DSM_FIFO_SLOTS], my[LSM6DSM_FIFO_SLOTS], mz[LSM6DSM_FIFO_SLOTS];   // sensor hub words
+  uint8_t fresh[LSM6DSM_FIFO_SLOTS];   // LSM6DSM_DS_* read in this period
+  float dt[LSM6DSM_FIFO_SLOTS];        // seconds since the previous period, from the timestamps when they are on
+} lsm6dsm_fifo_t;
+
 
 class LSM6DSM
 {
@@ -165,6 +223,15 @@ class LSM6DSM
   void reset();
   void selfTest();
   void readData(int16_t * destination);
+  void initFIFO(uint8_t FIFO_ODR, uint8_t mode, uint8_t gyroDec, uint8_t accelDec, uint8_t hubDec, uint8_t ds4Dec, uint8_t watermark);
+  uint8_t readFIFO(lsm6dsm_fifo_t * dest, uint32_t now_us);
+  void initTimestamp();
+  void passThrough(bool enable);
+  void initSensorHub(uint8_t slaveAddress, uint8_t subAddress, uint8_t count, uint8_t rate);
+  uint32_t fifoOverruns;
+  float fifoPeriod;      // seconds per FIFO ODR period
+  uint64_t timestamp;    // ticks of the newest timestamp read, unwrapped from 24 bits
+  float tickLength_us;   // one tick measured against micros(), 25 us nominal
   void I2Cscan();
   void writeByte(uint8_t address, uint8_t subAddress, uint8_t data);
   uint8_t readByte(uint8_t address, uint8_t subAddress);
@@ -173,6 +240,16 @@ class LSM6DSM
   uint8_t _intPin1;
   uint8_t _intPin2;
   float _aRes, _gRes;
+  uint8_t _pattern[LSM6DSM_PATTERN_MAX];   // LSM6DSM_DS_* of each data set in FIFO pattern order
+  uint16_t _patternSets;
+  int16_t _held[10];                       // last value of every column, readData() layout then the hub words
+  bool _timestamps, _haveTimestamp, _contiguous, _anchored;
+  uint32_t _lastTick;                      // raw 24-bit counter
+  uint16_t _sinceTimestamp;                // periods since the last timestamp
+  float _dt;
+  uint64_t _anchorTicks;                   // tickLength_us baseline, against micros()
+  uint32_t _anchor_us;
+  uint8_t _tickSamples;
 
 };
 
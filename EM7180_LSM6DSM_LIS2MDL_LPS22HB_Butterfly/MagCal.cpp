@@ -0,0 +1,218 @@
+#include "MagCal.h"
+
+#define MAGCAL_MAX_SAMPLES 4096   // then the sums are halved, so old samples fade and float sums stay exact enough
+
+static uint8_t tri(uint8_t i, uint8_t j)   // index of (i, j), i <= j, in the packed upper triangle
+{
+  return i * 10 - i * (i - 1) / 2 + (j - i);
+}
+
+MagCal::MagCal()
+{
+  minSpacing = 0.05f;
+  minSamples = 100;
+  solveInterval = 25;
+  maxFitError = 0.05f;
+  maxOffsetError = 0.004f;
+  reset();
+}
+
+void MagCal::reset()
+{
+  memset(_S, 0, sizeof(_S));
+  memset(offset, 0, sizeof(offset));
+  memset(softIron, 0, sizeof(softIron));
+  softIron[0][0] = softIron[1][1] = softIron[2][2] = 1.0f;
+  radius = fitError = offsetError = 0.0f;
+  samples = _sinceSolve = 0;
+  _scale = 0.0f;
+  valid = false;
+}
+
+bool MagCal::add(const float * m)
+{
+  if (_scale == 0.0f) {
+    float n = sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+    if (n <= 0.0f) return false;
+    _scale = 1.0f / n;
+  }
+  float x = m[0] * _scale, y = m[1] * _scale, z = m[2] * _scale;
+  if (samples) {
+    float dx = x - _last[0], dy = y - _last[1], dz = z - _last[2];
+    if (dx * dx + dy * dy + dz * dz < minSpacing * minSpacing) return false;
+  }
+  _last[0] = x; _last[1] = y; _last[2] = z;
+
+  float xx = x * x, yy = y * y, zz = z * z;
+  float r[10] = {xx + yy - 2.0f * zz, xx + zz - 2.0f * yy, 2.0f * x * y, 2.0f * x * z, 2.0f * y * z,
+                 2.0f * x, 2.0f * y, 2.0f * z, 1.0f, xx + yy + zz};
+  float * s = _S;
+  for (uint8_t i = 0; i < 10; i++) {
+    float ri = r[i];
+    for (uint8_t j = i; j < 10; j++) *s++ += ri * r[j];
+  }
+
+  if (++samples >= MAGCAL_MAX_SAMPLES) halve();
+  if (samples < minSamples || ++_sinceSolve < solveInterval) return false;
+  return solve();
+}
+
+void MagCal::halve()
+{
+  for (uint8_t i = 0; i < 55; i++) _S[i] *= 0.5f;
+  samples /= 2;
+}
+
+bool MagCal::solve()
+{
+  _sinceSolve = 0;
+  if (samples < 10) return false;
+
+  // Normal equations N u = b by Cholesky, N = L L'
+  float L[9][9], u[9];
+  for (uint8_t i = 0; i < 9; i++) {
+    for (uint8_t j = 0; j <= i; j++) {
+      float sum = _S[tri(j, i)];
+      for (uint8_t k = 0; k < j; k++) sum -= L[i][k] * L[j][k];
+      if (i == j) {
+        if (sum <= 0.0f) return false;
+        L[i][i] = sqrtf(sum);
+      } else {
+        L[i][j] = sum / L[j][j];
+      }
+    }
+  }
+  for (uint8_t i = 0; i < 9; i++) {
+    float sum = _S[tri(i, 9)];
+    for (uint8_t k = 0; k < i; k++) sum -= L[i][k] * u[k];
+    u[i] = sum / L[i][i];
+  }
+  for (int8_t i = 8; i >= 0; i--) {
+    float sum = u[i];
+    for (uint8_t k = i + 1; k < 9; k++) sum -= L[k][i] * u[k];
+    u[i] = sum / L[i][i];
+  }
+
+  // Residual |d2 - D u|^2 = d2'd2 - u'b, relative to the mean of d2
+  float residual = _S[tri(9, 9)];
+  for (uint8_t i = 0; i < 9; i++) residual -= u[i] * _S[tri(i, 9)];
+  float meanD2 = _S[tri(8, 9)] / (float)samples;
+  float error = sqrtf(fabsf(residual) / (float)samples) / meanD2;
+  if (error > maxFitError || (valid && error > 2.0f * fitError + 0.01f)) {
+    // No one ellipsoid fits, or clearly worse than the published one did: the mounting or the surroundings
+    // changed, so the older samples fade faster
+    halve();
+    return false;
+  }
+
+  // Covariance of the linear terms g = u[5..7]: residual / (samples - 9) times that block of N^-1, from
+  // columns 5 - 7 of L^-1
+  float Li[9][3], covg[3][3];
+  for (uint8_t c = 0; c < 3; c++) {
+    for (uint8_t i = 0; i < 9; i++) {
+      if (i < c + 5) { Li[i][c] = 0.0f; continue; }
+      float sum = i == c + 5 ? 1.0f : 0.0f;
+      for (uint8_t k = c + 5; k < i; k++) sum -= L[i][k] * Li[k][c];
+      Li[i][c] = sum / L[i][i];
+    }
+  }
+  float s2 = fabsf(residual) / (float)(samples - 9);
+  for (uint8_t a = 0; a < 3; a++)
+    for (uint8_t b = 0; b < 3; b++) {
+      float sum = 0.0f;
+      for (uint8_t i = 0; i < 9; i++) sum += Li[i][a] * Li[i][b];
+      covg[a][b] = s2 * sum;
+    }
+
+  // Back to the quadric x'A x + 2 g'x + c = 0
+  float A[3][3] = {{u[0] + u[1] - 1.0f, u[2], u[3]},
+                   {u[2], u[0] - 2.0f * u[1] - 1.0f, u[4]},
+                   {u[3], u[4], u[1] - 2.0f * u[0] - 1.0f}};
+  float g[3] = {u[5], u[6], u[7]};
+
+  // Centre = -A^-1 g
+  float c00 = A[1][1] * A[2][2] - A[1][2] * A[2][1];
+  float c01 = A[1][2] * A[2][0] - A[1][0] * A[2][2];
+  float c02 = A[1][0] * A[2][1] - A[1][1] * A[2][0];
+  float det = A[0][0] * c00 + A[0][1] * c01 + A[0][2] * c02;
+  if (fabsf(det) < 1e-12f) return false;
+  float Ai[3][3] = {{c00, A[0][2] * A[2][1] - A[0][1] * A[2][2], A[0][1] * A[1][2] - A[0][2] * A[1][1]},
+                    {c01, A[0][0] * A[2][2] - A[0][2] * A[2][0], A[0][2] * A[1][0] - A[0][0] * A[1][2]},
+                    {c02, A[0][1] * A[2][0] - A[0][0] * A[2][1], A[0][0] * A[1][1] - A[0][1] * A[1][0]}};
+  float centre[3], varCentre = 0.0f;
+  for (uint8_t i = 0; i < 3; i++) {
+    centre[i] = -(Ai[i][0] * g[0] + Ai[i][1] * g[1] + Ai[i][2] * g[2]) / det;
+    for (uint8_t a = 0; a < 3; a++)
+      for (uint8_t b = 0; b < 3; b++) varCentre += Ai[i][a] * Ai[i][b] * covg[a][b];   // carried through -A^-1 g
+  }
+  varCentre /= det * det;
+
+  // (x - centre)' Q (x - centre) = 1 with Q = A / (centre' A centre - c)
+  float k = -u[8];
+  for (uint8_t i = 0; i < 3; i++)
+    for (uint8_t j = 0; j < 3; j++) k += centre[i] * A[i][j] * centre[j];
+  if (fabsf(k) < 1e-12f) return false;
+  float Q[3][3], V[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  for (uint8_t i = 0; i < 3; i++)
+    for (uint8_t j = 0; j < 3; j++) Q[i][j] = A[i][j] / k;
+
+  // Jacobi eigen decomposition of the symmetric Q, Q = V diag V'
+  for (uint8_t sweep = 0; sweep < 10; sweep++) {
+    float off = Q[0][1] * Q[0][1] + Q[0][2] * Q[0][2] + Q[1][2] * Q[1][2];
+    if (off < 1e-14f) break;
+    for (uint8_t p = 0; p < 2; p++) {
+      for (uint8_t q = p + 1; q < 3; q++) {
+        if (fabsf(Q[p][q]) < 1e-12f) continue;
+        float theta = (Q[q][q] - Q[p][p]) / (2.0f * Q[p][q]);
+        float t = (theta >= 0.0f ? 1.0f : -1.0f) / (fabsf(theta) + sqrtf(theta * theta + 1.0f));
+        float cs = 1.0f / sqrtf(t * t + 1.0f), sn = t * cs;
+        for (uint8_t r = 0; r < 3; r++) {   // Q = Q J
+          float a = Q[r][p], b = Q[r][q];
+          Q[r][p] = cs * a - sn * b;
+          Q[r][q] = sn * a + cs * b;
+        }
+        for (uint8_t r = 0; r < 3; r++) {   // Q = J' Q
+          float a = Q[p][r], b = Q[q][r];
+          Q[p][r] = cs * a - sn * b;
+          Q[q][r] = sn * a + cs * b;
+        }
+        for (uint8_t r = 0; r < 3; r++) {   // V = V J
+          float a = V[r][p], b = V[r][q];
+          V[r][p] = cs * a - sn * b;
+          V[r][q] = sn * a + cs * b;
+        }
+      }
+    }
+  }
+
+  // An ellipsoid has three positive axes; one much longer than another means too little coverage yet
+  float lambda[3] = {Q[0][0], Q[1][1], Q[2][2]};
+  if (lambda[0] <= 0.0f || lambda[1] <= 0.0f || lambda[2] <= 0.0f) return false;
+  float lmin = fminf(lambda[0], fminf(lambda[1], lambda[2])), lmax = fmaxf(lambda[0], fmaxf(lambda[1], lambda[2]));
+  if (lmax > 9.0f * lmin) return false;
+
+  // A walk over part of the sphere can fit as small a residual with the centre poorly pinned down
+  float r = 1.0f / sqrtf(cbrtf(lambda[0] * lambda[1] * lambda[2]));
+  float centreError = sqrtf(varCentre) / r;
+  if (centreError > maxOffsetError) return false;
+
+  // softIron = V diag(sqrt(lambda) * r) V', r the geometric mean radius so the field strength is kept
+  float w[3] = {sqrtf(lambda[0]) * r, sqrtf(lambda[1]) * r, sqrtf(lambda[2]) * r};
+  for (uint8_t i = 0; i < 3; i++)
+    for (uint8_t j = 0; j < 3; j++)
+      softIron[i][j] = V[i][0] * w[0] * V[j][0] + V[i][1] * w[1] * V[j][1] + V[i][2] * w[2] * V[j][2];
+  for (uint8_t i = 0; i < 3; i++) offset[i] = centre[i] / _scale;
+  radius = r / _scale;
+  fitError = error;
+  offsetError = centreError;
+  valid = true;
+  return true;
+}
+
+void MagCal::apply(const float * m, float * out)
+{
+  float x = m[0] - offset[0], y = m[1] - offset[1], z = m[2] - offset[2];
+  out[0] = softIron[0][0] * x + softIron[0][1] * y + softIron[0][2] * z;
+  out[1] = softIron[1][0] * x + softIron[1][1] * y + softIron[1][2] * z;
+  out[2] = softIron[2][0] * x + softIron[2][1] * y + softIron[2][2] * z;
+}
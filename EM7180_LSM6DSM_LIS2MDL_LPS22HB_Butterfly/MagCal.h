@@ -0,0 +1,59 @@
+/* Streaming ellipsoid fit magnetometer calibration
+
+  Hard and soft iron turn the sphere of field vectors into an offset, rotated ellipsoid. Instead of a
+  blocking min/max sweep per axis, add() takes samples while the sketch keeps running. A sample is kept only
+  when it has moved far enough from the last kept one, so a board lying still does not swamp the fit, and it
+  goes into a running 10 x 10 normal matrix (upper triangle, 55 floats): constant memory however long it runs.
+
+  Every solveInterval kept samples the least-squares ellipsoid is solved (the 9 parameter form of
+  Petrov's ellipsoid_fit, by Cholesky), and if it is a sane ellipsoid with its offset pinned down to within
+  maxOffsetError the result is published as
+
+      corrected = softIron * (raw - offset)
+
+  where softIron is the full symmetric 3 x 3 matrix that maps the ellipsoid back onto a sphere of radius
+  `radius`, in the units of the input. The offset check holds back the fits of a walk over part of the
+  sphere, whose residual is as small as a good fit's. A solve whose residual is well above the published
+  fit's halves the sums, so after the board is remounted the old samples fade within a few minutes.
+*/
+
+#ifndef MagCal_h
+#define MagCal_h
+
+#include "Arduino.h"
+
+class MagCal
+{
+  public:
+    MagCal();
+
+    void reset();
+    bool add(const float * m);                 // true when this sample produced a new accepted fit
+    bool solve();
+    void apply(const float * m, float * out);
+
+    float offset[3];
+    float softIron[3][3];
+    float radius;
+    float fitError;          // rms algebraic residual relative to the mean squared field
+    float offsetError;       // standard error of the offset, relative to the field
+    uint16_t samples;        // kept samples in the normal matrix
+    bool valid;
+
+    float minSpacing;        // fraction of the field a sample must move to be kept, default 0.05
+    uint16_t minSamples;     // before the first solve, default 100
+    uint16_t solveInterval;  // kept samples between solves, default 25
+    float maxFitError;       // reject solutions above this, default 0.05
+    float maxOffsetError;    // reject solutions whose offset standard error is above this fraction of the
+                             // field, default 0.004
+
+  private:
+    float _S[55];            // sum of z z' over kept samples, z = [9 regressors, |m|^2], scaled by _scale
+    float _last[3];
+    float _scale;            // 1 / |first sample|, keeps the sums near unity
+    uint16_t _sinceSolve;
+
+    void halve();
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "TempBias.h"
+
+#define TEMPBIAS_MAX_WEIGHT 1000   // caps a bin's weight so one long soak does not swamp the others
+#define TEMPBIAS_MAX_COUNT  4000   // past this a bin's mean moves 1/4000 of the way per observation, so it
+                                   // keeps following the sensor as it ages instead of freezing
+
+TempBias::TempBias(float resolution)
+{
+  _resolution = resolution;
+  memset(_mean, 0, sizeof(_mean));
+  memset(_temperature, 0, sizeof(_temperature));
+  memset(_count, 0, sizeof(_count));
+  memset(coef, 0, sizeof(coef));
+  memset(bias, 0, sizeof(bias));
+  order = 0;
+  refitInterval = 500;
+  observations = 0;
+  _sinceFit = 0;
+  _tLow = _tHigh = 0.0f;
+}
+
+void TempBias::observe(float temperature, const float * value)
+{
+  int16_t bin = (int16_t)floorf((temperature - TEMPBIAS_T_MIN) / TEMPBIAS_BIN_WIDTH);
+  if (bin < 0 || bin >= TEMPBIAS_BINS) return;
+
+  if (_count[bin] < TEMPBIAS_MAX_COUNT) _count[bin]++;
+  float k = 1.0f / (float)_count[bin];
+  for (uint8_t i = 0; i < 3; i++) _mean[bin][i] += (value[i] - _mean[bin][i]) * k;
+  _temperature[bin] += (temperature - _temperature[bin]) * k;
+  observations++;
+
+  if (++_sinceFit >= refitInterval) {
+    fit();
+    setTemperature(temperature);
+  }
+}
+
+// Weighted least squares on the bins' mean temperatures, solved through the 3 x 3 normal equations
+void TempBias::fit()
+{
+  _sinceFit = 0;
+  float S[5] = {0, 0, 0, 0, 0};       // sum w * t^k
+  float B[3][3];                      // per axis, sum w * t^k * y
+  memset(B, 0, sizeof(B));
+  int16_t first = -1, last = -1;
+
+  for (uint8_t b = 0; b < TEMPBIAS_BINS; b++) {
+    if (!_count[b]) continue;
+    if (first < 0) first = b;
+    last = b;
+    float w = (float)(_count[b] < TEMPBIAS_MAX_WEIGHT ? _count[b] : TEMPBIAS_MAX_WEIGHT);
+    float t = _temperature[b] - TEMPBIAS_T_REF;
+    float tk = w;
+    for (uint8_t k = 0; k < 5; k++) {
+      S[k] += tk;
+      if (k < 3) for (uint8_t i = 0; i < 3; i++) B[i][k] += tk * _mean[b][i];
+      tk *= t;
+    }
+  }
+  if (first < 0) return;
+
+  _tLow = _temperature[first] - TEMPBIAS_T_REF;
+  _tHigh = _temperature[last] - TEMPBIAS_T_REF;
+  uint8_t bins = 0;
+  for (uint8_t b = first; b <= last; b++) if (_count[b]) bins++;
+  float span = _tHigh - _tLow;
+  order = (span >= 12.0f && bins >= 4) ? 2 : (span >= 4.0f && bins >= 2) ? 1 : 0;
+
+  uint8_t n = order + 1;
+  for (uint8_t i = 0; i < 3; i++) {
+    float A[3][4];
+    for (uint8_t r = 0; r < n; r++) {
+      for (uint8_t c = 0; c < n; c++) A[r][c] = S[r + c];
+      A[r][n] = B[i][r];
+    }
+    // Gaussian elimination, the system is symmetric positive definite
+    bool ok = true;
+    for (uint8_t c = 0; c < n && ok; c++) {
+      if (fabsf(A[c][c]) < 1e-12f) { ok = false; break; }
+      for (uint8_t r = c + 1; r < n; r++) {
+        float f = A[r][c] / A[c][c];
+        for (uint8_t k = c; k <= n; k++) A[r][k] -= f * A[c][k];
+      }
+    }
+    if (!ok) continue;   // keep the previous fit for this axis
+    float x[3] = {0, 0, 0};
+    for (int8_t r = n - 1; r >= 0; r--) {
+      float s = A[r][n];
+      for (uint8_t k = r + 1; k < n; k++) s -= A[r][k] * x[k];
+      x[r] = s / A[r][r];
+    }
+    coef[i][0] = x[0]; coef[i][1] = x[1]; coef[i][2] = x[2];
+  }
+}
+
+void TempBias::setTemperature(float temperature)
+{
+  float dT = temperature - TEMPBIAS_T_REF;
+  if (dT < _tLow) dT = _tLow;
+  if (dT > _tHigh) dT = _tHigh;
+  for (uint8_t i = 0; i < 3; i++) bias[i] = coef[i][0] + dT * (coef[i][1] + dT * coef[i][2]);
+}
+
+void TempBias::correct(float * value)
+{
+  value[0] -= bias[0];
+  value[1] -= bias[1];
+  value[2] -= bias[2];
+}
+
+// Record: version, number of bins, then per occupied bin its index, its count (saturated at 255), its mean
+// temperature as 1/255ths of the bin and the three means as int16 multiples of the resolution. Version 1
+// records, without the temperature, still load with the bin centre in its place.
+uint16_t TempBias::save(uint8_t * buf)
+{
+  uint16_t len = 2;
+  uint8_t bins = 0;
+  for (uint8_t b = 0; b < TEMPBIAS_BINS; b++) {
+    if (!_count[b]) continue;
+    buf[len++] = b;
+    buf[len++] = (uint8_t)(_count[b] < 255 ? _count[b] : 255);
+    float f = (_temperature[b] - TEMPBIAS_T_MIN) / TEMPBIAS_BIN_WIDTH - (float)b;
+    buf[len++] = (uint8_t)lroundf((f < 0.0f ? 0.0f : f > 1.0f ? 1.0f : f) * 255.0f);
+    for (uint8_t i = 0; i < 3; i++) {
+      float q = _mean[b][i] / _resolution;
+      if (q > 32767.0f) q = 32767.0f;
+      if (q < -32768.0f) q = -32768.0f;
+      int16_t v = (int16_t)lroundf(q);
+      buf[len++] = (uint8_t)(v & 0xFF);
+      buf[len++] = (uint8_t)((uint16_t)v >> 8);
+    }
+    bins++;
+  }
+  buf[0] = 0x02;   // record version
+  buf[1] = bins;
+  return len;
+}
+
+bool TempBias::load(const uint8_t * buf, uint16_t len)
+{
+  if (len < 2 || (buf[0] != 0x01 && buf[0] != 0x02)) return false;
+  uint8_t size = buf[0] == 0x01 ? 8 : 9;
+  if (len < 2 + size * (uint16_t)buf[1]) return false;
+  memset(_mean, 0, sizeof(_mean));
+  memset(_temperature, 0, sizeof(_temperature));
+  memset(_count, 0, sizeof(_count));
+  const uint8_t * p = buf + 2;
+  for (uint8_t n = 0; n < buf[1]; n++, p += size) {
+    uint8_t b = p[0];
+    if (b >= TEMPBIAS_BINS) return false;
+    _count[b] = p[1];
+    float f = size == 9 ? (float)p[2] / 255.0f : 0.5f;
+    _temperature[b] = TEMPBIAS_T_MIN + ((float)b + f) * TEMPBIAS_BIN_WIDTH;
+    const uint8_t * m = p + size - 6;
+    for (uint8_t i = 0; i < 3; i++) _mean[b][i] = (float)(int16_t)(m[2 * i] | m[2 * i + 1] << 8) * _resolution;
+  }
+  fit();
+  return true;
+}
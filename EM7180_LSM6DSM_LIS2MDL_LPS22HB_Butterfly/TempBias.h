@@ -0,0 +1,57 @@
+/* Temperature-dependent bias model, learned online
+
+  While the board is still, each reading of a three axis sensor is a direct observation of its bias.
+  observe() files these by the sensor's own temperature into 2 C bins, keeping a running mean per axis
+  and of the temperature itself. After a few thousand observations the means turn into moving averages,
+  so a bin follows the sensor as it ages; the temperature mean then sits where the recent observations
+  were, not at the bin centre. Every refitInterval observations a polynomial in (T - 25 C) is fitted per
+  axis by weighted least squares over the bin means: constant, linear or quadratic depending on the
+  temperature span seen so far.
+
+  setTemperature() evaluates the polynomials once per temperature reading (clamped to the span that has
+  been observed, so the fit is never extrapolated); correct() then only subtracts three numbers per sample.
+
+  save()/load() keep the bins, not just the fit, so learning carries on across power cycles: 9 bytes per
+  occupied bin, at most TEMPBIAS_RECORD_MAX bytes.
+*/
+
+#ifndef TempBias_h
+#define TempBias_h
+
+#include "Arduino.h"
+
+#define TEMPBIAS_BINS        40
+#define TEMPBIAS_T_MIN       -20.0f   // C, lower edge of bin 0
+#define TEMPBIAS_BIN_WIDTH   2.0f     // C
+#define TEMPBIAS_T_REF       25.0f    // C, polynomial origin
+#define TEMPBIAS_RECORD_MAX  (2 + 9 * TEMPBIAS_BINS)
+
+class TempBias
+{
+  public:
+    TempBias(float resolution);   // smallest bias step kept by save(), in the sensor's units
+
+    void observe(float temperature, const float * value);   // value is the reading while stationary
+    void fit();
+    void setTemperature(float temperature);
+    void correct(float * value);                              // value[0..2] -= bias at the current temperature
+
+    uint16_t save(uint8_t * buf);
+    bool load(const uint8_t * buf, uint16_t len);
+
+    float coef[3][3];      // per axis: c0 + c1 * dT + c2 * dT^2
+    float bias[3];         // at the last setTemperature()
+    uint8_t order;         // polynomial order of the current fit
+    uint16_t refitInterval;
+    uint32_t observations;
+
+  private:
+    float _mean[TEMPBIAS_BINS][3];
+    float _temperature[TEMPBIAS_BINS];   // mean temperature of the observations, C
+    uint16_t _count[TEMPBIAS_BINS];
+    float _resolution;
+    float _tLow, _tHigh;   // span of occupied bins, polynomial variable
+    uint16_t _sinceFit;
+};
+
+#endif
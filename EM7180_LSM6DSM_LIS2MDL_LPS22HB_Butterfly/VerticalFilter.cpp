@@ -0,0 +1,76 @@
+#include "VerticalFilter.h"
+
+VerticalFilter::VerticalFilter()
+{
+  setNoise(0.3f, 0.02f, 0.5f);
+  reset(0.0f);
+  initialised = false;   // the first baro sample sets the altitude
+}
+
+void VerticalFilter::setNoise(float accelNoise, float biasNoise, float baroNoise)
+{
+  _qa = accelNoise * accelNoise;
+  _qb = biasNoise * biasNoise;
+  _r = baroNoise * baroNoise;
+}
+
+void VerticalFilter::reset(float altitude_m)
+{
+  altitude = altitude_m;
+  velocity = 0.0f;
+  accelBias = 0.0f;
+  memset(_P, 0, sizeof(_P));
+  _P[0][0] = _r;
+  _P[1][1] = 1.0f;
+  _P[2][2] = 0.1f;
+  initialised = true;
+}
+
+void VerticalFilter::predict(float accelUp, float dt)
+{
+  if (!initialised || dt <= 0.0f) return;
+  float a = accelUp - accelBias;
+  float dt2 = 0.5f * dt * dt;
+  altitude += velocity * dt + a * dt2;
+  velocity += a * dt;
+
+  // P = F P F' + Q with F = [1 dt -dt^2/2; 0 1 -dt; 0 0 1], written out for the symmetric P
+  float p00 = _P[0][0], p01 = _P[0][1], p02 = _P[0][2];
+  float p11 = _P[1][1], p12 = _P[1][2], p22 = _P[2][2];
+  float a00 = p00 + dt * p01 - dt2 * p02;            // F P, the entries the product needs
+  float a01 = p01 + dt * p11 - dt2 * p12;
+  float a02 = p02 + dt * p12 - dt2 * p22;
+  float a11 = p11 - dt * p12;
+  float a12 = p12 - dt * p22;
+
+  _P[0][0] = a00 + dt * a01 - dt2 * a02 + _qa * dt2 * dt2;
+  _P[0][1] = _P[1][0] = a01 - dt * a02 + _qa * dt2 * dt;
+  _P[0][2] = _P[2][0] = a02;
+  _P[1][1] = a11 - dt * a12 + _qa * dt * dt;
+  _P[1][2] = _P[2][1] = a12;
+  _P[2][2] = p22 + _qb * dt;
+}
+
+void VerticalFilter::correct(float baroAltitude_m)
+{
+  if (!initialised) {
+    reset(baroAltitude_m);
+    return;
+  }
+  float s = _P[0][0] + _r;
+  float k0 = _P[0][0] / s, k1 = _P[1][0] / s, k2 = _P[2][0] / s;
+  float y = baroAltitude_m - altitude;
+  altitude += k0 * y;
+  velocity += k1 * y;
+  accelBias += k2 * y;
+
+  // P = (I - K H) P with H = [1 0 0]
+  float p0[3] = {_P[0][0], _P[0][1], _P[0][2]};
+  float k[3] = {k0, k1, k2};
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = i; j < 3; j++) {
+      _P[i][j] -= k[i] * p0[j];
+      _P[j][i] = _P[i][j];
+    }
+  }
+}
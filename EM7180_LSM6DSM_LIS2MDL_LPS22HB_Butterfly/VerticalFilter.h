@@ -0,0 +1,36 @@
+/* Baro-inertial vertical channel
+
+  A three state Kalman filter (altitude, vertical velocity, vertical accelerometer bias) with fixed size
+  storage. predict() runs at the IMU rate with the gravity-removed vertical acceleration in the earth
+  frame; correct() runs whenever a barometric altitude arrives. Between baro samples altitude and
+  velocity follow the accelerometer, and the baro pulls out the drift the accelerometer cannot see.
+
+  Units are metres, seconds, m/s and m/s^2, up positive.
+*/
+
+#ifndef VerticalFilter_h
+#define VerticalFilter_h
+
+#include "Arduino.h"
+
+class VerticalFilter
+{
+  public:
+    VerticalFilter();
+
+    void setNoise(float accelNoise, float biasNoise, float baroNoise);  // m/s^2, m/s^3, m (1 sigma)
+    void reset(float altitude_m);
+    void predict(float accelUp, float dt);
+    void correct(float baroAltitude_m);
+
+    float altitude;     // m
+    float velocity;     // m/s
+    float accelBias;    // m/s^2
+    bool initialised;
+
+  private:
+    float _P[3][3];
+    float _qa, _qb, _r;  // variances
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "Altitude.h"
+
+#define ALTITUDE_STEP ((ALTITUDE_P_MAX - ALTITUDE_P_MIN) / ALTITUDE_SEGMENTS)
+
+Altitude::Altitude()
+{
+  const double h = ALTITUDE_STEP;
+  for (uint8_t i = 0; i < ALTITUDE_SEGMENTS; i++) {
+    double p0 = ALTITUDE_P_MIN + i * h, p1 = p0 + h;
+    double f0 = pow(p0, ALTITUDE_EXPONENT), f1 = pow(p1, ALTITUDE_EXPONENT);
+    double d0 = ALTITUDE_EXPONENT * f0 / p0, d1 = ALTITUDE_EXPONENT * f1 / p1;   // slopes
+    _coef[i][0] = (float)f0;
+    _coef[i][1] = (float)d0;
+    _coef[i][2] = (float)((3.0 * (f1 - f0) / h - 2.0 * d0 - d1) / h);
+    _coef[i][3] = (float)((2.0 * (f0 - f1) / h + d0 + d1) / (h * h));
+  }
+  setQNH(1013.25f);
+}
+
+void Altitude::setQNH(float qnh_mbar)
+{
+  qnh = qnh_mbar;
+  _scale = ALTITUDE_SCALE_FT / (float)pow((double)qnh_mbar, ALTITUDE_EXPONENT);
+}
+
+float Altitude::powTable(float pressure_mbar)
+{
+  float x = (pressure_mbar - ALTITUDE_P_MIN) * (1.0f / ALTITUDE_STEP);
+  int16_t i = (int16_t)x;
+  if (x < 0.0f) i = 0;
+  if (i > ALTITUDE_SEGMENTS - 1) i = ALTITUDE_SEGMENTS - 1;
+  float dp = pressure_mbar - (ALTITUDE_P_MIN + (float)i * ALTITUDE_STEP);
+  const float * c = _coef[i];
+  return c[0] + dp * (c[1] + dp * (c[2] + dp * c[3]));
+}
+
+float Altitude::feet(float pressure_mbar)
+{
+  return ALTITUDE_SCALE_FT - _scale * powTable(pressure_mbar);
+}
+
+float Altitude::metres(float pressure_mbar)
+{
+  return feet(pressure_mbar) * 0.3048f;
+}
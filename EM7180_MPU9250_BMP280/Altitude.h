@@ -0,0 +1,42 @@
+/* Pressure altitude without a per-sample pow()
+
+  altitude = 145366.45 ft * (1 - (p / QNH)^0.190284), the ISA formula the sketches use. Splitting the
+  ratio gives p^0.190284 * QNH^-0.190284; the second factor only changes with setQNH(), and p^0.190284 is
+  taken from a table of 32 cubic segments over 300 - 1100 mbar (Hermite fits to the exact curve and its
+  slope, 512 bytes built once by the constructor). A sample costs one table lookup and four multiply-adds.
+
+  Against the pow() formula the table is within 0.01 m over 300 - 1100 mbar (float evaluation included,
+  QNH 950 - 1050 mbar). Outside that range the end segments are extrapolated: the error grows to about
+  2 m at 250 mbar, where the curve bends hardest, and stays near 0.01 m up to 1150 mbar
+  (tools/Altitude).
+*/
+
+#ifndef Altitude_h
+#define Altitude_h
+
+#include "Arduino.h"
+
+#define ALTITUDE_SEGMENTS   32
+#define ALTITUDE_P_MIN      300.0f     // mbar
+#define ALTITUDE_P_MAX      1100.0f    // mbar
+#define ALTITUDE_EXPONENT   0.190284
+#define ALTITUDE_SCALE_FT   145366.45f
+
+class Altitude
+{
+  public:
+    Altitude();
+
+    void setQNH(float qnh_mbar);     // sea level reference, 1013.25 mbar by default
+    float feet(float pressure_mbar);
+    float metres(float pressure_mbar);
+
+    float qnh;
+
+  private:
+    float _coef[ALTITUDE_SEGMENTS][4];   // p^0.190284 = c0 + dp * (c1 + dp * (c2 + dp * c3)) in each segment
+    float _scale;                        // ALTITUDE_SCALE_FT / QNH^0.190284
+    float powTable(float pressure_mbar);
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "BMP280Compensator.h"
+
+BMP280Compensator::BMP280Compensator()
+{
+  _T1 = _T2 = _T3 = 0;
+  _P1 = _P2 = _P3 = _P4 = _P5 = _P6 = _P7 = _P8 = _P9 = 0;
+}
+
+void BMP280Compensator::begin(const uint8_t * calib)
+{
+  _T1 = (uint16_t)(((uint16_t) calib[1] << 8) | calib[0]);
+  _T2 = ( int16_t)((( int16_t) calib[3] << 8) | calib[2]);
+  _T3 = ( int16_t)((( int16_t) calib[5] << 8) | calib[4]);
+  _P1 = (uint16_t)(((uint16_t) calib[7] << 8) | calib[6]);
+  _P2 = ( int16_t)((( int16_t) calib[9] << 8) | calib[8]);
+  _P3 = ( int16_t)((( int16_t) calib[11] << 8) | calib[10]);
+  _P4 = ( int16_t)((( int16_t) calib[13] << 8) | calib[12]);
+  _P5 = ( int16_t)((( int16_t) calib[15] << 8) | calib[14]);
+  _P6 = ( int16_t)((( int16_t) calib[17] << 8) | calib[16]);
+  _P7 = ( int16_t)((( int16_t) calib[19] << 8) | calib[18]);
+  _P8 = ( int16_t)((( int16_t) calib[21] << 8) | calib[20]);
+  _P9 = ( int16_t)((( int16_t) calib[23] << 8) | calib[22]);
+}
+
+void BMP280Compensator::temperature(int32_t adc_T, bmp280_temp_t * t) const
+{
+  int32_t var1 = ((((adc_T >> 3) - (_T1 << 1))) * _T2) >> 11;
+  int32_t var2 = (((((adc_T >> 4) - _T1) * ((adc_T >> 4) - _T1)) >> 12) * _T3) >> 14;
+  t->t_fine = var1 + var2;
+  t->T = (t->t_fine * 5 + 128) >> 8;
+
+  // Temperature-only half of the pressure formula, as in the reference
+  int64_t v1 = (int64_t)t->t_fine - 128000;
+  int64_t v2 = v1 * v1 * _P6;
+  v2 = v2 + ((v1 * _P5) << 17);
+  v2 = v2 + (_P4 << 35);
+  v1 = ((v1 * v1 * _P3) >> 8) + ((v1 * _P2) << 12);
+  v1 = ((((int64_t)1) << 47) + v1) * _P1 >> 33;
+  t->offset = v2;
+  t->divisor = v1;
+
+  // Float path: q = (u * 2^31 - offset) * 3125 / divisor, then
+  // Pa = (q + P9 * q^2 / 2^51 + P8 * q / 2^19) / 2^16 + P7 / 16, expanded into powers of u
+  if (v1 == 0) {
+    t->c0 = t->c1 = t->c2 = 0.0f;
+    return;
+  }
+  double a = 2147483648.0 * 3125.0 / (double)v1;
+  double b = (double)v2 * 3125.0 / (double)v1;
+  double s1 = (1.0 + (double)_P8 / 524288.0) / 65536.0;
+  double s2 = (double)_P9 / 147573952589676412928.0;   // 2^67
+  t->c2 = (float)(s2 * a * a);
+  t->c1 = (float)(s1 * a - 2.0 * s2 * a * b);
+  t->c0 = (float)(s2 * b * b - s1 * b + (double)_P7 / 16.0);
+}
+
+uint32_t BMP280Compensator::pressure(const bmp280_temp_t & t, int32_t adc_P) const
+{
+  if (t.divisor == 0) return 0;   // avoid exception caused by division by zero
+  int64_t p = 1048576 - adc_P;
+  p = (((p << 31) - t.offset) * 3125) / t.divisor;
+  int64_t var1 = (_P9 * (p >> 13) * (p >> 13)) >> 25;
+  int64_t var2 = (_P8 * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + (_P7 << 4);
+  return (uint32_t)p;
+}
+
+float BMP280Compensator::pressureFast(const bmp280_temp_t & t, int32_t adc_P) const
+{
+  float u = (float)(1048576 - adc_P);
+  return t.c0 + u * (t.c1 + u * t.c2);
+}
+
+// Batches share one context, so the divisor check and all temperature terms are outside the loop
+void BMP280Compensator::pressures(const bmp280_temp_t & t, const int32_t * adc_P, uint32_t * out, uint16_t n) const
+{
+  if (t.divisor == 0) {
+    memset(out, 0, n * sizeof(uint32_t));
+    return;
+  }
+  const int64_t offset = t.offset, divisor = t.divisor, p7 = _P7 << 4;
+  for (uint16_t i = 0; i < n; i++) {
+    int64_t p = 1048576 - adc_P[i];
+    p = (((p << 31) - offset) * 3125) / divisor;
+    int64_t var1 = (_P9 * (p >> 13) * (p >> 13)) >> 25;
+    int64_t var2 = (_P8 * p) >> 19;
+    out[i] = (uint32_t)(((p + var1 + var2) >> 8) + p7);
+  }
+}
+
+void BMP280Compensator::pressuresFast(const bmp280_temp_t & t, const int32_t * adc_P, float * out, uint16_t n) const
+{
+  const float c0 = t.c0, c1 = t.c1, c2 = t.c2;
+  for (uint16_t i = 0; i < n; i++) {
+    float u = (float)(1048576 - adc_P[i]);
+    out[i] = c0 + u * (c1 + u * c2);
+  }
+}
@@ -0,0 +1,49 @@
+/* BMP280 compensation engine
+
+  The datasheet compensation (bmp280_compensate_T/P) threads the fine temperature through the shared
+  t_fine and recomputes every temperature-only term of the pressure formula for each sample.
+
+  Here the trimming words are parsed once by begin(). temperature() turns a raw temperature into a
+  bmp280_temp_t context that holds everything of the pressure formula that depends on temperature only:
+  the int64 offset and divisor of the exact path, and the three coefficients of the float path, in
+  which pressure is a quadratic in the raw count. Any number of pressure samples can then be converted
+  against one context, singly or in batches, and nothing in the engine changes after begin().
+
+  pressure() is bit-exact with the datasheet 64-bit reference (Q24.8 Pa). pressureFast() evaluates the
+  quadratic in float: two multiply-adds and no division per sample, within 0.05 Pa of the exact result
+  over the sensor range.
+*/
+
+#ifndef BMP280Compensator_h
+#define BMP280Compensator_h
+
+#include "Arduino.h"
+
+struct bmp280_temp_t {
+  int32_t t_fine;
+  int32_t T;             // 0.01 degC
+  int64_t offset;        // var2 of the reference, scaled by 2^31 raw counts
+  int64_t divisor;       // var1 of the reference, zero if the trimming is invalid
+  float c0, c1, c2;      // Pa = c0 + c1 * u + c2 * u^2, u = 2^20 - raw pressure
+};
+
+class BMP280Compensator
+{
+  public:
+    BMP280Compensator();
+
+    void begin(const uint8_t * calib);    // the 24 bytes from BMP280_CALIB00
+
+    void temperature(int32_t adc_T, bmp280_temp_t * t) const;
+
+    uint32_t pressure(const bmp280_temp_t & t, int32_t adc_P) const;             // Q24.8 Pa, exact
+    float pressureFast(const bmp280_temp_t & t, int32_t adc_P) const;            // Pa
+    void pressures(const bmp280_temp_t & t, const int32_t * adc_P, uint32_t * out, uint16_t n) const;
+    void pressuresFast(const bmp280_temp_t & t, const int32_t * adc_P, float * out, uint16_t n) const;
+
+  private:
+    int32_t _T1, _T2, _T3;
+    int64_t _P1, _P2, _P3, _P4, _P5, _P6, _P7, _P8, _P9;
+};
+
+#endif
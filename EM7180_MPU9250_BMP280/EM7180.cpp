@@ -60,7 +60,7 @@ void EM7180::init()
   if (readByte(EM7180_ADDRESS, EM7180_SentralStatus) & 0x08)  Serial.println("EM7180 in initialized state!");
   if (readByte(EM7180_ADDRESS, EM7180_SentralStatus) & 0x10)  Serial.println("No EEPROM detected!");
   int count = 0;
-  while (!STAT) {
+  while (!STAT && !fwUploaded) {   // a reset would throw away firmware the host uploaded
     writeByte(EM7180_ADDRESS, EM7180_ResetRequest, 0x01);
     delay(500);
     count++;
@@ -73,7 +73,8 @@ void EM7180::init()
     if (count > 10) break;
   }
 
-  if (!(readByte(EM7180_ADDRESS, EM7180_SentralStatus) & 0x04))  Serial.println("EEPROM upload successful!");
+  if (fwUploaded) Serial.println("Firmware uploaded by the host!");
+  else if (!(readByte(EM7180_ADDRESS, EM7180_SentralStatus) & 0x04))  Serial.println("EEPROM upload successful!");
   delay(1000); // give some time to read the screen
 
   // Set up the SENtral as sensor bus in normal operating mode
@@ -354,6 +355,91 @@ void EM7180::init()
 
 }
 
+// Host upload follows the SENtral's ResetRequest -> HostControl upload enable -> UploadAddress/UploadData ->
+// CRCHost sequence. On a board whose EEPROM holds a valid image the SENtral loads that first after the reset, so
+// to save the EEPROM boot time the EEPROM must be blank or its image flagged EEPROMNoExec.
+struct fw_memory_t {
+  const uint8_t * data;
+  uint32_t left;
+};
+
+static int fw_memory_read(void * context, uint8_t * buf, uint16_t count)
+{
+  fw_memory_t * m = (fw_memory_t *) context;
+  if (count > m->left) count = m->left;
+  memcpy(buf, m->data, count);
+  m->data += count;
+  m->left -= count;
+  return count;
+}
+
+bool EM7180::uploadFirmware(const uint8_t * image, uint32_t length)
+{
+  fw_memory_t m = {image, length};
+  return uploadFirmware(fw_memory_read, &m);
+}
+
+bool EM7180::uploadFirmware(fw_read_t read, void * context)
+{
+  uint32_t start = micros();
+  sentral_fw_header_t header;
+  fwUploaded = false;
+  Wire.begin(I2C_MASTER, 0x00, _i2c_pin, I2C_PULLUP_EXT, EM7180_UPLOAD_RATE);
+  uint8_t buf[EM7180_UPLOAD_CHUNK];
+
+  if (read(context, buf, EM7180_FW_HEADER_SIZE) != EM7180_FW_HEADER_SIZE) return false;
+  memcpy(&header, buf, EM7180_FW_HEADER_SIZE);
+  if (header.magic != EM7180_FW_MAGIC || header.textLength == 0 || (header.textLength & 0x03)) {
+    Serial.println("ERROR! Not a SENtral firmware image!");
+    return false;
+  }
+
+  // Reset and wait for the SENtral to report the initialized state
+  writeByte(EM7180_ADDRESS, EM7180_ResetRequest, 0x01);
+  uint32_t t0 = millis();
+  while (!(readByte(EM7180_ADDRESS, EM7180_SentralStatus) & 0x08)) {
+    if (millis() - t0 > EM7180_UPLOAD_TIMEOUT) return false;
+    delay(1);
+  }
+
+  writeByte(EM7180_ADDRESS, EM7180_HostControl, 0x02);   // enable host upload
+  writeByte(EM7180_ADDRESS, EM7180_UploadAddress, 0x00);
+  writeByte(EM7180_ADDRESS, EM7180_UploadAddress + 1, 0x00);
+
+  // The SENtral takes the text as 32-bit words most significant byte first, the file stores them the other way round
+  uint16_t left = header.textLength;
+  while (left) {
+    uint16_t n = left < EM7180_UPLOAD_CHUNK ? left : EM7180_UPLOAD_CHUNK;
+    if (read(context, buf, n) != n) {
+      writeByte(EM7180_ADDRESS, EM7180_HostControl, 0x00);
+      return false;
+    }
+    Wire.beginTransmission(EM7180_ADDRESS);
+    Wire.write(EM7180_UploadData);
+    for (uint16_t i = 0; i < n; i += 4) {
+      Wire.write(buf[i + 3]);
+      Wire.write(buf[i + 2]);
+      Wire.write(buf[i + 1]);
+      Wire.write(buf[i]);
+    }
+    Wire.endTransmission();
+    left -= n;
+  }
+
+  uint8_t crc[4];
+  readBytes(EM7180_ADDRESS, EM7180_CRCHost, 4, crc);
+  writeByte(EM7180_ADDRESS, EM7180_HostControl, 0x00);   // end of upload, init() starts the algorithm
+  uint32_t sentralCRC = (uint32_t)crc[0] | (uint32_t)crc[1] << 8 | (uint32_t)crc[2] << 16 | (uint32_t)crc[3] << 24;
+  uploadTime_us = micros() - start;
+  if (sentralCRC != header.textCRC) {
+    Serial.print("ERROR! Firmware upload CRC 0x"); Serial.print(sentralCRC, HEX);
+    Serial.print(", image 0x"); Serial.println(header.textCRC, HEX);
+    return false;
+  }
+  fwUploaded = true;
+  return true;
+}
+
 pose_msg_t EM7180::getSentralRPY()
 {
   if (!passThru) {
@@ -415,6 +501,7 @@ pose_msg_t EM7180::getSentralRPY()
 
       if (eventStatus & 0x04) { // new quaternion data available
         readSENtralQuatData(Quat);
+        if (!firstQuat_us) firstQuat_us = micros();
       }
 
       // get BMP280 pressure
@@ -499,10 +586,11 @@ pose_msg_t EM7180::getSentralRPY()
     // Print temperature in degrees Centigrade
     //    Serial.print("Gyro temperature is ");  Serial.print(temperature, 1);  Serial.println(" degrees C"); // Print T values to tenths of s degree C
     if (passThru) {
-      rawPress =  readBMP280Pressure();
-      pressure = (float) bmp280_compensate_P(rawPress) / 25600.; // Pressure in mbar
       rawTemp =   readBMP280Temperature();
-      temperature = (float) bmp280_compensate_T(rawTemp) / 100.;
+      bmp280.temperature(rawTemp, &bmp280Temp);   // temperature first, pressure is compensated against it
+      temperature = (float) bmp280Temp.T / 100.;
+      rawPress =  readBMP280Pressure();
+      pressure = (float) bmp280.pressure(bmp280Temp, rawPress) / 25600.; // Pressure in mbar
 
     }
 
@@ -551,7 +639,7 @@ pose_msg_t EM7180::getSentralRPY()
       Serial.print("Altimeter pressure = ");
       Serial.print(pressure, 2);
       Serial.println(" mbar");// pressure in millibar
-      altitude = 145366.45f * (1.0f - pow((pressure / 1013.25f), 0.190284f));
+      altitude = altimeter.feet(pressure);
       Serial.print("Altitude = ");
       Serial.print(altitude, 2);
       Serial.println(" feet");
@@ -573,6 +661,7 @@ pose_msg_t EM7180::getSentralRPY()
   }
   pose_msg_t pose_msg;
   //pose_msg = {0, Quat, euler}
+  pose_msg.timestamp = Now; // micros() of this update, used to line lidar returns up with the attitude
   pose_msg.quat[0] = Quat[0];
   pose_msg.quat[1] = Quat[1];
   pose_msg.quat[2] = Quat[2];
@@ -748,10 +837,11 @@ void EM7180::defaultEM7180()
     // Print temperature in degrees Centigrade
     //    Serial.print("Gyro temperature is ");  Serial.print(temperature, 1);  Serial.println(" degrees C"); // Print T values to tenths of s degree C
     if (passThru) {
-      rawPress =  readBMP280Pressure();
-      pressure = (float) bmp280_compensate_P(rawPress) / 25600.; // Pressure in mbar
       rawTemp =   readBMP280Temperature();
-      temperature = (float) bmp280_compensate_T(rawTemp) / 100.;
+      bmp280.temperature(rawTemp, &bmp280Temp);   // temperature first, pressure is compensated against it
+      temperature = (float) bmp280Temp.T / 100.;
+      rawPress =  readBMP280Pressure();
+      pressure = (float) bmp280.pressure(bmp280Temp, rawPress) / 25600.; // Pressure in mbar
 
     }
 
@@ -816,7 +906,7 @@ void EM7180::defaultEM7180()
       Serial.print("Altimeter pressure = ");
       Serial.print(pressure, 2);
       Serial.println(" mbar");// pressure in millibar
-      altitude = 145366.45f * (1.0f - pow((pressure / 1013.25f), 0.190284f));
+      altitude = altimeter.feet(pressure);
       Serial.print("Altitude = ");
       Serial.print(altitude, 2);
       Serial.println(" feet");
@@ -50,6 +50,8 @@
 #include <SPI.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include "BMP280Compensator.h"
+#include "Altitude.h"
 
 // BMP280 registers
 #define BMP280_TEMP_XLSB  0xFC
@@ -288,14 +290,34 @@
 #define EM7180_ADDRESS           0x28   // Address of the EM7180 SENtral sensor hub
 #define M24512DFM_DATA_ADDRESS   0x50   // Address of the 500 page M24512DRC EEPROM data buffer, 1024 bits (128 8-bit bytes) per page
 #define M24512DFM_IDPAGE_ADDRESS 0x58   // Address of the single M24512DRC lockable EEPROM ID page
+#define M24512DFM_READ_CHUNK     256    // bytes per read request, within the i2c_t3 Rx buffer (I2C_RX_BUFFER_LENGTH)
 #define MPU9250_ADDRESS          0x68   // Device address of MPU9250 when ADO = 0
 #define AK8963_ADDRESS           0x0C   // Address of magnetometer
 #define BMP280_ADDRESS           0x76   // Address of BMP280 altimeter when ADO = 0
 
 #define SerialDebug true  // set to true to get Serial output for debugging
 
+// SENtral firmware (.fw) image: this header, then textLength bytes of program text
+#define EM7180_FW_MAGIC          0x652A // first two bytes 0x2A, 0x65
+#define EM7180_FW_HEADER_SIZE    16
+#define EM7180_UPLOAD_CHUNK      128    // bytes per burst write to UploadData, a multiple of 4 that fits the i2c_t3 Tx buffer
+#define EM7180_UPLOAD_TIMEOUT    1000   // ms to wait for the SENtral to come out of reset
+#define EM7180_UPLOAD_RATE       I2C_RATE_1000   // the SENtral host bus does Fast-mode Plus, init() drops back to 400 kHz
+
+struct sentral_fw_header_t {
+  uint16_t magic;
+  uint16_t flags;
+  uint32_t textCRC;      // what the SENtral's CRCHost register must read after the upload
+  uint32_t reserved1;
+  uint16_t textLength;
+  uint16_t reserved2;
+};
+
+// Supplies the next count bytes of a firmware image, returns how many it gave (SD file, serial link, ...)
+typedef int (*fw_read_t)(void * context, uint8_t * buf, uint16_t count);
+
 struct pose_msg_t {
-  int timestamp;
+  uint32_t timestamp;   // micros() of the attitude update
   float quat[4];
   float euler[3];
   float twist[3];
@@ -315,6 +337,14 @@ class EM7180
     void init();
     pose_msg_t getSentralRPY();
 
+    // Host upload of the SENtral firmware straight into its RAM, instead of the SENtral loading it from the EEPROM.
+    // Call before init(); returns false on a bad image, a CRC mismatch or a timeout.
+    bool uploadFirmware(const uint8_t * image, uint32_t length);   // image in host flash or RAM
+    bool uploadFirmware(fw_read_t read, void * context);           // image streamed from elsewhere
+    uint32_t uploadTime_us = 0;                                    // duration of the last upload
+    bool fwUploaded = false;                                       // init() then skips the EEPROM boot checks
+    uint32_t firstQuat_us = 0;                                     // micros() of the first quaternion read, 0 until then
+
     // Set initial input parameters
     enum Ascale {
       AFS_2G = 0,
@@ -398,6 +428,8 @@ class EM7180
     // BMP280 compensation parameters
     uint16_t dig_T1, dig_P1;
     int16_t  dig_T2, dig_T3, dig_P2, dig_P3, dig_P4, dig_P5, dig_P6, dig_P7, dig_P8, dig_P9;
+    BMP280Compensator bmp280;     // compensation engine, set up from the trimming words in BMP280Init()
+    bmp280_temp_t bmp280Temp;     // latest temperature context, reused for every pressure sample until the next one
     double Temperature, Pressure; // stores BMP280 pressures sensor pressure and temperature
     int32_t rawPress, rawTemp;   // pressure and temperature raw count output for BMP280
 
@@ -410,6 +442,7 @@ class EM7180
     float gyroBias[3] = {0, 0, 0}, accelBias[3] = {0, 0, 0}, magBias[3] = {0, 0, 0}, magScale[3]  = {0, 0, 0};  // Bias corrections for gyro, accelerometer, mag
     int16_t tempCount, rawPressure, rawTemperature;   // pressure, temperature raw count output
     float   temperature, pressure, altitude; // Stores the MPU9250 internal chip temperature in degrees Celsius
+    Altitude altimeter;           // pressure to altitude, set altimeter.setQNH() for the local sea level pressure
     float SelfTest[6];            // holds results of gyro and accelerometer self test
 
     // global constants for 9 DoF fusion and AHRS (Attitude and Heading Reference System)
@@ -1146,14 +1179,14 @@ class EM7180
       return data;                             // Return data read from slave register
     }
 
-    void M24512DFMreadBytes(uint8_t device_address, uint8_t data_address1, uint8_t data_address2, uint8_t count, uint8_t * dest)
+    void M24512DFMreadBytes(uint8_t device_address, uint8_t data_address1, uint8_t data_address2, uint16_t count, uint8_t * dest)
     {
       Wire.beginTransmission(device_address);   // Initialize the Tx buffer
       Wire.write(data_address1);                     // Put slave register address in Tx buffer
       Wire.write(data_address2);                     // Put slave register address in Tx buffer
       Wire.endTransmission(I2C_NOSTOP);         // Send the Tx buffer, but send a restart to keep connection alive
       //  Wire.endTransmission(false);              // Send the Tx buffer, but send a restart to keep connection alive
-      uint8_t i = 0;
+      uint16_t i = 0;
       //        Wire.requestFrom(address, count);       // Read bytes from slave register address
       Wire.requestFrom(device_address, (size_t) count);  // Read bytes from slave register address
       while (Wire.available()) {
@@ -1161,6 +1194,39 @@ class EM7180
       }                // Put read results in the Rx buffer
     }
 
+    // Current address read: carries on from where the last read or write left the EEPROM's address counter
+    uint16_t M24512DFMreadCurrent(uint8_t device_address, uint16_t count, uint8_t * dest)
+    {
+      uint16_t i = 0;
+      Wire.requestFrom(device_address, (size_t) count);  // Read bytes from the current address
+      while (Wire.available()) {
+        dest[i++] = Wire.read();
+      }
+      return i;
+    }
+
+    // Reads count bytes (up to the whole 64 kB) from address on. Only the first request sends the address, the
+    // rest are current address reads of M24512DFM_READ_CHUNK bytes, so the EEPROM stays in one sequential read
+    // (wrapping from 0xFFFF to 0x0000 as the device does). Returns the number of bytes read.
+    uint32_t M24512DFMreadRange(uint8_t device_address, uint16_t address, uint32_t count, uint8_t * dest)
+    {
+      uint32_t done = 0;
+      if (count > 0x10000) count = 0x10000;
+      while (done < count) {
+        uint16_t n = (count - done < M24512DFM_READ_CHUNK) ? count - done : M24512DFM_READ_CHUNK;
+        if (done == 0) {
+          Wire.beginTransmission(device_address);
+          Wire.write(address >> 8);
+          Wire.write(address & 0xFF);
+          Wire.endTransmission(I2C_NOSTOP);   // restart straight into the first read
+        }
+        uint16_t got = M24512DFMreadCurrent(device_address, n, &dest[done]);
+        done += got;
+        if (got < n) break;                   // NACKed, e.g. in the middle of a write cycle
+      }
+      return done;
+    }
+
 
 
 
@@ -1201,43 +1267,24 @@ class EM7180
       dig_P7 = ( int16_t)((( int16_t) calib[19] << 8) | calib[18]);
       dig_P8 = ( int16_t)((( int16_t) calib[21] << 8) | calib[20]);
       dig_P9 = ( int16_t)((( int16_t) calib[23] << 8) | calib[22]);
+      bmp280.begin(calib);
     }
 
     // Returns temperature in DegC, resolution is 0.01 DegC. Output value of
-    // “5123” equals 51.23 DegC.
+    // “5123” equals 51.23 DegC. Also refreshes bmp280Temp and t_fine for bmp280_compensate_P().
     int32_t bmp280_compensate_T(int32_t adc_T)
     {
-      int32_t var1, var2, T;
-      var1 = ((((adc_T >> 3) - ((int32_t)dig_T1 << 1))) * ((int32_t)dig_T2)) >> 11;
-      var2 = (((((adc_T >> 4) - ((int32_t)dig_T1)) * ((adc_T >> 4) - ((int32_t)dig_T1))) >> 12) * ((int32_t)dig_T3)) >> 14;
-      t_fine = var1 + var2;
-      T = (t_fine * 5 + 128) >> 8;
-      return T;
+      bmp280.temperature(adc_T, &bmp280Temp);
+      t_fine = bmp280Temp.t_fine;
+      return bmp280Temp.T;
     }
 
     // Returns pressure in Pa as unsigned 32 bit integer in Q24.8 format (24 integer bits and 8
-    //fractional bits).
+    //fractional bits), against the temperature of the last bmp280_compensate_T() call.
     //Output value of “24674867” represents 24674867/256 = 96386.2 Pa = 963.862 hPa
     uint32_t bmp280_compensate_P(int32_t adc_P)
     {
-      long long var1, var2, p;
-      var1 = ((long long)t_fine) - 128000;
-      var2 = var1 * var1 * (long long)dig_P6;
-      var2 = var2 + ((var1 * (long long)dig_P5) << 17);
-      var2 = var2 + (((long long)dig_P4) << 35);
-      var1 = ((var1 * var1 * (long long)dig_P3) >> 8) + ((var1 * (long long)dig_P2) << 12);
-      var1 = (((((long long)1) << 47) + var1)) * ((long long)dig_P1) >> 33;
-      if (var1 == 0)
-      {
-        return 0;
-        // avoid exception caused by division by zero
-      }
-      p = 1048576 - adc_P;
-      p = (((p << 31) - var2) * 3125) / var1;
-      var1 = (((long long)dig_P9) * (p >> 13) * (p >> 13)) >> 25;
-      var2 = (((long long)dig_P8) * p) >> 19;
-      p = ((p + var1 + var2) >> 8) + (((long long)dig_P7) << 4);
-      return (uint32_t)p;
+      return bmp280.pressure(bmp280Temp, adc_P);
     }
 
 
@@ -1,14 +1,86 @@
 #include "EM7180.h"
 #include "RPLidar.h"
+#include "RPLidarParser.h"
+#include "PointCloud.h"
+#include "TimeOffset.h"
+#include "VoxelMap.h"
+
+#define LIDAR_SERIAL  Serial1
+#define LIDAR_RING    1024   // receive ring, power of two
+#define LIDAR_BATCH   64     // returns decoded per parse
+
+// How late the returns reach the sketch. An express capsule is decoded against the next one, so its returns
+// arrive about a capsule (32 returns, 8 ms at 4000 per second) after they were measured. TimeOffset can track
+// this instead, but only where the lidar turns on its own: here rplidar.update() drives the rotation tab from
+// the IMU rate, so the lidar angles follow the same loop as the IMU rate and the correlation can not see the
+// offset. Leave LIDAR_LATE_ESTIMATE at 0 on this rig.
+#define LIDAR_LATE_US        8000
+#define LIDAR_LATE_ESTIMATE  0
+
+#define MAP_RESOLUTION  150     // mm
+#define MAP_RANGE       12000   // mm, the RPLidar A1's reach
+
+// Host upload of the SENtral firmware before init(), instead of the SENtral booting it from its EEPROM. Off by
+// default. FW_UPLOAD_FLASH compiles the image in from EM7180_fw.h ("xxd -i EM7180.fw > EM7180_fw.h", then make
+// the array const so it stays in flash), FW_UPLOAD_SD reads FW_FILE from an SD card on the SPI bus.
+#define FW_UPLOAD_OFF    0
+#define FW_UPLOAD_FLASH  1
+#define FW_UPLOAD_SD     2
+#define FW_UPLOAD        FW_UPLOAD_OFF
+#define FW_SD_CS         10
+#define FW_FILE          "/EM7180.fw"
+
+#if FW_UPLOAD == FW_UPLOAD_FLASH
+#include "EM7180_fw.h"
+#elif FW_UPLOAD == FW_UPLOAD_SD
+#include <SdFat.h>
+SdFat SD;
+SdFile fwFile;
+#endif
 
 EM7180 imu(I2C_PINS_7_8, 17);
 RPLidar rplidar(14);
+RPLidarParser lidarParser;
+PointCloud cloud;
+VoxelMap voxelMap(MAP_RESOLUTION);
 pose_msg_t pose;
+#if LIDAR_LATE_ESTIMATE
+TimeOffset lidarClock;       // lidar time = IMU time + lidarClock.offset_us
+#endif
+
+uint8_t lidarRing[LIDAR_RING];
+uint32_t lidarHead = 0;
+rplidar_measurement_t lidarNodes[LIDAR_BATCH];
+uint32_t lidarBatch_us = 0;  // arrival of the previous batch of returns, lidar time
+int32_t lidarAngle_q6 = -1;  // angle of the last return in that batch
+const float mapOrigin[3] = {0.0f, 0.0f, 0.0f};   // the lidar, there is no translation estimate on board
+
+uint32_t boot_us;            // start of setup(), for the time to the first quaternion
+bool firstQuatShown = false;
 
 void setup()
 {
+  boot_us = micros();
+#if FW_UPLOAD != FW_UPLOAD_OFF
+  Serial.begin(38400);
+#if FW_UPLOAD == FW_UPLOAD_FLASH
+  bool uploaded = imu.uploadFirmware(EM7180_fw, EM7180_fw_len);
+#else
+  bool uploaded = SD.begin(FW_SD_CS, SPI_HALF_SPEED) && fwFile.open(FW_FILE, O_RDONLY) && imu.uploadFirmware(fwFileRead, &fwFile);
+  fwFile.close();
+#endif
+  if (uploaded) {
+    Serial.print("Firmware uploaded in "); Serial.print(imu.uploadTime_us); Serial.println(" us");
+  } else {
+    Serial.println("Firmware upload failed, the SENtral boots from its EEPROM");
+  }
+#endif
   imu.init();
   rplidar.init();
+  LIDAR_SERIAL.begin(115200);
+  lidarStartScan();
+  cloud.init();
+  cloud.lidarLate_us = LIDAR_LATE_US;
   rplidar.RotationSpoofTimer.begin(rplidar_inthandler, 6000);
   attachInterrupt(imu._int_pin, myinthandler, RISING);  // define interrupt for INT pin output of EM7180
 }
@@ -17,7 +89,52 @@ void loop()
 {
 //  imu.defaultEM7180();/
   pose = imu.getSentralRPY();
+  if (imu.firstQuat_us && !firstQuatShown) {
+    firstQuatShown = true;
+    Serial.print("First quaternion "); Serial.print((imu.firstQuat_us - boot_us) / 1000); Serial.println(" ms after start up");
+  }
   rplidar.update(abs(pose.twist[2]));
+
+#if LIDAR_LATE_ESTIMATE
+  lidarClock.addImuRate(pose.timestamp, abs(pose.twist[2]));
+#endif
+  cloud.addPose(pose.timestamp, pose.quat);
+
+  // Lidar returns, time stamped on arrival, which is lidar time
+  while (LIDAR_SERIAL.available() && lidarHead - lidarParser.tail < LIDAR_RING) {
+    lidarRing[lidarHead & (LIDAR_RING - 1)] = LIDAR_SERIAL.read();
+    lidarHead++;
+  }
+  uint16_t n = lidarParser.parse(lidarRing, LIDAR_RING - 1, lidarHead, lidarNodes, LIDAR_BATCH);
+  if (n) {
+    uint32_t now = micros();
+    if (lidarAngle_q6 < 0) lidarBatch_us = now;
+    uint32_t dt = now - lidarBatch_us;
+
+#if LIDAR_LATE_ESTIMATE
+    // The latency estimate needs the rotation as the lidar itself measures it: the angle its returns advanced
+    // by since the last batch
+    if (lidarAngle_q6 >= 0 && dt > 0) {
+      int32_t advance = (int32_t)lidarNodes[n - 1].angle_q6 - lidarAngle_q6;
+      if (advance < 0) advance += 360 * 64;
+      lidarClock.addLidarRate(now - dt / 2, (float)advance / 64.0f * 1.0e6f / (float)dt);
+    }
+    cloud.lidarLate_us = (int32_t)lidarClock.offset_us;
+#endif
+    lidarAngle_q6 = lidarNodes[n - 1].angle_q6;
+
+    // Returns spread evenly since the previous batch, moved onto the IMU clock; finished sweeps go into the map
+    for (uint16_t done = 0; done < n; ) {
+      uint16_t used = cloud.addScan(&lidarNodes[done], n - done, lidarBatch_us + dt * done / n, now);
+      if (cloud.sweepReady) {
+        voxelMap.insertScan(cloud.x, cloud.y, cloud.z, cloud.count, mapOrigin, MAP_RANGE);
+        cloud.clear();
+      }
+      else if (!used) break;                 // no attitude yet
+      done += used;
+    }
+    lidarBatch_us = now;
+  }
 //  Serial.println(rplidar.RotRPM);
 }
 
@@ -30,3 +147,26 @@ void rplidar_inthandler()
 {
   rplidar.run();
 }
+
+// Stop whatever scan the lidar was left in, drop what it had sent, and ask for an express scan
+void lidarStartScan()
+{
+  uint8_t request[9] = {RPLIDAR_SYNC_BYTE1, RPLIDAR_CMD_STOP};
+  LIDAR_SERIAL.write(request, 2);
+  delay(2);   // the lidar takes 1 ms to stop
+  while (LIDAR_SERIAL.available()) LIDAR_SERIAL.read();
+  lidarParser.reset();
+
+  request[1] = RPLIDAR_CMD_EXPRESS_SCAN;
+  request[2] = 5;   // payload length, all zero for the legacy express mode
+  request[8] = 0;
+  for (uint8_t i = 0; i < 8; i++) request[8] ^= request[i];
+  LIDAR_SERIAL.write(request, 9);
+}
+
+#if FW_UPLOAD == FW_UPLOAD_SD
+int fwFileRead(void * context, uint8_t * buf, uint16_t count)
+{
+  return ((SdFile *) context)->read(buf, count);
+}
+#endif
@@ -0,0 +1,180 @@
+#include "PointCloud.h"
+
+float PointCloud::_sinTable[POINTCLOUD_TABLE_STEPS + 1];
+bool PointCloud::_tableReady = false;
+
+PointCloud::PointCloud()
+{
+  static const float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  static const float zero[3] = {0, 0, 0};
+  memcpy(_mount, identity, sizeof(_mount));
+  memcpy(_lever, zero, sizeof(_lever));
+  _poses = 0;
+  lidarLate_us = 0;
+  clear();
+}
+
+void PointCloud::init()
+{
+  if (!_tableReady) {
+    for (uint16_t i = 0; i <= POINTCLOUD_TABLE_STEPS; i++) {
+      _sinTable[i] = sinf((float)i * (2.0f * PI / POINTCLOUD_TABLE_STEPS));
+    }
+    _tableReady = true;
+  }
+  clear();
+}
+
+void PointCloud::clear()
+{
+  count = 0;
+  sweepReady = false;
+}
+
+void PointCloud::setMounting(const float * R, const float * t)
+{
+  memcpy(_mount, R, sizeof(_mount));
+  memcpy(_lever, t, sizeof(_lever));
+  _poses = 0;   // cached pose matrices include the old mounting
+}
+
+void PointCloud::addPose(uint32_t t_us, const float * quat)
+{
+  if (_poses && t_us == _t[_poses - 1]) return;
+  if (_poses == POINTCLOUD_POSES) {
+    memmove(_R[0], _R[1], sizeof(_R[0]) * (POINTCLOUD_POSES - 1));
+    memmove(&_t[0], &_t[1], sizeof(_t[0]) * (POINTCLOUD_POSES - 1));
+    _poses--;
+  }
+  poseMatrix(quat, _R[_poses]);
+  _t[_poses] = t_us;
+  _poses++;
+}
+
+// Builds [ (R*mount) column 0 | (R*mount) column 1 | R*lever ] row by row. The lidar returns lie in the
+// scan plane (z = 0 in the lidar frame), so the third mounting column never contributes.
+void PointCloud::poseMatrix(const float * quat, float * M)
+{
+  float qx = quat[0], qy = quat[1], qz = quat[2], qw = quat[3];  // SENtral order, w last
+  float R[9];
+  R[0] = 1.0f - 2.0f * (qy * qy + qz * qz); R[1] = 2.0f * (qx * qy - qz * qw);        R[2] = 2.0f * (qx * qz + qy * qw);
+  R[3] = 2.0f * (qx * qy + qz * qw);        R[4] = 1.0f - 2.0f * (qx * qx + qz * qz); R[5] = 2.0f * (qy * qz - qx * qw);
+  R[6] = 2.0f * (qx * qz - qy * qw);        R[7] = 2.0f * (qy * qz + qx * qw);        R[8] = 1.0f - 2.0f * (qx * qx + qy * qy);
+
+  for (uint8_t r = 0; r < 3; r++) {
+    const float * row = &R[3 * r];
+    M[3 * r + 0] = row[0] * _mount[0] + row[1] * _mount[3] + row[2] * _mount[6];
+    M[3 * r + 1] = row[0] * _mount[1] + row[1] * _mount[4] + row[2] * _mount[7];
+    M[3 * r + 2] = row[0] * _lever[0] + row[1] * _lever[1] + row[2] * _lever[2];
+  }
+}
+
+void PointCloud::sinCos(uint16_t angle_q6, float &s, float &c)
+{
+  uint16_t i = angle_q6 >> 4;                  // quarter-degree index
+  float f = (float)(angle_q6 & 0x0F) * (1.0f / 16.0f);
+  uint16_t j = i + POINTCLOUD_TABLE_STEPS / 4;  // cos(a) = sin(a + 90 deg)
+  if (j >= POINTCLOUD_TABLE_STEPS) j -= POINTCLOUD_TABLE_STEPS;
+  s = _sinTable[i] + f * (_sinTable[i + 1] - _sinTable[i]);
+  c = _sinTable[j] + f * (_sinTable[j + 1] - _sinTable[j]);
+}
+
+uint16_t PointCloud::addScan(const rplidar_measurement_t * nodes, uint16_t n, uint32_t t0_us, uint32_t t1_us)
+{
+  if (!_poses || !n) return 0;
+  t0_us -= lidarLate_us;   // onto the IMU clock the poses are stamped with
+  t1_us -= lidarLate_us;
+
+  // Attitude is interpolated linearly in the matrix elements between the poses either side of each
+  // return. Poses arrive at the EM7180 quaternion rate, so the rotation between them is small and the
+  // error is second order. Times are taken from the oldest pose; returns run forward in time, so the
+  // pair only ever moves on to newer poses. Returns outside the history hold the end pose.
+  float tStart = (float)(int32_t)(t0_us - _t[0]);
+  float step = (float)(int32_t)(t1_us - t0_us) / (float)n;
+  uint8_t k = 0;
+  float tA = 0.0f, tB = 0.0f, span = 0.0f;
+  const float * R = _R[0];
+  float dR[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  bool pair = false;
+
+  uint16_t i = 0;
+  for (; i < n; i++) {
+    const rplidar_measurement_t * node = &nodes[i];
+    if ((node->flags & RPLIDAR_FLAG_START) && count) {
+      sweepReady = true;
+      break;
+    }
+    if (count >= POINTCLOUD_MAX_POINTS) {
+      sweepReady = true;
+      break;
+    }
+    if (!node->distance_q2) continue;
+
+    float tNode = tStart + step * (float)i;
+    while (k + 2 < _poses && tNode > (float)(int32_t)(_t[k + 1] - _t[0])) {
+      k++;
+      pair = false;
+    }
+    if (!pair && _poses > 1) {
+      R = _R[k];
+      tA = (float)(int32_t)(_t[k] - _t[0]);
+      tB = (float)(int32_t)(_t[k + 1] - _t[0]);
+      span = tB - tA;
+      for (uint8_t e = 0; e < 9; e++) dR[e] = _R[k + 1][e] - R[e];
+      pair = true;
+    }
+    float f = span > 0.0f ? (tNode - tA) / span : 0.0f;
+    if (f < 0.0f) f = 0.0f;
+    if (f > 1.0f) f = 1.0f;
+
+    float s, c;
+    sinCos(node->angle_q6, s, c);
+    float d  = (float)node->distance_q2 * 0.25f;  // mm
+    float lx = d * c;
+    float ly = -d * s;                            // RPLidar angles run clockwise seen from the top
+
+    x[count] = (R[0] + f * dR[0]) * lx + (R[1] + f * dR[1]) * ly + (R[2] + f * dR[2]);
+    y[count] = (R[3] + f * dR[3]) * lx + (R[4] + f * dR[4]) * ly + (R[5] + f * dR[5]);
+    z[count] = (R[6] + f * dR[6]) * lx + (R[7] + f * dR[7]) * ly + (R[8] + f * dR[8]);
+    quality[count] = node->quality;
+    count++;
+  }
+  return i;
+}
+
+void PointCloud::writePLY(Print &out)
+{
+  out.print("ply\nformat binary_little_endian 1.0\nelement vertex ");
+  out.print((unsigned int)count);
+  out.print("\nproperty float x\nproperty float y\nproperty float z\nproperty uchar quality\nend_header\n");
+  writeBinary(out);
+}
+
+void PointCloud::writePCD(Print &out)
+{
+  out.print("# .PCD v0.7\nVERSION 0.7\nFIELDS x y z intensity\nSIZE 4 4 4 1\nTYPE F F F U\nCOUNT 1 1 1 1\nWIDTH ");
+  out.print((unsigned int)count);
+  out.print("\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS ");
+  out.print((unsigned int)count);
+  out.print("\nDATA binary\n");
+  writeBinary(out);
+}
+
+// Both formats store x, y, z, quality interleaved; gather 32 points at a time so the sink sees large writes
+void PointCloud::writeBinary(Print &out)
+{
+  uint8_t buffer[32 * 13];
+  uint16_t used = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    memcpy(&buffer[used], &x[i], 4);   // Cortex-M and x86 are both little endian
+    memcpy(&buffer[used + 4], &y[i], 4);
+    memcpy(&buffer[used + 8], &z[i], 4);
+    buffer[used + 12] = quality[i];
+    used += 13;
+    if (used == sizeof(buffer)) {
+      out.write(buffer, used);
+      used = 0;
+    }
+  }
+  if (used) out.write(buffer, used);
+}
@@ -0,0 +1,75 @@
+/* 3D point assembly for the rotating RPLidar
+
+  The RPLidar scan plane is spun about the platform axis and the EM7180 measures that rotation, so every
+  2D return can be placed in 3D by rotating it with the platform attitude at the time it was measured.
+  PointCloud keeps the latest EM7180 quaternions, interpolates the attitude for each return between the
+  two either side of it and writes the result into structure-of-arrays buffers sized for one lidar sweep.
+  The returns reach the sketch several milliseconds after they were measured, more than one quaternion
+  interval, so the two newest poses alone would not bracket them.
+
+  sin/cos of the lidar angle come from a quarter-degree table with linear interpolation (error < 3e-6).
+  A finished sweep can be streamed out as binary little-endian PLY or PCD to any Print (SdFile, Serial).
+*/
+
+#ifndef PointCloud_h
+#define PointCloud_h
+
+#include "Arduino.h"
+#include "RPLidarParser.h"
+
+#ifndef POINTCLOUD_MAX_POINTS
+#define POINTCLOUD_MAX_POINTS  1024   // returns kept per sweep, 13 bytes each
+#endif
+
+#ifndef POINTCLOUD_POSES
+#define POINTCLOUD_POSES       8      // attitude history, 40 ms at the EM7180's 200 Hz
+#endif
+
+#define POINTCLOUD_TABLE_STEPS 1440   // quarter-degree sine table
+
+class PointCloud
+{
+  public:
+    PointCloud();
+
+    void init();
+    void clear();
+
+    // Lidar to IMU mounting rotation (row major) and lever arm in mm, identity and zero by default
+    void setMounting(const float * R, const float * t);
+
+    // Attitude sample in the EM7180 register order qx, qy, qz, qw, as stored in pose_msg_t.quat
+    void addPose(uint32_t t_us, const float * quat);
+
+    // Place n returns measured evenly between t0_us and t1_us, in lidar time (lidarLate_us is taken off
+    // them). Stops at the start of the next sweep or when the buffers are full and sets sweepReady; returns
+    // the number of nodes consumed so the caller can write out the sweep, clear() and hand the rest back.
+    uint16_t addScan(const rplidar_measurement_t * nodes, uint16_t n, uint32_t t0_us, uint32_t t1_us);
+
+    void writePLY(Print &out);
+    void writePCD(Print &out);
+
+    uint16_t count;
+    bool sweepReady;
+    int32_t lidarLate_us;             // how far lidar time stamps run behind the IMU, from TimeOffset::offset_us
+    float x[POINTCLOUD_MAX_POINTS];   // mm, platform frame
+    float y[POINTCLOUD_MAX_POINTS];
+    float z[POINTCLOUD_MAX_POINTS];
+    uint8_t quality[POINTCLOUD_MAX_POINTS];
+
+  private:
+    static float _sinTable[POINTCLOUD_TABLE_STEPS + 1];
+    static bool _tableReady;
+
+    float _mount[9];
+    float _lever[3];
+    float _R[POINTCLOUD_POSES][9];   // oldest first, mounting folded into the attitude matrices
+    uint32_t _t[POINTCLOUD_POSES];
+    uint8_t _poses;
+
+    void sinCos(uint16_t angle_q6, float &s, float &c);
+    void poseMatrix(const float * quat, float * R);
+    void writeBinary(Print &out);
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include "RPLidarParser.h"
+
+// Variable bit scale used by the ultra capsule distance encoding (Slamtec SDK, _varbitscale_decode)
+#define RPLIDAR_VARBITSCALE_X2_SRC_BIT   9
+#define RPLIDAR_VARBITSCALE_X4_SRC_BIT   11
+#define RPLIDAR_VARBITSCALE_X8_SRC_BIT   12
+#define RPLIDAR_VARBITSCALE_X16_SRC_BIT  14
+#define RPLIDAR_VARBITSCALE_X2_DEST_VAL  512
+#define RPLIDAR_VARBITSCALE_X4_DEST_VAL  1280
+#define RPLIDAR_VARBITSCALE_X8_DEST_VAL  1792
+#define RPLIDAR_VARBITSCALE_X16_DEST_VAL 3328
+
+static const uint32_t VBS_SCALED_BASE[5] = {RPLIDAR_VARBITSCALE_X16_DEST_VAL, RPLIDAR_VARBITSCALE_X8_DEST_VAL,
+                                            RPLIDAR_VARBITSCALE_X4_DEST_VAL, RPLIDAR_VARBITSCALE_X2_DEST_VAL, 0};
+static const uint32_t VBS_TARGET_BASE[5] = {(1UL << RPLIDAR_VARBITSCALE_X16_SRC_BIT), (1UL << RPLIDAR_VARBITSCALE_X8_SRC_BIT),
+                                            (1UL << RPLIDAR_VARBITSCALE_X4_SRC_BIT), (1UL << RPLIDAR_VARBITSCALE_X2_SRC_BIT), 0};
+static const uint8_t  VBS_SCALED_LVL[5]  = {4, 3, 2, 1, 0};
+
+#define RPLIDAR_FULL_TURN_Q16  (360L << 16)
+#define RPLIDAR_FULL_TURN_Q6   (360L << 6)
+
+static uint32_t varbitscaleDecode(uint32_t scaled, uint8_t &scaleLevel)
+{
+  for (uint8_t i = 0; i < 5; i++) {
+    int32_t remain = (int32_t)scaled - (int32_t)VBS_SCALED_BASE[i];
+    if (remain >= 0) {
+      scaleLevel = VBS_SCALED_LVL[i];
+      return VBS_TARGET_BASE[i] + ((uint32_t)remain << scaleLevel);
+    }
+  }
+  scaleLevel = 0;
+  return 0;
+}
+
+// Word-at-a-time search for the first byte b with (b & valueMask) == value in avail bytes from start.
+// Each contiguous run of the ring is scanned four bytes per step with the classic "has zero byte" test.
+static uint32_t findSync(const uint8_t * ring, uint32_t mask, uint32_t start, uint32_t avail, uint8_t value, uint8_t valueMask)
+{
+  const uint32_t ones = 0x01010101UL, highs = 0x80808080UL;
+  const uint32_t pattern = ones * value, m = ones * valueMask;
+  uint32_t i = 0;
+
+  while (i < avail) {
+    uint32_t idx = (start + i) & mask;
+    uint32_t run = mask + 1 - idx;         // bytes before the ring wraps
+    if (run > avail - i) run = avail - i;
+    const uint8_t * p = &ring[idx];
+    uint32_t j = 0;
+    for (; j + 4 <= run; j += 4) {
+      uint32_t w;
+      memcpy(&w, p + j, 4);
+      uint32_t x = (w & m) ^ pattern;
+      if ((x - ones) & ~x & highs) break;  // some byte in this word matches
+    }
+    for (; j < run; j++) {
+      if ((p[j] & valueMask) == value) return i + j;
+    }
+    i += run;
+  }
+  return avail;
+}
+
+static inline void storeNode(rplidar_measurement_t * node, uint32_t dist_q2, int32_t angle_q6, bool sync)
+{
+  if (angle_q6 < 0) angle_q6 += RPLIDAR_FULL_TURN_Q6;
+  if (angle_q6 >= RPLIDAR_FULL_TURN_Q6) angle_q6 -= RPLIDAR_FULL_TURN_Q6;
+  node->angle_q6 = (uint16_t)angle_q6;
+  node->distance_q2 = dist_q2;
+  node->quality = dist_q2 ? 0x2F : 0;
+  node->flags = sync ? RPLIDAR_FLAG_START : 0;
+}
+
+
+RPLidarParser::RPLidarParser()
+{
+  _capsule = _capsuleBuf[0];
+  _scratch = _capsuleBuf[1];
+  reset();
+}
+
+void RPLidarParser::reset()
+{
+  _mode = WAIT_DESCRIPTOR;
+  _havePrevious = false;
+  tail = 0;
+  bytesDiscarded = 0;
+  checksumErrors = 0;
+  nodesDecoded = 0;
+}
+
+void RPLidarParser::setMode(uint8_t mode)
+{
+  _mode = mode;
+  _havePrevious = false;
+}
+
+uint8_t RPLidarParser::getMode()
+{
+  return _mode;
+}
+
+uint16_t RPLidarParser::parse(const uint8_t * ring, uint32_t mask, uint32_t head, rplidar_measurement_t * out, uint16_t maxOut)
+{
+  if (_mode == WAIT_DESCRIPTOR) {
+    parseDescriptor(ring, mask, head - tail);
+    if (_mode == WAIT_DESCRIPTOR) return 0;
+  }
+
+  uint16_t count;
+  if (_mode == STANDARD) count = parseNodes(ring, mask, head - tail, out, maxOut);
+  else                   count = parseCapsules(ring, mask, head - tail, out, maxOut);
+  nodesDecoded += count;
+  return count;
+}
+
+uint16_t RPLidarParser::parseDescriptor(const uint8_t * ring, uint32_t mask, uint32_t avail)
+{
+  while (avail >= RPLIDAR_DESCRIPTOR_LEN) {
+    uint32_t skip = findSync(ring, mask, tail, avail - 1, RPLIDAR_SYNC_BYTE1, 0xFF);
+    tail += skip; avail -= skip; bytesDiscarded += skip;
+    if (avail < RPLIDAR_DESCRIPTOR_LEN) return 0;
+
+    if (ring[(tail + 1) & mask] != RPLIDAR_SYNC_BYTE2) {
+      tail++; avail--; bytesDiscarded++;
+      continue;
+    }
+
+    uint8_t type = ring[(tail + 6) & mask];
+    if      (type == RPLIDAR_ANS_TYPE_MEASUREMENT)    _mode = STANDARD;
+    else if (type == RPLIDAR_ANS_TYPE_CAPSULED)       _mode = EXPRESS;
+    else if (type == RPLIDAR_ANS_TYPE_CAPSULED_ULTRA) _mode = ULTRA;
+    else {  // a response we do not stream (health, info, ...), skip its header and keep looking
+      tail += 2; avail -= 2; bytesDiscarded += 2;
+      continue;
+    }
+    _havePrevious = false;
+    tail += RPLIDAR_DESCRIPTOR_LEN;
+    return 1;
+  }
+  return 0;
+}
+
+uint16_t RPLidarParser::parseNodes(const uint8_t * ring, uint32_t mask, uint32_t avail, rplidar_measurement_t * out, uint16_t maxOut)
+{
+  uint16_t count = 0;
+  uint32_t t = tail;
+
+  while (avail >= RPLIDAR_NODE_LEN && count < maxOut) {
+    uint8_t b0 = ring[t & mask];
+    uint8_t b1 = ring[(t + 1) & mask];
+    uint16_t angle_q6 = ((uint16_t)ring[(t + 2) & mask] << 7) | (b1 >> 1);
+
+    // start flag and its inverse must differ, check bit must be set, angle must be below 360 degrees
+    if (!((b0 ^ (b0 >> 1)) & b1 & 0x01) || angle_q6 >= RPLIDAR_FULL_TURN_Q6) {
+      t++; avail--; bytesDiscarded++;
+      continue;
+    }
+
+    rplidar_measurement_t * node = &out[count++];
+    node->angle_q6 = angle_q6;
+    node->distance_q2 = (uint32_t)ring[(t + 3) & mask] | ((uint32_t)ring[(t + 4) & mask] << 8);
+    node->quality = b0 >> 2;
+    node->flags = b0 & RPLIDAR_FLAG_START;
+    t += RPLIDAR_NODE_LEN; avail -= RPLIDAR_NODE_LEN;
+  }
+  tail = t;
+  return count;
+}
+
+uint16_t RPLidarParser::parseCapsules(const uint8_t * ring, uint32_t mask, uint32_t avail, rplidar_measurement_t * out, uint16_t maxOut)
+{
+  uint16_t len = (_mode == EXPRESS) ? RPLIDAR_CAPSULE_LEN : RPLIDAR_ULTRA_CAPSULE_LEN;
+  uint16_t perCapsule = (_mode == EXPRESS) ? 2 * RPLIDAR_CAPSULE_CABINS : 3 * RPLIDAR_ULTRA_CAPSULE_CABINS;
+  uint16_t count = 0;
+
+  while (avail >= len && count + perCapsule <= maxOut) {
+    uint8_t b0 = ring[tail & mask];
+    uint8_t b1 = ring[(tail + 1) & mask];
+    if ((b0 & 0xF0) != 0xA0 || (b1 & 0xF0) != 0x50) {  // lost sync, jump to the next candidate sync nibble
+      _havePrevious = false;
+      uint32_t skip = findSync(ring, mask, tail + 1, avail - 1, 0xA0, 0xF0) + 1;
+      tail += skip; avail -= skip; bytesDiscarded += skip;
+      continue;
+    }
+
+    // The capsule has to outlive the ring because it is decoded against the next one, so it is copied out once
+    uint32_t idx = tail & mask;
+    uint32_t run = mask + 1 - idx;
+    if (run >= len) {
+      memcpy(_scratch, &ring[idx], len);
+    } else {
+      memcpy(_scratch, &ring[idx], run);
+      memcpy(&_scratch[run], &ring[0], len - run);
+    }
+
+    // A capsule that is lost or damaged leaves a gap, and the previous capsule cannot be decoded across it: its
+    // angles would be spread over two capsules' worth of rotation
+    if (!capsuleChecksumOK(_scratch, len) || (((uint16_t)_scratch[3] << 8 | _scratch[2]) & 0x7FFF) >= RPLIDAR_FULL_TURN_Q6) {
+      checksumErrors++;
+      _havePrevious = false;
+      tail++; avail--; bytesDiscarded++;
+      continue;
+    }
+
+    if (_scratch[3] & 0x80) _havePrevious = false;   // start of a new scan, previous capsule is stale
+    if (_havePrevious) count += (_mode == EXPRESS) ? decodeExpress(&out[count]) : decodeUltra(&out[count]);
+
+    uint8_t * spare = _capsule;
+    _capsule = _scratch;
+    _scratch = spare;
+    _havePrevious = true;
+    tail += len; avail -= len;
+  }
+  return count;
+}
+
+// Capsule checksum is the XOR of every byte after the two sync bytes; fold it a 32-bit word at a time
+bool RPLidarParser::capsuleChecksumOK(const uint8_t * capsule, uint16_t len)
+{
+  uint8_t expected = (capsule[0] & 0x0F) | ((capsule[1] & 0x0F) << 4);
+  uint32_t acc = 0;
+  for (uint16_t i = 4; i < len; i += 4) {  // payload after the header is a multiple of four bytes
+    uint32_t w;
+    memcpy(&w, &capsule[i], 4);
+    acc ^= w;
+  }
+  acc ^= acc >> 16;
+  acc ^= acc >> 8;
+  uint8_t sum = (uint8_t)acc ^ capsule[2] ^ capsule[3];
+  return sum == expected;
+}
+
+uint16_t RPLidarParser::decodeExpress(rplidar_measurement_t * out)
+{
+  const uint8_t * prev = _capsule;
+  const uint8_t * cur = _scratch;
+  int32_t curStart_q8  = (int32_t)(((uint16_t)cur[3] << 8 | cur[2]) & 0x7FFF) << 2;
+  int32_t prevStart_q8 = (int32_t)(((uint16_t)prev[3] << 8 | prev[2]) & 0x7FFF) << 2;
+  int32_t diff_q8 = curStart_q8 - prevStart_q8;
+  if (prevStart_q8 > curStart_q8) diff_q8 += (360L << 8);
+
+  int32_t inc_q16 = diff_q8 << 3;            // 32 measurements per capsule
+  int32_t angle_q16 = prevStart_q8 << 8;
+  uint16_t count = 0;
+
+  for (uint8_t pos = 0; pos < RPLIDAR_CAPSULE_CABINS; pos++) {
+    const uint8_t * cabin = &prev[4 + 5 * pos];
+    uint16_t d1 = (uint16_t)cabin[1] << 8 | cabin[0];
+    uint16_t d2 = (uint16_t)cabin[3] << 8 | cabin[2];
+    int32_t off1_q3 = (cabin[4] & 0x0F) | ((d1 & 0x03) << 4);
+    int32_t off2_q3 = (cabin[4] >> 4)   | ((d2 & 0x03) << 4);
+
+    bool sync = ((angle_q16 + inc_q16) % RPLIDAR_FULL_TURN_Q16) < inc_q16;
+    storeNode(&out[count++], d1 & 0xFFFC, (angle_q16 - (off1_q3 << 13)) >> 10, sync);
+    angle_q16 += inc_q16;
+
+    sync = ((angle_q16 + inc_q16) % RPLIDAR_FULL_TURN_Q16) < inc_q16;
+    storeNode(&out[count++], d2 & 0xFFFC, (angle_q16 - (off2_q3 << 13)) >> 10, sync);
+    angle_q16 += inc_q16;
+  }
+  return count;
+}
+
+uint16_t RPLidarParser::decodeUltra(rplidar_measurement_t * out)
+{
+  const uint8_t * prev = _capsule;
+  const uint8_t * cur = _scratch;
+  int32_t curStart_q8  = (int32_t)(((uint16_t)cur[3] << 8 | cur[2]) & 0x7FFF) << 2;
+  int32_t prevStart_q8 = (int32_t)(((uint16_t)prev[3] << 8 | prev[2]) & 0x7FFF) << 2;
+  int32_t diff_q8 = curStart_q8 - prevStart_q8;
+  if (prevStart_q8 > curStart_q8) diff_q8 += (360L << 8);
+
+  int32_t inc_q16 = (diff_q8 << 3) / 3;      // 96 measurements per capsule
+  int32_t angle_q16 = prevStart_q8 << 8;
+  uint16_t count = 0;
+
+  for (uint8_t pos = 0; pos < RPLIDAR_ULTRA_CAPSULE_CABINS; pos++) {
+    uint32_t combined, next;
+    memcpy(&combined, &prev[4 + 4 * pos], 4);
+    if (pos == RPLIDAR_ULTRA_CAPSULE_CABINS - 1) memcpy(&next, &cur[4], 4);
+    else                                         memcpy(&next, &prev[4 + 4 * (pos + 1)], 4);
+
+    int32_t predict1 = ((int32_t)(combined << 10)) >> 22;   // signed 10-bit deltas
+    int32_t predict2 = ((int32_t)combined) >> 22;
+    uint8_t lvl1, lvl2;
+    int32_t major  = varbitscaleDecode(combined & 0xFFF, lvl1);
+    int32_t major2 = varbitscaleDecode(next & 0xFFF, lvl2);
+    int32_t base1 = major, base2 = major2;
+    if (!major && major2) {
+      base1 = major2;
+      lvl1 = lvl2;
+    }
+
+    int32_t dist_q2[3];
+    dist_q2[0] = major << 2;
+    dist_q2[1] = (predict1 == -512 || predict1 == 0x1FF) ? 0 : (predict1 * (1 << lvl1) + base1) * 4;
+    dist_q2[2] = (predict2 == -512 || predict2 == 0x1FF) ? 0 : (predict2 * (1 << lvl2) + base2) * 4;
+
+    for (uint8_t c = 0; c < 3; c++) {
+      bool sync = ((angle_q16 + inc_q16) % RPLIDAR_FULL_TURN_Q16) < inc_q16;
+      // optical offset of the ranging module, 7.5 deg at short range, converted to a q16 angle in degrees
+      int32_t offset_q16 = 8578;
+      if (dist_q2[c] >= 50 * 4) {
+        int32_t k2 = 98361 / dist_q2[c];
+        offset_q16 = 9150 - (k2 << 6) - (k2 * k2 * k2) / 98304;
+      }
+      int32_t offsetDeg_q16 = (int32_t)(((int64_t)offset_q16 * 3754936) >> 16);  // * 180 / pi
+      storeNode(&out[count++], dist_q2[c] > 0 ? (uint32_t)dist_q2[c] : 0, (angle_q16 - offsetDeg_q16) >> 10, sync);
+      angle_q16 += inc_q16;
+    }
+  }
+  return count;
+}
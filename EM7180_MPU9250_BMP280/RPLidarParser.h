@@ -0,0 +1,88 @@
+/* RPLidar serial protocol parser
+
+  Incremental parser for the RPLidar A-series serial stream. It works directly on the UART/DMA receive
+  ring buffer (no copy of the stream is made) and understands the response descriptor, the 5-byte
+  standard scan node, the 84-byte express scan capsule and the 132-byte ultra capsule.
+
+  Decoded measurements are written into a caller-provided array, so no memory is allocated at run time.
+  Express and ultra capsules are decoded against the previous capsule (as in the Slamtec SDK), so their
+  measurements come out one capsule late. Each capsule is copied out of the ring once, into whichever of two
+  buffers does not hold the previous capsule; a good capsule then becomes the previous one by swapping pointers.
+
+  See the Slamtec "RPLIDAR Interface Protocol and Application Notes" for the wire format.
+*/
+
+#ifndef RPLidarParser_h
+#define RPLidarParser_h
+
+#include "Arduino.h"
+
+#define RPLIDAR_SYNC_BYTE1                0xA5
+#define RPLIDAR_SYNC_BYTE2                0x5A
+#define RPLIDAR_DESCRIPTOR_LEN            7
+
+#define RPLIDAR_CMD_STOP                  0x25  // requests, sent after RPLIDAR_SYNC_BYTE1
+#define RPLIDAR_CMD_SCAN                  0x20
+#define RPLIDAR_CMD_EXPRESS_SCAN          0x82  // with a 5-byte payload and a checksum
+
+#define RPLIDAR_ANS_TYPE_MEASUREMENT      0x81  // standard scan, 5-byte nodes
+#define RPLIDAR_ANS_TYPE_CAPSULED         0x82  // express scan, 84-byte capsules
+#define RPLIDAR_ANS_TYPE_CAPSULED_ULTRA   0x84  // ultra capsules, 132 bytes
+
+#define RPLIDAR_NODE_LEN                  5
+#define RPLIDAR_CAPSULE_LEN               84
+#define RPLIDAR_ULTRA_CAPSULE_LEN         132
+#define RPLIDAR_CAPSULE_CABINS            16
+#define RPLIDAR_ULTRA_CAPSULE_CABINS      32
+
+#define RPLIDAR_FLAG_START                0x01  // first measurement of a new 360 degree sweep
+
+struct rplidar_measurement_t {
+  uint16_t angle_q6;     // angle in degrees * 64, 0 .. 23039
+  uint8_t  quality;      // 0 .. 63, 0 means no valid return
+  uint8_t  flags;        // RPLIDAR_FLAG_START
+  uint32_t distance_q2;  // distance in mm * 4, 0 means no valid return
+};
+
+class RPLidarParser
+{
+  public:
+    RPLidarParser();
+
+    enum Mode {
+      WAIT_DESCRIPTOR = 0,
+      STANDARD,
+      EXPRESS,
+      ULTRA
+    };
+
+    void reset();
+    void setMode(uint8_t mode);   // skip the descriptor when the scan was started elsewhere
+    uint8_t getMode();
+
+    // Parse everything between the parser's read index and head in a ring of (mask + 1) bytes,
+    // where the ring size is a power of two. Returns the number of measurements written to out.
+    // Bytes that do not yet form a complete node or capsule are left in the ring for the next call.
+    uint16_t parse(const uint8_t * ring, uint32_t mask, uint32_t head, rplidar_measurement_t * out, uint16_t maxOut);
+
+    uint32_t tail;                // ring read index, free running
+    uint32_t bytesDiscarded;      // bytes skipped while resynchronising
+    uint32_t checksumErrors;      // capsules dropped on a bad checksum
+    uint32_t nodesDecoded;
+
+  private:
+    uint8_t  _mode;
+    bool     _havePrevious;
+    uint8_t  _capsuleBuf[2][RPLIDAR_ULTRA_CAPSULE_LEN];
+    uint8_t * _capsule;           // previous express/ultra capsule, one of _capsuleBuf
+    uint8_t * _scratch;           // capsule being validated, the other one
+
+    uint16_t parseDescriptor(const uint8_t * ring, uint32_t mask, uint32_t avail);
+    uint16_t parseNodes(const uint8_t * ring, uint32_t mask, uint32_t avail, rplidar_measurement_t * out, uint16_t maxOut);
+    uint16_t parseCapsules(const uint8_t * ring, uint32_t mask, uint32_t avail, rplidar_measurement_t * out, uint16_t maxOut);
+    uint16_t decodeExpress(rplidar_measurement_t * out);
+    uint16_t decodeUltra(rplidar_measurement_t * out);
+    bool capsuleChecksumOK(const uint8_t * capsule, uint16_t len);
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include "ScanMatcher.h"
+
+static const int8_t NEIGHBOUR[7][3] = {{0, 0, 0}, {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+
+ScanMatcher::ScanMatcher(float cellSize_mm)
+{
+  _invCell = 1.0f / cellSize_mm;
+  maxCorrespondence = cellSize_mm;
+  huber = 0.04f * cellSize_mm;
+  maxIterations = 15;
+  _cellsUsed = 0;
+  for (uint16_t i = 0; i < SCANMATCH_HASH_SIZE; i++) _hash[i] = -1;
+}
+
+uint16_t ScanMatcher::referenceCells()
+{
+  return _cellsUsed;
+}
+
+ScanMatcher::cell_t * ScanMatcher::findCell(int16_t cx, int16_t cy, int16_t cz, bool create)
+{
+  uint32_t h = ((uint32_t)cx * 73856093UL) ^ ((uint32_t)cy * 19349663UL) ^ ((uint32_t)cz * 83492791UL);
+  for (uint16_t probe = 0; probe < SCANMATCH_HASH_SIZE; probe++) {
+    uint16_t slot = (h + probe) & (SCANMATCH_HASH_SIZE - 1);
+    int16_t index = _hash[slot];
+    if (index < 0) {
+      if (!create || _cellsUsed >= SCANMATCH_MAX_CELLS) return NULL;
+      cell_t * cell = &_cells[_cellsUsed];
+      memset(cell, 0, sizeof(cell_t));
+      cell->cx = cx; cell->cy = cy; cell->cz = cz;
+      _hash[slot] = _cellsUsed++;
+      return cell;
+    }
+    cell_t * cell = &_cells[index];
+    if (cell->cx == cx && cell->cy == cy && cell->cz == cz) return cell;
+  }
+  return NULL;
+}
+
+void ScanMatcher::setReference(const float * x, const float * y, const float * z, uint16_t n)
+{
+  _cellsUsed = 0;
+  for (uint16_t i = 0; i < SCANMATCH_HASH_SIZE; i++) _hash[i] = -1;
+
+  for (uint16_t i = 0; i < n; i++) {
+    cell_t * cell = findCell((int16_t)floorf(x[i] * _invCell), (int16_t)floorf(y[i] * _invCell), (int16_t)floorf(z[i] * _invCell), true);
+    if (!cell) continue;
+    cell->n++;
+    cell->mean[0] += x[i]; cell->mean[1] += y[i]; cell->mean[2] += z[i];
+    cell->cov[0] += x[i] * x[i]; cell->cov[1] += x[i] * y[i]; cell->cov[2] += x[i] * z[i];
+    cell->cov[3] += y[i] * y[i]; cell->cov[4] += y[i] * z[i]; cell->cov[5] += z[i] * z[i];
+  }
+  for (uint16_t i = 0; i < _cellsUsed; i++) finishCell(&_cells[i]);
+}
+
+// Unit eigenvector of the symmetric C (xx xy xz yy yz zz) for a single eigenvalue, as the longest cross product
+// of two rows of (C - lambda I), which are all perpendicular to it
+static void eigenvector(const float * c, float lambda, float * v)
+{
+  float m[3][3] = {{c[0] - lambda, c[1], c[2]}, {c[1], c[3] - lambda, c[4]}, {c[2], c[4], c[5] - lambda}};
+  float best = 0.0f;
+  v[0] = v[1] = v[2] = 0.0f;
+  for (uint8_t i = 0; i < 2; i++) {
+    for (uint8_t j = i + 1; j < 3; j++) {
+      float x = m[i][1] * m[j][2] - m[i][2] * m[j][1];
+      float y = m[i][2] * m[j][0] - m[i][0] * m[j][2];
+      float z = m[i][0] * m[j][1] - m[i][1] * m[j][0];
+      float n2 = x * x + y * y + z * z;
+      if (n2 > best) { best = n2; v[0] = x; v[1] = y; v[2] = z; }
+    }
+  }
+  float norm = 1.0f / sqrtf(best);
+  v[0] *= norm; v[1] *= norm; v[2] *= norm;
+}
+
+// Mean and shape of a cell. The eigenvalues of the covariance come in closed form from the characteristic cubic.
+// Points spread in two directions make a plane, kept as its normal; points spread in one, where a single scan
+// line crosses the cell, make a line, kept as its direction. A cell with neither is left with n = 0.
+void ScanMatcher::finishCell(cell_t * cell)
+{
+  float inv = 1.0f / (float)cell->n;
+  float mx = cell->mean[0] * inv, my = cell->mean[1] * inv, mz = cell->mean[2] * inv;
+  cell->mean[0] = mx; cell->mean[1] = my; cell->mean[2] = mz;
+  if (cell->n < SCANMATCH_MIN_POINTS) return;
+
+  float c[6];
+  c[0] = cell->cov[0] * inv - mx * mx; c[1] = cell->cov[1] * inv - mx * my; c[2] = cell->cov[2] * inv - mx * mz;
+  c[3] = cell->cov[3] * inv - my * my; c[4] = cell->cov[4] * inv - my * mz; c[5] = cell->cov[5] * inv - mz * mz;
+
+  // Eigenvalues of the symmetric C (trigonometric solution of the cubic)
+  float q = (c[0] + c[3] + c[5]) / 3.0f;
+  float off = c[1] * c[1] + c[2] * c[2] + c[4] * c[4];
+  float d0 = c[0] - q, d1 = c[3] - q, d2 = c[5] - q;
+  float p = sqrtf((d0 * d0 + d1 * d1 + d2 * d2 + 2.0f * off) / 6.0f);
+  memset(cell->normal, 0, sizeof(cell->normal));
+  cell->line = false;
+  if (p <= 1e-6f * fabsf(q)) {                              // no shape at all
+    cell->n = 0;
+    return;
+  }
+  float b0 = d0 / p, b1 = c[1] / p, b2 = c[2] / p, b3 = d1 / p, b4 = c[4] / p, b5 = d2 / p;
+  float r = 0.5f * (b0 * (b3 * b5 - b4 * b4) - b1 * (b1 * b5 - b4 * b2) + b2 * (b1 * b4 - b3 * b2));
+  r = fminf(1.0f, fmaxf(-1.0f, r));
+  float phi = acosf(r) / 3.0f;
+  float smallest = q + 2.0f * p * cosf(phi + 2.0943951f);
+  float largest = q + 2.0f * p * cosf(phi);
+  float middle = 3.0f * q - largest - smallest;
+
+  // Range noise alone spreads a line across it, so the spread that makes a plane or a line is set against
+  // the cell size as well as against the spread across it
+  float spread = SCANMATCH_MIN_SPREAD / _invCell;
+  spread *= spread;
+  if (middle >= spread && middle > SCANMATCH_MIN_RATIO * smallest) {
+    eigenvector(c, smallest, cell->normal);
+  } else if (largest >= spread && largest > SCANMATCH_MIN_RATIO * middle) {
+    eigenvector(c, largest, cell->normal);
+    cell->line = true;
+  } else {
+    cell->n = 0;
+  }
+}
+
+void ScanMatcher::accumulateAll(const float * x, const float * y, const float * z, uint16_t n, const float * R, const scan_match_t & at, float gate, normal_eq_t & eq)
+{
+  accumulate(x, y, z, 0, n, R, at, gate, eq);
+}
+
+void ScanMatcher::accumulate(const float * x, const float * y, const float * z, uint16_t first, uint16_t last, const float * R, const scan_match_t & at, float gate, normal_eq_t & eq)
+{
+  float h = 0.25f * gate;
+  float cy = cosf(at.yaw), sy = sinf(at.yaw);
+  for (uint16_t i = first; i < last; i++) {
+    float px = R[0] * x[i] + R[1] * y[i] + R[2] * z[i];
+    float py = R[3] * x[i] + R[4] * y[i] + R[5] * z[i];
+    float pz = R[6] * x[i] + R[7] * y[i] + R[8] * z[i];
+    float qx = cy * px - sy * py + at.t[0];
+    float qy = sy * px + cy * py + at.t[1];
+    float qz = pz + at.t[2];
+
+    // Correspondence is the plane of the nearest cell mean among the point's cell and its six faces
+    int16_t vx = (int16_t)floorf(qx * _invCell), vy = (int16_t)floorf(qy * _invCell), vz = (int16_t)floorf(qz * _invCell);
+    cell_t * cell = NULL;
+    float best = 1e30f;
+    for (uint8_t k = 0; k < 7; k++) {
+      cell_t * c = findCell(vx + NEIGHBOUR[k][0], vy + NEIGHBOUR[k][1], vz + NEIGHBOUR[k][2], false);
+      if (!c || c->n < SCANMATCH_MIN_POINTS) continue;
+      float ex = qx - c->mean[0], ey = qy - c->mean[1], ez = qz - c->mean[2];
+      float d2 = ex * ex + ey * ey + ez * ez;
+      if (d2 < best) {
+        best = d2;
+        cell = c;
+      }
+    }
+    if (!cell) continue;
+
+    // Distance to the plane, or to the line along the perpendicular from it
+    float ex = qx - cell->mean[0], ey = qy - cell->mean[1], ez = qz - cell->mean[2];
+    float nrm[3], r;
+    if (cell->line) {
+      const float * d = cell->normal;
+      float along = d[0] * ex + d[1] * ey + d[2] * ez;
+      nrm[0] = ex - along * d[0]; nrm[1] = ey - along * d[1]; nrm[2] = ez - along * d[2];
+      r = sqrtf(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+      if (r < 1e-3f) continue;
+      nrm[0] /= r; nrm[1] /= r; nrm[2] /= r;
+    } else {
+      nrm[0] = cell->normal[0]; nrm[1] = cell->normal[1]; nrm[2] = cell->normal[2];
+      r = nrm[0] * ex + nrm[1] * ey + nrm[2] * ez;
+    }
+    float ar = fabsf(r);
+    if (ar > gate) continue;
+    float w = (ar > h) ? h / ar : 1.0f;
+
+    // d(q)/d(yaw) = (-(qy - ty), qx - tx, 0)
+    float J[4] = {nrm[0] * -(qy - at.t[1]) + nrm[1] * (qx - at.t[0]), nrm[0], nrm[1], nrm[2]};
+    for (uint8_t a = 0; a < 4; a++) {
+      for (uint8_t b = a; b < 4; b++) eq.A[a][b] += w * J[a] * J[b];
+      eq.A[a][4] -= w * J[a] * r;
+    }
+    eq.sumr2 += w * r * r;
+    eq.sumw += w;
+    eq.inliers++;
+  }
+}
+
+scan_match_t ScanMatcher::match(const float * x, const float * y, const float * z, uint16_t n, const float * deltaQuat, const scan_match_t * guess)
+{
+  scan_match_t result;
+  memset(&result, 0, sizeof(result));
+  if (guess) {
+    result.yaw = guess->yaw;
+    result.t[0] = guess->t[0]; result.t[1] = guess->t[1]; result.t[2] = guess->t[2];
+  }
+
+  // IMU prior: rotation between the sweeps, qx qy qz qw as reported by the EM7180
+  float R[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  if (deltaQuat) {
+    float qx = deltaQuat[0], qy = deltaQuat[1], qz = deltaQuat[2], qw = deltaQuat[3];
+    R[0] = 1.0f - 2.0f * (qy * qy + qz * qz); R[1] = 2.0f * (qx * qy - qz * qw);        R[2] = 2.0f * (qx * qz + qy * qw);
+    R[3] = 2.0f * (qx * qy + qz * qw);        R[4] = 1.0f - 2.0f * (qx * qx + qz * qz); R[5] = 2.0f * (qy * qz - qx * qw);
+    R[6] = 2.0f * (qx * qz - qy * qw);        R[7] = 2.0f * (qy * qz + qx * qw);        R[8] = 1.0f - 2.0f * (qx * qx + qy * qy);
+  }
+
+  // The first iterations take everything within maxCorrespondence so that a poor start can still pull in;
+  // the gate then closes in on the residuals down to four Huber widths, where cells straddling a corner or
+  // an edge no longer pull the result off
+  float gate = maxCorrespondence;
+  for (uint8_t iter = 0; iter < maxIterations; iter++) {
+    normal_eq_t eq;
+    memset(&eq, 0, sizeof(eq));
+    accumulateAll(x, y, z, n, R, result, gate, eq);
+    float (*A)[5] = eq.A;
+
+    result.inliers = eq.inliers;
+    result.iterations = iter + 1;
+    result.rms = (eq.sumw > 0.0f) ? sqrtf(eq.sumr2 / eq.sumw) : 0.0f;
+    if (eq.inliers < 8) break;
+
+    // Gaussian elimination with partial pivoting on the symmetric 4 x 4 system
+    for (uint8_t a = 0; a < 4; a++) for (uint8_t b = 0; b < a; b++) A[a][b] = A[b][a];
+    bool singular = false;
+    for (uint8_t col = 0; col < 4; col++) {
+      uint8_t pivot = col;
+      for (uint8_t r = col + 1; r < 4; r++) if (fabsf(A[r][col]) > fabsf(A[pivot][col])) pivot = r;
+      if (fabsf(A[pivot][col]) < 1e-9f) { singular = true; break; }
+      if (pivot != col) for (uint8_t k = 0; k < 5; k++) { float tmp = A[col][k]; A[col][k] = A[pivot][k]; A[pivot][k] = tmp; }
+      for (uint8_t r = col + 1; r < 4; r++) {
+        float f = A[r][col] / A[col][col];
+        for (uint8_t k = col; k < 5; k++) A[r][k] -= f * A[col][k];
+      }
+    }
+    if (singular) break;   // degenerate geometry (e.g. a single plane), keep the last estimate
+    float dx[4];
+    for (int8_t r = 3; r >= 0; r--) {
+      float s = A[r][4];
+      for (uint8_t k = r + 1; k < 4; k++) s -= A[r][k] * dx[k];
+      dx[r] = s / A[r][r];
+    }
+
+    result.yaw += dx[0];
+    result.t[0] += dx[1]; result.t[1] += dx[2]; result.t[2] += dx[3];
+    float narrow = fmaxf(4.0f * huber, fminf(gate, 3.0f * result.rms));
+    if (narrow >= gate && fabsf(dx[0]) < 1e-4f && fabsf(dx[1]) + fabsf(dx[2]) + fabsf(dx[3]) < 0.5f) {
+      result.converged = true;
+      break;
+    }
+    gate = narrow;
+  }
+  return result;
+}
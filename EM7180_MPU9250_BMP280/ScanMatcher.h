@@ -0,0 +1,86 @@
+/* IMU-seeded scan matcher for platform pose estimation
+
+  Successive lidar sweeps are registered against each other with point-to-plane ICP, point-to-line where
+  only a single scan line crosses a cell. The EM7180 supplies the rotation between sweeps, which is applied
+  to the new sweep before matching, so the solver only has to refine the residual yaw (drift of the
+  magnetometer-free heading) and the translation.
+
+  The reference sweep is indexed once into a flat voxel hash where every cell keeps the mean and the
+  plane normal or line direction of its points. Each iteration looks up the cell under every transformed
+  point, builds the 4 x 4 normal equations of the residuals with a Huber weight and solves them in place.
+  The correspondence pass only reads the index, so a host build can override accumulateAll() and share
+  the points out between threads (tools/ScanMatcher).
+*/
+
+#ifndef ScanMatcher_h
+#define ScanMatcher_h
+
+#include "Arduino.h"
+
+#ifndef SCANMATCH_MAX_CELLS
+#define SCANMATCH_MAX_CELLS   192      // reference cells, 60 bytes each
+#endif
+#define SCANMATCH_HASH_SIZE   512      // power of two, larger than SCANMATCH_MAX_CELLS
+#define SCANMATCH_MIN_POINTS  4        // points needed in a cell to trust its plane
+#define SCANMATCH_MIN_SPREAD  0.1f     // rms spread along a cell's plane or line, in cell edges
+#define SCANMATCH_MIN_RATIO   9.0f     // variance along the plane or line over that across it
+
+struct scan_match_t {
+  float yaw;            // rad, correction about the platform z axis
+  float t[3];           // mm
+  float rms;            // mm, weighted point-to-plane residual
+  uint16_t inliers;
+  uint8_t iterations;
+  bool converged;
+};
+
+class ScanMatcher
+{
+  public:
+    ScanMatcher(float cellSize_mm);
+    virtual ~ScanMatcher() {}
+
+    // Index a sweep (mm) as the reference for the following match() calls
+    void setReference(const float * x, const float * y, const float * z, uint16_t n);
+
+    // Register a sweep against the reference. deltaQuat is the EM7180 rotation from the reference sweep
+    // to this one (qx, qy, qz, qw, NULL if the points are already attitude-rotated); guess seeds yaw and t.
+    scan_match_t match(const float * x, const float * y, const float * z, uint16_t n, const float * deltaQuat, const scan_match_t * guess);
+
+    float maxCorrespondence;   // mm, residuals beyond this are ignored at the start
+    float huber;               // mm, residuals beyond this are down-weighted once the gate has closed
+    uint8_t maxIterations;
+    uint16_t referenceCells();
+
+  protected:
+    struct normal_eq_t {
+      float A[4][5];    // augmented normal equations, unknowns d_yaw, dtx, dty, dtz
+      float sumr2, sumw;
+      uint16_t inliers;
+    };
+
+    // Correspondences of points first .. last - 1 under rotation R, then the current yaw and t, added into eq.
+    // Residuals beyond gate are ignored, beyond a quarter of it down-weighted.
+    void accumulate(const float * x, const float * y, const float * z, uint16_t first, uint16_t last, const float * R, const scan_match_t & at, float gate, normal_eq_t & eq);
+    virtual void accumulateAll(const float * x, const float * y, const float * z, uint16_t n, const float * R, const scan_match_t & at, float gate, normal_eq_t & eq);
+
+  private:
+    struct cell_t {
+      int16_t cx, cy, cz;
+      uint16_t n;       // points, 0 once finished if they make neither a plane nor a line
+      bool line;
+      float mean[3];
+      float normal[3];  // of the plane, or the direction of the line
+      float cov[6];     // xx xy xz yy yz zz sums while building
+    };
+
+    cell_t _cells[SCANMATCH_MAX_CELLS];
+    int16_t _hash[SCANMATCH_HASH_SIZE];
+    uint16_t _cellsUsed;
+    float _invCell;
+
+    cell_t * findCell(int16_t cx, int16_t cy, int16_t cz, bool create);
+    void finishCell(cell_t * cell);
+};
+
+#endif
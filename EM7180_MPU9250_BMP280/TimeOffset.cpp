@@ -0,0 +1,211 @@
+#include "TimeOffset.h"
+
+TimeOffset::TimeOffset()
+{
+  for (uint16_t k = 0; k < TIMEOFFSET_FFT / 2; k++) {
+    _cos[k] = cosf(2.0f * PI * (float)k / (float)TIMEOFFSET_FFT);
+    _sin[k] = sinf(2.0f * PI * (float)k / (float)TIMEOFFSET_FFT);
+  }
+  minCorrelation = 0.5f;
+  smoothing = 0.2f;
+  maxLagBins = 32;
+  reset();
+}
+
+void TimeOffset::reset()
+{
+  memset(_imuCount, 0, sizeof(_imuCount));
+  memset(_lidarCount, 0, sizeof(_lidarCount));
+  _haveImu = _haveLidar = _haveBase = false;
+  offset_us = 0.0f;
+  lastMeasurement_us = 0.0f;
+  correlation = 0.0f;
+  estimates = 0;
+}
+
+uint32_t TimeOffset::lidarToImuTime(uint32_t lidar_us)
+{
+  return lidar_us - (int32_t)offset_us;
+}
+
+uint32_t TimeOffset::imuToLidarTime(uint32_t imu_us)
+{
+  return imu_us + (int32_t)offset_us;
+}
+
+void TimeOffset::accumulate(float * sum, uint16_t * bins, uint8_t * counts, uint32_t bin, float value)
+{
+  uint16_t slot = bin % TIMEOFFSET_RING;
+  if (bins[slot] != (uint16_t)bin || counts[slot] == 0) {
+    bins[slot] = (uint16_t)bin;
+    sum[slot] = 0.0f;
+    counts[slot] = 0;
+  }
+  if (counts[slot] == 255) return;
+  sum[slot] += value;
+  counts[slot]++;
+}
+
+// Bin of a time stamp on the grid shared by both streams. Dividing micros() itself would jump back to 0 when
+// it wraps, so the grid is a running bin count anchored at the newest time seen, and a stamp only ever enters
+// as its wrap-safe difference from that anchor.
+uint32_t TimeOffset::binOf(uint32_t t_us)
+{
+  if (!_haveBase) {
+    _base_us = t_us;
+    _baseBin = 0;
+    _haveBase = true;
+  }
+  int32_t dt = (int32_t)(t_us - _base_us);
+  if (dt >= 0) {
+    uint32_t bins = (uint32_t)dt / TIMEOFFSET_BIN_US;
+    _base_us += bins * TIMEOFFSET_BIN_US;
+    _baseBin += bins;
+    return _baseBin;
+  }
+  return _baseBin - ((uint32_t)(-dt) + TIMEOFFSET_BIN_US - 1) / TIMEOFFSET_BIN_US;   // a stamp behind the anchor
+}
+
+void TimeOffset::addImuRate(uint32_t t_us, float rate_dps)
+{
+  uint32_t bin = binOf(t_us);
+  accumulate(_imuSum, _imuBin, _imuCount, bin, rate_dps);
+  if (!_haveImu || (int32_t)(bin - _lastImuBin) > 0) _lastImuBin = bin;
+  if (!_haveImu) _lastEstimateBin = bin;
+  _haveImu = true;
+
+  if (_haveLidar && (int32_t)(_lastImuBin - _lastEstimateBin) >= TIMEOFFSET_HOP) {
+    _lastEstimateBin = _lastImuBin;
+    estimate();
+  }
+}
+
+void TimeOffset::addLidarRate(uint32_t t_us, float rate_dps)
+{
+  uint32_t bin = binOf(t_us);
+  accumulate(_lidarSum, _lidarBin, _lidarCount, bin, rate_dps);
+  if (!_haveLidar || (int32_t)(bin - _lastLidarBin) > 0) _lastLidarBin = bin;
+  _haveLidar = true;
+}
+
+// Bin averages of one stream over the window. Empty bins are interpolated between their neighbours and
+// held at the ends. Returns the number of bins that had samples.
+uint16_t TimeOffset::fill(float * dest, const float * sum, const uint16_t * bins, const uint8_t * counts, uint32_t start)
+{
+  uint16_t valid = 0;
+  int16_t last = -1;
+  for (uint16_t i = 0; i < TIMEOFFSET_BINS; i++) {
+    uint32_t bin = start + i;
+    uint16_t slot = bin % TIMEOFFSET_RING;
+    if (!counts[slot] || bins[slot] != (uint16_t)bin) continue;
+    dest[i] = sum[slot] / (float)counts[slot];
+    if (last < 0) {
+      for (uint16_t j = 0; j < i; j++) dest[j] = dest[i];
+    } else {
+      float step = (dest[i] - dest[last]) / (float)(i - last);
+      for (uint16_t j = last + 1; j < i; j++) dest[j] = dest[last] + step * (float)(j - last);
+    }
+    last = i;
+    valid++;
+  }
+  if (last >= 0) for (uint16_t j = last + 1; j < TIMEOFFSET_BINS; j++) dest[j] = dest[last];
+  return valid;
+}
+
+// In-place iterative radix-2 FFT of _re/_im, forward kernel exp(-2 pi i nk / N)
+void TimeOffset::fft(bool inverse)
+{
+  const uint16_t n = TIMEOFFSET_FFT;
+  for (uint16_t i = 1, j = 0; i < n; i++) {
+    uint16_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      float tr = _re[i]; _re[i] = _re[j]; _re[j] = tr;
+      float ti = _im[i]; _im[i] = _im[j]; _im[j] = ti;
+    }
+  }
+  float sign = inverse ? 1.0f : -1.0f;
+  for (uint16_t len = 2; len <= n; len <<= 1) {
+    uint16_t half = len >> 1, step = n / len;
+    for (uint16_t i = 0; i < n; i += len) {
+      for (uint16_t k = 0; k < half; k++) {
+        float wr = _cos[k * step], wi = sign * _sin[k * step];
+        uint16_t a = i + k, b = a + half;
+        float xr = _re[b] * wr - _im[b] * wi;
+        float xi = _re[b] * wi + _im[b] * wr;
+        _re[b] = _re[a] - xr; _im[b] = _im[a] - xi;
+        _re[a] += xr;         _im[a] += xi;
+      }
+    }
+  }
+}
+
+void TimeOffset::estimate()
+{
+  // Only bins both streams have finished with
+  uint32_t end = ((int32_t)(_lastImuBin - _lastLidarBin) < 0) ? _lastImuBin : _lastLidarBin;
+  uint32_t start = end - TIMEOFFSET_BINS;
+
+  if (fill(_re, _imuSum, _imuBin, _imuCount, start) < TIMEOFFSET_BINS / 2) return;
+  if (fill(_im, _lidarSum, _lidarBin, _lidarCount, start) < TIMEOFFSET_BINS / 2) return;
+
+  // Both streams are differenced, which whitens the mostly low-frequency rate spectrum and sharpens the
+  // correlation peak. The lidar window is then cut to its centre so every lag up to maxLag overlaps the
+  // same number of IMU bins; with the full window the shrinking overlap would pull the peak towards zero.
+  int16_t maxLag = (maxLagBins < TIMEOFFSET_BINS / 4) ? maxLagBins : TIMEOFFSET_BINS / 4;
+  uint16_t lo = maxLag, hi = TIMEOFFSET_BINS - maxLag;
+  float energy[TIMEOFFSET_BINS + 1];   // running IMU energy, to normalise the peak over its own overlap
+  float ey = 0.0f;
+  for (uint16_t i = TIMEOFFSET_BINS - 1; i > 0; i--) {
+    _re[i] -= _re[i - 1];
+    _im[i] = (i >= lo && i < hi) ? _im[i] - _im[i - 1] : 0.0f;
+    ey += _im[i] * _im[i];
+  }
+  _re[0] = _im[0] = 0.0f;
+  energy[0] = 0.0f;
+  for (uint16_t i = 0; i < TIMEOFFSET_BINS; i++) energy[i + 1] = energy[i] + _re[i] * _re[i];
+  if (energy[TIMEOFFSET_BINS] < 1e-6f || ey < 1e-6f) return;   // steady rotation carries no timing information
+  for (uint16_t i = TIMEOFFSET_BINS; i < TIMEOFFSET_FFT; i++) _re[i] = _im[i] = 0.0f;
+
+  // One FFT of z = imu + i lidar, then split Z[k] and conj(Z[N-k]) into the two spectra and form
+  // IMU * conj(lidar). The product of two real signals' spectra is Hermitian, so only half is computed.
+  fft(false);
+  for (uint16_t k = 0; k <= TIMEOFFSET_FFT / 2; k++) {
+    uint16_t m = (TIMEOFFSET_FFT - k) & (TIMEOFFSET_FFT - 1);
+    float a = _re[k], b = _im[k], c = _re[m], d = _im[m];
+    float xr = 0.5f * (a + c), xi = 0.5f * (b - d);   // IMU spectrum
+    float yr = 0.5f * (b + d), yi = 0.5f * (c - a);   // lidar spectrum
+    float pr = xr * yr + xi * yi;
+    float pi = xi * yr - xr * yi;
+    _re[k] = pr; _im[k] = pi;
+    _re[m] = pr; _im[m] = -pi;
+  }
+  fft(true);   // _re[k] = N * sum_n imu[n + k] lidar[n]
+
+  // A lidar stream running D bins late peaks at lag -D
+  int16_t bestLag = 0;
+  float best = -1e30f;
+  for (int16_t lag = -maxLag; lag <= maxLag; lag++) {
+    float v = _re[lag & (TIMEOFFSET_FFT - 1)];
+    if (v > best) {
+      best = v;
+      bestLag = lag;
+    }
+  }
+  float ex = energy[hi + bestLag] - energy[lo + bestLag];
+  correlation = (ex > 0.0f) ? best / ((float)TIMEOFFSET_FFT * sqrtf(ex * ey)) : 0.0f;
+  if (correlation < minCorrelation) return;
+
+  float frac = 0.0f;
+  if (bestLag > -maxLag && bestLag < maxLag) {
+    float ym = _re[(bestLag - 1) & (TIMEOFFSET_FFT - 1)], yp = _re[(bestLag + 1) & (TIMEOFFSET_FFT - 1)];
+    float den = ym - 2.0f * best + yp;
+    if (den < 0.0f) frac = 0.5f * (ym - yp) / den;
+  }
+
+  lastMeasurement_us = -((float)bestLag + frac) * (float)TIMEOFFSET_BIN_US;
+  if (estimates == 0) offset_us = lastMeasurement_us;
+  else offset_us += smoothing * (lastMeasurement_us - offset_us);
+  estimates++;
+}
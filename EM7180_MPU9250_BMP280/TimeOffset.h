@@ -0,0 +1,67 @@
+/* IMU to lidar time offset estimator
+
+  The platform rotation is seen twice: as the EM7180 z rate (timestamped with micros() in getSentralRPY)
+  and as the lidar rotation rate (the angles of its returns against their arrival). Both are binned onto a
+  common 10 ms grid and the latest window is cross-correlated every hop. The correlation is computed with
+  one complex FFT carrying both real signals, a spectrum product and one inverse FFT, zero-padded so the
+  correlation is linear rather than circular. The peak lag, refined by parabolic interpolation, is
+  smoothed into offset_us.
+
+  offset_us is positive when lidar timestamps run late: true time = lidar time - offset_us. Copy it into
+  PointCloud::lidarLate_us, which takes it off the scan times before they meet the poses, or convert single
+  stamps with lidarToImuTime(). The lidar rate has to be independent of the IMU. Where the lidar's turn is
+  itself driven from the IMU rate, as the EM7180_MPU9250_BMP280 sketch's rotation tab signal is, the two
+  streams only differ by that loop and the offset cannot be seen. Steady rotation carries no timing
+  information either, so estimates are only taken while the rate varies over the window.
+*/
+
+#ifndef TimeOffset_h
+#define TimeOffset_h
+
+#include "Arduino.h"
+
+#define TIMEOFFSET_BINS      128                       // correlation window in bins
+#define TIMEOFFSET_FFT       (2 * TIMEOFFSET_BINS)     // zero-padded FFT length
+#define TIMEOFFSET_RING      (2 * TIMEOFFSET_BINS)     // bins kept per stream, room for one stream to lag
+#define TIMEOFFSET_HOP       32                        // bins between estimates
+#define TIMEOFFSET_BIN_US    10000UL
+
+class TimeOffset
+{
+  public:
+    TimeOffset();
+
+    void reset();
+    void addImuRate(uint32_t t_us, float rate_dps);
+    void addLidarRate(uint32_t t_us, float rate_dps);
+
+    uint32_t lidarToImuTime(uint32_t lidar_us);                // apply the current estimate
+    uint32_t imuToLidarTime(uint32_t imu_us);
+
+    float offset_us;          // tracked estimate
+    float lastMeasurement_us; // latest raw correlation estimate
+    float correlation;        // normalised peak height of the latest estimate, 0 .. 1
+    float minCorrelation;     // estimates below this are ignored
+    float smoothing;          // weight of a new estimate in the tracked offset
+    uint16_t maxLagBins;      // search range, +/- bins, at most TIMEOFFSET_BINS / 4
+    uint32_t estimates;
+
+  private:
+    float _imuSum[TIMEOFFSET_RING], _lidarSum[TIMEOFFSET_RING];
+    uint16_t _imuBin[TIMEOFFSET_RING], _lidarBin[TIMEOFFSET_RING];   // low bits of the bin held by each slot
+    uint8_t _imuCount[TIMEOFFSET_RING], _lidarCount[TIMEOFFSET_RING];
+    uint32_t _lastImuBin, _lastLidarBin, _lastEstimateBin;
+    uint32_t _base_us, _baseBin;   // grid anchor: _base_us starts bin _baseBin
+    bool _haveImu, _haveLidar, _haveBase;
+
+    float _re[TIMEOFFSET_FFT], _im[TIMEOFFSET_FFT];
+    float _cos[TIMEOFFSET_FFT / 2], _sin[TIMEOFFSET_FFT / 2];
+
+    uint32_t binOf(uint32_t t_us);
+    void accumulate(float * sum, uint16_t * bins, uint8_t * counts, uint32_t bin, float value);
+    uint16_t fill(float * dest, const float * sum, const uint16_t * bins, const uint8_t * counts, uint32_t start);
+    void fft(bool inverse);
+    void estimate();
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "VoxelMap.h"
+
+VoxelMap::VoxelMap(float resolution_mm)
+{
+  resolution = resolution_mm;
+  _invResolution = 1.0f / resolution_mm;
+  clear();
+}
+
+void VoxelMap::clear()
+{
+  memset(_hash, -1, sizeof(_hash));
+  _tilesUsed = 0;
+  raysInserted = 0;
+  voxelsUpdated = 0;
+  droppedUpdates = 0;
+}
+
+uint16_t VoxelMap::tilesUsed()
+{
+  return _tilesUsed;
+}
+
+float VoxelMap::bytesPerCubicMetre()
+{
+  if (!_tilesUsed) return 0.0f;
+  float tileEdge_m = resolution * VOXELMAP_TILE_DIM * 0.001f;
+  float volume = (float)_tilesUsed * tileEdge_m * tileEdge_m * tileEdge_m;
+  return (float)(_tilesUsed * sizeof(voxel_tile_t) + sizeof(_hash)) / volume;
+}
+
+voxel_tile_t * VoxelMap::findTile(int16_t tx, int16_t ty, int16_t tz, bool create)
+{
+  uint32_t h = ((uint32_t)tx * 73856093UL) ^ ((uint32_t)ty * 19349663UL) ^ ((uint32_t)tz * 83492791UL);
+  for (uint16_t probe = 0; probe < VOXELMAP_HASH_SIZE; probe++) {
+    uint16_t slot = (h + probe) & (VOXELMAP_HASH_SIZE - 1);
+    int8_t index = _hash[slot];
+    if (index < 0) {
+      if (!create || _tilesUsed >= VOXELMAP_MAX_TILES) return NULL;
+      voxel_tile_t * tile = &_tiles[_tilesUsed];
+      tile->tx = tx; tile->ty = ty; tile->tz = tz;
+      memset(tile->logodds, 0, sizeof(tile->logodds));
+      _hash[slot] = (int8_t)_tilesUsed++;
+      return tile;
+    }
+    voxel_tile_t * tile = &_tiles[index];
+    if (tile->tx == tx && tile->ty == ty && tile->tz == tz) return tile;
+  }
+  return NULL;
+}
+
+void VoxelMap::updateVoxel(voxel_tile_t *&tile, int32_t vx, int32_t vy, int32_t vz, int8_t delta)
+{
+  int16_t tx = vx >> VOXELMAP_TILE_BITS, ty = vy >> VOXELMAP_TILE_BITS, tz = vz >> VOXELMAP_TILE_BITS;
+  if (!tile || tile->tx != tx || tile->ty != ty || tile->tz != tz) {
+    tile = findTile(tx, ty, tz, true);
+    if (!tile) {
+      droppedUpdates++;
+      return;
+    }
+  }
+  const int32_t m = VOXELMAP_TILE_DIM - 1;
+  int8_t &cell = tile->logodds[((vz & m) << (2 * VOXELMAP_TILE_BITS)) | ((vy & m) << VOXELMAP_TILE_BITS) | (vx & m)];
+  int16_t value = cell + delta;
+  if (value > VOXELMAP_LOGODDS_MAX) value = VOXELMAP_LOGODDS_MAX;
+  if (value < VOXELMAP_LOGODDS_MIN) value = VOXELMAP_LOGODDS_MIN;
+  cell = (int8_t)value;
+  voxelsUpdated++;
+}
+
+void VoxelRay::begin(const float * from, const float * to)
+{
+  steps = 0;
+  for (uint8_t k = 0; k < 3; k++) {
+    v[k] = (int32_t)floorf(from[k]);
+    e[k] = (int32_t)floorf(to[k]);
+    float d = to[k] - from[k];
+    if (d > 0.0f) {
+      s[k] = 1;
+      tDelta[k] = 1.0f / d;
+      tMax[k] = ((float)(v[k] + 1) - from[k]) * tDelta[k];
+    } else if (d < 0.0f) {
+      s[k] = -1;
+      tDelta[k] = -1.0f / d;
+      tMax[k] = (from[k] - (float)v[k]) * tDelta[k];
+    } else {
+      s[k] = 0;
+      tDelta[k] = tMax[k] = 1e30f;
+    }
+    steps += (uint32_t)abs(e[k] - v[k]);
+  }
+}
+
+// One ray from one point to another, both in mm: misses along the way, a hit or a miss at the end
+void VoxelMap::castRay(const float * from, const float * to, bool hit)
+{
+  float o[3], end[3];
+  for (uint8_t k = 0; k < 3; k++) {
+    o[k] = from[k] * _invResolution;
+    end[k] = to[k] * _invResolution;
+  }
+  VoxelRay ray;
+  ray.begin(o, end);
+
+  voxel_tile_t * tile = NULL;
+  for (uint32_t i = 0; i < ray.steps; i++) {
+    updateVoxel(tile, ray.v[0], ray.v[1], ray.v[2], VOXELMAP_LOGODDS_MISS);
+    ray.step();
+  }
+  updateVoxel(tile, ray.e[0], ray.e[1], ray.e[2], hit ? VOXELMAP_LOGODDS_HIT : VOXELMAP_LOGODDS_MISS);
+}
+
+void VoxelMap::insertScan(const float * x, const float * y, const float * z, uint16_t n, const float * origin, float maxRange_mm)
+{
+  float maxRange2 = maxRange_mm * maxRange_mm;
+  for (uint16_t i = 0; i < n; i++) {
+    float end[3] = {x[i], y[i], z[i]};
+    float r2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+    if (r2 == 0.0f) continue;
+    bool hit = true;
+    if (r2 > maxRange2) {   // beyond the trusted range only clear free space up to maxRange
+      float scale = maxRange_mm / sqrtf(r2);
+      end[0] *= scale; end[1] *= scale; end[2] *= scale;
+      hit = false;
+    }
+    end[0] += origin[0]; end[1] += origin[1]; end[2] += origin[2];
+    castRay(origin, end, hit);
+    raysInserted++;
+  }
+}
+
+int8_t VoxelMap::getLogOdds(float x, float y, float z)
+{
+  int32_t vx = (int32_t)floorf(x * _invResolution);
+  int32_t vy = (int32_t)floorf(y * _invResolution);
+  int32_t vz = (int32_t)floorf(z * _invResolution);
+  voxel_tile_t * tile = findTile(vx >> VOXELMAP_TILE_BITS, vy >> VOXELMAP_TILE_BITS, vz >> VOXELMAP_TILE_BITS, false);
+  if (!tile) return 0;
+  const int32_t m = VOXELMAP_TILE_DIM - 1;
+  return tile->logodds[((vz & m) << (2 * VOXELMAP_TILE_BITS)) | ((vy & m) << VOXELMAP_TILE_BITS) | (vx & m)];
+}
+
+bool VoxelMap::isOccupied(float x, float y, float z)
+{
+  return getLogOdds(x, y, z) > VOXELMAP_OCCUPIED;
+}
@@ -0,0 +1,91 @@
+/* Tiled sparse occupancy map for the IMU-stabilised lidar points
+
+  Space is divided into tiles of 8 x 8 x 8 voxels. Tiles are allocated on first touch from a fixed pool
+  and found through a small open-addressing hash of their integer coordinates, so nothing is allocated at
+  run time and a tile's 512 voxels sit in one contiguous 512 byte block.
+
+  Each voxel holds a saturating int8 log-odds value. insertScan() casts one 3D DDA ray per point from the
+  sensor origin: every voxel crossed gets a miss, the end voxel gets a hit. The walk keeps a pointer to the
+  current tile and only goes back to the hash when it crosses a tile boundary.
+*/
+
+#ifndef VoxelMap_h
+#define VoxelMap_h
+
+#include "Arduino.h"
+
+#ifndef VOXELMAP_MAX_TILES
+#define VOXELMAP_MAX_TILES   48       // 512 bytes each, at most 127
+#endif
+#ifndef VOXELMAP_HASH_SIZE
+#define VOXELMAP_HASH_SIZE   128      // power of two, at least twice VOXELMAP_MAX_TILES
+#endif
+#if VOXELMAP_MAX_TILES > 127
+#error "VoxelMap tile indices are stored as int8_t"
+#endif
+#define VOXELMAP_TILE_BITS   3
+#define VOXELMAP_TILE_DIM    (1 << VOXELMAP_TILE_BITS)
+#define VOXELMAP_TILE_VOXELS (VOXELMAP_TILE_DIM * VOXELMAP_TILE_DIM * VOXELMAP_TILE_DIM)
+
+#define VOXELMAP_LOGODDS_HIT       6  // about +0.85 in natural log-odds at the 1/7 scale used here
+#define VOXELMAP_LOGODDS_MISS     -2
+#define VOXELMAP_LOGODDS_MAX      64
+#define VOXELMAP_LOGODDS_MIN     -64
+#define VOXELMAP_OCCUPIED          8
+
+// Amanatides-Woo traversal from one point to another, in voxel units: steps voxels are crossed starting at
+// v, each step() moves to the next, and e is the voxel the ray ends in
+struct VoxelRay {
+  void begin(const float * from, const float * to);
+  inline void step() {
+    uint8_t k = (tMax[0] < tMax[1]) ? ((tMax[0] < tMax[2]) ? 0 : 2) : ((tMax[1] < tMax[2]) ? 1 : 2);
+    v[k] += s[k];
+    tMax[k] += tDelta[k];
+  }
+
+  int32_t v[3], e[3];
+  uint32_t steps;
+
+  private:
+    int32_t s[3];
+    float tMax[3], tDelta[3];
+};
+
+struct voxel_tile_t {
+  int16_t tx, ty, tz;
+  int8_t  logodds[VOXELMAP_TILE_VOXELS];
+};
+
+class VoxelMap
+{
+  public:
+    VoxelMap(float resolution_mm);
+
+    void clear();
+
+    // Insert one sweep of points (mm, already rotated by the platform attitude) seen from origin (mm)
+    void insertScan(const float * x, const float * y, const float * z, uint16_t n, const float * origin, float maxRange_mm);
+
+    int8_t getLogOdds(float x, float y, float z);
+    bool isOccupied(float x, float y, float z);
+
+    uint16_t tilesUsed();
+    float bytesPerCubicMetre();   // pool memory over the volume covered by allocated tiles
+
+    float resolution;             // voxel edge in mm
+    uint32_t raysInserted;
+    uint32_t voxelsUpdated;
+    uint32_t droppedUpdates;      // voxels not stored because the tile pool is full
+
+  private:
+    voxel_tile_t _tiles[VOXELMAP_MAX_TILES];
+    int8_t _hash[VOXELMAP_HASH_SIZE];
+    uint16_t _tilesUsed;
+    float _invResolution;
+
+    voxel_tile_t * findTile(int16_t tx, int16_t ty, int16_t tz, bool create);
+    void castRay(const float * from, const float * to, bool hit);
+    void updateVoxel(voxel_tile_t *&tile, int32_t vx, int32_t vy, int32_t vz, int8_t delta);
+};
+
+#endif
@@ -339,7 +339,14 @@ int myLed     = 13;  // LED on the Teensy 3.1
 uint16_t Pcal[8];         // calibration constants from MS5637 PROM registers
 unsigned char nCRC;       // calculated check sum to ensure PROM integrity
 uint32_t D1 = 0, D2 = 0;  // raw MS5637 pressure and temperature data
-double dT, OFFSET, SENS, T2, OFFSET2, SENS2;  // First order and second order corrections for raw S5637 temperature and pressure data
+int64_t OFFSET, SENS;     // offset and sensitivity at the latest temperature, second order corrections included
+// Pass-through reads never wait on a conversion: MS5637Update() starts one and returns, and on a later pass reads
+// the result and starts the next. Temperature moves slowly, so it is only converted every few pressures.
+#define MS5637_PRESSURES_PER_TEMPERATURE 4
+uint8_t MS5637Converting = 0;    // ADC_D1 or ADC_D2 while a conversion runs, 0 before the first
+uint8_t MS5637SinceTemperature = 0;
+bool MS5637HaveTemperature = false;
+uint32_t MS5637Start_us = 0;
 
 // MPU9250 variables
 int16_t accelCount[3];  // Stores the 16-bit signed accelerometer sensor output
@@ -854,6 +861,8 @@ void loop()
 //    my *= magScale[1];
 //    mz *= magScale[2]; 
  //   }
+
+    MS5637Update(micros());  // harvests a finished conversion into Pressure and Temperature, starts the next
   } 
  
  
@@ -911,39 +920,7 @@ void loop()
    // Print temperature in degrees Centigrade      
 //   Serial.print("Gyro temperature is ");  Serial.print(temperature, 1);  Serial.println(" degrees C"); // Print T values to tenths of s degree C
  
-    D1 = MS5637Read(ADC_D1, OSR);  // get raw pressure value
-    D2 = MS5637Read(ADC_D2, OSR);  // get raw temperature value
-    dT = D2 - Pcal[5]*pow(2,8);    // calculate temperature difference from reference
-    OFFSET = Pcal[2]*pow(2, 17) + dT*Pcal[4]/pow(2,6);
-    SENS = Pcal[1]*pow(2,16) + dT*Pcal[3]/pow(2,7);
- 
-    Temperature = (2000 + (dT*Pcal[6])/pow(2, 23))/100;           // First-order Temperature in degrees Centigrade
-//
-// Second order corrections
-    if(Temperature > 20) 
-    {
-      T2 = 5*dT*dT/pow(2, 38); // correction for high temperatures
-      OFFSET2 = 0;
-      SENS2 = 0;
-    }
-    if(Temperature < 20)                   // correction for low temperature
-    {
-      T2      = 3*dT*dT/pow(2, 33); 
-      OFFSET2 = 61*(100*Temperature - 2000)*(100*Temperature - 2000)/16;
-      SENS2   = 29*(100*Temperature - 2000)*(100*Temperature - 2000)/16;
-    } 
-    if(Temperature < -15)                      // correction for very low temperature
-    {
-      OFFSET2 = OFFSET2 + 17*(100*Temperature + 1500)*(100*Temperature + 1500);
-      SENS2 = SENS2 + 9*(100*Temperature + 1500)*(100*Temperature + 1500);
-    }
- // End of second order corrections
- //
-     Temperature = Temperature - T2/100;
-     OFFSET = OFFSET - OFFSET2;
-     SENS = SENS - SENS2;
- 
-     Pressure = (((D1*SENS)/pow(2, 21) - OFFSET)/pow(2, 15))/100;  // Pressure in mbar or kPa
+    // Pressure and Temperature come from MS5637Update() on every pass
 
    }
     
@@ -1770,34 +1747,95 @@ void SENtralPassThroughMode()
         }
         }
 
-        uint32_t MS5637Read(uint8_t CMD, uint8_t OSR)  // temperature data read
+        // Conversion times are the datasheet maxima with about 10% margin
+        uint32_t MS5637ConversionTime(uint8_t OSR)
         {
-        uint8_t data[3] = {0,0,0};
-        Wire.beginTransmission(MS5637_ADDRESS);  // Initialize the Tx buffer
-        Wire.write(CMD | OSR);                  // Put pressure conversion command in Tx buffer
-        Wire.endTransmission(I2C_NOSTOP);        // Send the Tx buffer, but send a restart to keep connection alive
-        
         switch (OSR)
         {
-          case ADC_256: delay(1); break;  // delay for conversion to complete
-          case ADC_512: delay(3); break;
-          case ADC_1024: delay(4); break;
-          case ADC_2048: delay(6); break;
-          case ADC_4096: delay(10); break;
-          case ADC_8192: delay(20); break;
+          case ADC_256:  return 600;
+          case ADC_512:  return 1170;
+          case ADC_1024: return 2290;
+          case ADC_2048: return 4550;
+          case ADC_4096: return 9050;
+          default:       return 18090;
         }
-       
+        }
+
+        void MS5637StartConversion(uint8_t CMD, uint32_t now_us)
+        {
+        Wire.beginTransmission(MS5637_ADDRESS);  // Initialize the Tx buffer
+        Wire.write(CMD | OSR);                   // Put conversion command in Tx buffer
+        Wire.endTransmission();                  // Send the Tx buffer
+        MS5637Converting = CMD;
+        MS5637Start_us = now_us;
+        }
+
+        uint32_t MS5637ReadADC()
+        {
+        uint8_t data[3] = {0,0,0};
         Wire.beginTransmission(MS5637_ADDRESS);  // Initialize the Tx buffer
-        Wire.write(0x00);                        // Put ADC read command in Tx buffer
+        Wire.write(MS5637_ADC_READ);             // Put ADC read command in Tx buffer
         Wire.endTransmission(I2C_NOSTOP);        // Send the Tx buffer, but send a restart to keep connection alive
   uint8_t i = 0;
         Wire.requestFrom(MS5637_ADDRESS, 3);     // Read three bytes from slave PROM address 
   while (Wire.available()) {
         data[i++] = Wire.read(); }               // Put read results in the Rx buffer
-        return (uint32_t) (((uint32_t) data[0] << 16) | (uint32_t) data[1] << 8 | data[2]); // construct PROM data for return to main program
+        return (uint32_t) (((uint32_t) data[0] << 16) | (uint32_t) data[1] << 8 | data[2]);
+        }
+
+        // First and second order temperature compensation from the datasheet, in integers, once per temperature
+        void MS5637Compensate()
+        {
+        int64_t dT = (int64_t)D2 - ((int64_t)Pcal[5] << 8);
+        int64_t TEMP = 2000 + ((dT * Pcal[6]) >> 23);
+        int64_t OFF = ((int64_t)Pcal[2] << 17) + ((dT * Pcal[4]) >> 6);
+        int64_t SNS = ((int64_t)Pcal[1] << 16) + ((dT * Pcal[3]) >> 7);
+        int64_t T2, OFF2 = 0, SENS2 = 0;
+        if(TEMP < 2000) {                        // correction for low temperature
+          T2 = (3 * dT * dT) >> 33;
+          OFF2 = 61 * (TEMP - 2000) * (TEMP - 2000) / 16;
+          SENS2 = 29 * (TEMP - 2000) * (TEMP - 2000) / 16;
+          if(TEMP < -1500) {                     // correction for very low temperature
+            OFF2 += 17 * (TEMP + 1500) * (TEMP + 1500);
+            SENS2 += 9 * (TEMP + 1500) * (TEMP + 1500);
+          }
+        }
+        else T2 = (5 * dT * dT) >> 38;           // correction for high temperature
+        Temperature = (double)(TEMP - T2) / 100.0;
+        OFFSET = OFF - OFF2;
+        SENS = SNS - SENS2;
         }
 
+        // Call on every pass; true when Pressure has a new sample
+        bool MS5637Update(uint32_t now_us)
+        {
+        if(MS5637Converting == 0) {
+          MS5637StartConversion(ADC_D2, now_us);  // temperature first, pressure needs it
+          return false;
+        }
+        if(now_us - MS5637Start_us < MS5637ConversionTime(OSR)) return false;
 
+        bool newPressure = false;
+        uint32_t raw = MS5637ReadADC();
+        if(raw == 0) {
+          // no conversion completed, start over
+        }
+        else if(MS5637Converting == ADC_D2) {
+          D2 = raw;
+          MS5637Compensate();
+          MS5637HaveTemperature = true;
+          MS5637SinceTemperature = 0;
+        }
+        else if(MS5637HaveTemperature) {
+          D1 = raw;
+          Pressure = (double)((((int64_t)D1 * SENS >> 21) - OFFSET) >> 15) / 100.0;  // Pressure in mbar
+          MS5637SinceTemperature++;
+          newPressure = true;
+        }
+        bool needTemperature = !MS5637HaveTemperature || MS5637SinceTemperature >= MS5637_PRESSURES_PER_TEMPERATURE;
+        MS5637StartConversion(needTemperature ? ADC_D2 : ADC_D1, now_us);  // keep the sensor converting
+        return newPressure;
+        }
 
 unsigned char MS5637checkCRC(uint16_t * n_prom)  // calculate checksum from PROM register contents
 {
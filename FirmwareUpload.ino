@@ -67,6 +67,16 @@
 #define EM7180_ADDRESS      0x28   // Address of the EM7180 SENtral sensor hub#define M24512DFM_DATA_ADDRESS   0x50   // Address of the 500 page M24512DFM EEPROM data buffer, 1024 bits (128 8-bit bytes) per page
 #define M24512DFM_DATA_ADDRESS   0x50   // Address of the 500 page M24512DFM EEPROM data buffer, 1024 bits (128 8-bit bytes) per page
 #define M24512DFM_IDPAGE_ADDRESS 0x58   // Address of the single M24512DFM lockable EEPROM ID page
+#define M24512DFM_PAGE_SIZE      128    // bytes per page write
+#define M24512DFM_PAGES          512    // 64 kB
+#define M24512DFM_WRITE_TIMEOUT  20     // ms to wait for a write cycle to finish, the datasheet maximum is 5 ms
+#define M24512DFM_READ_CHUNK     256    // bytes per read request, fits the i2c_t3 receive buffer
+#define M24512DFM_IMAGE_END      0x7E00 // WarmStartandAccelCal keeps its warm start store and flight recorder from here up
+#define SD_CHUNK                 1024   // bytes per SD card read, eight EEPROM pages
+
+bool differentialFlash = true;          // only write pages that differ from the image, and skip the erase
+uint16_t pagesSkipped, pagesWritten, pagesVerified;
+uint32_t imageCRC;                      // of the file as read from the SD card
 
 SdFat SD;
 SdFile sd_file;
@@ -93,13 +103,22 @@ void setup() {
   
   I2Cscan();
   
+  crc32Init();
   sd_file.open("/EM6500.fw", O_RDONLY);  
   Serial.println("File Open!");
   
-  uint8_t buffer[128];
-  uint8_t numbytes= 0, MSadd = 0, totnum = 0;
+  uint16_t page;
+  uint32_t imageSize = sd_file.fileSize();
+  if (imageSize > M24512DFM_IMAGE_END) {
+    Serial.print("WARNING! the image runs past 0x"); Serial.print(M24512DFM_IMAGE_END, HEX);
+    Serial.println(" and will overwrite the warm start store and flight recorder");
+  }
 
-   Serial.println("erasing EEPROM");
+   if (!differentialFlash) {
+   // Only the pages the image will cover, the warm start store and flight recorder above it are kept
+   uint16_t erasePages = (imageSize + M24512DFM_PAGE_SIZE - 1) / M24512DFM_PAGE_SIZE;
+   if (erasePages > M24512DFM_PAGES) erasePages = M24512DFM_PAGES;
+   Serial.print("erasing EEPROM up to 0x"); Serial.println((uint32_t) erasePages * M24512DFM_PAGE_SIZE, HEX);
      uint8_t eraseBuffer[128] = {
        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 
        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 
@@ -110,16 +129,15 @@ void setup() {
        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 
        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
        
-   for (MSadd = 0; MSadd < 256; MSadd++) {          // MS address byte, 0 to 255
-     M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, MSadd, 0x00, 128, eraseBuffer); // write data starting at first byte of page MSadd
-     delay(100);
-     M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, MSadd, 0x80, 128, eraseBuffer); // write data starting at 128th byte of page MSadd
-     delay(100);
-
-     totnum++;
-     if (MSadd = 255) { break; }
-     Serial.print("totnum"); Serial.println(totnum);
-     Serial.print("MSadd 0x"); Serial.println(MSadd, HEX);
+   uint32_t start = millis();
+   for (page = 0; page < erasePages; page++) {
+     M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, page >> 1, (page & 0x01) << 7, M24512DFM_PAGE_SIZE, eraseBuffer); // write one 128-byte page
+     if (!M24512DFMwaitReady(M24512DFM_DATA_ADDRESS)) {                                  // poll until the write cycle is over
+       Serial.print("EEPROM erase timed out at page "); Serial.println(page);
+       break;
+     }
+   }
+   Serial.print("erase took "); Serial.print(millis() - start); Serial.println(" ms");
    }
    
    // Verify EEPROM ihas been erased
@@ -162,23 +180,20 @@ void setup() {
    
    // write configuration file to EEPROM
       Serial.println("writing data to EEPROM");
-   for (MSadd = 0; MSadd < 256; MSadd++) {          // MS address byte, 0 to 255
-     numbytes = sd_file.read(buffer, 128); // 128 bytes per page, 500 pages
-     Serial.print("first two bytes: "); Serial.print("0x"); Serial.print(buffer[0], HEX); Serial.print("0x"); Serial.println(buffer[1], HEX);
-     Serial.print("Number of bytes = "); Serial.println(numbytes);  // print number of bytes read
-     M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, MSadd, 0x00, 128, buffer); // write data starting at first byte of page MSadd
-     delay(100);
-     numbytes = sd_file.read(buffer, 128); // 128 bytes per page, 500 pages
-     Serial.print("first two bytes: "); Serial.print("0x"); Serial.print(buffer[0], HEX); Serial.print("0x"); Serial.println(buffer[1], HEX);
-     Serial.print("Number of bytes = "); Serial.println(numbytes);  // print number of bytes read
-     M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, MSadd, 0x80, 128, buffer); // write data starting at 128th byte of page MSadd
-     delay(100);
-
-     if (numbytes < 128) { break; }
-     totnum++;
-     Serial.print("totnum"); Serial.println(totnum);
-     Serial.print("MSadd 0x"); Serial.println(MSadd, HEX);
-   }
+   uint32_t start = millis();
+   uint32_t written = M24512DFMprogram(M24512DFM_DATA_ADDRESS, sd_file, differentialFlash);
+   Serial.print("wrote "); Serial.print(written); Serial.print(" bytes in "); Serial.print(millis() - start); Serial.println(" ms");
+   Serial.print("pages skipped "); Serial.print(pagesSkipped); Serial.print(", written "); Serial.print(pagesWritten);
+   if (differentialFlash) { Serial.print(", verified "); Serial.print(pagesVerified); }
+   Serial.println("");
+
+   // Verify the whole programmed region against the file
+   start = millis();
+   uint32_t eepromCRC = M24512DFMcrc(M24512DFM_DATA_ADDRESS, written);
+   Serial.print("verify took "); Serial.print(millis() - start); Serial.println(" ms");
+   Serial.print("file CRC 0x"); Serial.print(imageCRC, HEX); Serial.print(", EEPROM CRC 0x"); Serial.println(eepromCRC, HEX);
+   if (eepromCRC == imageCRC) Serial.println("EEPROM image verified");
+   else Serial.println("ERROR! EEPROM image does not match the file!");
 
   
   // Read first page of EEPROM
@@ -325,20 +340,160 @@ void SENtralPassThroughMode()
 	return data;                             // Return data read from slave register
 }
 
-        void M24512DFMreadBytes(uint8_t device_address, uint8_t data_address1, uint8_t data_address2, uint8_t count, uint8_t * dest)
+        void M24512DFMreadBytes(uint8_t device_address, uint8_t data_address1, uint8_t data_address2, uint16_t count, uint8_t * dest)
 {  
 	Wire.beginTransmission(device_address);   // Initialize the Tx buffer
 	Wire.write(data_address1);                     // Put slave register address in Tx buffer
 	Wire.write(data_address2);                     // Put slave register address in Tx buffer
 	Wire.endTransmission(I2C_NOSTOP);         // Send the Tx buffer, but send a restart to keep connection alive
 //	Wire.endTransmission(false);              // Send the Tx buffer, but send a restart to keep connection alive
-	uint8_t i = 0;
+	uint16_t i = 0;
 //        Wire.requestFrom(address, count);       // Read bytes from slave register address 
         Wire.requestFrom(device_address, (size_t) count);  // Read bytes from slave register address 
 	while (Wire.available()) {
         dest[i++] = Wire.read(); }                // Put read results in the Rx buffer
 }
 
+// After a write the M24512DFM does not acknowledge its address until the internal write cycle has finished,
+// so poll for the ACK instead of waiting a fixed worst-case delay
+        bool M24512DFMwaitReady(uint8_t device_address)
+{
+        uint32_t start = millis();
+        while (true) {
+          Wire.beginTransmission(device_address);
+          if (Wire.endTransmission() == 0) return true;                 // acknowledged, ready for the next command
+          if (millis() - start > M24512DFM_WRITE_TIMEOUT) return false;
+        }
+}
+
+// Current address read: carries on from where the last read or write left the EEPROM's address counter,
+// so a long sequential read needs no address phase or restart between requests. Returns the number of bytes read.
+        uint16_t M24512DFMreadCurrent(uint8_t device_address, uint16_t count, uint8_t * dest)
+{
+        uint16_t i = 0;
+        Wire.requestFrom(device_address, (size_t) count);  // Read bytes from the current address
+        while (Wire.available()) {
+        dest[i++] = Wire.read(); }                         // Put read results in the Rx buffer
+        return i;
+}
+
+// Reads count bytes (up to the whole 64 kB) from address on. Only the first request sends the address, the rest
+// are current address reads of M24512DFM_READ_CHUNK bytes, so the EEPROM stays in one sequential read (wrapping
+// from 0xFFFF to 0x0000 as the device does). Returns the number of bytes read.
+        uint32_t M24512DFMreadRange(uint8_t device_address, uint16_t address, uint32_t count, uint8_t * dest)
+{
+        uint32_t done = 0;
+        if (count > 0x10000) count = 0x10000;
+        while (done < count) {
+          uint16_t n = (count - done < M24512DFM_READ_CHUNK) ? count - done : M24512DFM_READ_CHUNK;
+          if (done == 0) {
+            Wire.beginTransmission(device_address);
+            Wire.write(address >> 8);
+            Wire.write(address & 0xFF);
+            Wire.endTransmission(I2C_NOSTOP);   // restart straight into the first read
+          }
+          uint16_t got = M24512DFMreadCurrent(device_address, n, &dest[done]);
+          done += got;
+          if (got < n) break;                   // NACKed, e.g. in the middle of a write cycle
+        }
+        return done;
+}
+
+// Standard reflected CRC-32 (polynomial 0xEDB88320), one table lookup per byte
+uint32_t crcTable[256];
+
+        void crc32Init()
+{
+        for (uint16_t i = 0; i < 256; i++) {
+          uint32_t c = i;
+          for (uint8_t k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+          crcTable[i] = c;
+        }
+}
+
+// Start from 0xFFFFFFFF and invert the final value
+        uint32_t crc32Update(uint32_t crc, const uint8_t * data, uint16_t count)
+{
+        while (count--) crc = crcTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        return crc;
+}
+
+// CRC-32 of count bytes from address 0, streamed back with one sequential read
+        uint32_t M24512DFMcrc(uint8_t device_address, uint32_t count)
+{
+        static uint8_t block[M24512DFM_READ_CHUNK];
+        uint32_t crc = 0xFFFFFFFFUL;
+        bool first = true;
+        while (count) {
+          uint16_t n = count < M24512DFM_READ_CHUNK ? count : M24512DFM_READ_CHUNK;
+          if (first) M24512DFMreadBytes(device_address, 0x00, 0x00, n, block);
+          else M24512DFMreadCurrent(device_address, n, block);
+          first = false;
+          crc = crc32Update(crc, block, n);
+          count -= n;
+        }
+        return ~crc;
+}
+
+// Stream an open file into the EEPROM from address 0. The file is read SD_CHUNK bytes at a time; each page
+// write is issued and the next page is made ready (refilling the buffer from the SD card when it runs out)
+// while the EEPROM commits, and only then is the EEPROM polled for the end of the write cycle.
+// With differential set, the EEPROM range under each chunk is read back first and only pages that differ
+// from the image are written; written pages are then read back once more and checked.
+// Returns the number of bytes of the image covered, and counts pages in pagesSkipped/Written/Verified.
+// The CRC-32 of the file as read from the SD card is left in imageCRC.
+        uint32_t M24512DFMprogram(uint8_t device_address, SdFile & file, bool differential)
+{
+        static uint8_t chunk[SD_CHUNK], current[SD_CHUNK];
+        int16_t len = file.read(chunk, SD_CHUNK);
+        uint32_t address = 0;
+        bool busy = false;
+        
+        pagesSkipped = pagesWritten = pagesVerified = 0;
+        imageCRC = 0xFFFFFFFFUL;
+        while (len > 0 && address < (uint32_t) M24512DFM_PAGES * M24512DFM_PAGE_SIZE) {
+          if (differential) {
+            if (busy && !M24512DFMwaitReady(device_address)) break;
+            busy = false;
+            M24512DFMreadRange(device_address, address, len, current);
+          }
+          uint8_t pages = 0, written = 0;                                // bit per page of this chunk
+          for (int16_t pos = 0; pos < len; pos += M24512DFM_PAGE_SIZE, pages++) {
+            uint8_t count = (len - pos < M24512DFM_PAGE_SIZE) ? len - pos : M24512DFM_PAGE_SIZE; // only the last page is short
+            if (differential && !memcmp(&chunk[pos], &current[pos], count)) {
+              pagesSkipped++;
+              continue;
+            }
+            if (busy && !M24512DFMwaitReady(device_address)) {
+              Serial.print("EEPROM write timed out at 0x"); Serial.println(address + pos, HEX);
+              return address + pos;
+            }
+            M24512DFMwriteBytes(device_address, (address + pos) >> 8, (address + pos) & 0xFF, count, &chunk[pos]);
+            busy = true;
+            written |= 1 << pages;
+            pagesWritten++;
+          }
+          if (differential && written) {                                 // read back what was written
+            if (!M24512DFMwaitReady(device_address)) break;
+            busy = false;
+            M24512DFMreadRange(device_address, address, len, current);
+            for (uint8_t i = 0; i < pages; i++) {
+              if (!(written & (1 << i))) continue;
+              int16_t pos = i * M24512DFM_PAGE_SIZE;
+              uint8_t count = (len - pos < M24512DFM_PAGE_SIZE) ? len - pos : M24512DFM_PAGE_SIZE;
+              if (!memcmp(&chunk[pos], &current[pos], count)) pagesVerified++;
+              else { Serial.print("EEPROM verify failed at 0x"); Serial.println(address + pos, HEX); }
+            }
+          }
+          imageCRC = crc32Update(imageCRC, chunk, len);
+          address += len;
+          len = file.read(chunk, SD_CHUNK);                              // refill while the last page commits
+        }
+        imageCRC = ~imageCRC;
+        if (busy) M24512DFMwaitReady(device_address);
+        return address;
+}
+
 // simple function to scan for I2C devices on the bus
 void I2Cscan() 
 {
@@ -260,6 +260,7 @@
 #define EM7180_ADDRESS           0x28   // Address of the EM7180 SENtral sensor hub
 #define M24512DFM_DATA_ADDRESS   0x50   // Address of the 500 page M24512DRC EEPROM data buffer, 1024 bits (128 8-bit bytes) per page
 #define M24512DFM_IDPAGE_ADDRESS 0x58   // Address of the single M24512DRC lockable EEPROM ID page
+#define M24512DFM_READ_CHUNK     256    // bytes per read request, within the i2c_t3 Rx buffer (I2C_RX_BUFFER_LENGTH)
 #define MPU9250_ADDRESS          0x68   // Device address of MPU9250 when ADO = 0
 #define AK8963_ADDRESS           0x0C   // Address of magnetometer
 #define BMP280_ADDRESS           0x76   // Address of BMP280 altimeter when ADO = 0
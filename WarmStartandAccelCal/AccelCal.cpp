@@ -0,0 +1,184 @@
+#include "AccelCal.h"
+
+AccelCal::AccelCal()
+{
+  lsbPerG = 2048.0f;
+  stillThreshold = 0.02f;
+  stillSamples = 50;
+  faceSamples = 200;
+  maxFitError = 0.02f;
+  memset(matrix, 0, sizeof(matrix));
+  memset(misalign, 0, sizeof(misalign));
+  for (uint8_t i = 0; i < 3; i++) {
+    matrix[i][i] = 1.0f / lsbPerG;
+    misalign[i][i] = 1.0f;
+    bias[i] = offset[i] = 0.0f;
+    scale[i] = 1.0f;
+  }
+  fitError = 0.0f;
+  valid = false;
+  reset();
+}
+
+void AccelCal::reset()
+{
+  memset(_sum, 0, sizeof(_sum));
+  memset(_count, 0, sizeof(_count));
+  faces = 0;
+  _still = 0;
+}
+
+bool AccelCal::add(const int16_t * raw)
+{
+  // Still while every axis stays near the running mean; any movement restarts the mean at this sample
+  float limit = stillThreshold * lsbPerG;
+  bool moved = _still == 0;
+  for (uint8_t i = 0; i < 3; i++)
+    if (fabsf(raw[i] - _mean[i]) > limit) moved = true;
+  if (moved) {
+    for (uint8_t i = 0; i < 3; i++) _mean[i] = raw[i];
+    _still = 1;
+    return false;
+  }
+  for (uint8_t i = 0; i < 3; i++) _mean[i] += (raw[i] - _mean[i]) * 0.125f;
+  if (_still < stillSamples) {
+    _still++;
+    return false;
+  }
+
+  // Gravity within about 6 degrees of one axis and about 1 g long, or the board is not resting on a face. A face
+  // mean further off bends the fit by up to a tenth of a g and can still pass maxFitError. The angle is of the raw counts,
+  // so it also holds the sensor's own offsets and cross-axis coupling, a degree or three on their own
+  uint8_t axis = 0;
+  for (uint8_t i = 1; i < 3; i++)
+    if (fabsf(_mean[i]) > fabsf(_mean[axis])) axis = i;
+  float n2 = _mean[0] * _mean[0] + _mean[1] * _mean[1] + _mean[2] * _mean[2];
+  float g2 = lsbPerG * lsbPerG;
+  if (_mean[axis] * _mean[axis] < 0.99f * n2 || n2 < 0.56f * g2 || n2 > 1.56f * g2) return false;
+
+  uint8_t face = 2 * axis + (_mean[axis] < 0.0f);
+  if (_count[face] >= faceSamples) return false;
+  for (uint8_t i = 0; i < 3; i++) _sum[face][i] += raw[i];
+  if (++_count[face] < faceSamples) return false;
+  faces |= 1 << face;
+  if (faces != 0x3F) return false;
+  if (solve()) return true;
+  reset();                                 // a bad fit; go round the faces again
+  return false;
+}
+
+bool AccelCal::solve()
+{
+  for (uint8_t f = 0; f < 6; f++)
+    if (!_count[f]) return false;
+
+  // Face means in nominal g with a 1 appended, x; each output axis i solves x' w_i = gravity_i over the faces.
+  // All three share the 4 x 4 normal matrix N = sum x x', so one Cholesky serves the three right hand sides.
+  float x[6][4], N[4][4], B[4][3], L[4][4], W[4][3];
+  memset(N, 0, sizeof(N));
+  memset(B, 0, sizeof(B));
+  for (uint8_t f = 0; f < 6; f++) {
+    for (uint8_t j = 0; j < 3; j++) x[f][j] = (float)_sum[f][j] / (_count[f] * lsbPerG);
+    x[f][3] = 1.0f;
+    float g = (f & 1) ? -1.0f : 1.0f;
+    for (uint8_t i = 0; i < 4; i++) {
+      for (uint8_t j = 0; j <= i; j++) N[i][j] += x[f][i] * x[f][j];
+      B[i][f / 2] += x[f][i] * g;
+    }
+  }
+  for (uint8_t i = 0; i < 4; i++) {
+    for (uint8_t j = 0; j <= i; j++) {
+      float sum = N[i][j];
+      for (uint8_t k = 0; k < j; k++) sum -= L[i][k] * L[j][k];
+      if (i == j) {
+        if (sum <= 0.0f) return false;
+        L[i][i] = sqrtf(sum);
+      } else {
+        L[i][j] = sum / L[j][j];
+      }
+    }
+  }
+  for (uint8_t c = 0; c < 3; c++) {
+    for (uint8_t i = 0; i < 4; i++) {
+      float sum = B[i][c];
+      for (uint8_t k = 0; k < i; k++) sum -= L[i][k] * W[k][c];
+      W[i][c] = sum / L[i][i];
+    }
+    for (int8_t i = 3; i >= 0; i--) {
+      float sum = W[i][c];
+      for (uint8_t k = i + 1; k < 4; k++) sum -= L[k][i] * W[k][c];
+      W[i][c] = sum / L[i][i];
+    }
+  }
+
+  float error = 0.0f;
+  for (uint8_t f = 0; f < 6; f++) {
+    for (uint8_t i = 0; i < 3; i++) {
+      float e = W[0][i] * x[f][0] + W[1][i] * x[f][1] + W[2][i] * x[f][2] + W[3][i];
+      if (i == f / 2) e -= (f & 1) ? -1.0f : 1.0f;
+      error += e * e;
+    }
+  }
+  error = sqrtf(error / 18.0f);
+
+  // M, in g per nominal g, and its inverse for the offset
+  float M[3][3];
+  for (uint8_t i = 0; i < 3; i++)
+    for (uint8_t j = 0; j < 3; j++) M[i][j] = W[j][i];
+  float c00 = M[1][1] * M[2][2] - M[1][2] * M[2][1];
+  float c01 = M[1][2] * M[2][0] - M[1][0] * M[2][2];
+  float c02 = M[1][0] * M[2][1] - M[1][1] * M[2][0];
+  float det = M[0][0] * c00 + M[0][1] * c01 + M[0][2] * c02;
+  if (fabsf(det) < 1e-6f) return false;
+  float Mi[3][3] = {{c00, M[0][2] * M[2][1] - M[0][1] * M[2][2], M[0][1] * M[1][2] - M[0][2] * M[1][1]},
+                    {c01, M[0][0] * M[2][2] - M[0][2] * M[2][0], M[0][2] * M[1][0] - M[0][0] * M[1][2]},
+                    {c02, M[0][1] * M[2][0] - M[0][0] * M[2][1], M[0][0] * M[1][1] - M[0][1] * M[1][0]}};
+
+  // A sensor more than 25 % off its nominal sensitivity is broken or set to another range, not miscalibrated
+  for (uint8_t i = 0; i < 3; i++)
+    if (M[i][i] < 0.8f || M[i][i] > 1.25f) return false;
+  if (error > maxFitError) return false;
+
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      matrix[i][j] = M[i][j] / lsbPerG;
+      misalign[i][j] = M[i][j] / M[j][j];
+    }
+    bias[i] = W[3][i];
+    scale[i] = 1.0f / M[i][i];
+  }
+  for (uint8_t i = 0; i < 3; i++)
+    offset[i] = -(Mi[i][0] * bias[0] + Mi[i][1] * bias[1] + Mi[i][2] * bias[2]) / det * lsbPerG;
+  fitError = error;
+  valid = true;
+  return true;
+}
+
+void AccelCal::set(const float m[3][3], const float b[3])
+{
+  memcpy(matrix, m, sizeof(matrix));
+  memcpy(bias, b, sizeof(bias));
+  valid = true;
+}
+
+void AccelCal::apply(const int16_t * raw, float * out)
+{
+  float x = raw[0], y = raw[1], z = raw[2];
+  out[0] = matrix[0][0] * x + matrix[0][1] * y + matrix[0][2] * z + bias[0];
+  out[1] = matrix[1][0] * x + matrix[1][1] * y + matrix[1][2] * z + bias[1];
+  out[2] = matrix[2][0] * x + matrix[2][1] * y + matrix[2][2] * z + bias[2];
+}
+
+int16_t AccelCal::faceMean(uint8_t face, uint8_t axis)
+{
+  if (!_count[face]) return 0;
+  int32_t s = _sum[face][axis];
+  return (s + (s < 0 ? -(int32_t)_count[face] : _count[face]) / 2) / _count[face];
+}
+
+uint8_t AccelCal::facesDone()
+{
+  uint8_t n = 0;
+  for (uint8_t f = 0; f < 6; f++) n += (faces >> f) & 1;
+  return n;
+}
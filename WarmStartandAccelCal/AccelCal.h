@@ -0,0 +1,60 @@
+/* Six-position accelerometer calibration
+
+  The old calibration averaged one axis at a time above or below +-1024 counts, and only ever gave the
+  SENtral a max and a min per axis. Here add() takes every accelerometer sample while the sketch keeps
+  running and finds the still orientations itself: a sample counts once the board has stayed within
+  stillThreshold of a running mean for stillSamples samples, and goes to the face (+X, -X, +Y, -Y, +Z, -Z)
+  that gravity points along. Each face keeps only a count and three integer sums, 84 bytes in all however
+  long the board sits there.
+
+  When all six faces hold faceSamples samples the face means are fitted, by least squares, to gravity along
+  the six axis directions:
+
+      corrected = matrix * raw + bias
+
+  with matrix the full 3 x 3 (scale, misalignment and cross-axis coupling, in g per count) and bias in g. It
+  is the same as misalign * ((raw - offset) / (scale * lsbPerG)), axis by axis inside the brackets and
+  misalign with a unit diagonal, which is how it is reported. apply() is the 9 multiply form.
+*/
+
+#ifndef AccelCal_h
+#define AccelCal_h
+
+#include "Arduino.h"
+
+class AccelCal
+{
+  public:
+    AccelCal();
+
+    void reset();                                    // clears the faces; the last accepted result stays in force
+    bool add(const int16_t * raw);                   // true when this sample completed the six faces and a fit
+    bool solve();
+    void set(const float m[3][3], const float b[3]); // load a stored result
+    void apply(const int16_t * raw, float * out);
+    int16_t faceMean(uint8_t face, uint8_t axis);    // counts, face 2 * axis for +, 2 * axis + 1 for -
+    uint8_t facesDone();
+
+    float matrix[3][3];
+    float bias[3];
+    float offset[3];         // counts
+    float scale[3];          // measured counts per g over lsbPerG, 1 for a perfect sensor
+    float misalign[3][3];
+    float fitError;          // rms residual over the six faces, g
+    uint8_t faces;           // bit per face holding faceSamples samples
+    bool valid;
+
+    float lsbPerG;           // nominal counts per g, default 2048
+    float stillThreshold;    // largest deviation from the running mean that is still, g, default 0.02
+    uint16_t stillSamples;   // still samples before they count, default 50
+    uint16_t faceSamples;    // samples per face, default 200
+    float maxFitError;       // reject solutions above this, g, default 0.02
+
+  private:
+    int32_t _sum[6][3];
+    uint16_t _count[6];
+    float _mean[3];          // running mean, counts
+    uint16_t _still;
+};
+
+#endif
@@ -144,8 +144,8 @@ void setup()
       // Put the Sentral in pass-thru mode
       WS_PassThroughMode();
 
-      // Fetch the WarmStart data from the M24512DFM I2C EEPROM
-      readSenParams();
+      // Fetch the WarmStart data from the M24512DFM I2C EEPROM, don't warm start from a missing or damaged record
+      if(!readSenParams()) warm_start = 0;
 
       // Take Sentral out of pass-thru mode and re-start algorithm
       WS_Resume();
@@ -177,8 +177,8 @@ void setup()
       // Put the Sentral in pass-thru mode
       WS_PassThroughMode();
 
-      // Fetch the WarmStart data from the M24512DFM I2C EEPROM
-      readAccelCal();
+      // Fetch the accelerometer calibration from the M24512DFM I2C EEPROM
+      if(!readAccelCal()) accel_cal = 0;
       Serial.print("X-acc max: "); Serial.println(global_conf.accZero_max[0]);
       Serial.print("Y-acc max: "); Serial.println(global_conf.accZero_max[1]);
       Serial.print("Z-acc max: "); Serial.println(global_conf.accZero_max[2]);
@@ -192,6 +192,14 @@ void setup()
     {
       Serial.println("***No Accel Cal***");
     }
+
+    // Find where the flight recorder log left off
+    WS_PassThroughMode();
+    FR_begin();
+
+    // and the six-position accelerometer correction, if there is one
+    if(readAccelMatrix()) Serial.println("!!!Accel Cal matrix active!!!");
+    WS_Resume();
   }
 
   // Give some time to read the screen
@@ -507,24 +515,28 @@ void loop()
     serial_input = Serial.read();
     if (serial_input == 49)
     {
-      delay(100);
-      EM7180_get_WS_params();
-      
-      // Put the Sentral in pass-thru mode
-      WS_PassThroughMode();
-
-      // Store WarmStart data to the M24512DFM I2C EEPROM
-      writeSenParams();
-
-      // Take Sentral out of pass-thru mode and re-start algorithm
-      WS_Resume();
-      warm_start_saved = 1;
+      // Store WarmStart data to the M24512DFM I2C EEPROM, fetched in the background over the next few passes
+      WS_checkpointStart(true);
     }
     if (serial_input == 50)
     {
-      calibratingA = 512;
+      // Start (or start over) a six-position accelerometer calibration
+      accelCal.reset();
+      accel_cal_saved = 0;
+      calibratingA = 1;
+    }
+    if (serial_input == 51)
+    {
+      // Dump the flight recorder log, at the next FR_task() with no warm start transfer running
+      FR_dumpNow = true;
     }
       
+    // Advance a warm start checkpoint if one is running
+    WS_checkpointTask();
+
+    // Push a logged error out to the EEPROM
+    FR_task();
+
     // Check event status register, way to chech data ready by polling rather than interrupt
     uint8_t eventStatus = readByte(EM7180_ADDRESS, EM7180_EventStatus); // reading clears the register
   
@@ -533,6 +545,7 @@ void loop()
     if(eventStatus & 0x02)
     { 
       uint8_t errorStatus = readByte(EM7180_ADDRESS, EM7180_ErrorRegister);
+      if(errorStatus) FR_logError(errorStatus);
       if(!errorStatus)
       {
         Serial.print(" EM7180 sensor status = "); Serial.println(errorStatus);
@@ -560,6 +573,14 @@ void loop()
        
       // Manages accelerometer calibration; is active when calibratingA > 0
       Accel_cal_check();
+
+      // Six-position correction of scale, offset and misalignment
+      if(accelCal.valid)
+      {
+        float a[3];
+        accelCal.apply(accelCount, a);
+        ax = a[0]; ay = a[1]; az = a[2];
+      }
     }
   
     if(eventStatus & 0x20)
@@ -587,6 +608,7 @@ void loop()
     if(eventStatus & 0x04)
     {
       readSENtralQuatData(Quat);
+      FR_logPose(Quat[3], Quat[0], Quat[1], Quat[2]);
     }
 
     // get BMP280 pressure
@@ -676,6 +698,15 @@ void loop()
         Serial.print(" Qy = "); Serial.print(Quat[2]); 
         Serial.print(" Qz = "); Serial.println(Quat[3]); 
       }               
+      if(!passThru)
+      {
+        // Checkpoint the warm start parameters when the SENtral reports a finished mag calibration, and now and
+        // then in case they have moved on since, but never while the calibration is unsettled (CalStable clear)
+        uint8_t algoStatus = readByte(EM7180_ADDRESS, EM7180_AlgorithmStatus);
+        if((algoStatus & 0x08) && (!(WS_algoStatus & 0x08) || millis() - WS_cpLast > WS_CP_INTERVAL)) WS_checkpointStart(false);
+        WS_algoStatus = algoStatus;
+        FR_logStatus(readByte(EM7180_ADDRESS, EM7180_SensorStatus), algoStatus);
+      }
       if(passThru)
       {
         rawPress =  readBMP280Pressure();
@@ -756,13 +787,15 @@ void loop()
           {
             Serial.println("Send '1' to store Warm Start configuration");
           }
-          if(accel_cal_saved > 0)
+          if(calibratingA > 0)
           {
-            Serial.print("Accel Cals Complete:"); Serial.println(accel_cal_saved);
+            Serial.print("Accel Cal faces complete: "); Serial.print(accel_cal_saved); Serial.println(" of 6");
           } else
           {
-            Serial.println("Send '2' to store Accel Cal");
+            if(accelCal.valid) Serial.println("Accel Cal matrix active");
+            Serial.println("Send '2' to start Accel Cal, then rest the board still on each of its six faces");
           }
+          Serial.println("Send '3' to dump the flight recorder log");
         }
       }
       Serial.print(millis()/1000.0, 1);Serial.print(",");
@@ -1066,17 +1099,24 @@ void WS_PassThroughMode()
   
   // First put SENtral in standby mode
   writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x01);
-  delay(5);
+  stat = readByte(EM7180_ADDRESS, EM7180_AlgorithmStatus);
+  while(!(stat & 0x01))
+  {
+    delay(1);
+    stat = readByte(EM7180_ADDRESS, EM7180_AlgorithmStatus);
+  }
   
   // Place SENtral in pass-through mode
   writeByte(EM7180_ADDRESS, EM7180_PassThruControl, 0x01);
-  delay(5);
   stat = readByte(EM7180_ADDRESS, EM7180_PassThruStatus);
   while(!(stat & 0x01))
   {
+    delay(1);
     stat = readByte(EM7180_ADDRESS, EM7180_PassThruStatus);
-    delay(5);
   }
+
+  // A flight recorder page may still be committing
+  M24512DFMwaitReady(M24512DFM_DATA_ADDRESS);
 }
 
 void WS_Resume()
@@ -1085,139 +1125,545 @@ void WS_Resume()
   
   // Cancel pass-through mode
   writeByte(EM7180_ADDRESS, EM7180_PassThruControl, 0x00);
-  delay(5);
   stat = readByte(EM7180_ADDRESS, EM7180_PassThruStatus);
   while((stat & 0x01))
   {
+    delay(1);
     stat = readByte(EM7180_ADDRESS, EM7180_PassThruStatus);
-    delay(5);
   }
 
   // Re-start algorithm
   writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x00);
-  delay(5);
   stat = readByte(EM7180_ADDRESS, EM7180_AlgorithmStatus);
   while((stat & 0x01))
   {
+    delay(1);
     stat = readByte(EM7180_ADDRESS, EM7180_AlgorithmStatus);
-    delay(5);
   }
 }
 
-void readSenParams()
+// Starts a background checkpoint of the warm start parameters: WS_checkpointTask() then fetches them a few per
+// loop() pass while fusion carries on, and only stops the SENtral (pass-through) for the EEPROM commit itself.
+// Unless forced, nothing is written when the parameters match the stored record.
+void WS_checkpointStart(bool force)
 {
-  uint8_t data[140];
-  uint8_t paramnum;
-  M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, 0x7f, 0x80, 12, &data[128]); // Page 255
-  delay(100);
-  M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, 0x7f, 0x00, 128, &data[0]); // Page 254
-  for (paramnum = 0; paramnum < 35; paramnum++) // 35 parameters
+  if(force) WS_cpForce = true;
+  WS_cpLast = millis();
+  if(WS_cpState != WS_CP_IDLE || calibratingA > 0) return;
+
+  WS_cpParam = 1;
+  writeByte(EM7180_ADDRESS, EM7180_ParamRequest, WS_cpParam);
+  writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x80); // Request parameter transfer procedure
+  WS_cpState = WS_CP_FETCH;
+  WS_cpBegan = millis();
+}
+
+void WS_checkpointTask()
+{
+  if(WS_cpState == WS_CP_FETCH)
+  {
+    // A SENtral that stops acknowledging would otherwise hold the transfer, and the flight recorder, forever
+    if(millis() - WS_cpBegan > WS_CP_TIMEOUT)
+    {
+      writeByte(EM7180_ADDRESS, EM7180_ParamRequest, 0x00);
+      writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x00);
+      WS_cpState = WS_CP_IDLE;
+      Serial.print("Warm Start checkpoint timed out at parameter "); Serial.println(WS_cpParam);
+      return;
+    }
+    for(uint8_t n = 0; n < WS_CP_PARAMS_PER_LOOP; n++)
+    {
+      // Not acknowledged yet, look again next pass rather than wait here
+      if(readByte(EM7180_ADDRESS, EM7180_ParamAcknowledge) != WS_cpParam) return;
+      readBytes(EM7180_ADDRESS, EM7180_SavedParamByte0, 4, WS_cpParams.Sen_param[WS_cpParam - 1]);
+      if(WS_cpParam == 35)
+      {
+        // Parameter request = 0 to end parameter transfer process
+        writeByte(EM7180_ADDRESS, EM7180_ParamRequest, 0x00);
+        writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x00);
+        WS_cpState = WS_CP_COMMIT;
+        return;
+      }
+      WS_cpParam++;
+      writeByte(EM7180_ADDRESS, EM7180_ParamRequest, WS_cpParam);
+    }
+  }
+  else if(WS_cpState == WS_CP_COMMIT)
   {
-    for (uint8_t i= 0; i < 4; i++)
+    WS_cpState = WS_CP_IDLE;
+    if(!WS_cpForce && WS_storeSlot && (WS_storeCache.flags & WS_STORE_HAS_PARAMS) &&
+       !memcmp(&WS_cpParams, &WS_storeCache.params, sizeof(WS_cpParams))) return;
+    WS_cpForce = false;
+
+    WS_PassThroughMode();
+    bool saved = WS_storeCommit(&WS_cpParams, NULL, NULL);
+    WS_Resume();
+    if(saved)
     {
-      WS_params.Sen_param[paramnum][i] = data[(paramnum*4 + i)];
+      WS_params = WS_cpParams;
+      warm_start_saved = 1;
+    } else
+    {
+      Serial.println("Warm Start save failed!");
     }
   }
 }
 
-void writeSenParams()
+bool readSenParams()
+{
+  WS_record rec;
+  if(!WS_storeLoad(&rec) || !(rec.flags & WS_STORE_HAS_PARAMS))
+  {
+    Serial.println("No valid Warm Start record in the EEPROM!");
+    return false;
+  }
+  WS_params = rec.params;
+  return true;
+}
+
+bool writeSenParams()
+{
+  return WS_storeCommit(&WS_params, NULL, NULL);
+}
+
+// Feeds the six-position calibration while one is running (calibratingA > 0). The board is turned by hand onto each
+// of its six faces and left still on each for a second or so, in any order; accel_cal_saved counts the faces done.
+void Accel_cal_check()
 {
-  uint8_t data[140];
-  uint8_t paramnum;
-  for (paramnum = 0; paramnum < 35; paramnum++) // 35 parameters
+  if(calibratingA == 0) return;
+  bool solved = accelCal.add(accelCount);
+  accel_cal_saved = accelCal.facesDone();
+  if(!solved) return;
+  calibratingA = 0;
+
+  Serial.print("Accel Cal fit error (g): "); Serial.println(accelCal.fitError, 4);
+  for(uint8_t axis = 0; axis < 3; axis++)
   {
-    for (uint8_t i= 0; i < 4; i++)
+    Serial.print("Axis "); Serial.print(axis); Serial.print(": scale "); Serial.print(accelCal.scale[axis], 4);
+    Serial.print(", offset "); Serial.print(accelCal.offset[axis], 1); Serial.print(", misalignment ");
+    Serial.print(accelCal.misalign[axis][0], 4); Serial.print(" "); Serial.print(accelCal.misalign[axis][1], 4);
+    Serial.print(" "); Serial.println(accelCal.misalign[axis][2], 4);
+  }
+
+  // The SENtral's own cal takes a max and min per axis. Face means taken through an active SENtral cal would
+  // stack a second correction on the first, so those only replace the stored max and min when it is off.
+  if(!accel_cal)
+  {
+    for(uint8_t axis = 0; axis < 3; axis++)
     {
-      data[(paramnum*4 + i)] = WS_params.Sen_param[paramnum][i];
+      global_conf.accZero_max[axis] = accelCal.faceMean(2 * axis, axis);
+      global_conf.accZero_min[axis] = accelCal.faceMean(2 * axis + 1, axis);
     }
   }
-  M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, 0x7f, 0x80, 12, &data[128]); // Page 255
-  delay(100);
-  M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, 0x7f, 0x00, 128, &data[0]); // Page 254
+  memcpy(accel_matrix.matrix, accelCal.matrix, sizeof(accel_matrix.matrix));
+  memcpy(accel_matrix.bias, accelCal.bias, sizeof(accel_matrix.bias));
+  accel_matrix.sentralCal = accel_cal;
+
+  // Put the Sentral in pass-thru mode
+  WS_PassThroughMode();
+
+  // Store accelerometer calibration data to the M24512DFM I2C EEPROM
+  bool saved = writeAccCal();
+
+  // Take Sentral out of pass-thru mode and re-start algorithm
+  WS_Resume();
+  if(!saved) Serial.println("Accel Cal save failed!");
 }
 
-void Accel_cal_check()
+bool readAccelCal()
+{
+  WS_record rec;
+  if(!WS_storeLoad(&rec) || !(rec.flags & WS_STORE_HAS_ACC_CAL))
+  {
+    Serial.println("No valid Accel Cal record in the EEPROM!");
+    return false;
+  }
+  global_conf = rec.cal;
+  return true;
+}
+
+// The stored six-position correction, if it was measured the way the SENtral is set up now. Call in pass-through.
+bool readAccelMatrix()
+{
+  WS_record rec;
+  if(!WS_storeLoad(&rec) || !(rec.flags & WS_STORE_HAS_ACC_MATRIX)) return false;
+  if(rec.accMatrix.sentralCal != accel_cal)
+  {
+    Serial.println("Accel Cal matrix was measured with the other SENtral Accel Cal setting, not applied");
+    return false;
+  }
+  accel_matrix = rec.accMatrix;
+  accelCal.set(accel_matrix.matrix, accel_matrix.bias);
+  return true;
+}
+
+bool writeAccCal()
+{
+  return WS_storeCommit(NULL, accel_cal ? NULL : &global_conf, &accel_matrix);
+}
+
+// Bitwise CRC-32 (reflected, polynomial 0xEDB88320); the records are short enough not to need a table
+uint32_t WS_crc32(const uint8_t * data, uint16_t count)
+{
+  uint32_t crc = 0xFFFFFFFF;
+  while(count--)
+  {
+    crc ^= *data++;
+    for(uint8_t k = 0; k < 8; k++) crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+  }
+  return ~crc;
+}
+
+bool WS_recordValid(const WS_record * rec)
+{
+  if(rec->magic != WS_STORE_MAGIC) return false;
+  if(rec->version == 0x01)                       // no accMatrix; its crc sits where accMatrix starts
+  {
+    uint32_t crc;
+    memcpy(&crc, &rec->accMatrix, sizeof(crc));
+    return !(rec->flags & WS_STORE_HAS_ACC_MATRIX) && crc == WS_crc32((const uint8_t *)rec, offsetof(WS_record, accMatrix));
+  }
+  return rec->version == WS_STORE_VERSION && rec->crc == WS_crc32((const uint8_t *)rec, offsetof(WS_record, crc));
+}
+
+// Reads both slots in one sequential read and returns the newest valid record in rec, also kept in WS_storeCache.
+// Returns the address of its slot, or 0 if neither slot holds a valid record.
+uint16_t WS_storeLoad(WS_record * rec)
 {
-  static int64_t a[3] = {0, 0, 0}, b[3] = {0, 0, 0};
+  uint8_t data[WS_STORE_SLOT_SIZE + sizeof(WS_record)];
+  WS_record a, b;
+  M24512DFMreadRange(M24512DFM_DATA_ADDRESS, WS_STORE_SLOT_A, sizeof(data), data);          // slot A and on into slot B
+  memcpy(&a, &data[0], sizeof(WS_record));
+  memcpy(&b, &data[WS_STORE_SLOT_SIZE], sizeof(WS_record));
+  bool aValid = WS_recordValid(&a), bValid = WS_recordValid(&b);
+  if(aValid && (!bValid || (int32_t)(a.seq - b.seq) > 0))
+  {
+    WS_storeCache = a;
+    WS_storeSlot = WS_STORE_SLOT_A;
+  } else if(bValid)
+  {
+    WS_storeCache = b;
+    WS_storeSlot = WS_STORE_SLOT_B;
+  } else
+  {
+    return 0;
+  }
+  if(WS_storeCache.version != WS_STORE_VERSION)  // older layout: nothing past cal is ours
+  {
+    memset(&WS_storeCache.accMatrix, 0, sizeof(WS_storeCache.accMatrix));
+    WS_storeCache.crc = 0;
+  }
+  *rec = WS_storeCache;
+  return WS_storeSlot;
+}
 
-  if (calibratingA > 0)
+// Writes a new record into the slot not holding the newest valid one, so the previous record survives until
+// the new one is complete and checked. A NULL section keeps what the newest record had.
+bool WS_storeCommit(const Sentral_WS_params * params, const acc_cal * cal, const acc_matrix * matrix)
+{
+  WS_record rec = WS_storeCache, check;
+  uint16_t newest = WS_storeSlot ? WS_storeSlot : WS_storeLoad(&rec);    // the store is only read once
+  if(!newest)
+  {
+    memset(&rec, 0, sizeof(rec));
+  }
+  if(params)
+  {
+    rec.params = *params;
+    rec.flags |= WS_STORE_HAS_PARAMS;
+  }
+  if(cal)
+  {
+    rec.cal = *cal;
+    rec.flags |= WS_STORE_HAS_ACC_CAL;
+  }
+  if(matrix)
   {
-    for (uint8_t axis = 0; axis < 3; axis++)
+    rec.accMatrix = *matrix;
+    rec.flags |= WS_STORE_HAS_ACC_MATRIX;
+  }
+  rec.magic = WS_STORE_MAGIC;
+  rec.version = WS_STORE_VERSION;
+  rec.seq++;
+  rec.crc = WS_crc32((const uint8_t *)&rec, offsetof(WS_record, crc));
+
+  uint16_t slot = (newest == WS_STORE_SLOT_A) ? WS_STORE_SLOT_B : WS_STORE_SLOT_A;
+  uint8_t * src = (uint8_t *)&rec;
+  for(uint16_t offset = 0; offset < sizeof(WS_record); offset += 128)  // one page write at a time
+  {
+    uint8_t n = (sizeof(WS_record) - offset < 128) ? sizeof(WS_record) - offset : 128;
+    M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, (slot + offset) >> 8, (slot + offset) & 0xFF, n, &src[offset]);
+    if(!M24512DFMwaitReady(M24512DFM_DATA_ADDRESS)) return false;
+  }
+
+  // Read the slot back, the commit only counts once it would load
+  M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, slot >> 8, slot & 0xFF, sizeof(WS_record), (uint8_t *)&check);
+  if(!WS_recordValid(&check) || check.seq != rec.seq) return false;
+  WS_storeCache = rec;
+  WS_storeSlot = slot;
+  return true;
+}
+
+//===================================================================================================================
+//====== Flight recorder
+//===================================================================================================================
+
+// Finds the end of the log: reads the header of every log page, takes the highest seq whose page passes its CRC
+// (at most one page, the one being written at a power cut, can be torn) and carries on after it.
+// Needs the EEPROM, so call it in pass-through.
+void FR_begin()
+{
+  FR_page page;
+  uint32_t best = 0, second = 0;
+  uint16_t bestPage = 0, secondPage = 0;
+  for(uint16_t p = 0; p < FR_PAGES; p++)
+  {
+    uint16_t address = (FR_FIRST_PAGE + p) * 128;
+    M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, address >> 8, address & 0xFF, offsetof(FR_page, data), (uint8_t *)&page);
+    if(page.magic != FR_PAGE_MAGIC || page.seq == 0xFFFFFFFF) continue;
+    if(page.seq > best)
     {
-      if (accelCount[axis] > 1024)
-      {
-        // Sum up 512 readings
-        a[axis] += accelCount[axis];
-      }
-      if (accelCount[axis] < -1024)
-      {
-        b[axis] += accelCount[axis];
-      }
-      // Clear global variables for next reading
-      accelCount[axis] = 0;
+      second = best; secondPage = bestPage;
+      best = page.seq; bestPage = p;
+    } else if(page.seq > second)
+    {
+      second = page.seq; secondPage = p;
     }
-    
-    // Calculate averages, and store values in EEPROM at end of calibration
-    if (calibratingA == 1)
+  }
+  FR_head = 0;
+  FR_seq = 1;
+  if(best && FR_readPage(bestPage, &page))
+  {
+    FR_head = (bestPage + 1) % FR_PAGES;
+    FR_seq = best + 1;
+  } else if(second && FR_readPage(secondPage, &page))
+  {
+    FR_head = (secondPage + 1) % FR_PAGES;
+    FR_seq = best + 1;                   // past the torn page's seq too, so its slot is not mistaken for newer
+  }
+  FR_buf.used = 0;
+  FR_ready = true;
+}
+
+bool FR_readPage(uint16_t p, FR_page * page)
+{
+  uint16_t address = (FR_FIRST_PAGE + p) * 128;
+  M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, address >> 8, address & 0xFF, sizeof(FR_page), (uint8_t *)page);
+  return FR_pageValid(page);
+}
+
+bool FR_pageValid(const FR_page * page)
+{
+  return page->magic == FR_PAGE_MAGIC && page->used <= FR_PAYLOAD_SIZE &&
+         page->crc == WS_crc32((const uint8_t *)page, offsetof(FR_page, crc));
+}
+
+// Appends one event. A page starts with the absolute time, and a gap longer than FR_MAX_TICKS ticks gets its own
+// time event; otherwise the tag carries the ticks since the last event. A full page is flushed to the EEPROM.
+void FR_append(uint8_t type, const uint8_t * payload, uint8_t count)
+{
+  uint32_t now = millis();
+  uint32_t ticks = (now - FR_lastTime) / FR_TICK;
+  bool stamp = FR_buf.used == 0 || ticks > FR_MAX_TICKS;
+  if(FR_buf.used + 1 + count + (stamp ? 5 : 0) > FR_PAYLOAD_SIZE)
+  {
+    if(!FR_flush())
     {
-      for (uint8_t axis = 0; axis < 3; axis++)
-      {
-        if (a[axis]>>9 > 1024)
-        {
-          global_conf.accZero_max[axis] = a[axis]>>9;
-        }
-        if (b[axis]>>9 < -1024)
-        {
-          global_conf.accZero_min[axis] = b[axis]>>9;
-        }
-        a[axis] = 0;
-        b[axis] = 0;
-      }
+      FR_dropped++;
+      return;
+    }
+    stamp = true;
+  }
+  if(stamp)
+  {
+    FR_buf.data[FR_buf.used++] = FR_EV_TIME;
+    memcpy(&FR_buf.data[FR_buf.used], &now, 4);
+    FR_buf.used += 4;
+    FR_lastTime = now;
+    ticks = 0;
+  }
+  FR_lastTime += ticks * FR_TICK;        // whole ticks only, so rounding does not pile up along the page
+  FR_buf.data[FR_buf.used++] = type | ticks;
+  memcpy(&FR_buf.data[FR_buf.used], payload, count);
+  FR_buf.used += count;
+}
 
-      //Write accZero to EEPROM
-      delay(100);
-      
-      // Put the Sentral in pass-thru mode
-      WS_PassThroughMode();
+// Logs every FR_poseDecimation'th call. The quaternion is kept as its three smallest components, the largest
+// one follows from |q| = 1 and is made positive (q and -q are the same rotation): in full, or as a three byte
+// delta when the largest component is the same as in the previous pose of the page and the change is small.
+void FR_logPose(float w, float x, float y, float z)
+{
+  if(!FR_ready || ++FR_poseCount < FR_poseDecimation) return;
+  FR_poseCount = 0;
+
+  // A delta must land in the page holding its reference, so start a new page now rather than in FR_append()
+  if(FR_buf.used + 13 > FR_PAYLOAD_SIZE && !FR_flush())
+  {
+    FR_dropped++;
+    return;
+  }
+  float q[4] = {w, x, y, z};
+  uint8_t largest = 0;
+  for(uint8_t i = 1; i < 4; i++) if(fabsf(q[i]) > fabsf(q[largest])) largest = i;
+  float s = (q[largest] < 0.0f) ? -FR_POSE_SCALE : FR_POSE_SCALE;
+  int16_t v[3];
+  for(uint8_t i = 0, k = 0; i < 4; i++) if(i != largest) v[k++] = (int16_t)lroundf(q[i] * s);
+
+  int16_t d[3] = {(int16_t)(v[0] - FR_lastPose[0]), (int16_t)(v[1] - FR_lastPose[1]), (int16_t)(v[2] - FR_lastPose[2])};
+  uint8_t used = FR_buf.used;
+  if(FR_poseRef && largest == FR_lastLargest && d[0] == (int8_t)d[0] && d[1] == (int8_t)d[1] && d[2] == (int8_t)d[2])
+  {
+    int8_t delta[3] = {(int8_t)d[0], (int8_t)d[1], (int8_t)d[2]};
+    FR_append(FR_EV_DPOSE, (uint8_t *)delta, 3);
+  } else
+  {
+    uint8_t full[7] = {largest};
+    memcpy(&full[1], v, 6);
+    FR_append(FR_EV_POSE, full, 7);
+  }
+  if(FR_buf.used == used) return;        // dropped
+  memcpy(FR_lastPose, v, sizeof(v));
+  FR_lastLargest = largest;
+  FR_poseRef = true;
+}
 
-      // Store accelerometer calibration data to the M24512DFM I2C EEPROM
-      writeAccCal();
+// Logs the status registers when they change
+void FR_logStatus(uint8_t sensorStatus, uint8_t algoStatus)
+{
+  if(!FR_ready || (sensorStatus == FR_lastStatus[0] && algoStatus == FR_lastStatus[1])) return;
+  uint8_t status[2] = {sensorStatus, algoStatus};
+  FR_append(FR_EV_STATUS, status, 2);
+  FR_lastStatus[0] = sensorStatus;
+  FR_lastStatus[1] = algoStatus;
+}
 
+// Errors go to the EEPROM at the next FR_task(), so what led up to a fault survives a reset that follows it
+void FR_logError(uint8_t errorStatus)
+{
+  if(!FR_ready) return;
+  FR_append(FR_EV_ERROR, &errorStatus, 1);
+  FR_flushNow = true;
+}
 
-      // Take Sentral out of pass-thru mode and re-start algorithm
-      WS_Resume();
-      accel_cal_saved++;
-      if(accel_cal_saved > 6) accel_cal_saved = 0;
-    }
-    calibratingA--;
+// A dump needs pass-through, which would cut off a warm start parameter transfer, so it waits for the checkpoint
+void FR_task()
+{
+  if(FR_flushNow && FR_flush()) FR_flushNow = false;
+  if(FR_dumpNow && WS_cpState == WS_CP_IDLE)
+  {
+    FR_dumpNow = false;
+    FR_dump();
   }
 }
 
-void readAccelCal()
+// Writes the page being filled to the head of the log and starts a new one. The SENtral is only stopped for the
+// page transfer: the write cycle finishes while fusion carries on, and the next EEPROM access ACK-polls for it.
+// Waits rather than break into a warm start parameter transfer.
+bool FR_flush()
 {
-  uint8_t data[12];
-  uint8_t axis;
+  if(!FR_ready || FR_buf.used == 0) return true;
+  if(WS_cpState == WS_CP_FETCH) return false;
+
+  FR_buf.magic = FR_PAGE_MAGIC;
+  FR_buf.reserved = 0xFF;
+  FR_buf.seq = FR_seq;
+  memset(&FR_buf.data[FR_buf.used], 0xFF, FR_PAYLOAD_SIZE - FR_buf.used);
+  FR_buf.crc = WS_crc32((const uint8_t *)&FR_buf, offsetof(FR_page, crc));
+
+  uint16_t address = (FR_FIRST_PAGE + FR_head) * 128;
+  if(!passThru) WS_PassThroughMode();
+  bool ready = M24512DFMwaitReady(M24512DFM_DATA_ADDRESS);
+  if(ready) M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, address >> 8, address & 0xFF, sizeof(FR_page), (uint8_t *)&FR_buf);
+  if(!passThru) WS_Resume();
+  if(!ready) return false;
+
+  FR_head = (FR_head + 1) % FR_PAGES;
+  FR_seq++;
+  FR_buf.used = 0;
+  FR_poseRef = false;                    // every page decodes on its own
+  return true;
+}
 
-  M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, 0x7f, 0x8c, 12, data); // Page 255
-  for (axis = 0; axis < 3; axis++)
+// Prints the whole log, oldest page first, one line per event: time in ms, event, values. The log is read in
+// two sequential runs, head to the top of the EEPROM and then the bottom of the log up to the head, with
+// current address reads carrying each run on a page at a time.
+void FR_dump()
+{
+  FR_page page;
+  uint32_t count = 0;
+  FR_flush();
+  if(!passThru) WS_PassThroughMode();
+  M24512DFMwaitReady(M24512DFM_DATA_ADDRESS);
+  Serial.println("FR,time_ms,event,values");
+  for(uint16_t p = 0; p < FR_PAGES; p++)
   {
-    global_conf.accZero_max[axis] = ((int16_t)(data[(2*axis + 1)]<<8) | data[2*axis]);
-    global_conf.accZero_min[axis] = ((int16_t)(data[(2*axis + 7)]<<8) | data[(2*axis + 6)]);
+    uint16_t n = (FR_head + p) % FR_PAGES;
+    uint16_t address = (FR_FIRST_PAGE + n) * 128;
+    if(p == 0 || n == 0) M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, address >> 8, address & 0xFF, sizeof(page), (uint8_t *)&page);
+    else M24512DFMreadCurrent(M24512DFM_DATA_ADDRESS, sizeof(page), (uint8_t *)&page);
+    if(FR_pageValid(&page)) count += FR_printPage(&page);
   }
+  if(!passThru) WS_Resume();
+  Serial.print("FR,"); Serial.print(count); Serial.print(" events, "); Serial.print(FR_dropped); Serial.println(" dropped");
 }
 
-void writeAccCal()
+uint16_t FR_printPage(const FR_page * page)
 {
-  uint8_t data[12];
-  uint8_t axis;
-  for (axis = 0; axis < 3; axis++)
+  uint32_t time = 0;
+  int16_t pose[3] = {0, 0, 0};
+  uint8_t largest = 0;
+  uint16_t count = 0;
+  for(uint8_t i = 0; i < page->used; )
   {
-    data[2*axis] = (global_conf.accZero_max[axis] & 0xff);
-    data[(2*axis + 1)] = (global_conf.accZero_max[axis] >> 8);
-    data[(2*axis + 6)] = (global_conf.accZero_min[axis] & 0xff);
-    data[(2*axis + 7)] = (global_conf.accZero_min[axis] >> 8);
+    uint8_t tag = page->data[i++];
+    time += (tag & ~FR_EV_TYPE) * FR_TICK;
+    if((tag & FR_EV_TYPE) == FR_EV_TIME)
+    {
+      memcpy(&time, &page->data[i], 4);
+      i += 4;
+      continue;
+    }
+    Serial.print("FR,"); Serial.print(time); Serial.print(",");
+    count++;
+    switch(tag & FR_EV_TYPE)
+    {
+      case FR_EV_POSE:
+      case FR_EV_DPOSE:
+        if((tag & FR_EV_TYPE) == FR_EV_POSE)
+        {
+          largest = page->data[i] & 0x03;
+          memcpy(pose, &page->data[i + 1], 6);
+          i += 7;
+        } else
+        {
+          for(uint8_t k = 0; k < 3; k++) pose[k] += (int8_t)page->data[i++];
+        }
+        {
+          float q[4], sum = 0.0f;
+          for(uint8_t j = 0, k = 0; j < 4; j++)
+          {
+            if(j == largest) continue;
+            q[j] = pose[k++] / FR_POSE_SCALE;
+            sum += q[j] * q[j];
+          }
+          q[largest] = (sum < 1.0f) ? sqrtf(1.0f - sum) : 0.0f;
+          Serial.print("pose,"); Serial.print(q[0], 5); Serial.print(","); Serial.print(q[1], 5); Serial.print(",");
+          Serial.print(q[2], 5); Serial.print(","); Serial.println(q[3], 5);
+        }
+        break;
+      case FR_EV_STATUS:
+        Serial.print("status,"); Serial.print(page->data[i], HEX); Serial.print(","); Serial.println(page->data[i + 1], HEX);
+        i += 2;
+        break;
+      case FR_EV_ERROR:
+        Serial.print("error,"); Serial.println(page->data[i++], HEX);
+        break;
+      default:
+        Serial.println("?");
+        return count;                    // unknown event, the rest of the page can't be parsed
+    }
   }
-  M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, 0x7f, 0x8c, 12, data); // Page 255
+  return count;
 }
 
 //===================================================================================================================
@@ -1907,13 +2353,13 @@ uint8_t M24512DFMreadByte(uint8_t device_address, uint8_t data_address1, uint8_t
   return data;                                    // Return data read from slave register
 }
 
-void M24512DFMreadBytes(uint8_t device_address, uint8_t data_address1, uint8_t data_address2, uint8_t count, uint8_t * dest)
+void M24512DFMreadBytes(uint8_t device_address, uint8_t data_address1, uint8_t data_address2, uint16_t count, uint8_t * dest)
 {  
   Wire.beginTransmission(device_address);            // Initialize the Tx buffer
   Wire.write(data_address1);                         // Put slave register address in Tx buffer
   Wire.write(data_address2);                         // Put slave register address in Tx buffer
   Wire.endTransmission(I2C_NOSTOP);                  // Send the Tx buffer, but send a restart to keep connection alive
-  uint8_t i = 0;
+  uint16_t i = 0;
   Wire.requestFrom(device_address, (size_t)count);  // Read bytes from slave register address 
   while (Wire.available())
   {
@@ -1921,6 +2367,54 @@ void M24512DFMreadBytes(uint8_t device_address, uint8_t data_address1, uint8_t d
   }                                                   // Put read results in the Rx buffer
 }
 
+// Current address read: carries on from where the last read or write left the EEPROM's address counter
+uint16_t M24512DFMreadCurrent(uint8_t device_address, uint16_t count, uint8_t * dest)
+{
+  uint16_t i = 0;
+  Wire.requestFrom(device_address, (size_t)count);  // Read bytes from the current address
+  while (Wire.available())
+  {
+    dest[i++] = Wire.read();
+  }                                                   // Put read results in the Rx buffer
+  return i;
+}
+
+// Reads count bytes (up to the whole 64 kB) from address on. Only the first request sends the address, the rest
+// are current address reads of M24512DFM_READ_CHUNK bytes, so the EEPROM stays in one sequential read (wrapping
+// from 0xFFFF to 0x0000 as the device does). Returns the number of bytes read.
+uint32_t M24512DFMreadRange(uint8_t device_address, uint16_t address, uint32_t count, uint8_t * dest)
+{
+  uint32_t done = 0;
+  if(count > 0x10000) count = 0x10000;
+  while(done < count)
+  {
+    uint16_t n = (count - done < M24512DFM_READ_CHUNK) ? count - done : M24512DFM_READ_CHUNK;
+    if(done == 0)
+    {
+      Wire.beginTransmission(device_address);
+      Wire.write(address >> 8);
+      Wire.write(address & 0xFF);
+      Wire.endTransmission(I2C_NOSTOP);              // restart straight into the first read
+    }
+    uint16_t got = M24512DFMreadCurrent(device_address, n, &dest[done]);
+    done += got;
+    if(got < n) break;                               // NACKed, e.g. in the middle of a write cycle
+  }
+  return done;
+}
+
+// The EEPROM does not acknowledge its address until the internal write cycle has finished
+bool M24512DFMwaitReady(uint8_t device_address)
+{
+  uint32_t start = millis();
+  while(true)
+  {
+    Wire.beginTransmission(device_address);
+    if(Wire.endTransmission() == 0) return true;
+    if(millis() - start > M24512DFM_WRITE_TIMEOUT) return false;
+  }
+}
+
 // simple function to scan for I2C devices on the bus
 void I2Cscan() 
 {
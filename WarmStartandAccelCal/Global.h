@@ -1,6 +1,8 @@
 #ifndef Globals_h
 #define Globals_h
 
+#include "AccelCal.h"
+
 /*************************************************************************************************/
 /*************                                                                     ***************/
 /*************                        Parameter Definitions                        ***************/
@@ -259,6 +261,46 @@
 
 #define EM7180_ADDRESS           0x28   // Address of the EM7180 SENtral sensor hub
 #define M24512DFM_DATA_ADDRESS   0x50   // Address of the 500 page M24512DRC EEPROM data buffer, 1024 bits (128 8-bit bytes) per page
+#define M24512DFM_WRITE_TIMEOUT  20     // ms to wait for a page write cycle to finish, the datasheet maximum is 5 ms
+#define M24512DFM_READ_CHUNK     256    // bytes per read request, within the i2c_t3 Rx buffer (I2C_RX_BUFFER_LENGTH)
+
+// Warm start record store: two slots of two pages each, written alternately
+#define WS_STORE_SLOT_A          0x7E00 // pages 252-253
+#define WS_STORE_SLOT_B          0x7F00 // pages 254-255, where the unversioned parameters used to live
+#define WS_STORE_SLOT_SIZE       0x100
+#define WS_STORE_MAGIC           0x5357 // "WS"
+#define WS_STORE_VERSION         0x02   // 2 added the accelerometer matrix, version 1 records still load
+#define WS_STORE_HAS_PARAMS      0x01   // record flags
+#define WS_STORE_HAS_ACC_CAL     0x02
+#define WS_STORE_HAS_ACC_MATRIX  0x04
+
+// Background warm start checkpoint
+#define WS_CP_PARAMS_PER_LOOP    4      // parameters fetched per loop() pass at most
+#define WS_CP_INTERVAL           600000 // ms between periodic checks for changed parameters
+#define WS_CP_TIMEOUT            1000   // ms for the whole parameter fetch before it is abandoned
+#define WS_CP_IDLE               0      // checkpoint states
+#define WS_CP_FETCH              1
+#define WS_CP_COMMIT             2
+
+// Flight recorder: a circular log of pose, status and error events in the upper half of the EEPROM. Pages are
+// written in turn, so every page takes the same share of the wear.
+#define FR_FIRST_PAGE            256    // 0x8000, nothing else lives above the warm start store
+#define FR_PAGES                 256
+#define FR_PAGE_MAGIC            0x5246 // "FR"
+#define FR_PAYLOAD_SIZE          116
+#define FR_POSE_DECIMATION       10     // log every 10th quaternion, 10 Hz at the 100 Hz quaternion rate
+#define FR_TICK                  10     // ms per unit of the event time stamps
+#define FR_MAX_TICKS             31
+// Event tags: type in the top three bits, ticks since the previous event in the low five, then the payload
+#define FR_EV_TIME               0x00   // uint32_t millis(), starts every page and bridges longer gaps
+#define FR_EV_POSE               0x20   // index of the largest quaternion component (w, x, y, z), the other three
+                                        // as int16_t * FR_POSE_SCALE, signed so the largest is positive
+#define FR_EV_DPOSE              0x40   // int8_t change of those three since the previous pose in the page
+#define FR_EV_STATUS             0x60   // sensor status, algorithm status
+#define FR_EV_ERROR              0x80   // error register
+#define FR_EV_TYPE               0xE0
+#define FR_POSE_SCALE            46340.0f // 32767 * sqrt(2), the smallest three components lie within +-1 / sqrt(2)
+
 #define M24512DFM_IDPAGE_ADDRESS 0x58   // Address of the single M24512DRC lockable EEPROM ID page
 #define MPU9250_ADDRESS          0x68   // Device address of MPU9250 when ADO = 0
 #define AK8963_ADDRESS           0x0C   // Address of magnetometer
@@ -340,11 +382,46 @@ struct acc_cal
   int16_t accZero_min[3];
 };
 
+// Six-position accelerometer correction, see AccelCal.h
+struct acc_matrix
+{
+  float matrix[3][3];             // g per count
+  float bias[3];                  // g
+  uint8_t sentralCal;             // 1 if measured with the SENtral's own accel cal (acc_cal) applied
+  uint8_t reserved[3];
+};
+
 struct Sentral_WS_params
 {
   uint8_t Sen_param[35][4];
 };
 
+// One slot of the warm start store, 216 bytes. The newest slot with a good magic, version and CRC wins,
+// so a write cut short by a power loss leaves the previous record in the other slot in charge.
+struct WS_record
+{
+  uint16_t magic;
+  uint8_t version;
+  uint8_t flags;                  // which sections hold data
+  uint32_t seq;                   // incremented on every commit
+  Sentral_WS_params params;
+  acc_cal cal;
+  acc_matrix accMatrix;           // not in version 1, whose crc sits here
+  uint32_t crc;                   // CRC-32 of everything above
+};
+
+// One page of the flight recorder, exactly one EEPROM page. The page with the highest seq and a good CRC is the
+// newest; a page torn by a power cut fails its CRC and is written over next.
+struct FR_page
+{
+  uint16_t magic;
+  uint8_t used;                   // payload bytes holding events, the rest is 0xFF
+  uint8_t reserved;
+  uint32_t seq;                   // incremented on every page written
+  uint8_t data[FR_PAYLOAD_SIZE];
+  uint32_t crc;                   // CRC-32 of everything above
+};
+
 /*************************************************************************************************/
 /*************                                                                     ***************/
 /*************                        Global Scope Variables                       ***************/
@@ -359,6 +436,35 @@ static int16_t                          warm_start_saved = 0;
 static int16_t                          accel_cal_saved = 0;
 static uint16_t                         calibratingA = 0;
 
+// Background warm start checkpoint
+uint8_t                                 WS_cpState = WS_CP_IDLE;
+uint8_t                                 WS_cpParam;            // parameter number awaiting acknowledge, 1 to 35
+bool                                    WS_cpForce;            // commit even if nothing changed
+uint32_t                                WS_cpLast = 0;         // millis() of the last check
+uint32_t                                WS_cpBegan;            // millis() the fetch started
+uint8_t                                 WS_algoStatus = 0;
+Sentral_WS_params                       WS_cpParams;           // parameters being fetched
+
+// Newest record in the warm start store, so a commit needn't read the store first
+WS_record                               WS_storeCache;
+uint16_t                                WS_storeSlot = 0;      // 0 until known
+
+// Flight recorder
+FR_page                                 FR_buf;                // page being filled
+uint16_t                                FR_head = 0;           // log page the next flush writes
+uint32_t                                FR_seq = 1;
+uint32_t                                FR_lastTime;           // millis() of the last event, in whole ticks
+int16_t                                 FR_lastPose[3];
+uint8_t                                 FR_lastLargest;
+bool                                    FR_poseRef = false;    // FR_lastPose is in this page, so a delta may follow
+uint8_t                                 FR_poseDecimation = FR_POSE_DECIMATION;
+uint8_t                                 FR_poseCount = 0;
+uint8_t                                 FR_lastStatus[2] = {0xFF, 0xFF};
+bool                                    FR_ready = false;      // FR_begin() has found the end of the log
+bool                                    FR_flushNow = false;   // an error is waiting to reach the EEPROM
+bool                                    FR_dumpNow = false;    // a dump was asked for, FR_task() runs it
+uint32_t                                FR_dropped = 0;        // events lost while the EEPROM was unavailable
+
 // Specify BMP280 configuration
 uint8_t                                 Posr = P_OSR_16;
 uint8_t                                 Tosr = T_OSR_02;
@@ -518,6 +624,8 @@ float                                   q[4] = {1.0f, 0.0f, 0.0f, 0.0f};
 float                                   eInt[3] = {0.0f, 0.0f, 0.0f};
 
 acc_cal                                 global_conf;
+AccelCal                                accelCal;
+acc_matrix                              accel_matrix;          // accelCal's result as stored
 Sentral_WS_params                       WS_params;
 
 #endif // Globals_h
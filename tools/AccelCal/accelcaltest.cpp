@@ -0,0 +1,202 @@
+/* accelcaltest: host tests and benchmark of the six-position accelerometer calibration in WarmStartandAccelCal
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../WarmStartandAccelCal accelcaltest.cpp ../../WarmStartandAccelCal/AccelCal.cpp -o accelcaltest
+    ./accelcaltest
+
+  Each trial makes up a sensor (scale within 8 %, cross-axis coupling within 2 %, offsets within 80 counts, 8 counts
+  of noise at 2048 counts per g) and feeds AccelCal::add() what the sketch would see: a second of tumbling, then
+  two seconds resting on one of the faces, taken in a random order, with a knock partway through each rest.
+
+    square       faces half a degree off their axes, a board on an ordinary table: every trial must solve, and
+                 the calibrated sensor must then read any direction of gravity to within 0.015 g
+    tilted       faces 10 degrees off: no face may be taken. Faces 3 to 5 degrees off, which the old 25 degree
+                 gate took, leave errors of 0.07 to 0.12 g that still pass maxFitError
+    range        a sensor at twice the nominal sensitivity (the wrong full scale) must be rejected
+    benchmark    time per solve(), apply() and add()
+
+  Exit status 1 if any test fails.
+*/
+
+#include "AccelCal.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+static std::mt19937 rng(1);
+static std::uniform_real_distribution<double> uniform(-1, 1);
+static std::normal_distribution<double> normal(0, 1);
+
+struct Sensor {
+  double A[3][3];        // counts per g
+  double offset[3];      // counts
+  double noise;          // counts rms
+
+  void read(const double * g, int16_t * raw) {
+    for (int i = 0; i < 3; i++) {
+      double s = offset[i] + noise * normal(rng);
+      for (int j = 0; j < 3; j++) s += A[i][j] * g[j];
+      raw[i] = (int16_t)lrint(s);
+    }
+  }
+};
+
+static Sensor makeSensor()
+{
+  Sensor s;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) s.A[i][j] = 2048 * (i == j ? 1 + 0.08 * uniform(rng) : 0.02 * uniform(rng));
+    s.offset[i] = 80 * uniform(rng);
+  }
+  s.noise = 8;
+  return s;
+}
+
+// Six rests in a random order, gravity the given angle in radians off each face's axis, in a random direction; true
+// once AccelCal has solved
+static bool calibrate(Sensor & s, AccelCal & cal, double angle)
+{
+  int order[6] = {0, 1, 2, 3, 4, 5};
+  std::shuffle(order, order + 6, rng);
+  int16_t raw[3];
+  for (int k = 0; k < 6; k++) {
+    for (int i = 0; i < 200; i++) {
+      double g[3] = {uniform(rng), uniform(rng), uniform(rng)};
+      double n = sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+      for (int j = 0; j < 3; j++) g[j] = g[j] / n * (1 + 0.5 * uniform(rng));
+      s.read(g, raw);
+      if (cal.add(raw)) return true;
+    }
+    int f = order[k], a = f / 2, b = (a + 1) % 3, c = (a + 2) % 3;
+    double phi = M_PI * uniform(rng), g[3];
+    g[a] = ((f & 1) ? -1 : 1) * cos(angle);
+    g[b] = sin(angle) * cos(phi);
+    g[c] = sin(angle) * sin(phi);
+    for (int i = 0; i < 400; i++) {
+      double gk[3] = {g[0], g[1], g[2]};
+      if (i == 150) gk[0] += 0.3;
+      s.read(gk, raw);
+      if (cal.add(raw)) return true;
+    }
+  }
+  return false;
+}
+
+// Largest error of the calibrated, noise free sensor over random directions of gravity, g
+static double sphereError(const Sensor & s, AccelCal & cal)
+{
+  Sensor q = s;
+  q.noise = 0;
+  double worst = 0;
+  for (int i = 0; i < 1000; i++) {
+    double g[3] = {uniform(rng), uniform(rng), uniform(rng)};
+    double n = sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+    for (int j = 0; j < 3; j++) g[j] /= n;
+    int16_t raw[3];
+    float out[3];
+    q.read(g, raw);
+    cal.apply(raw, out);
+    for (int j = 0; j < 3; j++) worst = std::max(worst, fabs(out[j] - g[j]));
+  }
+  return worst;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void square()
+{
+  const int trials = 200;
+  int solved = 0;
+  double worst = 0, worstFit = 0;
+  for (int t = 0; t < trials; t++) {
+    Sensor s = makeSensor();
+    AccelCal cal;
+    if (!calibrate(s, cal, 0.5 * M_PI / 180)) continue;
+    solved++;
+    worst = std::max(worst, sphereError(s, cal));
+    worstFit = std::max(worstFit, (double)cal.fitError);
+  }
+  printf("  %d of %d solved, worst error over the sphere %.4f g, worst fit residual %.4f g\n", solved, trials, worst, worstFit);
+  result("square", solved == trials && worst < 0.015);
+}
+
+static void tilted()
+{
+  const int trials = 200;
+  int taken = 0;
+  for (int t = 0; t < trials; t++) {
+    Sensor s = makeSensor();
+    AccelCal cal;
+    calibrate(s, cal, 10 * M_PI / 180);
+    taken += cal.facesDone();
+  }
+  printf("  %d faces taken in %d trials\n", taken, trials);
+  result("tilted", taken == 0);
+}
+
+static void range()
+{
+  Sensor s = {};
+  for (int i = 0; i < 3; i++) s.A[i][i] = 4096;
+  s.noise = 8;
+  AccelCal cal;
+  bool solved = calibrate(s, cal, 0);
+  printf("  twice the sensitivity: %s, %d faces\n", solved ? "accepted" : "rejected", cal.facesDone());
+  result("range", !solved && !cal.valid);
+}
+
+static void benchmark()
+{
+  Sensor s = {};
+  for (int i = 0; i < 3; i++) s.A[i][i] = 2048;
+  s.noise = 8;
+  AccelCal cal;
+  calibrate(s, cal, 0);
+
+  const int N = 1000000;
+  volatile bool ok;
+  volatile float sink = 0;
+  int16_t raw[3] = {12, -2040, 33};
+  float out[3];
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; i++) ok = cal.solve();
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; i++) {
+    raw[0] = i & 63;
+    cal.apply(raw, out);
+    sink += out[0];
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  AccelCal adding;
+  for (int i = 0; i < N; i++) {
+    raw[0] = i & 7;
+    adding.add(raw);
+    if (adding.faces) adding.reset();
+  }
+  auto t3 = std::chrono::steady_clock::now();
+  (void)ok;
+  printf("  solve %.0f ns, apply %.1f ns, add %.1f ns per call, sizeof(AccelCal) %zu bytes\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / N,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / N,
+         std::chrono::duration<double, std::nano>(t3 - t2).count() / N, sizeof(AccelCal));
+  result("benchmark", true);
+}
+
+int main()
+{
+  square();
+  tilted();
+  range();
+  benchmark();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/* altitudetest: host accuracy sweep and benchmark of the EM7180_MPU9250_BMP280 pressure altitude table
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../EM7180_MPU9250_BMP280 altitudetest.cpp ../../EM7180_MPU9250_BMP280/Altitude.cpp -o altitudetest
+    ./altitudetest
+
+  The reference is the sketches' formula, 145366.45 ft * (1 - (p / QNH)^0.190284), in double.
+
+    accuracy     Altitude::metres() every 0.01 mbar over 300 - 1100 mbar, at QNH 950 to 1050 mbar in 5 mbar
+                 steps, must be within 0.01 m of the reference; the sketches' own float expression is
+                 measured against the same reference for comparison
+    outside      the error extrapolating to 250 and 1150 mbar is printed, and must stay within 3 m
+    benchmark    ns per sample of Altitude::feet() and of the float pow() expression it replaces
+
+  Exit status 1 if any test fails.
+*/
+
+#include "Altitude.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+static double reference(double p, double qnh)
+{
+  return 145366.45 * (1.0 - pow(p / qnh, 0.190284)) * 0.3048;
+}
+
+// As getSentralRPY() and the baro sketches had it
+static float sketch(float pressure, float qnh)
+{
+  return 145366.45f * (1.0f - pow((pressure / qnh), 0.190284f));
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void accuracy()
+{
+  Altitude alt;
+  double worst = 0, worstP = 0, worstQnh = 0, worstSketch = 0;
+  for (int q = 0; q <= 20; q++) {
+    float qnh = 950.0f + 5.0f * q;
+    alt.setQNH(qnh);
+    for (int k = 0; k <= 80000; k++) {
+      float p = 300.0f + 0.01f * k;
+      double exact = reference(p, qnh);
+      double e = fabs(alt.metres(p) - exact);
+      if (e > worst) {
+        worst = e;
+        worstP = p;
+        worstQnh = qnh;
+      }
+      worstSketch = std::max(worstSketch, fabs(sketch(p, qnh) * 0.3048 - exact));
+    }
+  }
+  printf("  largest error %.4f m at %.2f mbar, QNH %.0f mbar; the float pow() expression's is %.4f m\n", worst,
+         worstP, worstQnh, worstSketch);
+  result("accuracy", worst <= 0.01);
+}
+
+static void outside()
+{
+  Altitude alt;
+  const float p[] = {250.0f, 275.0f, 1125.0f, 1150.0f};
+  double worst = 0;
+  printf("  error at");
+  for (int i = 0; i < 4; i++) {
+    double e = fabs(alt.metres(p[i]) - reference(p[i], 1013.25));
+    printf(" %.0f mbar %.2f m%s", p[i], e, i < 3 ? "," : "\n");
+    worst = std::max(worst, e);
+  }
+  result("outside", worst <= 3.0);
+}
+
+static volatile float sink;   // keeps the timed loops from being optimised away
+
+static void benchmark()
+{
+  Altitude alt;
+  const int N = 1024, ROUNDS = 5000;
+  float p[N];
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> pressure(300.0f, 1100.0f);
+  for (int i = 0; i < N; i++) p[i] = pressure(rng);
+
+  auto t0 = std::chrono::steady_clock::now();
+  float s = 0;
+  for (int r = 0; r < ROUNDS; r++) for (int i = 0; i < N; i++) s += alt.feet(p[i]);
+  sink = s;
+  auto t1 = std::chrono::steady_clock::now();
+  s = 0;
+  for (int r = 0; r < ROUNDS; r++) for (int i = 0; i < N; i++) s += sketch(p[i], 1013.25f);
+  sink = s;
+  auto t2 = std::chrono::steady_clock::now();
+  double table = std::chrono::duration<double>(t1 - t0).count() * 1e9 / (N * ROUNDS);
+  double powf = std::chrono::duration<double>(t2 - t1).count() * 1e9 / (N * ROUNDS);
+  printf("  ns per sample: Altitude::feet() %.2f, pow() expression %.2f\n", table, powf);
+  result("benchmark", true);
+}
+
+int main()
+{
+  accuracy();
+  outside();
+  benchmark();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,274 @@
+/* bmp280test: host tests and benchmark of the EM7180_MPU9250_BMP280 BMP280 compensation engine
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../EM7180_MPU9250_BMP280 bmp280test.cpp ../../EM7180_MPU9250_BMP280/BMP280Compensator.cpp -o bmp280test
+    ./bmp280test
+
+  The reference is bmp280_compensate_T_int32 and bmp280_compensate_P_int64 as printed in the Bosch BMP280
+  datasheet (BST-BMP280-DS001, section 8.2), with their t_fine global. The trimming sets are the datasheet's
+  example and 200 more, each word drawn within 20 % of the example's.
+
+    example      the datasheet example (adc_T 519888, adc_P 415148) must give 25.08 degC, and within 0.05 Pa
+                 of 100653.27 Pa, which the datasheet worked out in floating point
+    exact        temperature() and pressure() must equal the reference bit for bit, and pressures() must
+                 equal pressure(), for every trimming set over every 4096th raw temperature and every 64th
+                 raw pressure
+    fast         pressureFast() and pressuresFast() must stay within 0.05 Pa of the exact result wherever the
+                 sensor is in range (300 to 1100 hPa, -40 to 85 degC); the largest error is printed
+    benchmark    ns per sample of the reference, pressure(), pressures(), pressureFast() and pressuresFast()
+                 at one temperature, and of a temperature() context
+
+  Exit status 1 if any test fails.
+*/
+
+#include "BMP280Compensator.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Datasheet reference, verbatim but for the trimming words, which are members here. Kept out of line, as it is
+// in a sketch, so the benchmark does not get the temperature terms hoisted out of its loop by the compiler.
+struct Reference {
+  uint16_t dig_T1; int16_t dig_T2, dig_T3;
+  uint16_t dig_P1; int16_t dig_P2, dig_P3, dig_P4, dig_P5, dig_P6, dig_P7, dig_P8, dig_P9;
+  int32_t t_fine;
+
+  // Returns temperature in DegC, resolution is 0.01 DegC. Output value of "5123" equals 51.23 DegC.
+  __attribute__((noinline)) int32_t bmp280_compensate_T_int32(int32_t adc_T)
+  {
+    int32_t var1, var2, T;
+    var1 = ((((adc_T>>3) - ((int32_t)dig_T1<<1))) * ((int32_t)dig_T2)) >> 11;
+    var2 = (((((adc_T>>4) - ((int32_t)dig_T1)) * ((adc_T>>4) - ((int32_t)dig_T1))) >> 12) *
+      ((int32_t)dig_T3)) >> 14;
+    t_fine = var1 + var2;
+    T = (t_fine * 5 + 128) >> 8;
+    return T;
+  }
+
+  // Returns pressure in Pa as unsigned 32 bit integer in Q24.8 format (24 integer bits and 8 fractional bits).
+  // Output value of "24674867" represents 24674867/256 = 96386.2 Pa = 963.862 hPa
+  __attribute__((noinline)) uint32_t bmp280_compensate_P_int64(int32_t adc_P)
+  {
+    int64_t var1, var2, p;
+    var1 = ((int64_t)t_fine) - 128000;
+    var2 = var1 * var1 * (int64_t)dig_P6;
+    var2 = var2 + ((var1*(int64_t)dig_P5)<<17);
+    var2 = var2 + (((int64_t)dig_P4)<<35);
+    var1 = ((var1 * var1 * (int64_t)dig_P3)>>8) + ((var1 * (int64_t)dig_P2)<<12);
+    var1 = (((((int64_t)1)<<47)+var1))*((int64_t)dig_P1)>>33;
+    if (var1 == 0)
+    {
+      return 0; // avoid exception caused by division by zero
+    }
+    p = 1048576-adc_P;
+    p = (((p<<31)-var2)*3125)/var1;
+    var1 = (((int64_t)dig_P9) * (p>>13) * (p>>13)) >> 25;
+    var2 = (((int64_t)dig_P8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)dig_P7)<<4);
+    return (uint32_t)p;
+  }
+
+  // The 24 bytes from BMP280_CALIB00 for these words
+  void calib(uint8_t * c) const
+  {
+    const uint16_t w[12] = {dig_T1, (uint16_t)dig_T2, (uint16_t)dig_T3, dig_P1, (uint16_t)dig_P2, (uint16_t)dig_P3,
+                            (uint16_t)dig_P4, (uint16_t)dig_P5, (uint16_t)dig_P6, (uint16_t)dig_P7, (uint16_t)dig_P8,
+                            (uint16_t)dig_P9};
+    for (int i = 0; i < 12; i++) {
+      c[2 * i] = (uint8_t)w[i];
+      c[2 * i + 1] = (uint8_t)(w[i] >> 8);
+    }
+  }
+};
+
+static const Reference EXAMPLE = {27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000, 0};
+
+static std::mt19937 rng(1);
+
+static Reference randomTrimming()
+{
+  std::uniform_real_distribution<double> within(0.8, 1.2);
+  Reference r = EXAMPLE;
+  r.dig_T1 = (uint16_t)lrint(r.dig_T1 * within(rng));
+  r.dig_T2 = (int16_t)lrint(r.dig_T2 * within(rng));
+  r.dig_T3 = (int16_t)lrint(r.dig_T3 * within(rng));
+  r.dig_P1 = (uint16_t)lrint(r.dig_P1 * within(rng));
+  r.dig_P2 = (int16_t)lrint(r.dig_P2 * within(rng));
+  r.dig_P3 = (int16_t)lrint(r.dig_P3 * within(rng));
+  r.dig_P4 = (int16_t)lrint(r.dig_P4 * within(rng));
+  r.dig_P5 = (int16_t)lrint(r.dig_P5 * within(rng));
+  r.dig_P6 = (int16_t)lrint(r.dig_P6 * within(rng));
+  r.dig_P7 = (int16_t)lrint(r.dig_P7 * within(rng));
+  r.dig_P8 = (int16_t)lrint(r.dig_P8 * within(rng));
+  r.dig_P9 = (int16_t)lrint(r.dig_P9 * within(rng));
+  return r;
+}
+
+static std::vector<Reference> trimmings()
+{
+  std::vector<Reference> sets(1, EXAMPLE);
+  for (int i = 0; i < 200; i++) sets.push_back(randomTrimming());
+  return sets;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void example()
+{
+  Reference ref = EXAMPLE;
+  uint8_t calib[24];
+  ref.calib(calib);
+  BMP280Compensator bmp;
+  bmp.begin(calib);
+  bmp280_temp_t t;
+  bmp.temperature(519888, &t);
+  uint32_t p = bmp.pressure(t, 415148);
+  printf("  %.2f degC, %u / 256 = %.3f Pa, t_fine %d\n", t.T / 100.0, p, p / 256.0, t.t_fine);
+  result("example", t.T == 2508 && t.t_fine == 128422 && fabs(p / 256.0 - 100653.27) <= 0.05);
+}
+
+static void exact()
+{
+  std::vector<Reference> sets = trimmings();
+  std::vector<int32_t> raw;
+  for (int32_t adc = 0; adc < (1 << 20); adc += 64) raw.push_back(adc);
+  std::vector<uint32_t> batch(raw.size());
+  uint64_t checked = 0, wrong = 0;
+  for (size_t s = 0; s < sets.size(); s++) {
+    Reference ref = sets[s];
+    uint8_t calib[24];
+    ref.calib(calib);
+    BMP280Compensator bmp;
+    bmp.begin(calib);
+    for (int32_t adc_T = 0; adc_T < (1 << 20); adc_T += 4096) {
+      bmp280_temp_t t;
+      bmp.temperature(adc_T, &t);
+      wrong += t.T != ref.bmp280_compensate_T_int32(adc_T) || t.t_fine != ref.t_fine;
+      for (size_t i = 0; i < raw.size(); i += 64) {
+        uint16_t n = (uint16_t)std::min<size_t>(64, raw.size() - i);
+        bmp.pressures(t, &raw[i], &batch[i], n);
+      }
+      for (size_t i = 0; i < raw.size(); i++) {
+        uint32_t p = ref.bmp280_compensate_P_int64(raw[i]);
+        wrong += bmp.pressure(t, raw[i]) != p || batch[i] != p;
+      }
+      checked += raw.size() + 1;
+    }
+  }
+  printf("  %zu trimming sets, %llu conversions, %llu differ\n", sets.size(), (unsigned long long)checked,
+         (unsigned long long)wrong);
+  result("exact", wrong == 0);
+}
+
+static void fast()
+{
+  std::vector<Reference> sets = trimmings();
+  std::vector<int32_t> raw;
+  for (int32_t adc = 0; adc < (1 << 20); adc += 64) raw.push_back(adc);
+  std::vector<float> batch(raw.size());
+  double worst = 0;
+  uint64_t inRange = 0;
+  for (size_t s = 0; s < sets.size(); s++) {
+    uint8_t calib[24];
+    sets[s].calib(calib);
+    BMP280Compensator bmp;
+    bmp.begin(calib);
+    for (int32_t adc_T = 0; adc_T < (1 << 20); adc_T += 512) {
+      bmp280_temp_t t;
+      bmp.temperature(adc_T, &t);
+      if (t.T < -4000 || t.T > 8500) continue;
+      for (size_t i = 0; i < raw.size(); i += 64) {
+        uint16_t n = (uint16_t)std::min<size_t>(64, raw.size() - i);
+        bmp.pressuresFast(t, &raw[i], &batch[i], n);
+      }
+      for (size_t i = 0; i < raw.size(); i++) {
+        double p = bmp.pressure(t, raw[i]) / 256.0;
+        if (p < 30000 || p > 110000) continue;
+        inRange++;
+        double e = std::max(fabs(bmp.pressureFast(t, raw[i]) - p), fabs(batch[i] - p));
+        worst = std::max(worst, e);
+      }
+    }
+  }
+  printf("  %llu conversions in range, largest error %.4f Pa\n", (unsigned long long)inRange, worst);
+  result("fast", inRange > 0 && worst <= 0.05);
+}
+
+static volatile uint32_t sink;   // keeps the timed loops from being optimised away
+
+template <typename F> static double nsPer(uint32_t count, F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1e9 / count;
+}
+
+static void benchmark()
+{
+  Reference ref = EXAMPLE;
+  uint8_t calib[24];
+  ref.calib(calib);
+  BMP280Compensator bmp;
+  bmp.begin(calib);
+  bmp280_temp_t t;
+  bmp.temperature(519888, &t);
+  ref.bmp280_compensate_T_int32(519888);
+
+  const uint16_t N = 1024;
+  const int ROUNDS = 2000;
+  int32_t raw[N];
+  uint32_t out[N];
+  float outFast[N];
+  std::uniform_int_distribution<int32_t> adc(250000, 450000);
+  for (uint16_t i = 0; i < N; i++) raw[i] = adc(rng);
+
+  double reference = nsPer(N * ROUNDS, [&]() {
+    uint32_t s = 0;
+    for (int r = 0; r < ROUNDS; r++) for (uint16_t i = 0; i < N; i++) s += ref.bmp280_compensate_P_int64(raw[i]);
+    sink = s;
+  });
+  double single = nsPer(N * ROUNDS, [&]() {
+    uint32_t s = 0;
+    for (int r = 0; r < ROUNDS; r++) for (uint16_t i = 0; i < N; i++) s += bmp.pressure(t, raw[i]);
+    sink = s;
+  });
+  double batch = nsPer(N * ROUNDS, [&]() {
+    for (int r = 0; r < ROUNDS; r++) { bmp.pressures(t, raw, out, N); sink = out[r % N]; }
+  });
+  double singleFast = nsPer(N * ROUNDS, [&]() {
+    float s = 0;
+    for (int r = 0; r < ROUNDS; r++) for (uint16_t i = 0; i < N; i++) s += bmp.pressureFast(t, raw[i]);
+    sink = (uint32_t)s;
+  });
+  double batchFast = nsPer(N * ROUNDS, [&]() {
+    for (int r = 0; r < ROUNDS; r++) { bmp.pressuresFast(t, raw, outFast, N); sink = (uint32_t)outFast[r % N]; }
+  });
+  double context = nsPer(N * ROUNDS, [&]() {
+    int32_t s = 0;
+    for (int r = 0; r < ROUNDS; r++) for (uint16_t i = 0; i < N; i++) { bmp.temperature(raw[i] + 100000, &t); s += t.T; }
+    sink = (uint32_t)s;
+  });
+  printf("  ns per sample: reference %.1f, pressure() %.1f, pressures() %.1f, pressureFast() %.2f, "
+         "pressuresFast() %.2f\n", reference, single, batch, singleFast, batchFast);
+  printf("  ns per temperature() context %.1f\n", context);
+  result("benchmark", true);
+}
+
+int main()
+{
+  example();
+  exact();
+  fast();
+  benchmark();
+  return failures ? 1 : 0;
+}
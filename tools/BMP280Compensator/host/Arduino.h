@@ -0,0 +1,9 @@
+// Host stand-in for the little of the Arduino core BMP280Compensator uses
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#endif
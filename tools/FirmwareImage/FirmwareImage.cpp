@@ -0,0 +1,122 @@
+#include "FirmwareImage.h"
+
+#include <string.h>
+
+struct CrcTable {
+  uint32_t t[256];
+  CrcTable()
+  {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (uint8_t k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+  }
+};
+
+static uint16_t get16(const uint8_t * p) { return p[0] | p[1] << 8; }
+static uint32_t get32(const uint8_t * p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+static void put32(uint8_t * p, uint32_t v)
+{
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t roundPage(uint32_t n) { return (n + FW_PAGE_SIZE - 1) & ~(uint32_t)(FW_PAGE_SIZE - 1); }
+
+const char * fwStatusString(FwStatus status)
+{
+  switch (status) {
+    case FW_OK:         return "ok";
+    case FW_TOO_SHORT:  return "shorter than the header";
+    case FW_BAD_MAGIC:  return "not a SENtral firmware image";
+    case FW_BAD_LENGTH: return "bad text length";
+    case FW_BAD_CRC:    return "text CRC mismatch";
+    case FW_TOO_LARGE:  return "does not fit below the warm start store";
+    case FW_BAD_PACK:   return "corrupt page table";
+  }
+  return "?";
+}
+
+uint32_t fwCRC32(uint32_t crc, const uint8_t * data, size_t count)
+{
+  static const CrcTable table;   // built once, thread-safe since C++11
+  crc = ~crc;
+  while (count--) crc = table.t[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t fwPageHash(const uint8_t * data, size_t count)
+{
+  uint32_t h = 2166136261UL;
+  for (size_t i = 0; i < count; i++) {
+    h ^= data[i];
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+// The page table of a packed image is only accepted if every field agrees with the image in front of it
+static bool checkPack(const uint8_t * data, size_t length, const FwInfo & info)
+{
+  uint32_t at = roundPage(info.imageLength);
+  if (length < at + FW_PACK_HEADER) return false;
+  const uint8_t * t = data + at;
+  if (get32(t) != FW_PACK_MAGIC || get16(t + 4) != FW_PACK_VERSION) return false;
+  if (get16(t + 6) != info.imagePages || get32(t + 8) != info.imageLength) return false;
+  if (length < at + FW_PACK_HEADER + 4u * info.imagePages) return false;
+  if (get32(t + 12) != fwCRC32(0, data, at)) return false;
+  for (uint16_t i = 0; i < info.imagePages; i++)
+    if (get32(t + FW_PACK_HEADER + 4 * i) != fwPageHash(data + i * FW_PAGE_SIZE, FW_PAGE_SIZE)) return false;
+  return true;
+}
+
+FwStatus fwParse(const uint8_t * data, size_t length, FwInfo & info)
+{
+  memset(&info, 0, sizeof(info));
+  if (length < FW_HEADER_SIZE) return FW_TOO_SHORT;
+  info.header.magic = get16(data);
+  info.header.flags = get16(data + 2);
+  info.header.textCRC = get32(data + 4);
+  info.header.reserved1 = get32(data + 8);
+  info.header.textLength = get16(data + 12);
+  info.header.reserved2 = get16(data + 14);
+  if (info.header.magic != FW_MAGIC) return FW_BAD_MAGIC;
+
+  uint16_t text = info.header.textLength;
+  info.imageLength = FW_HEADER_SIZE + text;
+  info.imagePages = roundPage(info.imageLength) / FW_PAGE_SIZE;
+  info.packedLength = roundPage(roundPage(info.imageLength) + FW_PACK_HEADER + 4u * info.imagePages);
+  if (text == 0 || (text & 0x03) || length < info.imageLength) return FW_BAD_LENGTH;
+
+  info.textCRC = fwCRC32(0, data + FW_HEADER_SIZE, text);
+  if (info.textCRC != info.header.textCRC) return FW_BAD_CRC;
+  if (info.packedLength > FW_EEPROM_RESERVED) return FW_TOO_LARGE;
+
+  if (length > info.imageLength) {   // a plain .fw ends at the text, anything after it must be our table
+    if (!checkPack(data, length, info)) return FW_BAD_PACK;
+    info.packed = true;
+  }
+  return FW_OK;
+}
+
+FwStatus fwPack(const uint8_t * data, size_t length, std::vector<uint8_t> & out, FwInfo & info)
+{
+  FwStatus status = fwParse(data, length, info);
+  if (status != FW_OK) return status;
+
+  uint32_t at = roundPage(info.imageLength);
+  out.assign(info.packedLength, 0xFF);
+  memcpy(&out[0], data, info.imageLength);
+
+  uint8_t * t = &out[at];
+  put32(t, FW_PACK_MAGIC);
+  t[4] = FW_PACK_VERSION; t[5] = 0;
+  t[6] = info.imagePages; t[7] = info.imagePages >> 8;
+  put32(t + 8, info.imageLength);
+  put32(t + 12, fwCRC32(0, &out[0], at));
+  put32(t + 16, 0xFFFFFFFFUL);   // reserved
+  for (uint16_t i = 0; i < info.imagePages; i++)
+    put32(t + FW_PACK_HEADER + 4 * i, fwPageHash(&out[i * FW_PAGE_SIZE], FW_PAGE_SIZE));
+  return FW_OK;
+}
@@ -0,0 +1,70 @@
+/* SENtral firmware (.fw) images on the PC side
+
+  A .fw file from the SENtral Configuration Tool is a 16-byte header followed by textLength bytes of
+  program text; FirmwareUpload.ino copies it byte for byte into the M24512DFM from address 0. This library
+  parses and checks an image (magic, text length, the text CRC-32 the SENtral itself will check) and packs
+  it into what the EEPROM should end up holding:
+
+      [header + text, padded with 0xFF to a whole 128-byte page]
+      [page table, starting on the next page: FW_PACK_MAGIC, version, page count, image length,
+       CRC-32 of the padded image, then one 32-bit FNV-1a hash per image page]
+
+  The page hashes are the pageHash() of FirmwareUpload.ino over full 128-byte pages, so a flasher that has
+  the table of the image already in the EEPROM can tell which pages differ without reading them back. The
+  SENtral stops reading at textLength and never sees the padding or the table. All fields little endian.
+*/
+
+#ifndef FirmwareImage_h
+#define FirmwareImage_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define FW_MAGIC           0x652A
+#define FW_HEADER_SIZE     16
+#define FW_FLAG_NO_EXEC    0x0001       // EEPROMNoExec: the SENtral loads the image but does not run it
+#define FW_PAGE_SIZE       128          // M24512DFM page
+#define FW_EEPROM_SIZE     0x10000
+#define FW_EEPROM_RESERVED 0x7E00       // from here up belongs to the warm start A/B store
+#define FW_PACK_MAGIC      0x4B504653   // "SFPK"
+#define FW_PACK_VERSION    1
+#define FW_PACK_HEADER     20
+
+struct FwHeader {
+  uint16_t magic;
+  uint16_t flags;
+  uint32_t textCRC;
+  uint32_t reserved1;
+  uint16_t textLength;
+  uint16_t reserved2;
+};
+
+enum FwStatus {
+  FW_OK = 0,
+  FW_TOO_SHORT,          // not even a header
+  FW_BAD_MAGIC,
+  FW_BAD_LENGTH,         // text length zero, not a multiple of 4, or more than the file holds
+  FW_BAD_CRC,            // text does not match the header CRC
+  FW_TOO_LARGE,          // packed image would run into the warm start store
+  FW_BAD_PACK            // trailing data that is not a valid page table
+};
+
+struct FwInfo {
+  FwHeader header;
+  uint32_t textCRC;      // as computed over the text
+  uint32_t imageLength;  // header + text
+  uint32_t packedLength; // padded image + page table
+  uint16_t imagePages;
+  bool packed;           // the input already carried a valid page table
+};
+
+const char * fwStatusString(FwStatus status);
+
+uint32_t fwCRC32(uint32_t crc, const uint8_t * data, size_t count);   // start with 0, chains like zlib's crc32()
+uint32_t fwPageHash(const uint8_t * data, size_t count);
+
+FwStatus fwParse(const uint8_t * data, size_t length, FwInfo & info);
+FwStatus fwPack(const uint8_t * data, size_t length, std::vector<uint8_t> & out, FwInfo & info);
+
+#endif
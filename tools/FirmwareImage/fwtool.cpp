@@ -0,0 +1,168 @@
+/* fwtool: inspect, check and pack SENtral .fw images on a Linux PC
+
+  Build:  g++ -O2 -std=c++11 -pthread FirmwareImage.cpp fwtool.cpp -o fwtool
+
+  fwtool info  FILE|DIR ...            header fields and the result of the checks
+  fwtool check FILE|DIR ...            the checks only; exit status 1 if any image is bad
+  fwtool pack  -o OUTDIR FILE|DIR ...  write OUTDIR/<name>.pk, the page-aligned EEPROM image with its page table
+  -j N                                 worker threads, default one per CPU
+
+  Directories are scanned (not recursively) for *.fw and *.pk files. Inputs are mmap()ed, and the files are
+  shared out to the workers one at a time, so a directory of images is processed in parallel. Results are
+  printed in the order the files were given.
+*/
+
+#include "FirmwareImage.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum Command { INFO, CHECK, PACK };
+
+struct Job {
+  std::string path;
+  std::string report;
+  bool ok;
+};
+
+static bool hasSuffix(const std::string & s, const char * suffix)
+{
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static void addInput(const char * path, std::vector<Job> & jobs)
+{
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+    std::vector<std::string> names;
+    DIR * dir = opendir(path);
+    if (!dir) { jobs.push_back({path, "", false}); return; }
+    while (struct dirent * e = readdir(dir)) {
+      std::string name = e->d_name;
+      if (hasSuffix(name, ".fw") || hasSuffix(name, ".pk")) names.push_back(std::string(path) + "/" + name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (size_t i = 0; i < names.size(); i++) jobs.push_back({names[i], "", false});
+  } else {
+    jobs.push_back({path, "", false});
+  }
+}
+
+static bool writeFile(const std::string & path, const std::vector<uint8_t> & data)
+{
+  FILE * f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(&data[0], 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ok;
+}
+
+static void run(Job & job, Command command, const std::string & outDir)
+{
+  char line[256];
+  int fd = open(job.path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    job.report = job.path + ": " + strerror(errno) + "\n";
+    if (fd >= 0) close(fd);
+    return;
+  }
+  size_t length = st.st_size;
+  const uint8_t * data = NULL;
+  if (length) {
+    void * map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      job.report = job.path + ": mmap: " + strerror(errno) + "\n";
+      close(fd);
+      return;
+    }
+    data = (const uint8_t *) map;
+  }
+  close(fd);
+
+  FwInfo info;
+  std::vector<uint8_t> packed;
+  FwStatus status = command == PACK ? fwPack(data, length, packed, info) : fwParse(data, length, info);
+  job.ok = status == FW_OK;
+  snprintf(line, sizeof(line), "%s: %s\n", job.path.c_str(), fwStatusString(status));
+  job.report = line;
+
+  if (command == INFO && status != FW_TOO_SHORT) {
+    snprintf(line, sizeof(line),
+             "  magic 0x%04X  flags 0x%04X%s\n  text %u bytes, CRC 0x%08X (computed 0x%08X)\n"
+             "  image %u bytes in %u pages, packed %u bytes%s\n",
+             info.header.magic, info.header.flags, info.header.flags & FW_FLAG_NO_EXEC ? " (EEPROMNoExec)" : "",
+             info.header.textLength, info.header.textCRC, info.textCRC,
+             info.imageLength, info.imagePages, info.packedLength, info.packed ? ", input already packed" : "");
+    job.report += line;
+  }
+  if (command == PACK && job.ok) {
+    std::string name = job.path.substr(job.path.find_last_of('/') + 1);
+    name = outDir + "/" + name.substr(0, name.find_last_of('.')) + ".pk";
+    if (!writeFile(name, packed)) {
+      job.report = job.path + ": cannot write " + name + "\n";
+      job.ok = false;
+    } else {
+      job.report = job.path + " -> " + name + "\n";
+    }
+  }
+  if (data) munmap((void *) data, length);
+}
+
+static int usage()
+{
+  fprintf(stderr, "usage: fwtool info|check|pack [-j N] [-o OUTDIR] FILE|DIR ...\n");
+  return 2;
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc < 3) return usage();
+  Command command;
+  if (!strcmp(argv[1], "info")) command = INFO;
+  else if (!strcmp(argv[1], "check")) command = CHECK;
+  else if (!strcmp(argv[1], "pack")) command = PACK;
+  else return usage();
+
+  unsigned threads = std::thread::hardware_concurrency();
+  std::string outDir;
+  std::vector<Job> jobs;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) outDir = argv[++i];
+    else addInput(argv[i], jobs);
+  }
+  if (command == PACK && outDir.empty()) return usage();
+  if (threads < 1) threads = 1;
+  if (threads > jobs.size()) threads = jobs.size();
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&]() {
+      for (size_t i; (i = next++) < jobs.size(); ) run(jobs[i], command, outDir);
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+  int bad = 0;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    fputs(jobs[i].report.c_str(), jobs[i].ok ? stdout : stderr);
+    if (!jobs[i].ok) bad++;
+  }
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+// Host stand-in for the parts of the Teensy core FirmwareUpload uses. Time is simulated: it only moves when the
+// models in i2c_t3.h and SdFat.h or delay() advance it. Serial output is collected in serialOut.
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH    1
+#define LOW     0
+#define HEX     16
+#define DEC     10
+
+extern uint64_t simNow_ns;
+void simAdvance(uint64_t ns);
+
+inline uint32_t micros() { return simNow_ns / 1000; }
+inline uint32_t millis() { return simNow_ns / 1000000; }
+inline void delay(uint32_t ms) { simAdvance(ms * 1000000ull); }
+inline void delayMicroseconds(uint32_t us) { simAdvance(us * 1000ull); }
+
+extern std::string serialOut;
+
+struct HostSerial {
+  template<class T> void print(T v) { std::ostringstream o; o << v; serialOut += o.str(); }
+  template<class T> void print(T v, int format) {
+    std::ostringstream o;
+    if (format == HEX) o << std::hex << std::uppercase << (unsigned long)v;
+    else o << v;
+    serialOut += o.str();
+  }
+  template<class T> void println(T v) { print(v); println(); }
+  template<class T> void println(T v, int format) { print(v, format); println(); }
+  void println() { serialOut += "\n"; }
+  template<class... A> void printf(const char * format, A... a) {
+    char line[128];
+    snprintf(line, sizeof(line), format, a...);
+    serialOut += line;
+  }
+  void begin(long) {}
+};
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,55 @@
+// Host stand-in for SdFat: the one open file is simCard.image. Each read() costs a fixed call overhead, and
+// every 512 byte block it touches for the first time is loaded over SPI at 12 MHz.
+#ifndef SdFat_h
+#define SdFat_h
+
+#include "Arduino.h"
+#include <vector>
+
+#define O_RDONLY        0
+#define SPI_HALF_SPEED  0
+#define SPI_FULL_SPEED  0
+
+struct SimCard {
+  std::vector<uint8_t> image;
+  uint32_t reads = 0;
+};
+extern SimCard simCard;
+
+struct SdCard {
+  int errorCode() { return 0; }
+};
+
+class SdFat {
+public:
+  bool begin(uint8_t, int) { return true; }
+  SdCard * card() { return &_card; }
+private:
+  SdCard _card;
+};
+
+class SdFile {
+public:
+  bool open(const char *, int) { _pos = 0; _block = -1; return true; }
+  int read(void * dest, size_t n) {
+    simAdvance(20000);
+    simCard.reads++;
+    size_t k = 0;
+    while (k < n && _pos < simCard.image.size()) {
+      if ((long)(_pos / 512) != _block) {
+        _block = _pos / 512;
+        simAdvance(300000 + 512 * 670);
+      }
+      ((uint8_t *)dest)[k++] = simCard.image[_pos++];
+    }
+    return k;
+  }
+  uint32_t fileSize() { return simCard.image.size(); }
+  bool seekSet(uint32_t pos) { _pos = pos; return true; }
+  bool close() { return true; }
+private:
+  size_t _pos = 0;
+  long _block = -1;
+};
+
+#endif
@@ -0,0 +1,96 @@
+// Host stand-in for i2c_t3 with the two devices FirmwareUpload talks to: a SENtral that goes into pass-through,
+// and the M24512DFM EEPROM behind it. Every transfer advances simulated time as a 400 kHz bus would.
+#ifndef i2c_t3_h
+#define i2c_t3_h
+
+#include "Arduino.h"
+#include <vector>
+
+enum i2c_pins { I2C_PINS_7_8, I2C_PINS_16_17, I2C_PINS_18_19 };
+#define I2C_MASTER            0
+#define I2C_PULLUP_EXT        0
+#define I2C_RATE_400          0
+#define I2C_NOSTOP            0
+#define I2C_STOP              1
+#define I2C_RX_BUFFER_LENGTH  259
+#define I2C_TX_BUFFER_LENGTH  259
+
+// M24512DFM at 0x50: 16-bit address pointer, page writes wrap within their 128 bytes, NACK during the write
+// cycle, which lasts cycleMin_ns to cycleMax_ns. Only reachable while the SENtral is in pass-through. Bit 0 of the
+// byte at stuck, if set, is stuck high.
+struct SimEeprom {
+  uint8_t mem[65536];
+  uint16_t ptr = 0;
+  uint64_t busyUntil = 0;
+  uint32_t pageWrites = 0;
+  uint32_t polls = 0;                  // address NACKs while busy
+  uint32_t cycleMin_ns = 3800000, cycleMax_ns = 5000000;
+  uint32_t seed = 1;
+  int stuck = -1;
+
+  SimEeprom() { memset(mem, 0xFF, sizeof(mem)); }
+  bool busy() { return simNow_ns < busyUntil; }
+  uint32_t cycle_ns() { seed = seed * 1103515245 + 12345; return cycleMin_ns + (seed >> 8) % (cycleMax_ns - cycleMin_ns + 1); }
+};
+extern SimEeprom simEeprom;
+
+struct i2c_t3_ {
+  uint8_t addr;
+  std::vector<uint8_t> tx, rx;
+  size_t rpos = 0;
+  uint8_t sentral[256] = {0};
+  uint8_t sentralPtr = 0;
+
+  bool passThru() { return sentral[0x9E] & 0x01; }
+  static void bus(size_t bytes) { simAdvance((uint64_t)bytes * 9 * 2500 + 5000); }
+  void begin(int, int, i2c_pins, int, int) {}
+  void beginTransmission(uint8_t a) { addr = a; tx.clear(); }
+  size_t write(uint8_t b) { tx.push_back(b); return 1; }
+  size_t write(const uint8_t * p, size_t n) { tx.insert(tx.end(), p, p + n); return n; }
+
+  uint8_t endTransmission(int stop = I2C_STOP) {
+    if (addr == 0x28) {
+      bus(1 + tx.size());
+      if (tx.size()) sentralPtr = tx[0];
+      for (size_t i = 1; i < tx.size(); i++) {
+        uint8_t r = tx[0] + i - 1;
+        sentral[r] = tx[i];
+        if (r == 0xA0) sentral[0x9E] = tx[i] & 1;   // PassThruControl -> PassThruStatus
+      }
+      return 0;
+    }
+    if (addr != 0x50 || !passThru()) { bus(1); return 2; }
+    if (simEeprom.busy()) { bus(1); simEeprom.polls++; return 2; }
+    bus(1 + tx.size());
+    if (tx.size() >= 2) simEeprom.ptr = tx[0] << 8 | tx[1];
+    if (tx.size() > 2 && stop) {
+      uint16_t page = simEeprom.ptr & 0xFF80;
+      for (size_t i = 2; i < tx.size(); i++) {
+        uint16_t a = page | (simEeprom.ptr & 0x7F);
+        simEeprom.mem[a] = a == simEeprom.stuck ? tx[i] | 1 : tx[i];
+        simEeprom.ptr = page | ((simEeprom.ptr + 1) & 0x7F);
+      }
+      simEeprom.busyUntil = simNow_ns + simEeprom.cycle_ns();
+      simEeprom.pageWrites++;
+    }
+    return 0;
+  }
+
+  size_t requestFrom(uint8_t a, size_t n, int = I2C_STOP) {
+    rx.clear();
+    rpos = 0;
+    bus(1 + n);
+    if (a == 0x28) {
+      for (size_t i = 0; i < n; i++) rx.push_back(sentral[(uint8_t)(sentralPtr + i)]);
+      return n;
+    }
+    if (a != 0x50 || !passThru() || simEeprom.busy()) return 0;
+    for (size_t i = 0; i < n; i++) rx.push_back(simEeprom.mem[simEeprom.ptr++]);
+    return n;
+  }
+  int available() { return rx.size() - rpos; }
+  int read() { return rpos < rx.size() ? rx[rpos++] : -1; }
+};
+extern i2c_t3_ Wire;
+
+#endif
@@ -0,0 +1,274 @@
+/* uploadtest: host simulation of FirmwareUpload writing a SENtral firmware image from the SD card to the EEPROM
+
+  Build and run, from this directory:
+
+    sed -nE 's/^ *((void|bool|uint8_t|uint16_t|uint32_t) \w+\(.*\)) *\{? *(\/\/.*)?$/\1;/p' ../../FirmwareUpload.ino > host/protos.h
+    g++ -O2 -std=gnu++11 -w -Ihost -I../.. uploadtest.cpp -o uploadtest && ./uploadtest
+
+  The sed line writes the prototypes the Arduino IDE would generate. The whole sketch is then compiled against
+  host/, which models the bus: the M24512DFM with its page writes and a 3.8 to 5 ms write cycle it NACKs
+  through, reachable only in pass-through, and an SD card that loads 512 byte blocks at 12 MHz. Time is
+  simulated. The image is 22.3 kB of random bytes, about the size of a SENtral .fw file.
+
+    program      M24512DFMprogram() on a blank EEPROM must leave the image in it; prints the time, page
+                 writes and address polls, against the old loop of a 128 byte SD read, a page write and a
+                 fixed delay(100), reproduced here
+    slow chip    with a 15 to 19 ms write cycle the image must still go in whole; with a chip that never
+                 finishes its write cycle, M24512DFMprogram() must give up within the timeout and say where
+    differential M24512DFMprogram() with and without differential set, onto a blank EEPROM, one holding the
+                 same image and one holding an image 3 bytes different: the image must go in each time, and
+                 differential must write only the pages that differ; then a stuck bit, which its read back
+                 must report
+    crc          the sketch's CRC-32 against a bitwise one (and the standard check value), the CRC of the file
+                 M24512DFMprogram() leaves in imageCRC against the streamed M24512DFMcrc() read back, the
+                 verify time against page sized addressed reads, and 200 single bit flips, an erased page and
+                 a changed last byte, all of which must be caught
+    upload       the whole of setup() with the erase: the image verified, the warm start store and flight
+                 recorder above 0x7E00 left alone, and the time taken after the sketch's 6 s of start-up
+                 delays; an image that runs past 0x7E00 must be warned about
+
+  Exit status 1 if any test fails.
+*/
+
+#include "Arduino.h"
+#include "i2c_t3.h"
+#include "SdFat.h"
+#include "protos.h"
+
+#include "FirmwareUpload.ino"
+
+uint64_t simNow_ns = 0;
+std::string serialOut;
+HostSerial Serial;
+SimEeprom simEeprom;
+SimCard simCard;
+i2c_t3_ Wire;
+
+void simAdvance(uint64_t ns)
+{
+  simNow_ns += ns;
+}
+
+static const size_t IMAGE_SIZE = 22 * 1024 + 300;
+
+static uint32_t rngState = 7;
+static uint32_t rng()
+{
+  rngState = rngState * 1664525 + 1013904223;
+  return rngState >> 8;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+// A blank EEPROM (or the one there is) behind a SENtral already in pass-through, and the image opened on the card
+static void reset(bool blank = true)
+{
+  if (blank) simEeprom = SimEeprom();
+  simEeprom.busyUntil = simEeprom.pageWrites = simEeprom.polls = 0;
+  Wire = i2c_t3_();
+  SENtralPassThroughMode();
+  sd_file.open("/EM6500.fw", O_RDONLY);
+  simCard.reads = 0;
+  serialOut.clear();
+  simNow_ns = 0;
+}
+
+static bool holdsImage()
+{
+  return memcmp(simEeprom.mem, &simCard.image[0], simCard.image.size()) == 0;
+}
+
+// The loop M24512DFMprogram() replaced: a page at a time from the card, each write followed by delay(100)
+static void fixedDelayProgram()
+{
+  uint8_t buffer[128];
+  for (uint16_t page = 0; page < M24512DFM_PAGES; page++) {
+    int numbytes = sd_file.read(buffer, 128);
+    if (numbytes <= 0) break;
+    M24512DFMwriteBytes(M24512DFM_DATA_ADDRESS, page >> 1, (page & 0x01) << 7, numbytes, buffer);
+    delay(100);
+    if (numbytes < 128) break;
+  }
+}
+
+static void program()
+{
+  reset();
+  fixedDelayProgram();
+  double fixed_s = simNow_ns * 1e-9;
+  bool fixedOk = holdsImage();
+
+  reset();
+  uint32_t written = M24512DFMprogram(M24512DFM_DATA_ADDRESS, sd_file, false);
+  double polled_s = simNow_ns * 1e-9;
+  printf("  fixed delay(100): %.2f s, image %s\n", fixed_s, fixedOk ? "ok" : "BAD");
+  printf("  ACK polling:      %.2f s, %u bytes, %u page writes, %u polls, %u SD reads, image %s\n", polled_s,
+         written, simEeprom.pageWrites, simEeprom.polls, simCard.reads, holdsImage() ? "ok" : "BAD");
+  result("program", written == IMAGE_SIZE && holdsImage() && polled_s < fixed_s);
+}
+
+static void slowChip()
+{
+  reset();
+  simEeprom.cycleMin_ns = 15000000;
+  simEeprom.cycleMax_ns = 19000000;
+  uint32_t written = M24512DFMprogram(M24512DFM_DATA_ADDRESS, sd_file, false);
+  bool slowOk = written == IMAGE_SIZE && holdsImage();
+  printf("  15-19 ms cycle: %.2f s, image %s\n", simNow_ns * 1e-9, slowOk ? "ok" : "BAD");
+
+  reset();
+  simEeprom.cycleMin_ns = simEeprom.cycleMax_ns = 4000000000u;
+  written = M24512DFMprogram(M24512DFM_DATA_ADDRESS, sd_file, false);
+  bool gaveUp = written < IMAGE_SIZE && simNow_ns < 100000000 && serialOut.find("timed out at 0x80") != std::string::npos;
+  printf("  stuck chip: gave up after %.1f ms at byte %u\n", simNow_ns * 1e-6, written);
+  result("slow chip", slowOk && gaveUp);
+}
+
+// Programs whatever the EEPROM holds with the image, returns whether the image went in and wrote the expected pages
+static bool programOver(const char * name, bool differential, uint16_t expectWritten)
+{
+  reset(false);
+  uint32_t written = M24512DFMprogram(M24512DFM_DATA_ADDRESS, sd_file, differential);
+  bool ok = written == IMAGE_SIZE && holdsImage() && pagesWritten == expectWritten;
+  printf("    %-12s %.3f s, %3u pages skipped, %3u written, %3u verified, %s\n", name, simNow_ns * 1e-9,
+         pagesSkipped, pagesWritten, differential ? pagesVerified : 0, ok ? "ok" : "BAD");
+  return ok;
+}
+
+static void differential()
+{
+  const uint16_t pages = (IMAGE_SIZE + M24512DFM_PAGE_SIZE - 1) / M24512DFM_PAGE_SIZE;
+  std::vector<uint8_t> image = simCard.image, changed = image;
+  const uint32_t at[3] = {100, 5000, 17000};
+  for (int k = 0; k < 3; k++) changed[at[k]] ^= 0x40;
+  bool pass = true;
+
+  printf("  blank EEPROM\n");
+  for (int d = 0; d < 2; d++) {
+    simEeprom = SimEeprom();
+    pass = programOver(d ? "differential" : "full", d, pages) && pass;
+  }
+  printf("  same image\n");
+  pass = programOver("full", false, pages) && pass;
+  pass = programOver("differential", true, 0) && pass;
+  printf("  3 bytes changed\n");
+  simCard.image = changed;
+  for (int d = 0; d < 2; d++) {
+    memcpy(simEeprom.mem, &image[0], IMAGE_SIZE);
+    pass = programOver(d ? "differential" : "full", d, d ? 3 : pages) && pass;
+  }
+
+  // A page that will not take the image: the read back must catch it
+  image[0x2000] &= 0xFE;
+  simCard.image = image;
+  memcpy(simEeprom.mem, &image[0], IMAGE_SIZE);
+  simEeprom.mem[0x2000] |= 1;
+  simEeprom.stuck = 0x2000;
+  reset(false);
+  M24512DFMprogram(M24512DFM_DATA_ADDRESS, sd_file, true);
+  bool caught = pagesWritten == 1 && pagesVerified == 0 && serialOut.find("verify failed at 0x2000") != std::string::npos;
+  printf("  stuck bit at 0x2000: %u page written, %u verified, %s\n", pagesWritten, pagesVerified,
+         caught ? "reported" : "NOT REPORTED");
+  simEeprom.stuck = -1;
+  result("differential", pass && caught);
+}
+
+// Reflected CRC-32 a bit at a time, to hold the table against
+static uint32_t bitwiseCrc(const uint8_t * data, size_t count)
+{
+  uint32_t crc = 0xFFFFFFFF;
+  while (count--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = (crc & 1) ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+  }
+  return ~crc;
+}
+
+static void crc()
+{
+  crc32Init();
+  const uint8_t check[] = "123456789";
+  bool table = ~crc32Update(0xFFFFFFFF, check, 9) == 0xCBF43926 &&
+               ~crc32Update(0xFFFFFFFF, &simCard.image[0], IMAGE_SIZE) == bitwiseCrc(&simCard.image[0], IMAGE_SIZE);
+
+  reset();
+  uint32_t written = M24512DFMprogram(M24512DFM_DATA_ADDRESS, sd_file, false);
+  bool file = imageCRC == bitwiseCrc(&simCard.image[0], IMAGE_SIZE);
+  uint64_t t0 = simNow_ns;
+  bool clean = M24512DFMcrc(M24512DFM_DATA_ADDRESS, written) == imageCRC;
+  double verify_ms = (simNow_ns - t0) * 1e-6;
+
+  static uint8_t page[M24512DFM_PAGE_SIZE];
+  t0 = simNow_ns;
+  for (uint32_t a = 0; a < written; a += M24512DFM_PAGE_SIZE) {
+    uint16_t n = written - a < M24512DFM_PAGE_SIZE ? written - a : M24512DFM_PAGE_SIZE;
+    M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, a >> 8, a & 0xFF, n, page);
+  }
+  double paged_ms = (simNow_ns - t0) * 1e-6;
+
+  int missed = 0;
+  for (int t = 0; t < 200; t++) {
+    uint32_t a = rng() % written;
+    uint8_t bit = 1 << (rng() % 8);
+    simEeprom.mem[a] ^= bit;
+    if (M24512DFMcrc(M24512DFM_DATA_ADDRESS, written) == imageCRC) missed++;
+    simEeprom.mem[a] ^= bit;
+  }
+  memset(simEeprom.mem + 40 * M24512DFM_PAGE_SIZE, 0xFF, M24512DFM_PAGE_SIZE);
+  bool erased = M24512DFMcrc(M24512DFM_DATA_ADDRESS, written) != imageCRC;
+  memcpy(simEeprom.mem + 40 * M24512DFM_PAGE_SIZE, &simCard.image[40 * M24512DFM_PAGE_SIZE], M24512DFM_PAGE_SIZE);
+  simEeprom.mem[written - 1] ^= 0x80;
+  bool last = M24512DFMcrc(M24512DFM_DATA_ADDRESS, written) != imageCRC;
+  simEeprom.mem[written - 1] ^= 0x80;
+
+  printf("  table %s, file CRC 0x%08X %s, read back %s\n", table ? "agrees" : "DIFFERS", imageCRC,
+         file ? "agrees" : "DIFFERS", clean ? "matches" : "DOES NOT MATCH");
+  printf("  verify %.0f ms (%.1f kB/s), page sized addressed reads %.0f ms\n", verify_ms, written / verify_ms / 1.024,
+         paged_ms);
+  printf("  %d of 200 bit flips missed, erased page %s, last byte %s\n", missed, erased ? "caught" : "MISSED",
+         last ? "caught" : "MISSED");
+  result("crc", table && file && clean && missed == 0 && erased && last);
+}
+
+static void upload()
+{
+  simEeprom = SimEeprom();
+  for (size_t i = 0; i < sizeof(simEeprom.mem); i++) simEeprom.mem[i] = rng();   // whatever was there before
+  std::vector<uint8_t> above(simEeprom.mem + M24512DFM_IMAGE_END, simEeprom.mem + sizeof(simEeprom.mem));
+  Wire = i2c_t3_();
+  serialOut.clear();
+  simNow_ns = 0;
+  differentialFlash = false;
+  setup();
+  double upload_s = simNow_ns * 1e-9 - 6;
+  bool verified = serialOut.find("EEPROM image verified") != std::string::npos;
+  bool kept = memcmp(simEeprom.mem + M24512DFM_IMAGE_END, &above[0], above.size()) == 0;
+  printf("  %.2f s after the start-up delays, %u page writes, image %s, above 0x7E00 %s\n", upload_s,
+         simEeprom.pageWrites, verified && holdsImage() ? "verified" : "BAD", kept ? "kept" : "ERASED");
+
+  std::vector<uint8_t> image = simCard.image;
+  simCard.image.resize(M24512DFM_IMAGE_END + 1000);
+  Wire = i2c_t3_();
+  serialOut.clear();
+  setup();
+  bool warned = serialOut.find("WARNING! the image runs past 0x7E00") != std::string::npos;
+  printf("  a %zu byte image %s\n", simCard.image.size(), warned ? "is warned about" : "IS NOT WARNED ABOUT");
+  simCard.image = image;
+  result("upload", verified && holdsImage() && kept && warned);
+}
+
+int main()
+{
+  for (size_t i = 0; i < IMAGE_SIZE; i++) simCard.image.push_back(rng());
+  program();
+  slowChip();
+  differential();
+  crc();
+  upload();
+  return failures ? 1 : 0;
+}
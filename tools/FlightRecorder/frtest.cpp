@@ -0,0 +1,302 @@
+/* frtest: host tests of the flight recorder in WarmStartandAccelCal
+
+  Build and run, from this directory:
+
+    sed -nE 's|^([A-Za-z_][^;=]*\)) *\{? *(//.*)?$|\1;|p' ../../WarmStartandAccelCal/*.ino > host/protos.h
+    sed -nE 's/^ *(void \w+QuaternionUpdate\(.*\)) *$/\1;/p' ../../WarmStartandAccelCal/quaternionFilters >> host/protos.h
+    g++ -O2 -std=gnu++11 -w -Ihost -I../../WarmStartandAccelCal frtest.cpp -o frtest && ./frtest
+
+  The sed lines write the prototypes the Arduino IDE would generate. The whole sketch is then compiled against
+  host/, which models the bus: the M24512DFM with its page writes and write cycle, reachable only in pass-through,
+  and a SENtral that acknowledges warm start parameter requests. Time is simulated, so the minutes of logging
+  below take seconds.
+
+    wraparound   ten minutes of slow motion, nearly two laps of the 256 log pages; after a reset the dump must
+                 give back the newest 255 pages of events, in order, poses within 0.01 degrees, times exact
+    power loss   power cut at a random byte of a page write, 500 times; after each reset FR_begin() must find
+                 the end of the log and the dump must still match, losing at most the page being written
+    bandwidth    every quaternion logged at 100 Hz with fast motion (full poses), for a minute: nothing may
+                 be dropped; prints the EEPROM write rate and how long each flush stops the SENtral
+    dump         a dump asked for during a warm start parameter fetch must wait for it, not cut it off with
+                 pass-through, and run once the checkpoint is over
+
+  Exit status 1 if any test fails.
+*/
+
+#include "Arduino.h"
+#include "i2c_t3.h"
+#include "Global.h"
+#include "protos.h"
+
+#include "EM71280_MPU9250_BMP280_M24512DFC_WS_Acc_Cal.ino"
+#include "quaternionFilters"
+#include "AccelCal.cpp"
+
+#include <stdio.h>
+#include <vector>
+
+uint64_t simNow_ns = 0;
+std::string frOut;
+bool frCapture = false;
+int serialIn = -1;
+HostSerial Serial;
+SimEeprom simEeprom;
+SimSentral simSentral;
+i2c_t3_ Wire;
+
+void simAdvance(uint64_t ns)
+{
+  simNow_ns += ns;
+}
+
+static uint32_t rngState = 7;
+static uint32_t rng()
+{
+  rngState = rngState * 1664525 + 1013904223;
+  return rngState >> 8;
+}
+
+// What went into the log, to hold the dump against
+enum EventType { POSE, STATUS, ERROR };
+struct Event {
+  uint32_t t;
+  EventType type;
+  float v[4];
+};
+static std::vector<Event> logged;
+
+// The board turns about a wandering axis, rate radians per 10 ms step
+static float pose[4] = {1, 0, 0, 0};
+static void turn(float rate)
+{
+  float ax = (rng() % 1000) / 1000.0f - 0.5f, ay = (rng() % 1000) / 1000.0f - 0.5f, az = 0.3f;
+  float w = pose[0], x = pose[1], y = pose[2], z = pose[3];
+  w += -rate * (ax * x + ay * y + az * z);
+  x += rate * (ax * pose[0] + ay * z - az * y);
+  y += rate * (ay * pose[0] + az * pose[1] - ax * z);
+  z += rate * (az * pose[0] + ax * pose[2] - ay * pose[1]);
+  float n = sqrtf(w * w + x * x + y * y + z * z);
+  pose[0] = w / n; pose[1] = x / n; pose[2] = y / n; pose[3] = z / n;
+}
+
+// Logs for ms of simulated time: a quaternion every 10 ms, a status change now and then, rare errors
+static void run(uint32_t ms, float rate, bool errors = true)
+{
+  uint64_t end = simNow_ns + ms * 1000000ull;
+  while (simNow_ns < end) {
+    simNow_ns += 10000000;
+    turn(rate);
+    FR_logPose(pose[0], pose[1], pose[2], pose[3]);
+    if (FR_poseCount == 0) {
+      float s = pose[0] < 0 ? -1.0f : 1.0f;
+      logged.push_back({millis(), POSE, {s * pose[0], s * pose[1], s * pose[2], s * pose[3]}});
+    }
+    if (rng() % 500 == 0) {
+      uint8_t sensorStatus = rng(), algoStatus = rng();
+      FR_logStatus(sensorStatus, algoStatus);
+      logged.push_back({millis(), STATUS, {(float)sensorStatus, (float)algoStatus}});
+    }
+    if (errors && rng() % 3000 == 0) {
+      FR_logError(0x11);
+      logged.push_back({millis(), ERROR, {0x11}});
+    }
+    FR_task();
+  }
+}
+
+static void reset()
+{
+  FR_ready = false;
+  FR_buf.used = 0;
+  FR_poseRef = false;
+  FR_poseCount = 0;
+  FR_flushNow = false;
+  FR_dumpNow = false;
+  FR_lastStatus[0] = FR_lastStatus[1] = 0xFF;
+  WS_cpState = WS_CP_IDLE;
+  simEeprom.busyUntil = 0;
+  simSentral.write(0xA0, 0x00);
+  simSentral.write(0x54, 0x00);
+  WS_PassThroughMode();
+  FR_begin();
+  WS_Resume();
+}
+
+// Parses the FR lines of the captured dump
+static std::vector<Event> parse(const std::string & out)
+{
+  std::vector<Event> events;
+  size_t p = 0;
+  while (p < out.size()) {
+    size_t e = out.find('\n', p);
+    std::string line = out.substr(p, e - p);
+    p = e + 1;
+    if (line.compare(0, 3, "FR,") || line.find("time_ms") != std::string::npos || line.find("events") != std::string::npos)
+      continue;
+    Event ev = {};
+    unsigned a, b;
+    if (line.find(",status,") != std::string::npos) {
+      sscanf(line.c_str(), "FR,%u,status,%x,%x", &ev.t, &a, &b);
+      ev.type = STATUS; ev.v[0] = a; ev.v[1] = b;
+    } else if (line.find(",error,") != std::string::npos) {
+      sscanf(line.c_str(), "FR,%u,error,%x", &ev.t, &a);
+      ev.type = ERROR; ev.v[0] = a;
+    } else {
+      sscanf(line.c_str(), "FR,%u,pose,%f,%f,%f,%f", &ev.t, &ev.v[0], &ev.v[1], &ev.v[2], &ev.v[3]);
+      ev.type = POSE;
+    }
+    events.push_back(ev);
+  }
+  return events;
+}
+
+static std::vector<Event> dump()
+{
+  frOut.clear();
+  frCapture = true;
+  FR_dump();
+  frCapture = false;
+  return parse(frOut);
+}
+
+// Holds the dump against the logged events that end at logged[end - 1]; returns the number that differ
+static int compare(const std::vector<Event> & d, size_t end, double * maxAngle, int * maxTimeError)
+{
+  *maxAngle = 0;
+  *maxTimeError = 0;
+  if (d.empty() || d.size() > end) return -1;
+  int bad = 0;
+  for (size_t i = 0; i < d.size(); i++) {
+    const Event & e = logged[end - d.size() + i];
+    const Event & o = d[i];
+    if (o.type != e.type) { bad++; continue; }
+    int dt = abs((int)o.t - (int)e.t);
+    if (dt > *maxTimeError) *maxTimeError = dt;
+    if (e.type == POSE) {
+      double dot = 0, dd = 0;
+      for (int k = 0; k < 4; k++) dot += e.v[k] * o.v[k];
+      double s = dot < 0 ? -1 : 1;
+      for (int k = 0; k < 4; k++) dd += (e.v[k] - s * o.v[k]) * (e.v[k] - s * o.v[k]);
+      double angle = 2 * sqrt(dd) * 180 / M_PI;
+      if (angle > *maxAngle) *maxAngle = angle;
+    } else if (e.v[0] != o.v[0] || e.v[1] != o.v[1]) {
+      bad++;
+    }
+  }
+  return bad;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void wraparound()
+{
+  uint32_t pages = simEeprom.pageWrites;
+  run(600000, 0.002f);
+  FR_flush();
+  size_t end = logged.size();
+  printf("  %u pages written in 10 min, head %u seq %u, %u dropped\n", simEeprom.pageWrites - pages, FR_head, FR_seq, FR_dropped);
+  reset();
+  std::vector<Event> d = dump();
+  double angle;
+  int timeError;
+  int bad = compare(d, end, &angle, &timeError);
+  printf("  after reset: %zu events dumped of %zu logged, %d differ, pose error %.3f deg, time error %d ms\n",
+         d.size(), end, bad, angle, timeError);
+  result("wraparound", simEeprom.pageWrites - pages > FR_PAGES && bad == 0 && angle < 0.01 && timeError == 0 && !FR_dropped);
+}
+
+static void powerLoss()
+{
+  int trials = 500, badTrials = 0;
+  size_t lostMost = 0;
+  for (int k = 0; k < trials; k++) {
+    run(2000 + rng() % 5000, 0.01f);
+    simEeprom.cutAfter = simEeprom.bytesWritten + rng() % 300;
+    try {
+      run(60000, 0.01f);
+    } catch (int) {
+    }
+    simEeprom.cutAfter = -1;
+    reset();
+
+    // The dump must be in time order and end on a logged event, with everything before it intact
+    std::vector<Event> d = dump();
+    bool ok = !d.empty();
+    for (size_t i = 1; ok && i < d.size(); i++) if (d[i].t < d[i - 1].t) ok = false;
+    size_t end = 0;
+    if (ok) for (size_t i = logged.size(); i-- > 0; ) if (logged[i].t == d.back().t) { end = i + 1; break; }
+    double angle;
+    int timeError;
+    if (ok && (compare(d, end, &angle, &timeError) != 0 || angle > 0.05)) ok = false;
+    if (!ok) badTrials++;
+    if (logged.size() - end > lostMost) lostMost = logged.size() - end;
+    logged.resize(end);                  // the lost tail never reached the EEPROM
+  }
+  printf("  %d power cuts, %d with a bad log after reset, at most %zu events lost\n", trials, badTrials, lostMost);
+  result("power loss", badTrials == 0 && lostMost < FR_PAYLOAD_SIZE / 3);
+}
+
+static void bandwidth()
+{
+  FR_poseDecimation = 1;
+  uint32_t pages = simEeprom.pageWrites, dropped = FR_dropped;
+  size_t events = logged.size();
+  uint64_t start = simNow_ns;
+  run(60000, 0.5f, false);
+  double seconds = (simNow_ns - start) / 1e9;
+  printf("  100 Hz full poses: %.0f events/s, %.0f B/s to the EEPROM, %u dropped\n", (logged.size() - events) / seconds,
+         (simEeprom.pageWrites - pages) * 128.0 / seconds, FR_dropped - dropped);
+  bool ok = FR_dropped == dropped;
+
+  for (int i = 0; i < 12; i++) FR_append(FR_EV_POSE, (const uint8_t *)"\1\2\3\4\5\6", 6);
+  simEeprom.busyUntil = 0;
+  start = simNow_ns;
+  FR_flush();
+  printf("  SENtral stopped for %.2f ms per page flush\n", (simNow_ns - start) / 1e6);
+  FR_poseDecimation = FR_POSE_DECIMATION;
+  result("bandwidth", ok);
+}
+
+static void deferredDump()
+{
+  run(5000, 0.01f);
+  uint32_t cut = simSentral.transferCut, passThruInFetch = 0;
+  WS_checkpointStart(false);
+  FR_dumpNow = true;
+  frOut.clear();
+  frCapture = true;
+  int passes = 0;
+  bool early = false;
+  while (WS_cpState != WS_CP_IDLE && passes < 1000) {
+    WS_checkpointTask();
+    bool busy = WS_cpState != WS_CP_IDLE;
+    FR_task();
+    if (busy && !frOut.empty()) early = true;
+    if (WS_cpState == WS_CP_FETCH && simSentral.passThru()) passThruInFetch++;
+    simAdvance(2000000);
+    passes++;
+  }
+  FR_task();
+  frCapture = false;
+  bool dumped = !FR_dumpNow && frOut.find(" events, ") != std::string::npos;
+  cut = simSentral.transferCut - cut;
+  printf("  checkpoint done in %d passes, dump %s, %s, transfer cut %u times\n", passes,
+         early ? "ran during the fetch" : "waited for it", dumped ? "then ran" : "never ran", cut);
+  result("dump", !early && dumped && cut == 0 && passThruInFetch == 0);
+}
+
+int main()
+{
+  simNow_ns = 1000000000ull;
+  reset();
+  wraparound();
+  powerLoss();
+  bandwidth();
+  deferredDump();
+  return failures ? 1 : 0;
+}
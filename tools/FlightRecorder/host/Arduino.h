@@ -0,0 +1,63 @@
+// Host stand-in for the parts of the Teensy core the warm start sketch uses. Time is simulated: it only moves
+// when the models in i2c_t3.h or delay() advance it. Serial output is collected in frOut while frCapture is set.
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sstream>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+#define RISING  3
+#define PI      3.14159265358979f
+#define HEX     16
+#define DEC     10
+
+extern uint64_t simNow_ns;
+void simAdvance(uint64_t ns);
+
+inline uint32_t micros() { return simNow_ns / 1000; }
+inline uint32_t millis() { return simNow_ns / 1000000; }
+inline void delay(uint32_t ms) { simAdvance(ms * 1000000ull); }
+inline void delayMicroseconds(uint32_t us) { simAdvance(us * 1000ull); }
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return 0; }
+inline void attachInterrupt(uint8_t, void (*)(), int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+extern std::string frOut;
+extern bool frCapture;
+extern int serialIn;
+
+struct HostSerial {
+  template<class T> void print(T v) { if (frCapture) { std::ostringstream o; o << v; frOut += o.str(); } }
+  template<class T> void print(T v, int format) {
+    if (!frCapture) return;
+    std::ostringstream o;
+    if (format == HEX) o << std::hex << (unsigned)v;
+    else { o.precision(format); o << std::fixed << v; }
+    frOut += o.str();
+  }
+  template<class T> void println(T v) { print(v); println(); }
+  template<class T> void println(T v, int format) { print(v, format); println(); }
+  void println() { if (frCapture) frOut += "\n"; }
+  template<class... A> void printf(const char *, A...) {}
+  void begin(long) {}
+  int available() { return serialIn >= 0; }
+  int read() { int c = serialIn; serialIn = -1; return c; }
+};
+extern HostSerial Serial;
+
+#endif
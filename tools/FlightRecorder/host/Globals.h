@@ -0,0 +1,2 @@
+// The sketch includes "Globals.h", the file in its directory is Global.h
+#include "Global.h"
@@ -0,0 +1 @@
+// Host stand-in, the sketch includes SPI.h but the flight recorder does not use it
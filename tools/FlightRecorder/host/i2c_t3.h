@@ -0,0 +1,144 @@
+// Host stand-in for i2c_t3 with the two devices on the bus the flight recorder talks to: the M24512DFM EEPROM,
+// only reachable while the SENtral is in pass-through, and a SENtral that answers warm start parameter requests.
+// Every transfer advances simulated time as a 400 kHz bus would.
+#ifndef i2c_t3_h
+#define i2c_t3_h
+
+#include "Arduino.h"
+#include <vector>
+
+enum i2c_pins { I2C_PINS_7_8, I2C_PINS_16_17, I2C_PINS_18_19 };
+#define I2C_MASTER            0
+#define I2C_PULLUP_EXT        0
+#define I2C_RATE_400          0
+#define I2C_NOSTOP            0
+#define I2C_STOP              1
+#define I2C_RX_BUFFER_LENGTH  259
+#define I2C_TX_BUFFER_LENGTH  259
+
+// M24512DFM at 0x50: 16-bit address pointer, page writes wrap within their 128 bytes, NACK during the write cycle.
+// cutAfter >= 0 loses power after that many more data bytes: the rest of the page is left part old, part garbage.
+struct SimEeprom {
+  uint8_t mem[65536];
+  uint16_t ptr = 0;
+  uint64_t busyUntil = 0;
+  uint32_t pageWrites = 0;
+  uint64_t bytesWritten = 0;
+  int64_t cutAfter = -1;
+  uint32_t seed = 1;
+
+  SimEeprom() { memset(mem, 0xFF, sizeof(mem)); }
+  bool busy() { return simNow_ns < busyUntil; }
+  uint32_t cycle_ns() { seed = seed * 1103515245 + 12345; return 3800000 + (seed >> 8) % 1200001; }   // 3.8 to 5 ms
+};
+extern SimEeprom simEeprom;
+
+// SENtral at 0x28: a quaternion every 10 ms while the algorithm runs, flagged in EventStatus until that is read and
+// its read times kept in quatReads; each parameter request acknowledged 1 ms later, with paramSalt added to the
+// values, up to parameter silentFrom if that is set. transferCut counts pass-through or standby requests that
+// arrive in the middle of a parameter transfer.
+struct SimSentral {
+  uint8_t reg[256];
+  uint8_t ptr = 0;
+  uint8_t pendingAck = 0;
+  uint64_t ackAt = 0;
+  uint64_t nextQuat = 0;
+  uint32_t transferCut = 0;
+  uint8_t paramSalt = 0;
+  uint8_t silentFrom = 0;
+  std::vector<uint64_t> quatReads;
+
+  SimSentral() { memset(reg, 0, sizeof(reg)); }
+  bool passThru() { return reg[0x9E] & 0x01; }
+  void tick() {
+    if ((reg[0x54] & 0x01) || passThru()) nextQuat = simNow_ns + 10000000;
+    else if (simNow_ns >= nextQuat) {
+      reg[0x35] |= 0x04;
+      nextQuat = simNow_ns - simNow_ns % 10000000 + 10000000;
+    }
+    if (pendingAck && simNow_ns >= ackAt && !(silentFrom && pendingAck >= silentFrom)) {
+      reg[0x3A] = pendingAck;
+      for (int k = 0; k < 4; k++) reg[0x3B + k] = pendingAck * 4 + k + paramSalt;
+      pendingAck = 0;
+    }
+  }
+  void write(uint8_t r, uint8_t v) {
+    if (r == 0x54 && (reg[0x54] & 0x80) && !(v & 0x80) && reg[0x64]) transferCut++;
+    reg[r] = v;
+    if (r == 0x54) reg[0x38] = (reg[0x38] & ~1) | (v & 1);     // AlgorithmControl standby -> AlgorithmStatus
+    if (r == 0x64 && v) { pendingAck = v; ackAt = simNow_ns + 1000000; }
+    if (r == 0x64 && !v) reg[0x3A] = 0;
+    if (r == 0xA0) reg[0x9E] = v & 1;                           // PassThruControl -> PassThruStatus
+  }
+  uint8_t read(uint8_t r) {
+    uint8_t v = reg[r];
+    if (r == 0x35) reg[0x35] = 0;                               // EventStatus clears on read
+    if (r == 0x00) quatReads.push_back(simNow_ns);
+    return v;
+  }
+};
+extern SimSentral simSentral;
+
+struct i2c_t3_ {
+  uint8_t addr;
+  std::vector<uint8_t> tx, rx;
+  size_t rpos = 0;
+
+  static void bus(size_t bytes) { simAdvance((uint64_t)bytes * 9 * 2500 + 5000); }
+  void begin(int, int, i2c_pins, int, int) {}
+  void beginTransmission(uint8_t a) { addr = a; tx.clear(); }
+  size_t write(uint8_t b) { tx.push_back(b); return 1; }
+  size_t write(const uint8_t * p, size_t n) { tx.insert(tx.end(), p, p + n); return n; }
+
+  uint8_t endTransmission(int stop = I2C_STOP) {
+    if (addr == 0x28) {
+      bus(1 + tx.size());
+      simSentral.tick();
+      if (tx.size()) simSentral.ptr = tx[0];
+      for (size_t i = 1; i < tx.size(); i++) simSentral.write(tx[0] + i - 1, tx[i]);
+      return 0;
+    }
+    if (addr != 0x50) { bus(1 + tx.size()); return 0; }
+    if (!simSentral.passThru() || simEeprom.busy()) { bus(1); return 2; }
+    bus(1 + tx.size());
+    if (tx.size() >= 2) simEeprom.ptr = tx[0] << 8 | tx[1];
+    if (tx.size() > 2 && stop) {
+      uint16_t page = simEeprom.ptr & 0xFF80;
+      for (size_t i = 2; i < tx.size(); i++) {
+        if (simEeprom.cutAfter >= 0 && (int64_t)simEeprom.bytesWritten == simEeprom.cutAfter) {
+          for (size_t j = i; j < tx.size(); j++) {
+            if (rand() & 1) simEeprom.mem[page | (simEeprom.ptr & 0x7F)] = rand();
+            simEeprom.ptr = page | ((simEeprom.ptr + 1) & 0x7F);
+          }
+          throw 1;
+        }
+        simEeprom.bytesWritten++;
+        simEeprom.mem[page | (simEeprom.ptr & 0x7F)] = tx[i];
+        simEeprom.ptr = page | ((simEeprom.ptr + 1) & 0x7F);
+      }
+      simEeprom.busyUntil = simNow_ns + simEeprom.cycle_ns();
+      simEeprom.pageWrites++;
+    }
+    return 0;
+  }
+
+  size_t requestFrom(uint8_t a, size_t n, int = I2C_STOP) {
+    rx.clear();
+    rpos = 0;
+    bus(1 + n);
+    if (a == 0x28) {
+      simSentral.tick();
+      for (size_t i = 0; i < n; i++) rx.push_back(simSentral.read(simSentral.ptr + i));
+      return n;
+    }
+    if (a != 0x50) { rx.assign(n, 0); return n; }
+    if (!simSentral.passThru() || simEeprom.busy()) return 0;
+    for (size_t i = 0; i < n; i++) rx.push_back(simEeprom.mem[simEeprom.ptr++]);
+    return n;
+  }
+  int available() { return rx.size() - rpos; }
+  int read() { return rpos < rx.size() ? rx[rpos++] : -1; }
+};
+extern i2c_t3_ Wire;
+
+#endif
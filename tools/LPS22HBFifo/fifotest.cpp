@@ -0,0 +1,137 @@
+/* fifotest: host simulation of the Butterfly sketch's LPS22HB reads, per sample and through the FIFO
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly fifotest.cpp ../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly/LPS22HB.cpp -o fifotest
+    ./fifotest
+
+  host/Wire.h models the LPS22HB on a 400 kHz bus: 25 Hz, its clock 300 ppm slow, FIFO and register pointer as
+  the datasheet has them. The host answers each interrupt 150 - 250 us late and reads the way the sketch does:
+  readAltimeterPressure() and readAltimeterTemperature() on data ready, or readFIFO() on the watermark.
+
+    delivery     ten minutes at watermarks 8, 16 and 31: every sample must come out once, in order, with no
+                 read over the Wire buffer and no overrun
+    timestamps   in the same runs the reconstructed sample times must stay within 1 ms of when the sensor
+                 made them
+    overrun      the host stops answering for 3 s at watermark 16: the overrun must be counted, the samples
+                 after it must still come out in order and their times must be back within 1 ms
+    wakeups      wakeups per second and bus bytes and time per sample, per sample against each watermark;
+                 watermark 16 must wake at least ten times less often
+
+  Exit status 1 if any test fails.
+*/
+
+#include "LPS22HB.h"
+#include "Wire.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+static const uint8_t PODR = 0x03;   // P_25Hz, whose definition carries a semicolon
+
+uint64_t simNow_ns = 0;
+HostSerial Serial;
+SimLPS22HB simLPS22HB;
+TwoWire Wire;
+
+struct Run {
+  uint32_t wakeups, samples, bytes, outOfOrder, lost, overruns, tooLong;
+  uint64_t bus_ns;
+  double worstError_us;    // reconstructed time against the sensor's, after the stall if there was one
+};
+
+// seconds of 25 Hz samples, read per sample (watermark 0) or through the FIFO; the host is deaf from
+// stallAt for stallFor seconds
+static Run simulate(uint8_t watermark, double seconds, double stallAt = -1, double stallFor = 0)
+{
+  simNow_ns = 0;
+  simLPS22HB = SimLPS22HB();
+  simLPS22HB.period_ns = 40012000;   // 300 ppm slow
+  Wire = TwoWire();
+  LPS22H lps(5);
+  if (watermark) lps.initFIFO(PODR, LPS22H_FIFO_STREAM, watermark);
+  else lps.Init(PODR);
+  simLPS22HB.next_ns = simNow_ns + simLPS22HB.period_ns;
+
+  Run r = {};
+  uint32_t startBytes = Wire.bytes;
+  int32_t expected = -1;
+  lps22h_sample_t samples[LPS22H_FIFO_DEPTH];
+  uint64_t end = (uint64_t)(seconds * 1e9), stall0 = (uint64_t)(stallAt * 1e9), stall1 = (uint64_t)((stallAt + stallFor) * 1e9);
+  uint64_t recovered = stallAt >= 0 ? stall1 + 2000000000ull : 0;
+  srand(1);
+  while (simNow_ns < end) {
+    simNow_ns += 50000;
+    simLPS22HB.tick();
+    if (!simLPS22HB.interrupt() || (stallAt >= 0 && simNow_ns >= stall0 && simNow_ns < stall1)) continue;
+    simNow_ns += 150000 + rand() % 100000;
+    simLPS22HB.tick();
+    r.wakeups++;
+    uint64_t t0 = simNow_ns;
+    uint8_t n = 0;
+    if (watermark) n = lps.readFIFO(samples, LPS22H_FIFO_DEPTH, micros());
+    else {
+      samples[0].pressure = lps.readAltimeterPressure();
+      samples[0].temperature = lps.readAltimeterTemperature();
+      samples[0].timestamp = micros();
+      n = 1;
+    }
+    r.bus_ns += simNow_ns - t0;
+    for (uint8_t i = 0; i < n; i++) {
+      int32_t p = samples[i].pressure;
+      if (p < expected || p >= (int32_t)simLPS22HB.madeAt.size()) r.outOfOrder++;
+      else {
+        if (expected >= 0) r.lost += p - expected;
+        expected = p + 1;
+        double error = (double)(int32_t)(samples[i].timestamp - (uint32_t)(simLPS22HB.madeAt[p] / 1000));
+        if (simNow_ns >= recovered) r.worstError_us = std::max(r.worstError_us, fabs(error));
+      }
+      r.samples++;
+    }
+  }
+  r.bytes = Wire.bytes - startBytes;
+  r.overruns = lps.fifoOverruns;
+  r.tooLong = Wire.tooLong;
+  return r;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+int main()
+{
+  const uint8_t watermarks[] = {8, 16, 31};
+  Run runs[3];
+  bool delivered = true, timed = true;
+  for (int k = 0; k < 3; k++) {
+    Run & r = runs[k] = simulate(watermarks[k], 600);
+    printf("  watermark %2u: %u samples, %u out of order, %u lost, %u overruns, %u reads over the buffer, "
+           "times within %.0f us\n", watermarks[k], r.samples, r.outOfOrder, r.lost, r.overruns, r.tooLong,
+           r.worstError_us);
+    delivered = delivered && r.samples > 600 * 25 * 99 / 100 && !r.outOfOrder && !r.lost && !r.overruns && !r.tooLong;
+    timed = timed && r.worstError_us < 1000;
+  }
+  result("delivery", delivered);
+  result("timestamps", timed);
+
+  Run stalled = simulate(16, 60, 20, 3);
+  printf("  %u overruns, %u samples lost in the stall, %u out of order, times within %.0f us 2 s after it\n",
+         stalled.overruns, stalled.lost, stalled.outOfOrder, stalled.worstError_us);
+  result("overrun", stalled.overruns >= 1 && stalled.lost > 0 && !stalled.outOfOrder && stalled.worstError_us < 1000);
+
+  Run single = simulate(0, 600);
+  printf("  per sample:   %5.2f wakeups/s, %4.1f bus bytes and %3.0f us of bus per sample\n", single.wakeups / 600.0,
+         (double)single.bytes / single.samples, single.bus_ns / 1e3 / single.samples);
+  for (int k = 0; k < 3; k++) {
+    printf("  watermark %2u: %5.2f wakeups/s, %4.1f bus bytes and %3.0f us of bus per sample\n", watermarks[k],
+           runs[k].wakeups / 600.0, (double)runs[k].bytes / runs[k].samples, runs[k].bus_ns / 1e3 / runs[k].samples);
+  }
+  result("wakeups", single.samples == single.wakeups && runs[1].wakeups * 10 <= single.wakeups);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+// Host stand-in for the little of the STM32L4 core LPS22HB.cpp uses. Time is simulated: it only moves when
+// the bus model in Wire.h or the test advances it.
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+#define INPUT   0
+#define HEX     16
+
+extern uint64_t simNow_ns;
+
+inline uint32_t micros() { return simNow_ns / 1000; }
+inline void pinMode(uint8_t, uint8_t) {}
+
+struct HostSerial {
+  template<class T> void print(T) {}
+  template<class T> void print(T, int) {}
+  template<class T> void println(T) {}
+  template<class T> void println(T, int) {}
+};
+extern HostSerial Serial;
+
+#endif
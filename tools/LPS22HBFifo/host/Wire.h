@@ -0,0 +1,112 @@
+// Host stand-in for the STM32L4 core's Wire with an LPS22HB on the bus. The sensor makes a sample every
+// period_ns of its own clock; with FIFO_EN set they queue in its 32 slot FIFO, which the output registers
+// read from, the pointer wrapping from TEMP_OUT_H back to PRESS_OUT_XL. Every transfer advances simulated
+// time as a 400 kHz bus would and is counted. requestFrom() refuses more than the core's 32 byte buffer.
+#ifndef Wire_h
+#define Wire_h
+
+#include "Arduino.h"
+#include <deque>
+#include <vector>
+
+#define BUFFER_LENGTH 32
+
+struct SimLPS22HB {
+  uint8_t reg[128];
+  uint8_t ptr = 0;
+  uint64_t period_ns = 40000000, next_ns = 0;
+  int32_t made = 0;                            // samples so far, also the pressure of the next one
+  std::deque<int32_t> fifo;
+  std::vector<uint64_t> madeAt;                // simulated time each sample was made
+  bool overrun = false;
+
+  SimLPS22HB() { memset(reg, 0, sizeof(reg)); reg[0x0F] = 0xB1; reg[0x11] = 0x10; }
+  bool fifoOn() { return reg[0x11] & 0x40; }
+  uint8_t mode() { return reg[0x14] >> 5; }
+  uint8_t watermark() { return reg[0x14] & 0x1F; }
+
+  void tick() {
+    while (next_ns <= simNow_ns) {
+      if ((reg[0x10] & 0x70) && period_ns) {
+        int32_t p = made++;
+        madeAt.push_back(next_ns);
+        if (fifoOn() && mode() != 0) {
+          if (fifo.size() == 32) { fifo.pop_front(); overrun = true; }
+          fifo.push_back(p);
+        }
+        reg[0x28] = p; reg[0x29] = p >> 8; reg[0x2A] = p >> 16;
+        reg[0x2B] = 0xC4; reg[0x2C] = 0x09;    // 25.00 C
+        reg[0x27] |= 0x03;
+      }
+      next_ns += period_ns;
+    }
+  }
+  uint8_t fifoStatus() {
+    return (fifo.size() >= watermark() && watermark() ? 0x80 : 0) | (overrun ? 0x40 : 0) | (uint8_t)fifo.size();
+  }
+  bool interrupt() { return fifoOn() ? (reg[0x12] & 0x10) && (fifoStatus() & 0x80) : (reg[0x27] & 0x01); }
+
+  void write(uint8_t r, uint8_t v) {
+    reg[r] = v;
+    if (r == 0x14 && mode() == 0) { fifo.clear(); overrun = false; }
+  }
+  uint8_t read() {
+    uint8_t r = ptr;
+    if (r == 0x26) return fifoStatus();
+    bool increment = reg[0x11] & 0x10;
+    if (r >= 0x28 && r <= 0x2C) {
+      uint8_t v = reg[r];
+      if (fifoOn() && !fifo.empty()) {
+        int32_t p = fifo.front();
+        uint8_t slot[5] = {(uint8_t)p, (uint8_t)(p >> 8), (uint8_t)(p >> 16), 0xC4, 0x09};
+        v = slot[r - 0x28];
+      }
+      if (r == 0x2A) reg[0x27] &= ~0x01;
+      if (r == 0x2C) reg[0x27] &= ~0x02;
+      if (increment) ptr = r == 0x2C && fifoOn() ? 0x28 : r + 1;
+      if (r == 0x2C && fifoOn() && !fifo.empty()) { fifo.pop_front(); overrun = false; }
+      return v;
+    }
+    if (increment) ptr = r + 1;
+    return reg[r];
+  }
+};
+extern SimLPS22HB simLPS22HB;
+
+struct TwoWire {
+  uint8_t addr;
+  std::vector<uint8_t> tx, rx;
+  size_t rpos = 0;
+  uint32_t transfers = 0, bytes = 0, tooLong = 0;
+
+  void bus(size_t n) {   // address byte, n bytes, start or restart and stop
+    transfers++;
+    bytes += 1 + n;
+    simNow_ns += (uint64_t)(1 + n) * 9 * 2500 + 5000;
+  }
+  void beginTransmission(uint8_t a) { addr = a; tx.clear(); }
+  size_t write(uint8_t b) { tx.push_back(b); return 1; }
+  uint8_t endTransmission(bool = true) {
+    bus(tx.size());
+    if (addr != 0x5C) return 2;
+    simLPS22HB.tick();
+    if (tx.size()) simLPS22HB.ptr = tx[0] & 0x7F;
+    for (size_t i = 1; i < tx.size(); i++) simLPS22HB.write(simLPS22HB.ptr++, tx[i]);
+    return 0;
+  }
+  uint8_t requestFrom(uint8_t a, size_t n, bool = true) {
+    rx.clear();
+    rpos = 0;
+    if (n > BUFFER_LENGTH) { tooLong++; return 0; }
+    bus(n);
+    if (a != 0x5C) return 0;
+    simLPS22HB.tick();
+    for (size_t i = 0; i < n; i++) rx.push_back(simLPS22HB.read());
+    return n;
+  }
+  int available() { return rx.size() - rpos; }
+  int read() { return rpos < rx.size() ? rx[rpos++] : -1; }
+};
+extern TwoWire Wire;
+
+#endif
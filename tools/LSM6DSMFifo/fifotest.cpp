@@ -0,0 +1,328 @@
+/* fifotest: host simulation of the Butterfly sketch's LSM6DSM reads, on data ready and through the FIFO
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly fifotest.cpp ../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly/LSM6DSM.cpp ../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly/LIS2MDL.cpp -o fifotest
+    ./fifotest
+
+  host/Wire.h models the LSM6DSM on a 400 kHz bus. It runs as the sketch sets it up: gyro at 416 Hz, accel
+  at 208 Hz and temperature at 13 Hz in the FIFO (decimations 1, 2 and 32). The host answers each interrupt
+  100 - 300 us late, reading the way the sketch does: readData() on gyro data ready, or readFIFO() on the
+  threshold, draining again while INT2 stays high.
+
+    delivery     a minute at watermarks 16 and 64: every period must come out once and in order, each data set
+                 with the words of the period it was made in, or held from before when it is not due, and
+                 fresh[] saying which; no read may be over the Wire buffer
+    overrun      the host stops answering for 5 s at watermark 16: the overrun must be counted and the periods
+                 after it must still come out in order and aligned
+    wakeups      wakeups, transfers and bus load per second, data ready against each watermark; watermark 16
+                 must wake at least ten times less often and load the bus less
+    timestamps   five minutes with the chip's clock 1.2 % slow and the host 0.1 - 2 ms late, 12 ms on one wakeup
+                 in twenty: the error of each filter step's dt against the time between the samples it joins,
+                 with micros() on data ready, with the nominal FIFO period and with the FIFO timestamps. The
+                 timestamps must be within 10 us rms and add up to within 10 ms of the true time, with every
+                 period still checked as in delivery. The first 20 s, while the driver learns the tick length
+                 from micros(), are left out
+    hub          a minute of the LIS2MDL at 100 Hz read three ways: on data ready with its own interrupt, the
+                 LSM6DSM through the FIFO at watermark 16 with the LIS2MDL still on its own interrupt, and the
+                 sensor hub reading it into the FIFO every other accel sample. Interrupts, transfers and bytes
+                 per second are printed; every mag sample must come out, the hub's aligned with its period as
+                 in delivery, and the hub must take fewer interrupts and transfers than the FIFO alone
+
+  Exit status 1 if any test fails.
+*/
+
+#include "LSM6DSM.h"
+#include "LIS2MDL.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+uint64_t simNow_ns = 0;
+HostSerial Serial;
+SimLSM6DSM simLSM6DSM;
+SimLIS2MDL simLIS2MDL;
+TwoWire Wire;
+
+static const uint8_t INT1_PIN = 10, INT2_PIN = 9, MAG_PIN = 8;
+
+void simAdvance(uint64_t ns)
+{
+  simNow_ns += ns;
+  simLSM6DSM.tick();
+  simLIS2MDL.tick();
+}
+
+int digitalRead(uint8_t pin)
+{
+  if (pin == INT2_PIN) return simLSM6DSM.int2();
+  if (pin == MAG_PIN) return simLIS2MDL.drdy();
+  return 0;
+}
+
+// Follows the periods coming out of the driver: every data set must hold the words of its period when fresh
+// and the words it had before when not, and the fresh ones must be those due
+struct Checker {
+  uint8_t dec[4], bits[4];
+  int64_t next = 0;
+  uint16_t held[4][3];
+  uint32_t periods = 0, errors = 0, gaps = 0;
+
+  Checker(uint8_t g, uint8_t a, uint8_t m, uint8_t t, uint8_t ds4 = LSM6DSM_DS_TEMP)
+    : dec{g, a, m, t}, bits{LSM6DSM_DS_GYRO, LSM6DSM_DS_ACCEL, LSM6DSM_DS_HUB, ds4} { memset(held, 0, sizeof(held)); }
+
+  void slot(const lsm6dsm_fifo_t & b, uint8_t i, bool mayGap) {
+    const int16_t * cols[4][3] = {{b.gx, b.gy, b.gz}, {b.ax, b.ay, b.az}, {b.mx, b.my, b.mz},
+                                  {b.temperature, b.temperature, b.temperature}};
+    uint8_t fresh = b.fresh[i];
+    int64_t e = next;
+    for (uint8_t ds = 0; ds < 4; ds++) {
+      if (!(fresh & bits[ds]) || bits[ds] == LSM6DSM_DS_TIME) continue;
+      uint16_t k = (uint16_t)((uint16_t)cols[ds][0][i] - ds * 4) >> 4;   // the period, modulo 4096
+      e = next + ((k - next) & 4095);
+      break;
+    }
+    bool gap = e != next;
+    if (gap) {
+      gaps++;
+      if (!mayGap) errors++;
+    }
+    uint8_t due = 0;
+    for (uint8_t ds = 0; ds < 4; ds++) {
+      if (dec[ds] && e % dec[ds] == 0) due |= bits[ds];
+      if (bits[ds] == LSM6DSM_DS_TIME) continue;   // the timestamp is checked through dt
+      uint8_t words = ds == 3 ? 1 : 3;
+      for (uint8_t j = 0; j < words; j++) {
+        uint16_t want = (fresh & bits[ds]) ? simWord((uint32_t)e, ds, j) : held[ds][j];
+        if ((uint16_t)cols[ds][j][i] != want) errors++;
+        held[ds][j] = want;
+      }
+    }
+    if (!gap && fresh != due) errors++;   // the first period after an overrun may have lost its first sets
+    next = e + 1;
+    periods++;
+  }
+};
+
+enum Mag { MAG_NONE, MAG_HOST, MAG_HUB };   // no LIS2MDL, on the host bus with its own interrupt, in the FIFO
+
+struct Options {
+  uint8_t watermark;       // 0 reads on data ready
+  Mag mag;
+  double seconds;
+  bool timestamps;
+  double clock;            // the chip's oscillator against nominal
+  bool spiky;              // host 0.1 - 2 ms late, 12 ms on one wakeup in twenty, instead of 0.1 - 0.3 ms
+  double stallAt, stallFor;   // the host is deaf for stallFor seconds, though the interrupt edge is latched
+
+  Options(uint8_t w, double s) : watermark(w), mag(MAG_NONE), seconds(s), timestamps(false), clock(1), spiky(false), stallAt(-1),
+                                 stallFor(0) {}
+};
+
+struct Run {
+  uint32_t wakeups, transfers, bytes, periods, errors, gaps, lost, overruns, tooLong;
+  uint32_t magSamples, magErrors;   // read from the LIS2MDL or found fresh in the hub data set; out of sequence
+  double seconds;
+  double dtRms_us, dtMean_us, elapsedError_s;   // filter step dt against the true spacing of its samples
+};
+
+static Run simulate(const Options & o)
+{
+  simNow_ns = 0;
+  simLSM6DSM = SimLSM6DSM();
+  simLSM6DSM.clock = o.clock;
+  simLIS2MDL = SimLIS2MDL();
+  Wire = TwoWire();
+  srand(1);
+  LSM6DSM * imu = new LSM6DSM(INT1_PIN, INT2_PIN);
+  imu->init(AFS_2G, GFS_245DPS, AODR_208Hz, GODR_416Hz);
+  if (o.watermark && o.timestamps) imu->initTimestamp();
+  if (o.watermark) imu->initFIFO(GODR_416Hz, LSM6DSM_FIFO_CONTINUOUS, FIFO_DEC_1, FIFO_DEC_2,
+                                 o.mag == MAG_HUB ? FIFO_DEC_4 : FIFO_DEC_OFF, FIFO_DEC_32, o.watermark);
+  LIS2MDL * mag = new LIS2MDL(MAG_PIN);
+  if (o.mag != MAG_NONE) mag->init(MODR_100Hz);
+  if (o.mag == MAG_HUB) imu->initSensorHub(LIS2MDL_ADDRESS, LIS2MDL_OUTX_L_REG, 6, HUB_EVERY_2);
+  if (o.mag == MAG_HOST) mag->status();   // as the sketch does, so the first sample raises the pin
+
+  Run r = {};
+  Checker check(1, 2, o.mag == MAG_HUB ? 4 : 0, 32, o.timestamps ? LSM6DSM_DS_TIME : LSM6DSM_DS_TEMP);
+  int64_t magNext = -1;
+  double period_s = 1 / (416.0 * o.clock), dtSum = 0, dtSum2 = 0, dtTotal = 0, trueTotal = 0;
+  uint32_t dts = 0;
+  uint32_t lastMicros = 0;
+  uint32_t startTransfers = Wire.transfers, startBytes = Wire.bytes;
+  lsm6dsm_fifo_t * buf = new lsm6dsm_fifo_t;
+  uint64_t start = simNow_ns, end = start + (uint64_t)(o.seconds * 1e9);
+  uint64_t stall0 = start + (uint64_t)(o.stallAt * 1e9), stall1 = stall0 + (uint64_t)(o.stallFor * 1e9);
+  bool level = false, pending = false, magLevel = false, magPending = false;
+  int64_t drdyNext = -1;
+  while (simNow_ns < end) {
+    simAdvance(20000);
+    bool now = digitalRead(INT2_PIN);
+    if (now && !level) pending = true;
+    level = now;
+    if (o.mag == MAG_HOST) {
+      now = digitalRead(MAG_PIN);
+      if (now && !magLevel) magPending = true;
+      magLevel = now;
+    }
+    if (o.stallAt >= 0 && simNow_ns >= stall0 && simNow_ns < stall1) continue;
+    if (magPending) {
+      magPending = false;
+      simAdvance(100000 + rand() % 200000);
+      r.wakeups++;
+      if (mag->status() & 0x08) {
+        int16_t d[3];
+        mag->readData(d);
+        uint16_t m = ((uint16_t)d[0] >> 4) & 4095;
+        if (magNext >= 0 && m != (magNext & 4095)) r.magErrors++;
+        magNext = m + 1;
+        r.magSamples++;
+      }
+      magLevel = digitalRead(MAG_PIN);
+    }
+    if (!pending) continue;
+    pending = false;
+    if (!o.spiky) simAdvance(100000 + rand() % 200000);
+    else simAdvance(rand() % 20 ? 100000 + rand() % 1900000 : 12000000);
+    bool settled = simNow_ns - start > 20000000000ull;   // after the first tick length baselines
+    if (o.watermark) {
+      do {
+        r.wakeups++;
+        uint32_t overruns = imu->fifoOverruns;
+        uint8_t n = imu->readFIFO(buf, micros());
+        for (uint8_t i = 0; i < n; i++) {
+          int64_t before = check.next;
+          check.slot(*buf, i, i == 0 && imu->fifoOverruns != overruns);
+          if (o.mag == MAG_HUB && (buf->fresh[i] & LSM6DSM_DS_HUB)) r.magSamples++;
+          if (settled && check.next == before + 1 && before > 0) {
+            double e = (buf->dt[i] - period_s) * 1e6;
+            dtSum += e;
+            dtSum2 += e * e;
+            dtTotal += buf->dt[i];
+            trueTotal += period_s;
+            dts++;
+          }
+        }
+      } while (digitalRead(INT2_PIN));
+    } else {
+      r.wakeups++;
+      int16_t d[7];
+      imu->readData(d);
+      uint16_t k = ((uint16_t)d[1] >> 4) & 4095;
+      uint32_t now = micros();
+      if (drdyNext >= 0) {
+        uint16_t spacing = (k - (drdyNext - 1)) & 4095;   // samples between this read and the last
+        if (settled) {
+          double dt = (now - lastMicros) * 1e-6, e = (dt - spacing * period_s) * 1e6;
+          dtSum += e;
+          dtSum2 += e * e;
+          dtTotal += dt;
+          trueTotal += spacing * period_s;
+          dts++;
+        }
+        if (!o.spiky && k != (drdyNext & 4095)) r.errors++;
+      }
+      lastMicros = now;
+      drdyNext = k + 1;
+      r.periods++;
+    }
+    level = digitalRead(INT2_PIN);
+  }
+  if (o.watermark) {
+    r.periods = check.periods;
+    r.errors = check.errors;
+    r.gaps = check.gaps;
+    r.lost = (uint32_t)(check.next - check.periods);
+  }
+  r.transfers = Wire.transfers - startTransfers;
+  r.bytes = Wire.bytes - startBytes;
+  r.overruns = imu->fifoOverruns;
+  r.tooLong = Wire.tooLong;
+  r.seconds = o.seconds;
+  r.dtMean_us = dts ? dtSum / dts : 0;
+  r.dtRms_us = dts ? sqrt(dtSum2 / dts) : 0;
+  r.elapsedError_s = dtTotal - trueTotal;
+  delete buf;
+  delete mag;
+  delete imu;
+  return r;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void print(const char * name, const Run & r)
+{
+  printf("  %-13s %6.1f wakeups/s, %6.1f transfers/s, %5.0f bytes/s, bus %4.1f %%\n", name, r.wakeups / r.seconds,
+         r.transfers / r.seconds, r.bytes / r.seconds, r.bytes * 9 / 400000.0 / r.seconds * 100);
+}
+
+int main()
+{
+  Run w16 = simulate(Options(16, 60)), w64 = simulate(Options(64, 60));
+  const Run * runs[2] = {&w16, &w64};
+  bool pass = true;
+  for (int k = 0; k < 2; k++) {
+    const Run & r = *runs[k];
+    printf("  watermark %2u: %u periods, %u errors, %u gaps, %u overruns, %u reads over the buffer\n", k ? 64 : 16,
+           r.periods, r.errors, r.gaps, r.overruns, r.tooLong);
+    pass = pass && r.periods > 60 * 416 * 99 / 100 && !r.errors && !r.gaps && !r.overruns && !r.tooLong;
+  }
+  result("delivery", pass);
+
+  Options stall(16, 30);
+  stall.stallAt = 10;
+  stall.stallFor = 5;
+  Run stalled = simulate(stall);
+  printf("  %u overruns, %u periods out, %u lost in %u gap, %u errors\n", stalled.overruns, stalled.periods,
+         stalled.lost, stalled.gaps, stalled.errors);
+  result("overrun", stalled.overruns >= 1 && stalled.gaps == 1 && stalled.lost > 0 && !stalled.errors);
+
+  Run drdy = simulate(Options(0, 60));
+  print("data ready", drdy);
+  print("watermark 16", w16);
+  print("watermark 64", w64);
+  result("wakeups", !drdy.errors && w16.wakeups * 10 <= drdy.wakeups && w16.bytes < drdy.bytes);
+
+  Options o(0, 300);
+  o.clock = 0.988;
+  o.spiky = true;
+  Run micro = simulate(o);
+  o.watermark = 16;
+  Run nominal = simulate(o);
+  o.timestamps = true;
+  Run stamped = simulate(o);
+  const Run * ways[3] = {&micro, &nominal, &stamped};
+  const char * names[3] = {"micros()", "FIFO period", "timestamps"};
+  for (int k = 0; k < 3; k++)
+    printf("  %-12s dt error %7.1f us rms, %7.2f us mean, %8.4f s off after 280 s\n", names[k], ways[k]->dtRms_us,
+           ways[k]->dtMean_us, ways[k]->elapsedError_s);
+  printf("  timestamps: %u periods, %u errors, %u gaps, %u overruns\n", stamped.periods, stamped.errors, stamped.gaps,
+         stamped.overruns);
+  result("timestamps", stamped.dtRms_us < 10 && fabs(stamped.elapsedError_s) < 0.01 && !stamped.errors &&
+                       !stamped.gaps && stamped.periods > 300 * 411 * 99 / 100);
+
+  Options both(0, 60), host(16, 60), hub(16, 60);
+  both.mag = host.mag = MAG_HOST;
+  hub.mag = MAG_HUB;
+  Run ways3[3] = {simulate(both), simulate(host), simulate(hub)};
+  const char * modes[3] = {"data ready", "FIFO + host", "sensor hub"};
+  pass = true;
+  for (int k = 0; k < 3; k++) {
+    const Run & r = ways3[k];
+    print(modes[k], r);
+    printf("  %-13s %6.1f mag samples/s, %u out of sequence, %u errors\n", "", r.magSamples / r.seconds, r.magErrors,
+           r.errors);
+    pass = pass && !r.magErrors && !r.errors && !r.gaps && !r.tooLong;
+  }
+  result("hub", pass && ways3[0].magSamples >= 60 * 99 && ways3[1].magSamples >= 60 * 99 &&
+                ways3[2].magSamples >= 60 * 103 && ways3[2].wakeups < ways3[1].wakeups &&
+                ways3[2].transfers < ways3[1].transfers);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+// Host stand-in for the little of the STM32L4 core LSM6DSM.cpp uses. Time is simulated: it only moves when
+// the bus model in Wire.h, delay() or the test advances it. digitalRead() is the test's, so it can report the
+// simulated interrupt lines.
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+#define INPUT   0
+#define HEX     16
+
+extern uint64_t simNow_ns;
+void simAdvance(uint64_t ns);
+
+inline uint32_t micros() { return simNow_ns / 1000; }
+inline void delay(uint32_t ms) { simAdvance(ms * 1000000ull); }
+inline void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t pin);
+
+struct HostSerial {
+  template<class T> void print(T) {}
+  template<class T> void print(T, int) {}
+  template<class T> void println(T) {}
+  template<class T> void println(T, int) {}
+};
+extern HostSerial Serial;
+
+#endif
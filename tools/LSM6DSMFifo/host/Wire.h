@@ -0,0 +1,247 @@
+// Host stand-in for the STM32L4 core's Wire with an LSM6DSM on the bus. The chip makes a sample every period
+// of the gyro ODR, or of the FIFO ODR while the FIFO is on; its FIFO lays the data sets out in the pattern
+// the FIFO_CTRL3/4 decimations give, reports the pattern position of its oldest word in FIFO_STATUS3/4 and,
+// in continuous mode, drops its oldest words when full. Each data set word carries the period it was made
+// in, so a test can check what comes out. With TIMER_EN the timestamp counter runs off the same oscillator,
+// 25 us a tick with TIMER_HR, and with TIMER_PEDO_FIFO_EN it takes the fourth data set's place. Every
+// transfer advances simulated time as a 400 kHz bus would and is counted; transfer() refuses to read more
+// than the core's 32 byte buffer. Once slave 0 of the sensor hub is set up to read the LIS2MDL's six output
+// bytes, the hub data set carries the words of its period too; otherwise it reads zero. A LIS2MDL on the host
+// bus makes its samples the same way at its own ODR, with DRDY on its interrupt pin.
+#ifndef Wire_h
+#define Wire_h
+
+#include "Arduino.h"
+#include <deque>
+#include <vector>
+
+#define BUFFER_LENGTH 32
+
+// Word j of data set ds (0 gyro, 1 accel, 2 sensor hub, 3 temperature) made in period k
+inline uint16_t simWord(uint32_t k, uint8_t ds, uint8_t j) { return (uint16_t)(k * 16 + ds * 4 + j); }
+
+struct SimLSM6DSM {
+  uint8_t reg[128];
+  double clock = 1.0;                  // chip oscillator against nominal
+  uint64_t next_ns = 0;
+  uint32_t period = 0;                 // samples made since the FIFO (or the gyro) was started
+  uint32_t patternPeriods = 1;
+  uint64_t timerZero_ns = 0;           // when the timestamp counter was last reset
+  uint8_t bankA[128];                  // embedded functions registers, FUNC_CFG_ACCESS bit 7
+  std::deque<uint16_t> fifo;
+  std::vector<uint8_t> pattern;        // data set of every word in one pattern
+  uint32_t head = 0;                   // pattern position of the oldest word
+  bool overrun = false;
+  uint8_t ptr = 0;
+
+  SimLSM6DSM() { memset(reg, 0, sizeof(reg)); memset(bankA, 0, sizeof(bankA)); reg[0x0F] = 0x6A; reg[0x12] = 0x04; }
+
+  static double odr(uint8_t code) {
+    static const double hz[11] = {0, 12.5, 26, 52, 104, 208, 416, 833, 1666, 3333, 6666};
+    return code < 11 ? hz[code] : 0;
+  }
+  uint8_t mode() { return reg[0x0A] & 0x07; }
+  double rate() { return mode() ? odr(reg[0x0A] >> 3 & 0x0F) : odr(reg[0x11] >> 4); }
+  uint16_t threshold() { return reg[0x06] | (reg[0x07] & 0x07) << 8; }
+  uint8_t decimation(uint8_t ds) {
+    static const uint8_t factor[8] = {0, 1, 2, 3, 4, 8, 16, 32};
+    uint8_t code = ds == 0 ? reg[0x08] >> 3 : ds == 1 ? reg[0x08] : ds == 2 ? reg[0x09] : reg[0x09] >> 3;
+    if (ds == 3 && !(reg[0x07] & 0x88)) return 0;   // FIFO_TEMP_EN or TIMER_PEDO_FIFO_EN
+    return factor[code & 0x07];
+  }
+
+  void start() {
+    fifo.clear();
+    pattern.clear();
+    head = 0;
+    overrun = false;
+    period = 0;
+    patternPeriods = 1;
+    if (mode()) {
+      uint32_t periods = 1;
+      for (uint8_t ds = 0; ds < 4; ds++) {
+        uint32_t d = decimation(ds);
+        if (!d) continue;
+        uint32_t a = periods, b = d;
+        while (b) { uint32_t t = a % b; a = b; b = t; }
+        periods = periods / a * d;
+      }
+      for (uint32_t k = 0; k < periods; k++)
+        for (uint8_t ds = 0; ds < 4; ds++)
+          if (decimation(ds) && k % decimation(ds) == 0) for (uint8_t j = 0; j < 3; j++) pattern.push_back(ds);
+      patternPeriods = periods;
+    }
+    if (rate() > 0) next_ns = simNow_ns + (uint64_t)(1e9 / rate() / clock);
+  }
+  // Slave 0 reads LIS2MDL OUTX_L..OUTZ_H with FUNC_EN and MASTER_ON
+  bool hubReadsMag() {
+    return (reg[0x19] & 0x04) && (reg[0x1A] & 0x01) && bankA[0x02] == (0x1E << 1 | 0x01) && bankA[0x03] == 0x68 &&
+           (bankA[0x04] & 0x07) == 6;
+  }
+  uint32_t ticks(uint64_t at_ns) {
+    if (!(reg[0x19] & 0x20)) return 0;
+    double tick_ns = (reg[0x5C] & 0x10 ? 25000.0 : 6400000.0) / clock;
+    return (uint32_t)((at_ns - timerZero_ns) / tick_ns) & 0xFFFFFF;
+  }
+  void pop() {
+    fifo.pop_front();
+    head = (head + 1) % pattern.size();
+  }
+  void push(uint16_t w) {
+    if (fifo.size() == 2048) {
+      pop();
+      overrun = true;
+    }
+    fifo.push_back(w);
+  }
+
+  // One sample: the output registers, then the FIFO's data sets due in this period
+  void sample() {
+    uint32_t k = period++;
+    for (uint8_t j = 0; j < 3; j++) {
+      uint16_t g = simWord(k, 0, j), a = simWord(k, 1, j);
+      reg[0x22 + 2 * j] = g; reg[0x23 + 2 * j] = g >> 8;
+      reg[0x28 + 2 * j] = a; reg[0x29 + 2 * j] = a >> 8;
+    }
+    uint16_t temp = simWord(k, 3, 0);
+    reg[0x20] = temp; reg[0x21] = temp >> 8;
+    reg[0x1E] |= 0x07;
+    if (!mode() || pattern.empty()) return;
+    uint32_t p = k % patternPeriods, t = ticks(next_ns);   // stamped when taken, not when caught up
+    for (uint8_t ds = 0; ds < 4; ds++) {
+      if (!decimation(ds) || p % decimation(ds)) continue;
+      if (ds == 3 && (reg[0x07] & 0x80)) {
+        push((uint16_t)((t >> 8 & 0xFF) | (t >> 16 << 8)));   // TIMESTAMP[15:8], TIMESTAMP[23:16]
+        push((uint16_t)((t & 0xFF) << 8));                    // unused, TIMESTAMP[7:0]
+        push(0);                                              // step count
+      }
+      else if (ds == 2 && !hubReadsMag()) for (uint8_t j = 0; j < 3; j++) push(0);
+      else for (uint8_t j = 0; j < 3; j++) push(simWord(k, ds, j));
+    }
+  }
+
+  void tick() {
+    while (rate() > 0 && next_ns && next_ns <= simNow_ns) {
+      sample();
+      next_ns += (uint64_t)(1e9 / rate() / clock);
+    }
+  }
+  uint8_t status(uint8_t r) {
+    uint16_t n = fifo.size() & 0x7FF;
+    switch (r) {
+      case 0x3A: return n & 0xFF;
+      case 0x3B: return (fifo.size() >= threshold() && threshold() ? 0x80 : 0) | (overrun ? 0x40 : 0) |
+                        (fifo.empty() ? 0x10 : 0) | n >> 8;
+      case 0x3C: return head & 0xFF;
+      case 0x3D: return head >> 8 & 0x03;
+    }
+    return 0;
+  }
+  bool int2() {
+    if (reg[0x0E] & 0x08) return status(0x3B) & 0x80;          // FIFO threshold
+    return (reg[0x0E] & 0x02) && (reg[0x1E] & 0x02);            // gyro data ready, latched
+  }
+
+  void write(uint8_t r, uint8_t v) {
+    if (r != 0x01 && (reg[0x01] & 0x80)) {
+      bankA[r] = v;
+      return;
+    }
+    if (r == 0x42 && v == 0xAA) timerZero_ns = simNow_ns;
+    reg[r] = v;
+    if (r == 0x0A || (r == 0x11 && !mode())) start();
+  }
+  uint8_t read() {
+    uint8_t r = ptr;
+    if (r == 0x3E || r == 0x3F) {
+      uint16_t w = fifo.empty() ? 0 : fifo.front();
+      if (r == 0x3F && !fifo.empty()) {
+        pop();
+        overrun = false;
+      }
+      ptr = r == 0x3E ? 0x3F : 0x3E;
+      return r == 0x3E ? w & 0xFF : w >> 8;
+    }
+    if (r != 0x01 && (reg[0x01] & 0x80)) {
+      ptr = r + 1;
+      return bankA[r];
+    }
+    uint8_t v = r >= 0x3A && r <= 0x3D ? status(r) : reg[r];
+    if (r >= 0x40 && r <= 0x42) v = ticks(simNow_ns) >> 8 * (r - 0x40);
+    if (r >= 0x22 && r <= 0x27) reg[0x1E] &= ~0x02;
+    if (r >= 0x28 && r <= 0x2D) reg[0x1E] &= ~0x01;
+    ptr = r + 1;
+    return v;
+  }
+};
+extern SimLSM6DSM simLSM6DSM;
+
+struct SimLIS2MDL {
+  uint8_t reg[128];
+  uint64_t next_ns = 0;
+  uint32_t sample = 0;                 // samples made since continuous mode started
+  uint8_t ptr = 0;
+
+  SimLIS2MDL() { memset(reg, 0, sizeof(reg)); reg[0x4F] = 0x40; reg[0x60] = 0x03; }
+
+  bool continuous() { return (reg[0x60] & 0x03) == 0; }
+  double rate() { static const double hz[4] = {10, 20, 50, 100}; return hz[reg[0x60] >> 2 & 0x03]; }
+  void tick() {
+    while (continuous() && next_ns <= simNow_ns) {
+      uint32_t m = sample++;
+      for (uint8_t j = 0; j < 3; j++) {
+        uint16_t w = simWord(m, 2, j);
+        reg[0x68 + 2 * j] = w; reg[0x69 + 2 * j] = w >> 8;
+      }
+      reg[0x67] |= 0x08;               // Zyxda
+      next_ns += (uint64_t)(1e9 / rate());
+    }
+  }
+  bool drdy() { return (reg[0x62] & 0x01) && (reg[0x67] & 0x08); }
+  void write(uint8_t r, uint8_t v) {
+    bool was = continuous();
+    reg[r] = v;
+    if (r == 0x60 && continuous() && !was) {
+      sample = 0;
+      next_ns = simNow_ns + (uint64_t)(1e9 / rate());
+    }
+  }
+  uint8_t read() {
+    uint8_t r = ptr & 0x7F;            // the driver sets bit 7 of the sub-address; the chip auto-increments anyway
+    if (r >= 0x68 && r <= 0x6D) reg[0x67] &= ~0x08;
+    ptr = r + 1;
+    return reg[r];
+  }
+};
+extern SimLIS2MDL simLIS2MDL;
+
+struct TwoWire {
+  uint32_t transfers = 0, bytes = 0, tooLong = 0;
+
+  uint8_t transfer(uint8_t address, const uint8_t * tx, size_t txCount, uint8_t * rx, size_t rxCount) {
+    if (rxCount > BUFFER_LENGTH) {
+      tooLong++;
+      return 1;
+    }
+    size_t n = 1 + txCount + (rxCount ? 1 + rxCount : 0);   // address bytes, sub-address, data
+    transfers++;
+    bytes += n;
+    simAdvance((uint64_t)n * 9 * 2500 + 5000);
+    if (address == 0x6A) {
+      if (txCount) simLSM6DSM.ptr = tx[0];
+      for (size_t i = 1; i < txCount; i++) simLSM6DSM.write(simLSM6DSM.ptr++, tx[i]);
+      for (size_t i = 0; i < rxCount; i++) rx[i] = simLSM6DSM.read();
+      return 0;
+    }
+    if (address == 0x1E) {
+      if (txCount) simLIS2MDL.ptr = tx[0];
+      for (size_t i = 1; i < txCount; i++) simLIS2MDL.write(simLIS2MDL.ptr++ & 0x7F, tx[i]);
+      for (size_t i = 0; i < rxCount; i++) rx[i] = simLIS2MDL.read();
+      return 0;
+    }
+    return 2;
+  }
+};
+extern TwoWire Wire;
+
+#endif
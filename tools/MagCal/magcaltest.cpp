@@ -0,0 +1,245 @@
+/* magcaltest: host tests and benchmark of the Butterfly sketch's streaming magnetometer calibration
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly magcaltest.cpp ../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly/MagCal.cpp -o magcaltest
+    ./magcaltest
+
+  Synthetic LIS2MDL samples at 100 Hz of a 0.5 G field, raw = D * field + b with 2 mG of noise. D has its
+  diagonal within 25 % of one and cross-axis terms up to 0.15, b is up to 0.3 G on each axis. The board turns
+  in a random walk, 0.03 rad per sample, so the field direction wanders over the sphere the way it does when
+  the board is carried about. There are no recorded logs in the tree.
+
+    spheres      20 distorted spheres, judged on 2000 fresh directions after one and two minutes: every fit
+                 published must beat the per-axis min/max the sketches used before, on the same samples, and
+                 after two minutes all 20 must hold the corrected field magnitude within 1 % rms. A minute of
+                 random walk leaves some spheres half covered, and the fit waits for more
+    still        a minute lying still must keep next to no samples and publish no fit
+    tracking     after two minutes' fit the offset moves by 0.1 G on every axis, as when the board is remounted;
+                 within five minutes of turning the fit must be back within 5 mG of the new offset
+    benchmark    ns per add() including its periodic solves, per solve() and per apply(), and the state size
+
+  Exit status 1 if any test fails.
+*/
+
+#include "MagCal.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static const float FIELD = 0.5f, NOISE = 0.002f, STEP = 0.03f;
+static const int RATE = 100;
+
+static std::mt19937 rng(7);
+static std::normal_distribution<float> normal(0, 1);
+static std::uniform_real_distribution<float> uniform(-1, 1);
+
+struct Distortion {
+  float D[3][3], b[3];
+
+  void randomise() {
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++) D[i][j] = i == j ? 1 + 0.25f * uniform(rng) : 0.15f * uniform(rng);
+    for (int i = 0; i < 3; i++) b[i] = 0.3f * uniform(rng);
+  }
+  void raw(const float * d, float * m, float noise) const {
+    for (int i = 0; i < 3; i++) {
+      m[i] = b[i] + noise * normal(rng);
+      for (int j = 0; j < 3; j++) m[i] += D[i][j] * FIELD * d[j];
+    }
+  }
+};
+
+static void normalise(float * d)
+{
+  float n = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+  for (int i = 0; i < 3; i++) d[i] /= n;
+}
+
+// One random walk step of the field direction
+static void turn(float * d)
+{
+  for (int i = 0; i < 3; i++) d[i] += STEP * normal(rng);
+  normalise(d);
+}
+
+static float offsetError(const MagCal & cal, const Distortion & s)
+{
+  float e[3] = {cal.offset[0] - s.b[0], cal.offset[1] - s.b[1], cal.offset[2] - s.b[2]};
+  return sqrtf(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+// rms of the corrected field magnitude over fresh directions, for the fit and for min/max on the same samples
+static void spread(MagCal & cal, const Distortion & s, const float * lo, const float * hi, double & ef,
+                   double & em)
+{
+  const int checks = 2000;
+
+  // min/max as magcal*() and LIS2MDL::offsetBias() did it: centre per axis, scale to the mean half range
+  float centre[3], scale[3], half = 0;
+  for (int i = 0; i < 3; i++) {
+    centre[i] = (hi[i] + lo[i]) / 2;
+    half += (hi[i] - lo[i]) / 6;
+  }
+  for (int i = 0; i < 3; i++) scale[i] = half / ((hi[i] - lo[i]) / 2);
+
+  ef = em = 0;
+  for (int k = 0; k < checks; k++) {
+    float t[3] = {normal(rng), normal(rng), normal(rng)}, m[3], c[3], mm[3];
+    normalise(t);
+    s.raw(t, m, 0);
+    cal.apply(m, c);
+    for (int i = 0; i < 3; i++) mm[i] = (m[i] - centre[i]) * scale[i];
+    double nf = sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]) / cal.radius - 1;
+    double nm = sqrt(mm[0] * mm[0] + mm[1] * mm[1] + mm[2] * mm[2]) / half - 1;
+    ef += nf * nf;
+    em += nm * nm;
+  }
+  ef = sqrt(ef / checks);
+  em = sqrt(em / checks);
+}
+
+static void spheres()
+{
+  const int trials = 20;
+  bool pass = true;
+  std::vector<Distortion> sets(trials);
+  std::vector<MagCal> cals(trials);
+  std::vector<std::array<float, 6> > ranges(trials, std::array<float, 6>{{1e9f, 1e9f, 1e9f, -1e9f, -1e9f, -1e9f}});
+  std::vector<std::array<float, 3> > dirs(trials, std::array<float, 3>{{1, 0, 0}});
+  for (int t = 0; t < trials; t++) sets[t].randomise();
+  for (int minute = 1; minute <= 2; minute++) {
+    int fits = 0, good = 0, beaten = 0;
+    std::vector<double> fitSpread, minmaxSpread, offsets;
+    for (int t = 0; t < trials; t++) {
+      float * d = &dirs[t][0], * lo = &ranges[t][0], * hi = &ranges[t][3], m[3];
+      for (int k = 0; k < 60 * RATE; k++) {
+        turn(d);
+        sets[t].raw(d, m, NOISE);
+        cals[t].add(m);
+        for (int i = 0; i < 3; i++) {
+          lo[i] = std::min(lo[i], m[i]);
+          hi[i] = std::max(hi[i], m[i]);
+        }
+      }
+      double ef, em;
+      spread(cals[t], sets[t], lo, hi, ef, em);
+      minmaxSpread.push_back(em);
+      if (!cals[t].valid) continue;
+      fits++;
+      good += ef < 0.01;
+      beaten += ef < em;
+      fitSpread.push_back(ef);
+      offsets.push_back(offsetError(cals[t], sets[t]) * 1000);
+    }
+    std::sort(fitSpread.begin(), fitSpread.end());
+    std::sort(minmaxSpread.begin(), minmaxSpread.end());
+    std::sort(offsets.begin(), offsets.end());
+    printf("  after %d minute%s %d of %d published a fit, %d within 1 %%; field magnitude spread, median and worst:\n",
+           minute, minute > 1 ? "s" : "", fits, trials, good);
+    if (fits) printf("  %-12s %6.2f %% %6.2f %%\n", "ellipsoid", fitSpread[fits / 2] * 100, fitSpread.back() * 100);
+    printf("  %-12s %6.2f %% %6.2f %%\n", "min/max", minmaxSpread[trials / 2] * 100, minmaxSpread.back() * 100);
+    if (fits) printf("  offset error median %.1f mG, worst %.1f mG\n", offsets[fits / 2], offsets.back());
+    pass = pass && beaten == fits && (minute < 2 || good == trials);
+  }
+  result("spheres", pass);
+}
+
+static void still()
+{
+  Distortion s;
+  s.randomise();
+  MagCal cal;
+  float d[3] = {0.6f, -0.48f, 0.64f}, m[3];
+  normalise(d);
+  for (int k = 0; k < 60 * RATE; k++) {
+    s.raw(d, m, NOISE);
+    cal.add(m);
+  }
+  printf("  %u of %d samples kept, fit %s\n", cal.samples, 60 * RATE, cal.valid ? "published" : "none");
+  result("still", cal.samples <= 5 && !cal.valid);
+}
+
+static void tracking()
+{
+  Distortion s;
+  s.randomise();
+  MagCal cal;
+  float d[3] = {1, 0, 0}, m[3];
+  for (int k = 0; k < 120 * RATE; k++) {
+    turn(d);
+    s.raw(d, m, NOISE);
+    cal.add(m);
+  }
+  bool fitted = cal.valid;
+  float before = offsetError(cal, s) * 1000;
+  for (int i = 0; i < 3; i++) s.b[i] += 0.1f;
+  float moved = offsetError(cal, s) * 1000, after[6];
+  for (int minute = 0; minute < 6; minute++) {
+    for (int k = 0; k < 60 * RATE; k++) {
+      turn(d);
+      s.raw(d, m, NOISE);
+      cal.add(m);
+    }
+    after[minute] = offsetError(cal, s) * 1000;
+  }
+  printf("  offset error %.1f mG after two minutes, %.1f mG once moved, then by the minute:", before, moved);
+  for (int minute = 0; minute < 6; minute++) printf(" %.1f", after[minute]);
+  printf(" mG\n");
+  result("tracking", fitted && before < 5 && cal.valid && after[4] < 5);
+}
+
+static volatile float sink;   // keeps apply() from being optimised away
+
+static void benchmark()
+{
+  const int n = 100000;
+  std::vector<float> ms;
+  for (int k = 0; k < n; k++) {
+    float t[3] = {normal(rng), normal(rng), normal(rng)};
+    normalise(t);
+    for (int i = 0; i < 3; i++) ms.push_back(FIELD * t[i] + 0.1f + NOISE * normal(rng));
+  }
+  MagCal cal;
+  int solves = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int k = 0; k < n; k++) solves += cal.add(&ms[3 * k]);
+  auto t1 = std::chrono::steady_clock::now();
+  for (int k = 0; k < n / 10; k++) cal.solve();
+  auto t2 = std::chrono::steady_clock::now();
+  float out[3], sum = 0;
+  for (int k = 0; k < n; k++) {
+    cal.apply(&ms[3 * k], out);
+    sum += out[0];
+  }
+  auto t3 = std::chrono::steady_clock::now();
+  printf("  add()   %6.1f ns per sample, every one kept, %d accepted solves included\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / n, solves);
+  printf("  solve() %6.2f us\n", std::chrono::duration<double, std::micro>(t2 - t1).count() / (n / 10));
+  sink = sum;
+  printf("  apply() %6.1f ns per sample\n", std::chrono::duration<double, std::nano>(t3 - t2).count() / n);
+  printf("  state   %zu bytes\n", sizeof(MagCal));
+  result("benchmark", true);
+}
+
+int main()
+{
+  spheres();
+  still();
+  tracking();
+  benchmark();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+#include "OfflineCloud.h"
+
+#include <atomic>
+#include <thread>
+
+struct Piece {
+  uint32_t batch;          // first return of a sweep: batch, and node within the batch
+  uint16_t node;
+};
+
+static void takeSweep(PointCloud & cloud, std::vector<CloudSweep> & out)
+{
+  if (!cloud.count) return;
+  out.push_back(CloudSweep());
+  CloudSweep & s = out.back();
+  s.x.assign(cloud.x, cloud.x + cloud.count);
+  s.y.assign(cloud.y, cloud.y + cloud.count);
+  s.z.assign(cloud.z, cloud.z + cloud.count);
+  s.quality.assign(cloud.quality, cloud.quality + cloud.count);
+  cloud.clear();
+}
+
+// The sketch's loop from one sweep start up to the next: poses as they arrived, then each batch handed to
+// addScan() in the same slices with the same time stamps
+static void replay(const CloudRecording & rec, PointCloud & cloud, Piece from, Piece to, std::vector<CloudSweep> & out)
+{
+  uint32_t pose = rec.batches[from.batch].poses;
+  for (uint32_t k = pose >= POINTCLOUD_POSES ? pose - POINTCLOUD_POSES : 0; k < pose; k++) cloud.addPose(rec.poses[k].t_us, rec.poses[k].quat);
+
+  for (uint32_t b = from.batch; b < rec.batches.size() && (b < to.batch || (b == to.batch && to.node)); b++) {
+    const CloudBatch & batch = rec.batches[b];
+    for (; pose < batch.poses; pose++) cloud.addPose(rec.poses[pose].t_us, rec.poses[pose].quat);
+
+    const rplidar_measurement_t * nodes = &rec.nodes[batch.first];
+    uint16_t n = batch.count, end = b == to.batch ? to.node : n;
+    uint32_t dt = batch.t1_us - batch.t0_us;
+    cloud.lidarLate_us = batch.lidarLate_us;
+    for (uint16_t done = b == from.batch ? from.node : 0; done < end; ) {
+      // An empty cloud does not stop at a sweep start, so keep it from running into the next piece
+      uint16_t count = cloud.count || end == n ? n - done : end - done;
+      uint16_t used = cloud.addScan(&nodes[done], count, batch.t0_us + dt * done / n, batch.t1_us);
+      if (cloud.sweepReady) takeSweep(cloud, out);
+      else if (!used) break;
+      done += used;
+    }
+  }
+}
+
+std::vector<CloudSweep> cloudAssemble(const CloudRecording & rec, unsigned threads, const float * mount, const float * lever)
+{
+  // Cut at every sweep start after the first return
+  std::vector<Piece> cuts;
+  cuts.push_back({0, 0});
+  for (uint32_t b = 0; b < rec.batches.size(); b++) {
+    const CloudBatch & batch = rec.batches[b];
+    for (uint16_t i = 0; i < batch.count; i++)
+      if ((rec.nodes[batch.first + i].flags & RPLIDAR_FLAG_START) && (b || i)) cuts.push_back({b, i});
+  }
+  cuts.push_back({(uint32_t)rec.batches.size(), 0});
+
+  PointCloud first;
+  first.init();                      // fills the shared sine table before the workers start
+
+  std::vector<std::vector<CloudSweep> > pieces(cuts.size() - 1);
+  if (!threads) threads = std::thread::hardware_concurrency();
+  if (threads < 1) threads = 1;
+  if (threads > pieces.size()) threads = pieces.size();
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&]() {
+      PointCloud * cloud = new PointCloud;   // 13 kB of buffers, too much for a thread stack to take lightly
+      for (size_t i; (i = next++) < pieces.size(); ) {
+        cloud->init();
+        if (mount && lever) cloud->setMounting(mount, lever);
+        replay(rec, *cloud, cuts[i], cuts[i + 1], pieces[i]);
+        takeSweep(*cloud, pieces[i]);
+      }
+      delete cloud;
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+  std::vector<CloudSweep> sweeps;
+  for (size_t i = 0; i < pieces.size(); i++)
+    for (size_t j = 0; j < pieces[i].size(); j++) sweeps.push_back(pieces[i][j]);
+  return sweeps;
+}
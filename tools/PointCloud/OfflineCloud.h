@@ -0,0 +1,53 @@
+/* Offline point cloud assembly on the PC side
+
+  The sketch feeds PointCloud one loop at a time: the EM7180 poses as they come, then each batch of lidar
+  returns, spread evenly between the arrival of the previous batch and its own. A CloudRecording holds the
+  same stream, so a session can be assembled again on a PC with the same code and the same arithmetic:
+
+      poses      one per new EM7180 quaternion, in order
+      batches    per parse() that gave returns: its arrival times, the lidar latency then in force, where its
+                 returns start in nodes, and how many poses had arrived before it
+
+  Sweeps only depend on the last POINTCLOUD_POSES poses before them, so cloudAssemble() cuts the recording at the sweep starts
+  and shares the pieces out to worker threads, each with its own PointCloud. The sweeps come out in order and
+  identical to a single pass.
+*/
+
+#ifndef OfflineCloud_h
+#define OfflineCloud_h
+
+#include "PointCloud.h"
+
+#include <vector>
+
+struct CloudPose {
+  uint32_t t_us;
+  float quat[4];           // qx, qy, qz, qw, as in pose_msg_t.quat
+};
+
+struct CloudBatch {
+  uint32_t t0_us;          // arrival of the previous batch, lidar time
+  uint32_t t1_us;          // arrival of this one
+  int32_t lidarLate_us;
+  uint32_t first;          // index of its first return in nodes
+  uint16_t count;
+  uint32_t poses;          // poses added before it
+};
+
+struct CloudRecording {
+  std::vector<CloudPose> poses;
+  std::vector<CloudBatch> batches;
+  std::vector<rplidar_measurement_t> nodes;
+};
+
+struct CloudSweep {
+  std::vector<float> x, y, z;   // mm, platform frame
+  std::vector<uint8_t> quality;
+};
+
+// Every sweep of the recording, the last one too even though no start flag closes it. threads 0 means one per
+// CPU. mount and lever as for PointCloud::setMounting(), null for identity and zero.
+std::vector<CloudSweep> cloudAssemble(const CloudRecording & rec, unsigned threads, const float * mount = 0,
+                                      const float * lever = 0);
+
+#endif
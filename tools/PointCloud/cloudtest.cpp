@@ -0,0 +1,245 @@
+/* cloudtest: host tests and benchmark of the EM7180_MPU9250_BMP280 point cloud assembly
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -pthread -Ihost -I../../EM7180_MPU9250_BMP280 cloudtest.cpp OfflineCloud.cpp ../../EM7180_MPU9250_BMP280/PointCloud.cpp -o cloudtest
+    ./cloudtest
+
+  The recording is what the sketch would see on a platform rolling at 180 degrees per second under a lidar at
+  10 Hz and 4000 returns per second, everything 12 m away: a loop pass every millisecond, an EM7180 pose every
+  5 ms and in each batch the returns measured in a millisecond that ended 6 ms before they were read. One return
+  in twenty is empty.
+
+    accuracy     every point against the exact rotation at its IMU time, worked out in double precision: the
+                 worst error must stay below 1 mm
+    throughput   points per second through addScan() the way the sketch calls it, on one core
+    offline      cloudAssemble() on 1, 2, 4 and 8 threads must give the sketch loop's sweeps bit for bit; the
+                 time for each is printed
+    formats      PLY and PCD headers and sizes
+
+  Exit status 1 if any test fails.
+*/
+
+#include "OfflineCloud.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+static const uint32_t LOOP_US = 1000;
+static const uint32_t POSE_US = 5000;
+static const uint32_t NODE_US = 250;          // 4000 returns per second
+static const uint32_t TURN_US = 100000;       // 10 Hz
+static const int32_t  LATE_US = 6000;
+static const double   ROLL_RATE = M_PI;       // rad/s
+static const uint32_t RANGE_Q2 = 12000 * 4;
+
+static double roll(double t_us) { return ROLL_RATE * t_us * 1e-6; }
+
+static bool empty(uint32_t t) { return (t / NODE_US) % 20 == 7; }
+
+// The return measured at IMU time t; the sketch time stamps it on arrival, LATE_US later
+static rplidar_measurement_t node(uint32_t t)
+{
+  rplidar_measurement_t m;
+  uint32_t phase = t % TURN_US;
+  m.angle_q6 = (uint16_t)((uint64_t)phase * 360 * 64 / TURN_US);
+  m.quality = empty(t) ? 0 : 47;
+  m.flags = phase == 0 ? RPLIDAR_FLAG_START : 0;
+  m.distance_q2 = empty(t) ? 0 : RANGE_Q2;
+  return m;
+}
+
+static CloudRecording record(uint32_t seconds)
+{
+  CloudRecording rec;
+  for (uint32_t now = LATE_US + LOOP_US; now <= seconds * 1000000u; now += LOOP_US) {
+    if (now % POSE_US == 0) {
+      double a = roll(now);
+      CloudPose p = {now, {(float)sin(a / 2), 0, 0, (float)cos(a / 2)}};
+      rec.poses.push_back(p);
+    }
+    CloudBatch b = {now - LOOP_US, now, LATE_US, (uint32_t)rec.nodes.size(), 0,
+                    (uint32_t)rec.poses.size()};
+    for (uint32_t t = now - LOOP_US; t < now; t += NODE_US, b.count++) rec.nodes.push_back(node(t - LATE_US));
+    rec.batches.push_back(b);
+  }
+  return rec;
+}
+
+// The sketch's loop, one pose and one batch at a time
+static std::vector<CloudSweep> sketch(const CloudRecording & rec, PointCloud & cloud, uint64_t * points)
+{
+  std::vector<CloudSweep> sweeps;
+  uint32_t pose = 0;
+  cloud.init();
+  for (size_t k = 0; k < rec.batches.size(); k++) {
+    const CloudBatch & b = rec.batches[k];
+    for (; pose < b.poses; pose++) cloud.addPose(rec.poses[pose].t_us, rec.poses[pose].quat);
+    const rplidar_measurement_t * nodes = &rec.nodes[b.first];
+    uint16_t n = b.count;
+    uint32_t dt = b.t1_us - b.t0_us;
+    cloud.lidarLate_us = b.lidarLate_us;
+    for (uint16_t done = 0; done < n; ) {
+      uint16_t used = cloud.addScan(&nodes[done], n - done, b.t0_us + dt * done / n, b.t1_us);
+      if (cloud.sweepReady) {
+        if (points) *points += cloud.count;
+        else {
+          CloudSweep s;
+          s.x.assign(cloud.x, cloud.x + cloud.count);
+          s.y.assign(cloud.y, cloud.y + cloud.count);
+          s.z.assign(cloud.z, cloud.z + cloud.count);
+          s.quality.assign(cloud.quality, cloud.quality + cloud.count);
+          sweeps.push_back(s);
+        }
+        cloud.clear();
+      }
+      else if (!used) break;
+      done += used;
+    }
+  }
+  return sweeps;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void accuracy()
+{
+  CloudRecording rec = record(2);
+  PointCloud * cloud = new PointCloud;
+  std::vector<CloudSweep> sweeps = sketch(rec, *cloud, 0);
+  delete cloud;
+
+  // The sweeps after the first hold the non-empty returns in order from the first sweep start; walk the time
+  // they were measured at alongside them
+  double worst = 0;
+  size_t points = 0;
+  uint32_t t = TURN_US;
+  for (size_t s = 1; s < sweeps.size(); s++) {   // the first is cut short by the missing poses
+    for (size_t i = 0; i < sweeps[s].x.size(); i++, points++) {
+      while (empty(t)) t += NODE_US;
+      rplidar_measurement_t m = node(t);
+      double a = m.angle_q6 / 64.0 * M_PI / 180, d = m.distance_q2 / 4.0;
+      double lx = d * cos(a), ly = -d * sin(a), r = roll(t);
+      double x = lx, y = ly * cos(r), z = ly * sin(r);
+      double e = sqrt((x - sweeps[s].x[i]) * (x - sweeps[s].x[i]) + (y - sweeps[s].y[i]) * (y - sweeps[s].y[i]) +
+                      (z - sweeps[s].z[i]) * (z - sweeps[s].z[i]));
+      worst = std::max(worst, e);
+      t += NODE_US;
+    }
+  }
+  printf("  %zu points in %zu sweeps, worst error %.3f mm at 12 m\n", points, sweeps.size() - 1, worst);
+  result("accuracy", points > 5000 && worst < 1.0);
+}
+
+static void throughput()
+{
+  CloudRecording rec = record(60);
+  PointCloud * cloud = new PointCloud;
+  uint64_t points = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  sketch(rec, *cloud, &points);
+  auto t1 = std::chrono::steady_clock::now();
+  delete cloud;
+  double s = std::chrono::duration<double>(t1 - t0).count();
+  printf("  %llu points in %.1f ms, %.1f M points/s, %.0f ns per point\n", (unsigned long long)points, s * 1e3,
+         points / s * 1e-6, s * 1e9 / points);
+  result("throughput", points > 0);
+}
+
+static bool same(const std::vector<CloudSweep> & a, const std::vector<CloudSweep> & b)
+{
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z || a[i].quality != b[i].quality) return false;
+  }
+  return true;
+}
+
+static void offline()
+{
+  CloudRecording rec = record(60);
+  PointCloud * cloud = new PointCloud;
+  std::vector<CloudSweep> reference = sketch(rec, *cloud, 0);
+  if (cloud->count) {   // the sweep still open at the end of the recording
+    CloudSweep s;
+    s.x.assign(cloud->x, cloud->x + cloud->count);
+    s.y.assign(cloud->y, cloud->y + cloud->count);
+    s.z.assign(cloud->z, cloud->z + cloud->count);
+    s.quality.assign(cloud->quality, cloud->quality + cloud->count);
+    reference.push_back(s);
+  }
+  delete cloud;
+
+  bool pass = true;
+  const unsigned threads[] = {1, 2, 4, 8};
+  for (unsigned k = 0; k < 4; k++) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<CloudSweep> sweeps = cloudAssemble(rec, threads[k]);
+    auto t1 = std::chrono::steady_clock::now();
+    bool ok = same(sweeps, reference);
+    printf("  %u thread%s: %zu sweeps in %.1f ms, %s\n", threads[k], threads[k] > 1 ? "s" : "", sweeps.size(),
+           std::chrono::duration<double, std::milli>(t1 - t0).count(), ok ? "identical" : "DIFFERENT");
+    pass = pass && ok;
+  }
+  printf("  %u CPU%s on this machine\n", std::thread::hardware_concurrency(),
+         std::thread::hardware_concurrency() == 1 ? "" : "s");
+  result("offline", pass);
+}
+
+class Capture : public Print
+{
+  public:
+    std::string data;
+    size_t write(const uint8_t * buffer, size_t size) { data.append((const char *)buffer, size); return size; }
+};
+
+static void formats()
+{
+  CloudRecording rec = record(1);
+  std::vector<CloudSweep> sweeps = cloudAssemble(rec, 1);
+  PointCloud * cloud = new PointCloud;
+  cloud->init();
+  const CloudSweep & s = sweeps[2];
+  cloud->count = s.x.size();
+  std::copy(s.x.begin(), s.x.end(), cloud->x);
+  std::copy(s.y.begin(), s.y.end(), cloud->y);
+  std::copy(s.z.begin(), s.z.end(), cloud->z);
+  std::copy(s.quality.begin(), s.quality.end(), cloud->quality);
+
+  Capture ply, pcd;
+  cloud->writePLY(ply);
+  cloud->writePCD(pcd);
+  size_t plyHeader = ply.data.find("end_header\n") + 11, pcdHeader = pcd.data.find("DATA binary\n") + 12;
+  std::string count = "element vertex " + std::to_string(cloud->count) + "\n";
+  bool pass = ply.data.compare(0, 4, "ply\n") == 0 && ply.data.find(count) != std::string::npos &&
+              ply.data.size() == plyHeader + 13u * cloud->count &&
+              pcd.data.find("POINTS " + std::to_string(cloud->count) + "\n") != std::string::npos &&
+              pcd.data.size() == pcdHeader + 13u * cloud->count &&
+              ply.data.compare(plyHeader, std::string::npos, pcd.data, pcdHeader, std::string::npos) == 0;
+  float x0;
+  memcpy(&x0, &ply.data[plyHeader], 4);
+  pass = pass && x0 == cloud->x[0];
+  printf("  %u points: PLY %zu bytes, PCD %zu bytes\n", cloud->count, ply.data.size(), pcd.data.size());
+  delete cloud;
+  result("formats", pass);
+}
+
+int main()
+{
+  accuracy();
+  throughput();
+  offline();
+  formats();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+// Host stand-in for the little of the Arduino core PointCloud uses: math, PI and Print
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define PI 3.14159265358979f
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t * buffer, size_t size) = 0;
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t print(const char * s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(unsigned int v) {
+      char s[12];
+      snprintf(s, sizeof(s), "%u", v);
+      return print(s);
+    }
+};
+
+#endif
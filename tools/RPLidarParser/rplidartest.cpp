@@ -0,0 +1,449 @@
+/* rplidartest: host fuzz tests and throughput benchmark of the RPLidar stream parser in EM7180_MPU9250_BMP280
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../EM7180_MPU9250_BMP280 rplidartest.cpp ../../EM7180_MPU9250_BMP280/RPLidarParser.cpp -o rplidartest
+    ./rplidartest
+
+  The streams are synthetic captures: a response descriptor and then standard nodes, express capsules or ultra
+  capsules encoded here from known returns, a sweep of 5 to 12 m walls at 10 Hz. The expected returns come from
+  these encoders and the protocol document, not from the parser.
+
+    clean        each stream whole, through rings of 256 B to 64 kB in DMA sized pieces of 1 to 300 bytes: every
+                 return must come out, distances exact, angles within 1/32 degree
+    truncated    bytes dropped from the middle of a node or capsule, as on a UART overrun, 300 times per mode
+    corrupted    bits flipped and bytes overwritten inside nodes and capsules, 300 times per mode
+    resync       line noise (random bytes, lone sync bytes, fake capsule headers and stray descriptors) between
+                 nodes and capsules, 300 times per mode
+                 For these three the parser must never write past maxOut or return an angle of 360 degrees or
+                 more, and must lock back onto the stream. Capsule modes must pass only returns that were sent,
+                 at their sent angles, and lose only the capsules the damage touched and their neighbours. The
+                 one exception is a damaged capsule that still passes the 8 bit checksum by chance, 1 in 256;
+                 the test finds those in the damaged stream and lets each spoil two capsules. Standard nodes
+                 carry only two check bits, so that mode may pass a few false nodes, and lose a few true ones,
+                 at each hit and for every 5 bytes of noise
+    throughput   MB/s of stream parsed and returns per second for each mode, through a 4 kB ring in 64 byte
+                 pieces
+
+  Exit status 1 if any test fails.
+*/
+
+#include "RPLidarParser.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static std::mt19937 rng(1);
+
+static int uniform(int lo, int hi)
+{
+  return std::uniform_int_distribution<int>(lo, hi)(rng);
+}
+
+struct Return {
+  double angle;          // degrees
+  uint32_t dist_q2;
+};
+
+// A scene of rough walls; distance in mm at an angle in degrees. The roughness keeps neighbouring returns apart
+// when the output is matched against what was sent.
+static uint32_t scene(double angle)
+{
+  return (uint32_t)(5000 + 7000 * fabs(sin(angle * M_PI / 90))) + uniform(0, 255);
+}
+
+static void descriptor(std::vector<uint8_t> & s, uint8_t type, uint8_t len)
+{
+  const uint8_t d[7] = {RPLIDAR_SYNC_BYTE1, RPLIDAR_SYNC_BYTE2, len, 0, 0, 0x40, type};
+  s.insert(s.end(), d, d + 7);
+}
+
+// Standard scan: 5 byte nodes, 2000 per second
+static void standardStream(std::vector<uint8_t> & s, std::vector<Return> & sent, std::vector<size_t> & at, int nodes)
+{
+  descriptor(s, RPLIDAR_ANS_TYPE_MEASUREMENT, RPLIDAR_NODE_LEN);
+  for (int i = 0; i < nodes; i++) {
+    uint16_t angle_q6 = (uint16_t)((i * 23040L / 200 + uniform(0, 40)) % 23040);
+    bool start = angle_q6 < 23040 / 200;
+    uint16_t dist_q2 = (uint16_t)std::min<uint32_t>(scene(angle_q6 / 64.0) * 4, 65535);
+    uint8_t quality = i % 7 ? 47 : 0;
+    uint8_t n[5] = {(uint8_t)(quality << 2 | (start ? 1 : 2)), (uint8_t)(angle_q6 << 1 | 1), (uint8_t)(angle_q6 >> 7),
+                    (uint8_t)dist_q2, (uint8_t)(dist_q2 >> 8)};
+    s.insert(s.end(), n, n + 5);
+    at.push_back(s.size());
+    sent.push_back({angle_q6 / 64.0, dist_q2});
+  }
+}
+
+static void checksum(uint8_t * c, int len)
+{
+  uint8_t sum = 0;
+  for (int i = 2; i < len; i++) sum ^= c[i];
+  c[0] = 0xA0 | (sum & 0x0F);
+  c[1] = 0x50 | (sum >> 4);
+}
+
+// Express scan: 84 byte capsules of 32 returns, each return decoded against the next capsule's start angle.
+// Returns sent with capsule k are only known once capsule k + 1 is there, so at[] marks where they end.
+static void expressStream(std::vector<uint8_t> & s, std::vector<Return> & sent, std::vector<size_t> & at, int capsules)
+{
+  descriptor(s, RPLIDAR_ANS_TYPE_CAPSULED, RPLIDAR_CAPSULE_LEN);
+  int start_q6 = uniform(0, 23039);
+  std::vector<int> starts;
+  for (int k = 0; k <= capsules; k++) starts.push_back((start_q6 + k * 23040L / 125 + uniform(-8, 8) * (k > 0)) % 23040);
+  for (int k = 0; k < capsules; k++) {
+    uint8_t c[RPLIDAR_CAPSULE_LEN];
+    c[2] = (uint8_t)starts[k];
+    c[3] = (uint8_t)(starts[k] >> 8) | (k == 0 ? 0x80 : 0);
+    int diff = starts[k + 1] - starts[k];
+    if (diff < 0) diff += 23040;
+    for (int j = 0; j < 16; j++) {
+      uint8_t * cabin = &c[4 + 5 * j];
+      int off[2] = {uniform(0, 63), uniform(0, 63)};
+      uint16_t d[2];
+      for (int m = 0; m < 2; m++) {
+        double angle = (starts[k] + diff * (2 * j + m) / 32.0) / 64.0 - off[m] / 8.0;
+        if (angle < 0) angle += 360;
+        if (angle >= 360) angle -= 360;
+        uint32_t dist = uniform(0, 19) ? scene(angle) : 0;
+        d[m] = (uint16_t)((dist * 4) & 0xFFFC) | (off[m] >> 4);
+        if (k + 1 < capsules) sent.push_back({angle, (uint32_t)d[m] & 0xFFFC});
+      }
+      cabin[0] = (uint8_t)d[0];
+      cabin[1] = (uint8_t)(d[0] >> 8);
+      cabin[2] = (uint8_t)d[1];
+      cabin[3] = (uint8_t)(d[1] >> 8);
+      cabin[4] = (uint8_t)((off[0] & 0x0F) | (off[1] & 0x0F) << 4);
+    }
+    checksum(c, RPLIDAR_CAPSULE_LEN);
+    s.insert(s.end(), c, c + RPLIDAR_CAPSULE_LEN);
+    if (k > 0) at.push_back(s.size());
+  }
+}
+
+// Angle offset of the ultra capsule ranging module, from the protocol document, degrees
+static double ultraOffset(uint32_t dist_q2)
+{
+  int32_t offset_q16 = 8578;
+  if (dist_q2 >= 50 * 4) {
+    int32_t k2 = 98361 / dist_q2;
+    offset_q16 = 9150 - (k2 << 6) - (k2 * k2 * k2) / 98304;
+  }
+  return offset_q16 / 65536.0 * 180 / M_PI;
+}
+
+// Ultra capsules: 132 bytes of 32 cabins, 96 returns. Distances are kept below 512 mm so the majors are not
+// scaled. A cabin's first predicted return is a delta from its own major, the second from the next cabin's.
+static void ultraStream(std::vector<uint8_t> & s, std::vector<Return> & sent, std::vector<size_t> & at, int capsules)
+{
+  descriptor(s, RPLIDAR_ANS_TYPE_CAPSULED_ULTRA, RPLIDAR_ULTRA_CAPSULE_LEN);
+  int start_q6 = uniform(0, 23039);
+  std::vector<int> starts, majors;
+  for (int k = 0; k <= capsules; k++) starts.push_back((start_q6 + k * 23040L / 42 + uniform(-8, 8) * (k > 0)) % 23040);
+  for (int j = 0; j <= 32 * capsules; j++) majors.push_back(uniform(100, 400));
+  for (int k = 0; k < capsules; k++) {
+    uint8_t c[RPLIDAR_ULTRA_CAPSULE_LEN];
+    c[2] = (uint8_t)starts[k];
+    c[3] = (uint8_t)(starts[k] >> 8) | (k == 0 ? 0x80 : 0);
+    int diff = starts[k + 1] - starts[k];
+    if (diff < 0) diff += 23040;
+    for (int j = 0; j < 32; j++) {
+      int major = majors[32 * k + j], next = majors[32 * k + j + 1];
+      int p1 = uniform(-90, 90), p2 = uniform(-90, 90);
+      uint32_t cabin = (uint32_t)major | ((uint32_t)(p1 & 0x3FF) << 12) | ((uint32_t)(p2 & 0x3FF) << 22);
+      memcpy(&c[4 + 4 * j], &cabin, 4);
+      uint32_t dist[3] = {(uint32_t)major * 4, (uint32_t)(major + p1) * 4, (uint32_t)(next + p2) * 4};
+      for (int m = 0; m < 3; m++) {
+        double angle = (starts[k] + diff * (3 * j + m) / 96.0) / 64.0 - ultraOffset(dist[m]);
+        if (angle < 0) angle += 360;
+        if (angle >= 360) angle -= 360;
+        if (k + 1 < capsules) sent.push_back({angle, dist[m]});
+      }
+    }
+    checksum(c, RPLIDAR_ULTRA_CAPSULE_LEN);
+    s.insert(s.end(), c, c + RPLIDAR_ULTRA_CAPSULE_LEN);
+    if (k > 0) at.push_back(s.size());
+  }
+}
+
+enum Kind { STANDARD, EXPRESS, ULTRA };
+static const char * kindName[3] = {"standard", "express", "ultra"};
+
+struct Stream {
+  std::vector<uint8_t> bytes;
+  std::vector<Return> sent;
+  std::vector<size_t> at;  // per node, or per pair of capsules, where its returns are complete
+  int perUnit;             // returns per entry of at
+  int unitLen;             // bytes of a node or capsule
+};
+
+static Stream makeStream(Kind kind, int units)
+{
+  Stream st;
+  if (kind == STANDARD) {
+    standardStream(st.bytes, st.sent, st.at, units);
+    st.perUnit = 1;
+    st.unitLen = RPLIDAR_NODE_LEN;
+  } else if (kind == EXPRESS) {
+    expressStream(st.bytes, st.sent, st.at, units);
+    st.perUnit = 32;
+    st.unitLen = RPLIDAR_CAPSULE_LEN;
+  } else {
+    ultraStream(st.bytes, st.sent, st.at, units);
+    st.perUnit = 96;
+    st.unitLen = RPLIDAR_ULTRA_CAPSULE_LEN;
+  }
+  return st;
+}
+
+// Runs bytes through a ring of 1 << ringBits in pieces of 1 to maxPiece bytes; false if the parser misbehaved
+static bool feed(RPLidarParser & p, const std::vector<uint8_t> & bytes, int ringBits, int maxPiece, std::vector<rplidar_measurement_t> & got)
+{
+  const uint16_t maxOut = 128;
+  std::vector<uint8_t> ring(1 << ringBits);
+  uint32_t mask = ring.size() - 1, head = p.tail;
+  rplidar_measurement_t out[maxOut + 1];
+  size_t i = 0;
+  bool ok = true;
+  while (true) {
+    uint32_t room = ring.size() - (head - p.tail);
+    uint32_t piece = std::min<uint32_t>(std::min<uint32_t>(uniform(1, maxPiece), room), bytes.size() - i);
+    for (uint32_t j = 0; j < piece; j++) ring[head++ & mask] = bytes[i++];
+    out[maxOut].angle_q6 = 0xBEEF;
+    uint16_t n = p.parse(ring.data(), mask, head, out, maxOut);
+    if (n > maxOut || out[maxOut].angle_q6 != 0xBEEF || (int32_t)(head - p.tail) < 0) ok = false;
+    for (uint16_t j = 0; j < n; j++) {
+      if (out[j].angle_q6 >= 23040) ok = false;
+      got.push_back(out[j]);
+    }
+    if (i == bytes.size() && (n == 0 || !ok)) break;
+  }
+  return ok;
+}
+
+static double angleError(const Return & r, const rplidar_measurement_t & m)
+{
+  double e = fabs(m.angle_q6 / 64.0 - r.angle);
+  return std::min(e, 360 - e);
+}
+
+static bool same(const Return & r, const rplidar_measurement_t & m)
+{
+  return m.distance_q2 == r.dist_q2 && angleError(r, m) < 1 / 32.0;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void clean()
+{
+  bool pass = true;
+  for (int kind = STANDARD; kind <= ULTRA; kind++) {
+    int trials = 0, bad = 0;
+    double worst = 0;
+    for (int ringBits = 8; ringBits <= 16; ringBits += 2) {
+      for (int maxPiece = 1; maxPiece <= 300; maxPiece = maxPiece * 3 + 1) {
+        Stream st = makeStream((Kind)kind, kind == STANDARD ? 3000 : 300);
+        RPLidarParser p;
+        std::vector<rplidar_measurement_t> got;
+        bool ok = feed(p, st.bytes, ringBits, maxPiece, got) && got.size() == st.sent.size() && !p.bytesDiscarded &&
+                  !p.checksumErrors;
+        for (size_t i = 0; ok && i < got.size(); i++) {
+          worst = std::max(worst, angleError(st.sent[i], got[i]));
+          if (!same(st.sent[i], got[i])) ok = false;
+        }
+        trials++;
+        if (!ok) bad++;
+      }
+    }
+    printf("  %-8s %d streams, %d wrong, worst angle error %.4f degrees\n", kindName[kind], trials, bad, worst);
+    if (bad) pass = false;
+  }
+  result("clean", pass);
+}
+
+enum Damage { TRUNCATE, CORRUPT, NOISE };
+
+// Damages a stream in a few places and holds what comes out against what was sent
+static void damaged(Damage damage, const char * name)
+{
+  bool pass = true;
+  for (int kind = STANDARD; kind <= ULTRA; kind++) {
+    int trials = 300, bad = 0, events = 0;
+    long lost = 0, allowed = 0, foreign = 0, sentTotal = 0, chance = 0;
+    for (int t = 0; t < trials; t++) {
+      Stream st = makeStream((Kind)kind, kind == STANDARD ? 600 : 60);
+
+      // Damage applied back to front so earlier offsets stay put
+      std::vector<uint8_t> s = st.bytes;
+      std::vector<bool> touched(st.at.size() + 1, false), intact(st.at.size() + 1, true);
+      int hits = uniform(1, 4);
+      long noiseBytes = 0;
+      std::vector<size_t> where;
+      while ((int)where.size() < hits) {  // far enough apart that no two hits touch the same units
+        size_t w = uniform(20, (int)s.size() - 20);
+        bool near = false;
+        for (size_t o : where) if (w + 4 * st.unitLen > o && o + 4 * st.unitLen > w) near = true;
+        if (!near) where.push_back(w);
+      }
+      std::sort(where.rbegin(), where.rend());
+      for (size_t w : where) {
+        size_t from = w, to = w;
+        if (damage == TRUNCATE) {
+          to = std::min(w + uniform(1, st.unitLen - 1), s.size());
+          s.erase(s.begin() + from, s.begin() + to);
+        } else if (damage == CORRUPT) {
+          int n = uniform(1, 3);
+          for (int j = 0; j < n; j++) {
+            size_t b = std::min(w + uniform(0, 8), s.size() - 1);
+            if (uniform(0, 1)) s[b] ^= 1 << uniform(0, 7);
+            else s[b] = (uint8_t)uniform(0, 255);
+            to = std::max(to, b + 1);
+          }
+        } else {
+          std::vector<uint8_t> noise;
+          int n = uniform(1, 200);
+          for (int j = 0; j < n; j++) {
+            int r = uniform(0, 9);
+            if (r == 0) noise.push_back(RPLIDAR_SYNC_BYTE1);
+            else if (r == 1) { noise.push_back(0xA0 | uniform(0, 15)); noise.push_back(0x50 | uniform(0, 15)); }
+            else noise.push_back((uint8_t)uniform(0, 255));
+          }
+          if (uniform(0, 3) == 0) descriptor(noise, kind == STANDARD ? RPLIDAR_ANS_TYPE_MEASUREMENT : kind == EXPRESS ?
+                                             RPLIDAR_ANS_TYPE_CAPSULED : RPLIDAR_ANS_TYPE_CAPSULED_ULTRA, st.unitLen);
+          // in between units, at the end of the one w falls in
+          size_t u = std::lower_bound(st.at.begin(), st.at.end(), w + st.unitLen * (kind != STANDARD)) - st.at.begin();
+          from = to = u < st.at.size() ? st.at[u] - st.unitLen * (kind != STANDARD) : s.size();
+          s.insert(s.begin() + from, noise.begin(), noise.end());
+          noiseBytes += noise.size();
+        }
+        for (size_t u = 0; u < touched.size(); u++) {
+          size_t begin = 7 + u * st.unitLen, end = begin + st.unitLen;
+          if (from < end && to > begin) intact[u] = false;
+          if (from < end && (to > begin || (from == to && from == end - (damage == NOISE) * st.unitLen))) touched[u] = true;
+        }
+        events++;
+      }
+
+      // A damaged node or capsule loses its own returns. A capsule takes the previous capsule's returns with it,
+      // and the next one's too when the damaged capsule still passes the checksum by chance.
+      std::vector<bool> spoilt(st.at.size(), false);
+      for (size_t u = 0; u < touched.size(); u++) {
+        if (!touched[u]) continue;
+        for (int k = kind == STANDARD ? 0 : -1; k <= (kind == STANDARD ? 0 : 1); k++)
+          if (u + k < spoilt.size()) spoilt[u + k] = true;
+      }
+
+      // Those chance passes: the windows of the damaged stream that look like a good capsule, less the capsules
+      // that came through untouched
+      long collisions = 0;
+      if (kind != STANDARD) {
+        for (size_t q = 0; q + st.unitLen <= s.size(); q++) {
+          if ((s[q] & 0xF0) != 0xA0 || (s[q + 1] & 0xF0) != 0x50) continue;
+          uint8_t sum = 0;
+          for (int j = 2; j < st.unitLen; j++) sum ^= s[q + j];
+          if (sum == ((s[q] & 0x0F) | (s[q + 1] & 0x0F) << 4) && ((s[q + 3] << 8 | s[q + 2]) & 0x7FFF) < 23040)
+            collisions++;
+        }
+        for (size_t u = 0; u < intact.size(); u++) collisions -= intact[u];
+      }
+
+      RPLidarParser p;
+      std::vector<rplidar_measurement_t> got;
+      bool ok = feed(p, s, uniform(8, 12), uniform(1, 300), got);
+
+      // Walk the output along what was sent; whatever does not match in order is false
+      size_t i = 0;
+      long found = 0, f = 0;
+      std::vector<bool> seen(st.sent.size(), false);
+      for (const rplidar_measurement_t & m : got) {
+        size_t j = i;
+        while (j < st.sent.size() && j < i + 4000 && !same(st.sent[j], m)) j++;
+        if (j < st.sent.size() && j < i + 4000) {
+          seen[j] = true;
+          i = j + 1;
+          found++;
+        } else {
+          f++;
+        }
+      }
+      long missing = 0, excused = 0;
+      for (size_t u = 0; u < st.at.size(); u++) {
+        for (int j = 0; j < st.perUnit; j++) {
+          if (seen[u * st.perUnit + j]) continue;
+          if (spoilt[u]) excused++;
+          else missing++;
+        }
+      }
+      if (kind == STANDARD) {
+        // until it finds the node boundary again the parser may take false nodes, and lose the true ones they
+        // overlap
+        if (f > 4 * hits + noiseBytes / RPLIDAR_NODE_LEN || missing > 4 * hits) ok = false;
+      } else {
+        if (f > 2 * st.perUnit * collisions || missing > 2 * st.perUnit * collisions) ok = false;
+      }
+      if (!ok) bad++;
+      lost += (long)st.sent.size() - found;
+      allowed += excused;
+      foreign += f;
+      sentTotal += st.sent.size();
+      chance += collisions;
+    }
+    printf("  %-8s %d streams, %d hits, %d wrong; %ld of %ld returns lost (%ld near the damage), %ld false",
+           kindName[kind], trials, events, bad, lost, sentTotal, allowed, foreign);
+    if (kind != STANDARD) printf(", %ld damaged capsules passed the checksum", chance);
+    printf("\n");
+    if (bad) pass = false;
+  }
+  result(name, pass);
+}
+
+// The parser as the sketch runs it: a 4 kB ring filled 64 bytes at a time
+static void throughput()
+{
+  for (int kind = STANDARD; kind <= ULTRA; kind++) {
+    Stream st = makeStream((Kind)kind, kind == STANDARD ? 200000 : kind == EXPRESS ? 12000 : 8000);
+    const uint32_t mask = 4095;
+    static uint8_t ring[4096];
+    static rplidar_measurement_t out[512];
+    double best = 1e9;
+    long returns = 0;
+    for (int rep = 0; rep < 5; rep++) {
+      RPLidarParser p;
+      uint32_t head = 0;
+      size_t i = 0;
+      returns = 0;
+      auto t0 = std::chrono::steady_clock::now();
+      while (i < st.bytes.size()) {
+        size_t piece = std::min<size_t>(64, st.bytes.size() - i);
+        for (size_t j = 0; j < piece; j++) ring[head++ & mask] = st.bytes[i++];
+        returns += p.parse(ring, mask, head, out, 512);
+      }
+      auto t1 = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    // the copy into the ring is part of the timing; it stands in for the DMA
+    printf("  %-8s %.1f MB in %.1f ms: %.0f MB/s, %.1f M returns/s\n", kindName[kind], st.bytes.size() / 1e6, best * 1e3,
+           st.bytes.size() / best / 1e6, returns / best / 1e6);
+  }
+  result("throughput", true);
+}
+
+int main()
+{
+  clean();
+  damaged(TRUNCATE, "truncated");
+  damaged(CORRUPT, "corrupted");
+  damaged(NOISE, "resync");
+  throughput();
+  return failures ? 1 : 0;
+}
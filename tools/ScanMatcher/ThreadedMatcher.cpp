@@ -0,0 +1,76 @@
+#include "ThreadedMatcher.h"
+
+ThreadedMatcher::ThreadedMatcher(float cellSize_mm, unsigned threads) : ScanMatcher(cellSize_mm)
+{
+  if (!threads) threads = std::thread::hardware_concurrency();
+  if (threads < 1) threads = 1;
+  _partial.resize(threads);
+  _generation = 0;
+  _finished = 0;
+  _stop = false;
+  for (unsigned t = 1; t < threads; t++) _workers.push_back(std::thread(&ThreadedMatcher::work, this, t));
+}
+
+ThreadedMatcher::~ThreadedMatcher()
+{
+  {
+    std::lock_guard<std::mutex> hold(_lock);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (size_t t = 0; t < _workers.size(); t++) _workers[t].join();
+}
+
+// Run index of the current job, into eq
+void ThreadedMatcher::run(unsigned index, normal_eq_t & eq)
+{
+  memset(&eq, 0, sizeof(eq));
+  unsigned runs = _partial.size();
+  uint16_t first = (uint16_t)((uint32_t)_job.n * index / runs), last = (uint16_t)((uint32_t)_job.n * (index + 1) / runs);
+  accumulate(_job.x, _job.y, _job.z, first, last, _job.R, *_job.at, _job.gate, eq);
+}
+
+void ThreadedMatcher::work(unsigned index)
+{
+  unsigned seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> hold(_lock);
+      _wake.wait(hold, [&]() { return _stop || _generation != seen; });
+      if (_stop) return;
+      seen = _generation;
+    }
+    run(index, _partial[index]);
+    {
+      std::lock_guard<std::mutex> hold(_lock);
+      _finished++;
+    }
+    _done.notify_one();
+  }
+}
+
+void ThreadedMatcher::accumulateAll(const float * x, const float * y, const float * z, uint16_t n, const float * R, const scan_match_t & at, float gate, normal_eq_t & eq)
+{
+  Job job = {x, y, z, n, R, &at, gate};
+  {
+    std::lock_guard<std::mutex> hold(_lock);
+    _job = job;
+    _finished = 0;
+    _generation++;
+  }
+  _wake.notify_all();
+  run(0, _partial[0]);   // this thread takes the first run
+  {
+    std::unique_lock<std::mutex> hold(_lock);
+    _done.wait(hold, [&]() { return _finished == _workers.size(); });
+  }
+
+  for (size_t p = 0; p < _partial.size(); p++) {
+    const normal_eq_t & part = _partial[p];
+    for (uint8_t a = 0; a < 4; a++)
+      for (uint8_t b = 0; b < 5; b++) eq.A[a][b] += part.A[a][b];
+    eq.sumr2 += part.sumr2;
+    eq.sumw += part.sumw;
+    eq.inliers += part.inliers;
+  }
+}
@@ -0,0 +1,50 @@
+/* ScanMatcher with the correspondence search spread over threads, for matching recordings on a PC
+
+  Each Gauss-Newton iteration hands every worker an equal run of the sweep; the workers look up their
+  points' cells in the shared, read-only reference index and build partial normal equations, which are
+  added up in run order. The workers stay up between iterations and between match() calls, so a match
+  only pays for waking them. The sums are taken in a different order than on one thread, so the result
+  agrees with ScanMatcher to rounding, not bit for bit.
+*/
+
+#ifndef ThreadedMatcher_h
+#define ThreadedMatcher_h
+
+#include "ScanMatcher.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadedMatcher : public ScanMatcher
+{
+  public:
+    ThreadedMatcher(float cellSize_mm, unsigned threads);   // threads 0 means one per CPU
+    ~ThreadedMatcher();
+
+  protected:
+    void accumulateAll(const float * x, const float * y, const float * z, uint16_t n, const float * R, const scan_match_t & at, float gate, normal_eq_t & eq);
+
+  private:
+    struct Job {
+      const float * x, * y, * z;
+      uint16_t n;
+      const float * R;
+      const scan_match_t * at;
+      float gate;
+    };
+
+    std::vector<std::thread> _workers;
+    std::vector<normal_eq_t> _partial;
+    std::mutex _lock;
+    std::condition_variable _wake, _done;
+    Job _job;
+    unsigned _generation, _finished;
+    bool _stop;
+
+    void run(unsigned index, normal_eq_t & eq);
+    void work(unsigned index);
+};
+
+#endif
@@ -0,0 +1,260 @@
+/* matchtest: host tests and benchmark of the EM7180_MPU9250_BMP280 scan matcher
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -pthread -Ihost -I../../EM7180_MPU9250_BMP280 matchtest.cpp ThreadedMatcher.cpp ../../EM7180_MPU9250_BMP280/ScanMatcher.cpp ../../EM7180_MPU9250_BMP280/PointCloud.cpp -o matchtest
+    ./matchtest
+
+  Scans are PointCloud sweeps, made the way the sketch makes them, from EM7180 quaternions of a platform
+  rolling at 180 degrees per second in a 3.5 x 3.0 x 2.2 m room, with 10 mm of range noise. The reference
+  is two seconds of sweeps (8000 points) taken at the origin with the true attitude; a single second leaves
+  the scan lines on the side walls half a cell apart, so most cells there hold one line and the matches
+  drift along them. Each trial takes one second of sweeps (4000 points) from somewhere up to 200 mm away
+  (50 mm in height), at a different part of the roll, with the EM7180 heading off by up to 3 degrees, and
+  matches it with 600 mm cells and no guess. The room needs about 170 of those cells, inside the default
+  pool; at 500 mm it would need 213.
+
+    convergence  the reference must fit the cell pool, and at least 95 % of 200 trials must converge to
+                 within 0.3 degrees of the heading error and 20 mm of the displacement; the spread of the
+                 errors and iterations is printed
+    threaded     ThreadedMatcher on 1, 2, 4 and 8 threads must agree with ScanMatcher to rounding
+    throughput   matches per second and correspondences per second (points times iterations), ScanMatcher
+                 on one core and ThreadedMatcher on each thread count
+
+  There are no recorded sweeps in the tree, so the scans here are all synthetic.
+
+  Exit status 1 if any test fails.
+*/
+
+#include "ThreadedMatcher.h"
+#include "PointCloud.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static const uint32_t LOOP_US = 1000;
+static const uint32_t POSE_US = 5000;
+static const uint32_t NODE_US = 250;          // 4000 returns per second
+static const uint32_t TURN_US = 100000;       // 10 Hz
+static const int32_t  LATE_US = 6000;
+static const double   ROLL_RATE = M_PI;       // rad/s
+static const float    CELL = 600;             // mm
+
+static const double lo[3] = {-1520, -1480, -980}, hi[3] = {1980, 1530, 1210};   // room walls, mm
+
+static std::mt19937 rng(1);
+static std::uniform_real_distribution<double> uniform(-1, 1);
+static std::normal_distribution<double> normal(0, 1);
+
+struct Scan {
+  std::vector<float> x, y, z;
+};
+
+struct Place {
+  double c[3];       // sensor position, mm
+  double yawError;   // rad, EM7180 heading minus the true one
+  uint32_t start;    // us
+};
+
+static double roll(double t_us) { return ROLL_RATE * t_us * 1e-6; }
+
+// The return measured at IMU time t from the sensor at c: the distance to the wall along the beam
+static rplidar_measurement_t node(uint32_t t, const double * c)
+{
+  rplidar_measurement_t m;
+  uint32_t phase = t % TURN_US;
+  m.angle_q6 = (uint16_t)((uint64_t)phase * 360 * 64 / TURN_US);
+  m.quality = 47;
+  m.flags = phase == 0 ? RPLIDAR_FLAG_START : 0;
+  double a = m.angle_q6 / 64.0 * M_PI / 180, r = roll(t);
+  double u[3] = {cos(a), -sin(a) * cos(r), -sin(a) * sin(r)}, d = 1e9;
+  for (int k = 0; k < 3; k++) {
+    if (u[k] > 1e-9) d = std::min(d, (hi[k] - c[k]) / u[k]);
+    if (u[k] < -1e-9) d = std::min(d, (lo[k] - c[k]) / u[k]);
+  }
+  m.distance_q2 = (uint32_t)lrint((d + 10 * normal(rng)) * 4);
+  return m;
+}
+
+// Whole sweeps from the sketch's loop, starting at the first sweep after place.start
+static Scan scan(const Place & place, int count = 10)
+{
+  Scan s;
+  PointCloud * cloud = new PointCloud;
+  cloud->init();
+  cloud->lidarLate_us = LATE_US;
+  rplidar_measurement_t nodes[LOOP_US / NODE_US];
+  int sweeps = 0;
+  double sz = sin(place.yawError / 2), cz = cos(place.yawError / 2);
+  for (uint32_t now = place.start + LATE_US + LOOP_US; sweeps <= count; now += LOOP_US) {
+    if (now % POSE_US == 0) {
+      double a = roll(now), sx = sin(a / 2), cx = cos(a / 2);
+      float quat[4] = {(float)(cz * sx), (float)(sz * sx), (float)(sz * cx), (float)(cz * cx)};
+      cloud->addPose(now, quat);
+    }
+    uint16_t n = 0;
+    for (uint32_t t = now - LOOP_US; t < now; t += NODE_US) nodes[n++] = node(t - LATE_US, place.c);
+    uint32_t dt = LOOP_US;
+    for (uint16_t done = 0; done < n; ) {
+      uint16_t used = cloud->addScan(&nodes[done], n - done, now - LOOP_US + dt * done / n, now);
+      if (cloud->sweepReady) {
+        if (sweeps++) {   // the first is cut short by the missing poses
+          s.x.insert(s.x.end(), cloud->x, cloud->x + cloud->count);
+          s.y.insert(s.y.end(), cloud->y, cloud->y + cloud->count);
+          s.z.insert(s.z.end(), cloud->z, cloud->z + cloud->count);
+        }
+        cloud->clear();
+      }
+      else if (!used) break;
+      done += used;
+    }
+  }
+  delete cloud;
+  return s;
+}
+
+static Place randomPlace()
+{
+  Place p;
+  p.c[0] = 200 * uniform(rng);
+  p.c[1] = 200 * uniform(rng);
+  p.c[2] = 50 * uniform(rng);
+  p.yawError = 3 * M_PI / 180 * uniform(rng);
+  p.start = 1000000 + 1000 * (uint32_t)(1000 * (uniform(rng) + 1));
+  return p;
+}
+
+static scan_match_t match(ScanMatcher & matcher, const Scan & s)
+{
+  return matcher.match(&s.x[0], &s.y[0], &s.z[0], s.x.size(), NULL, NULL);
+}
+
+// Yaw error in degrees and displacement error in mm of a match of a scan from place
+static void errors(const scan_match_t & m, const Place & place, double & yaw, double & t)
+{
+  yaw = fabs(m.yaw + place.yawError) * 180 / M_PI;
+  double e[3] = {m.t[0] - place.c[0], m.t[1] - place.c[1], m.t[2] - place.c[2]};
+  t = sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static ScanMatcher * reference(ScanMatcher * matcher, const Scan & ref)
+{
+  matcher->setReference(&ref.x[0], &ref.y[0], &ref.z[0], ref.x.size());
+  return matcher;
+}
+
+static void convergence(const Scan & ref)
+{
+  ScanMatcher * matcher = reference(new ScanMatcher(CELL), ref);
+  const int trials = 200;
+  int good = 0;
+  std::vector<double> yaws, ts, iterations;
+  for (int i = 0; i < trials; i++) {
+    Place place = randomPlace();
+    scan_match_t m = match(*matcher, scan(place));
+    double yaw, t;
+    errors(m, place, yaw, t);
+    good += m.converged && yaw < 0.3 && t < 20;
+    yaws.push_back(yaw);
+    ts.push_back(t);
+    iterations.push_back(m.iterations);
+  }
+  std::sort(yaws.begin(), yaws.end());
+  std::sort(ts.begin(), ts.end());
+  std::sort(iterations.begin(), iterations.end());
+  printf("  %u of %u reference cells, %zu points\n", matcher->referenceCells(), SCANMATCH_MAX_CELLS, ref.x.size());
+  printf("  %d of %d converged: heading error median %.3f, 95 %% %.3f, worst %.3f deg\n", good, trials,
+         yaws[trials / 2], yaws[trials * 95 / 100], yaws.back());
+  printf("  displacement error median %.1f, 95 %% %.1f, worst %.1f mm; iterations median %.0f, worst %.0f\n",
+         ts[trials / 2], ts[trials * 95 / 100], ts.back(), iterations[trials / 2], iterations.back());
+  result("convergence", matcher->referenceCells() < SCANMATCH_MAX_CELLS && good >= trials * 95 / 100);
+  delete matcher;
+}
+
+static void threaded(const Scan & ref)
+{
+  ScanMatcher * serial = reference(new ScanMatcher(CELL), ref);
+  std::vector<Place> places;
+  std::vector<Scan> scans;
+  for (int i = 0; i < 20; i++) {
+    places.push_back(randomPlace());
+    scans.push_back(scan(places.back()));
+  }
+  bool pass = true;
+  const unsigned threads[] = {1, 2, 4, 8};
+  for (unsigned k = 0; k < 4; k++) {
+    ThreadedMatcher * matcher = new ThreadedMatcher(CELL, threads[k]);
+    reference(matcher, ref);
+    double worstYaw = 0, worstT = 0;
+    bool same = true;
+    for (size_t i = 0; i < scans.size(); i++) {
+      scan_match_t a = match(*serial, scans[i]), b = match(*matcher, scans[i]);
+      worstYaw = std::max(worstYaw, fabs((double)a.yaw - b.yaw) * 180 / M_PI);
+      for (int j = 0; j < 3; j++) worstT = std::max(worstT, fabs((double)a.t[j] - b.t[j]));
+      same = same && a.converged == b.converged && abs(a.iterations - b.iterations) <= 1;
+    }
+    bool ok = same && worstYaw < 1e-3 && worstT < 0.5;
+    printf("  %u thread%s: largest difference %.1e deg, %.1e mm, %s\n", threads[k], threads[k] > 1 ? "s" : "",
+           worstYaw, worstT, ok ? "agree" : "DIFFER");
+    pass = pass && ok;
+    delete matcher;
+  }
+  result("threaded", pass);
+  delete serial;
+}
+
+static void time(ScanMatcher & matcher, const std::vector<Scan> & scans, const char * name)
+{
+  const int rounds = 20;
+  uint64_t correspondences = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < scans.size(); i++) correspondences += (uint64_t)match(matcher, scans[i]).iterations * scans[i].x.size();
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  printf("  %-22s %6.0f matches/s, %5.1f M correspondences/s, %.2f ms per match\n", name, rounds * scans.size() / s,
+         correspondences / s * 1e-6, s * 1e3 / (rounds * scans.size()));
+}
+
+static void throughput(const Scan & ref)
+{
+  std::vector<Scan> scans;
+  for (int i = 0; i < 20; i++) scans.push_back(scan(randomPlace()));
+
+  ScanMatcher * matcher = reference(new ScanMatcher(CELL), ref);
+  time(*matcher, scans, "ScanMatcher");
+  delete matcher;
+  const unsigned threads[] = {1, 2, 4, 8};
+  for (unsigned k = 0; k < 4; k++) {
+    char name[32];
+    snprintf(name, sizeof(name), "ThreadedMatcher, %u", threads[k]);
+    ThreadedMatcher * threadedMatcher = new ThreadedMatcher(CELL, threads[k]);
+    time(*reference(threadedMatcher, ref), scans, name);
+    delete threadedMatcher;
+  }
+  printf("  %u CPU%s on this machine\n", std::thread::hardware_concurrency(),
+         std::thread::hardware_concurrency() == 1 ? "" : "s");
+  result("throughput", true);
+}
+
+int main()
+{
+  Place origin = {{0, 0, 0}, 0, 1000000};
+  Scan ref = scan(origin, 20);
+  convergence(ref);
+  threaded(ref);
+  throughput(ref);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+/* boottest: host simulation of the EM7180_MPU9250_BMP280 start up, the SENtral booting from its EEPROM against
+  EM7180::uploadFirmware() loading its RAM from the host
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=gnu++11 -w -Ihost -I../../EM7180_MPU9250_BMP280 boottest.cpp ../../EM7180_MPU9250_BMP280/EM7180.cpp ../../EM7180_MPU9250_BMP280/BMP280Compensator.cpp ../../EM7180_MPU9250_BMP280/Altitude.cpp -o boottest
+    ./boottest
+
+  EM7180.cpp is compiled against host/, which models the SENtral on the host bus (see host/i2c_t3.h) with a
+  2 ms reset and, when its EEPROM holds the image, the image read over its sensor bus at 400 kHz. Time is
+  simulated and starts at power on. Each case runs the sketch's setup() as far as the SENtral goes, with or
+  without the upload, then its loop() until the first quaternion, and reports the time to it as the sketch
+  prints it. The image is 14 kB of random text behind a valid header, about the size of a SENtral .fw file.
+  These are modelled times, not bench measurements; they are only as good as the SENtral model.
+
+    boot         the EEPROM boot, a host upload at 1 MHz and one on a bus held to 400 kHz must each reach a
+                 quaternion; prints the upload time and the time to the first quaternion, as init() stands
+                 and with its read-the-screen delays of a second or more left out, and the upload at 1 MHz
+                 must beat the EEPROM boot once those delays are out
+    reject       an image with a flipped text byte must fail on the CRC and one with a bad magic before the
+                 SENtral is touched, both leaving fwUploaded false
+
+  Exit status 1 if any test fails.
+*/
+
+#include "EM7180.h"
+
+#include <random>
+#include <vector>
+
+uint64_t simNow_ns = 0;
+bool skipScreenDelays = false;
+std::string serialOut;
+HostSerial Serial;
+i2c_t3_ Wire;
+SimSentral simSentral;
+
+void simAdvance(uint64_t ns) { simNow_ns += ns; }
+
+static const uint16_t TEXT = 14336;
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static std::vector<uint8_t> makeImage()
+{
+  std::mt19937 rng(1);
+  std::vector<uint8_t> image(EM7180_FW_HEADER_SIZE + TEXT);
+  for (size_t i = EM7180_FW_HEADER_SIZE; i < image.size(); i++) image[i] = rng();
+  sentral_fw_header_t header = {EM7180_FW_MAGIC, 0, SimSentral::crc32(&image[EM7180_FW_HEADER_SIZE], TEXT), 0, TEXT, 0};
+  memcpy(&image[0], &header, EM7180_FW_HEADER_SIZE);
+  return image;
+}
+
+// Power on with or without the image in the EEPROM
+static void powerOn(bool eeprom, uint32_t busMax_hz)
+{
+  simNow_ns = 0;
+  serialOut.clear();
+  simSentral = SimSentral();
+  simSentral.eepromText = eeprom ? TEXT : 0;
+  simSentral.reset();
+  Wire = i2c_t3_();
+  Wire.busMax_hz = busMax_hz;
+}
+
+struct Boot {
+  bool uploaded;
+  uint32_t upload_us;
+  uint32_t firstQuat_ms;   // as the sketch prints it, 0 for none within 30 s
+};
+
+// setup() and loop() as far as the SENtral goes; the INT pin is taken as wired to the quaternion event
+static Boot run(const std::vector<uint8_t> * image, bool eeprom, uint32_t busMax_hz, bool skip)
+{
+  powerOn(eeprom, busMax_hz);
+  skipScreenDelays = skip;
+  EM7180 imu(I2C_PINS_16_17, 8);
+  Boot b = {false, 0, 0};
+  uint32_t boot_us = micros();
+  if (image) {
+    b.uploaded = imu.uploadFirmware(&(*image)[0], image->size());
+    b.upload_us = imu.uploadTime_us;
+  }
+  imu.init();
+  while (!imu.firstQuat_us && millis() < 30000) {
+    delay(1);
+    imu.newData = simSentral.running() && simNow_ns >= simSentral.nextQuat;
+    imu.getSentralRPY();
+  }
+  if (imu.firstQuat_us) b.firstQuat_ms = (imu.firstQuat_us - boot_us) / 1000;
+  skipScreenDelays = false;
+  return b;
+}
+
+static void boot(const std::vector<uint8_t> & image)
+{
+  struct Case {
+    const char * name;
+    bool upload;
+    uint32_t busMax_hz;
+  } cases[] = {
+    {"EEPROM boot", false, 1000000},
+    {"upload, 1 MHz", true, 1000000},
+    {"upload, 400 kHz", true, 400000},
+  };
+  bool pass = true;
+  uint32_t fast[3];
+  printf("  %-16s %10s %16s %16s\n", "", "upload", "first quat", "without delays");
+  for (int k = 0; k < 3; k++) {
+    Boot full = run(cases[k].upload ? &image : NULL, !cases[k].upload, cases[k].busMax_hz, false);
+    Boot quick = run(cases[k].upload ? &image : NULL, !cases[k].upload, cases[k].busMax_hz, true);
+    fast[k] = quick.firstQuat_ms;
+    char upload[16] = "-";
+    if (cases[k].upload) snprintf(upload, sizeof(upload), "%.1f ms", full.upload_us / 1000.0);
+    printf("  %-16s %10s %13u ms %13u ms\n", cases[k].name, upload, full.firstQuat_ms, quick.firstQuat_ms);
+    pass = pass && full.firstQuat_ms && quick.firstQuat_ms && full.uploaded == cases[k].upload && quick.uploaded == cases[k].upload;
+  }
+  printf("  the SENtral reads the image from its EEPROM in %.1f ms\n",
+         (20 + 9 * (3 + EM7180_FW_HEADER_SIZE + TEXT)) * 2.5e-3);
+  result("boot", pass && fast[1] < fast[0]);
+}
+
+static void reject(const std::vector<uint8_t> & image)
+{
+  std::vector<uint8_t> corrupt = image, magic = image;
+  corrupt[EM7180_FW_HEADER_SIZE + 1000] ^= 0x10;
+  magic[0] ^= 0xFF;
+
+  powerOn(false, 1000000);
+  EM7180 imu(I2C_PINS_16_17, 8);
+  bool crcFailed = !imu.uploadFirmware(&corrupt[0], corrupt.size()) && !imu.fwUploaded &&
+                   serialOut.find("CRC") != std::string::npos;
+  printf("  flipped text bit: %s", serialOut.c_str());
+
+  powerOn(false, 1000000);
+  bool magicFailed = !imu.uploadFirmware(&magic[0], magic.size()) && !imu.fwUploaded && simSentral.ram.empty() &&
+                     simNow_ns == 0;
+  printf("  bad magic: %s", serialOut.c_str());
+  result("reject", crcFailed && magicFailed);
+}
+
+int main()
+{
+  std::vector<uint8_t> image = makeImage();
+  boot(image);
+  reject(image);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+// Host stand-in for the parts of the Teensy core EM7180.cpp uses. Time is simulated: it only moves when the
+// SENtral model in i2c_t3.h or delay() advances it. Serial output goes to serialOut. With skipScreenDelays set,
+// delays of a second or more (the ones init() gives to read the screen) return at once.
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sstream>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+#define RISING  3
+#define PI      3.14159265358979f
+#define HEX     16
+#define DEC     10
+
+extern uint64_t simNow_ns;
+extern bool skipScreenDelays;
+void simAdvance(uint64_t ns);
+
+inline uint32_t micros() { return simNow_ns / 1000; }
+inline uint32_t millis() { return simNow_ns / 1000000; }
+inline void delay(uint32_t ms) { if (!(skipScreenDelays && ms >= 1000)) simAdvance(ms * 1000000ull); }
+inline void delayMicroseconds(uint32_t us) { simAdvance(us * 1000ull); }
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return 0; }
+inline void attachInterrupt(uint8_t, void (*)(), int) {}
+
+extern std::string serialOut;
+
+struct HostSerial {
+  template<class T> void print(T v) { std::ostringstream o; o << v; serialOut += o.str(); }
+  template<class T> void print(T v, int format) {
+    std::ostringstream o;
+    if (format == HEX) o << std::hex << std::uppercase << (unsigned long)v;
+    else { o.precision(format); o << std::fixed << v; }
+    serialOut += o.str();
+  }
+  template<class T> void println(T v) { print(v); println(); }
+  template<class T> void println(T v, int format) { print(v, format); println(); }
+  void println() { serialOut += "\n"; }
+  void begin(long) {}
+};
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1 @@
+// Host stand-in, EM7180.h includes SPI.h but the SENtral is on I2C
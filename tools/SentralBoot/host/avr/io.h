@@ -0,0 +1 @@
+// Host stand-in, nothing in EM7180.cpp needs the AVR registers
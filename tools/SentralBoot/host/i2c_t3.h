@@ -0,0 +1,119 @@
+// Host stand-in for i2c_t3 with a SENtral at 0x28. Every transfer advances simulated time at the rate passed
+// to begin(), held to busMax_hz for a bus whose pull-ups will not do Fast-mode Plus.
+//
+// Out of reset the SENtral takes boot_ns, then, with a valid image in its EEPROM, reads it over its own sensor
+// bus at 400 kHz before it reports EEPROM detected and uploaded. Without one it reports No EEPROM and takes a
+// host upload: HostControl 0x02, the text into UploadData, its CRC in CRCHost. Once running with firmware it
+// raises the quaternion event every 10 ms, and acknowledges each parameter request at once.
+#ifndef i2c_t3_h
+#define i2c_t3_h
+
+#include "Arduino.h"
+#include <vector>
+
+enum i2c_pins { I2C_PINS_7_8, I2C_PINS_16_17, I2C_PINS_18_19 };
+#define I2C_MASTER            0
+#define I2C_PULLUP_EXT        0
+#define I2C_RATE_400          400000
+#define I2C_RATE_1000         1000000
+#define I2C_NOSTOP            0
+#define I2C_STOP              1
+#define I2C_RX_BUFFER_LENGTH  259
+#define I2C_TX_BUFFER_LENGTH  259
+
+struct SimSentral {
+  uint8_t reg[256];
+  uint8_t ptr = 0;
+  uint32_t eepromText = 0;          // text length of a valid image in the EEPROM, 0 for none
+  uint64_t boot_ns = 2000000;
+  uint64_t readyAt = 0;
+  bool firmware = false;            // loaded, from the EEPROM or the host
+  bool uploading = false;
+  uint64_t nextQuat = 0;
+  std::vector<uint8_t> ram;
+
+  SimSentral() { memset(reg, 0, sizeof(reg)); }
+  static uint32_t crc32(const uint8_t * data, size_t count) {
+    uint32_t crc = 0xFFFFFFFF;
+    while (count--) {
+      crc ^= *data++;
+      for (int k = 0; k < 8; k++) crc = (crc & 1) ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+    }
+    return ~crc;
+  }
+  void reset() {
+    uint64_t eepromRead_ns = eepromText ? (20 + 9 * (3 + 16 + (uint64_t)eepromText)) * 2500 : 0;
+    readyAt = simNow_ns + boot_ns + eepromRead_ns;
+    firmware = eepromText != 0;
+    uploading = false;
+    ram.clear();
+    memset(reg, 0, sizeof(reg));
+  }
+  bool running() { return firmware && (reg[0x34] & 0x01) && !(reg[0x54] & 0x01); }
+  void tick() {
+    if (!running()) nextQuat = simNow_ns + 10000000;
+    else if (simNow_ns >= nextQuat) {
+      reg[0x35] |= 0x04;
+      nextQuat = simNow_ns - simNow_ns % 10000000 + 10000000;
+    }
+  }
+  void write(uint8_t r, uint8_t v) {
+    if (r == 0x96 && uploading) { ram.push_back(v); return; }
+    reg[r] = v;
+    if (r == 0x9B && (v & 1)) reset();
+    if (r == 0x34) {
+      if (uploading && !(v & 0x02) && !ram.empty()) firmware = true;
+      uploading = v & 0x02;
+    }
+    if (r == 0x64) reg[0x3A] = v;                    // ParamRequest acknowledged at once
+  }
+  uint8_t read(uint8_t r) {
+    if (simNow_ns < readyAt) return 0;
+    if (r == 0x37) return 0x08 | (eepromText ? 0x03 : 0x10);
+    if (r >= 0x97 && r <= 0x9A) {                    // CRC of the text in file order, the words came MSB first
+      std::vector<uint8_t> text(ram.size());
+      for (size_t i = 0; i + 3 < ram.size(); i += 4)
+        for (int k = 0; k < 4; k++) text[i + k] = ram[i + 3 - k];
+      return crc32(text.empty() ? NULL : &text[0], text.size()) >> (8 * (r - 0x97));
+    }
+    uint8_t v = reg[r];
+    if (r == 0x35) reg[0x35] = 0;                    // EventStatus clears on read
+    return v;
+  }
+};
+extern SimSentral simSentral;
+
+struct i2c_t3_ {
+  uint8_t addr;
+  std::vector<uint8_t> tx, rx;
+  size_t rpos = 0;
+  uint32_t rate_hz = 400000, busMax_hz = 1000000;
+
+  void bus(size_t bytes) { simAdvance((20 + 9 * (uint64_t)bytes) * 1000000000ull / rate_hz); }
+  void begin(int, int, i2c_pins, int, uint32_t rate) { rate_hz = rate < busMax_hz ? rate : busMax_hz; }
+  void beginTransmission(uint8_t a) { addr = a; tx.clear(); }
+  size_t write(uint8_t b) { tx.push_back(b); return 1; }
+
+  uint8_t endTransmission(int = I2C_STOP) {
+    if (addr != 0x28) { bus(1); return 2; }
+    bus(1 + tx.size());
+    simSentral.tick();
+    if (tx.size()) simSentral.ptr = tx[0];
+    for (size_t i = 1; i < tx.size(); i++) simSentral.write(tx[0] == 0x96 ? 0x96 : tx[0] + i - 1, tx[i]);
+    return 0;
+  }
+  size_t requestFrom(uint8_t a, size_t n, int = I2C_STOP) {
+    rx.clear();
+    rpos = 0;
+    bus(1 + n);
+    if (a != 0x28) return 0;
+    simSentral.tick();
+    for (size_t i = 0; i < n; i++) rx.push_back(simSentral.read(simSentral.ptr + i));
+    return n;
+  }
+  int available() { return rx.size() - rpos; }
+  int read() { return rpos < rx.size() ? rx[rpos++] : -1; }
+};
+extern i2c_t3_ Wire;
+
+#endif
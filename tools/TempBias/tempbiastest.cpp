@@ -0,0 +1,195 @@
+/* tempbiastest: host evaluation of the Butterfly sketch's temperature dependent gyro bias model
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly tempbiastest.cpp ../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly/TempBias.cpp -o tempbiastest
+    ./tempbiastest
+
+  Synthetic gyro logs at 208 Hz with 0.05 dps of noise and a quadratic bias in temperature, about 1 dps over
+  0 - 50 C, fed the way the sketch feeds the model: observe() while the board is still, setTemperature() once
+  a second. There are no recorded logs in the tree.
+
+    drift        learn on a two hour warm-up from 0 to 50 C, still every other minute; save, load into a fresh
+                 model and run a cool-down from 45 to 5 C. The rms bias error of the model must be under 0.02
+                 dps and at least ten times smaller than that of a one-shot bias taken at power-up
+    ageing       two hours still at 25 C, then every axis' bias steps by 0.2 dps; after another minute still
+                 the model must be within 0.02 dps of it, which a bin count left to climb to 65535 never is
+    record       save() must fit TEMPBIAS_RECORD_MAX and load() must give back the bias to the resolution; the
+                 same record cut down to version 1 must still load, within 0.05 dps: without the bin
+                 temperatures it takes the bin centres, up to a degree off here
+    benchmark    ns per correct(), setTemperature(), observe() and fit()
+
+  Exit status 1 if any test fails.
+*/
+
+#include "TempBias.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+static const double RATE = 208, NOISE = 0.05;
+static const double C[3][3] = {{-0.50, 0.012, 0.00030}, {0.14, -0.008, 0.00020}, {0.28, 0.020, -0.00040}};
+
+static std::mt19937 rng(1);
+static std::normal_distribution<double> normal(0, 1);
+
+static double trueBias(int axis, double temperature, double step = 0)
+{
+  double dT = temperature - 25;
+  return C[axis][0] + dT * (C[axis][1] + dT * C[axis][2]) + step;
+}
+
+// seconds at RATE with the temperature going from t0 to t1, still when still(second) says so; returns the
+// rms over the run, taken once a second, of the model's bias error and of the error of the bias at t0
+template<class Still>
+static void run(TempBias & model, double seconds, double t0, double t1, Still still, double step,
+                double & modelRms, double & fixedRms)
+{
+  double sm = 0, sf = 0;
+  uint32_t n = 0, samples = (uint32_t)(seconds * RATE);
+  for (uint32_t i = 0; i < samples; i++) {
+    double t = t0 + (t1 - t0) * i / samples;
+    if (i % (uint32_t)RATE == 0) {
+      model.setTemperature((float)t);
+      for (int a = 0; a < 3; a++) {
+        double e = model.bias[a] - trueBias(a, t, step), f = trueBias(a, t0, step) - trueBias(a, t, step);
+        sm += e * e;
+        sf += f * f;
+      }
+      n += 3;
+    }
+    if (!still(i / (uint32_t)RATE)) continue;
+    float g[3];
+    for (int a = 0; a < 3; a++) g[a] = (float)(trueBias(a, t, step) + NOISE * normal(rng));
+    model.observe((float)t, g);
+  }
+  modelRms = sqrt(sm / n);
+  fixedRms = sqrt(sf / n);
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void drift()
+{
+  TempBias * learner = new TempBias(0.001f);
+  double m, f;
+  run(*learner, 7200, 0, 50, [](uint32_t s) { return (s / 60) % 2 == 0; }, 0, m, f);
+  uint8_t buf[TEMPBIAS_RECORD_MAX];
+  uint16_t len = learner->save(buf);
+  TempBias * model = new TempBias(0.001f);
+  bool loaded = model->load(buf, len);
+  run(*model, 7200, 45, 5, [](uint32_t) { return false; }, 0, m, f);
+  printf("  %u observations, %u byte record, order %u: cool-down bias error %.4f dps rms, %.4f with the "
+         "power-up bias\n", learner->observations, len, model->order, m, f);
+  result("drift", loaded && m < 0.02 && m * 10 < f);
+  delete learner;
+  delete model;
+}
+
+static void ageing()
+{
+  TempBias * model = new TempBias(0.001f);
+  double m, f;
+  run(*model, 7200, 25, 25, [](uint32_t) { return true; }, 0, m, f);
+  run(*model, 60, 25, 25, [](uint32_t) { return true; }, 0.2, m, f);
+  model->fit();
+  model->setTemperature(25);
+  double worst = 0;
+  for (int a = 0; a < 3; a++) worst = std::max(worst, fabs(model->bias[a] - trueBias(a, 25, 0.2)));
+  printf("  after a 0.2 dps step and 60 s still: %.4f dps off\n", worst);
+  result("ageing", worst < 0.02);
+  delete model;
+}
+
+static void record()
+{
+  TempBias * model = new TempBias(0.001f);
+  double m, f;
+  run(*model, 7200, -20, 60, [](uint32_t) { return true; }, 0, m, f);   // every bin occupied
+  uint8_t buf[TEMPBIAS_RECORD_MAX + 16];
+  uint16_t len = model->save(buf);
+  TempBias * copy = new TempBias(0.001f);
+  bool loaded = copy->load(buf, len);
+  double worst = 0;
+  for (float t = -15; t <= 55; t += 1) {
+    model->setTemperature(t);
+    copy->setTemperature(t);
+    for (int a = 0; a < 3; a++) worst = std::max(worst, (double)fabsf(model->bias[a] - copy->bias[a]));
+  }
+
+  // Version 1: the same bins without the temperature byte
+  uint8_t old[TEMPBIAS_RECORD_MAX];
+  uint16_t oldLen = 2;
+  old[0] = 0x01;
+  old[1] = buf[1];
+  for (uint8_t n = 0; n < buf[1]; n++) {
+    const uint8_t * p = buf + 2 + 9 * n;
+    old[oldLen++] = p[0];
+    old[oldLen++] = p[1];
+    for (int k = 3; k < 9; k++) old[oldLen++] = p[k];
+  }
+  TempBias * older = new TempBias(0.001f);
+  bool oldLoaded = older->load(old, oldLen);
+  double oldWorst = 0;
+  for (float t = -15; t <= 55; t += 1) {
+    model->setTemperature(t);
+    older->setTemperature(t);
+    for (int a = 0; a < 3; a++) oldWorst = std::max(oldWorst, (double)fabsf(model->bias[a] - older->bias[a]));
+  }
+  printf("  %u of %u bytes, loaded bias within %.5f dps; version 1, %u bytes, within %.5f dps\n", len,
+         TEMPBIAS_RECORD_MAX, worst, oldLen, oldWorst);
+  result("record", loaded && len <= TEMPBIAS_RECORD_MAX && worst < 0.001 && oldLoaded && oldWorst < 0.05);
+  delete older;
+  delete model;
+  delete copy;
+}
+
+static volatile float sink;   // keeps the timed loops from being optimised away
+
+static void benchmark()
+{
+  TempBias * model = new TempBias(0.001f);
+  double m, f;
+  run(*model, 3600, 0, 50, [](uint32_t) { return true; }, 0, m, f);
+  const int N = 10000000, FITS = 100000;
+  float g[3] = {0.1f, 0.2f, 0.3f};
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; i++) {
+    model->correct(g);
+    g[0] += 1e-7f;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; i++) model->setTemperature(20.0f + (float)(i & 255) * 0.05f);
+  auto t2 = std::chrono::steady_clock::now();
+  model->refitInterval = 65535;
+  for (int i = 0; i < N; i++) model->observe(20.0f + (float)(i & 255) * 0.05f, g);
+  auto t3 = std::chrono::steady_clock::now();
+  for (int i = 0; i < FITS; i++) model->fit();
+  auto t4 = std::chrono::steady_clock::now();
+  sink = g[0] + model->bias[0] + model->coef[0][0];
+  auto ns = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b, int n) {
+    return std::chrono::duration<double>(b - a).count() * 1e9 / n;
+  };
+  printf("  ns per correct() %.1f, setTemperature() %.1f, observe() %.1f, fit() %.0f\n", ns(t0, t1, N),
+         ns(t1, t2, N), ns(t2, t3, N), ns(t3, t4, FITS));
+  result("benchmark", true);
+  delete model;
+}
+
+int main()
+{
+  drift();
+  ageing();
+  record();
+  benchmark();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+/* verticaltest: host lag and noise benchmark of the Butterfly sketch's baro-inertial vertical filter
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -Ihost -I../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly verticaltest.cpp ../../EM7180_LSM6DSM_LIS2MDL_LPS22HB_Butterfly/VerticalFilter.cpp -o verticaltest
+    ./verticaltest
+
+  Synthetic flights, fed the way the sketch feeds the filter: predict() at 208 Hz with the vertical
+  acceleration (0.05 m/s^2 of noise and a 0.2 m/s^2 bias), correct() at 25 Hz with the baro altitude
+  (0.3 m of noise, the LPS22HB at its default filter setting). The filter runs with its default noise.
+
+    hover        60 s at rest: rms altitude and climb rate noise after the first 10 s, against the raw baro;
+                 the altitude noise must be under half the baro's and the climb rate under 0.1 m/s, and the
+                 accelerometer bias must be learnt to within 0.05 m/s^2
+    lag          60 s of a 2 m, 4 s period bob: the delay that best lines the estimate up with the truth,
+                 for the filter, the raw baro and an eight sample (320 ms) moving average of it; the filter
+                 must lag under 20 ms and its climb rate must be within 0.15 m/s rms
+    step         a climb starting at 2 m/s out of a hover: the time until the climb rate reads 90 % of it,
+                 which must be under 50 ms
+    benchmark    ns per predict() and per correct()
+
+  Exit status 1 if any test fails.
+*/
+
+#include "VerticalFilter.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+
+static const double IMU_HZ = 208, BARO_HZ = 25;
+static const double ACCEL_NOISE = 0.05, ACCEL_BIAS = 0.2, BARO_NOISE = 0.3;
+
+static std::mt19937 rng(1);
+static std::normal_distribution<double> normal(0, 1);
+
+struct Truth {
+  std::function<double(double)> h, v, a;   // altitude, climb rate, vertical acceleration at time t
+};
+
+struct Track {
+  std::vector<double> t, h, v, baro;        // at every IMU step: truth, then the estimate
+  std::vector<double> estH, estV, baroAt;   // baroAt: the latest raw baro sample
+  double bias;
+};
+
+static Track fly(const Truth & truth, double seconds)
+{
+  Track k;
+  VerticalFilter f;
+  double nextBaro = 0, lastBaro = truth.h(0);
+  uint32_t steps = (uint32_t)(seconds * IMU_HZ);
+  for (uint32_t i = 0; i <= steps; i++) {
+    double t = i / IMU_HZ;
+    if (i) f.predict((float)(truth.a(t) + ACCEL_BIAS + ACCEL_NOISE * normal(rng)), (float)(1 / IMU_HZ));
+    if (t >= nextBaro) {
+      lastBaro = truth.h(t) + BARO_NOISE * normal(rng);
+      f.correct((float)lastBaro);
+      nextBaro += 1 / BARO_HZ;
+    }
+    k.t.push_back(t);
+    k.h.push_back(truth.h(t));
+    k.v.push_back(truth.v(t));
+    k.estH.push_back(f.altitude);
+    k.estV.push_back(f.velocity);
+    k.baroAt.push_back(lastBaro);
+  }
+  k.bias = f.accelBias;
+  return k;
+}
+
+static double rms(const std::vector<double> & a, const std::vector<double> & b, size_t from, size_t lag = 0)
+{
+  double s = 0;
+  size_t n = 0;
+  for (size_t i = from; i < a.size(); i++, n++) {
+    double e = a[i] - b[i - lag];
+    s += e * e;
+  }
+  return sqrt(s / n);
+}
+
+// The delay, in IMU steps, that best lines est up with truth
+static size_t bestLag(const std::vector<double> & est, const std::vector<double> & truth, size_t from)
+{
+  size_t best = 0;
+  double bestRms = 1e30;
+  for (size_t lag = 0; lag < 200 && lag <= from; lag++) {
+    double r = rms(est, truth, from, lag);
+    if (r < bestRms) {
+      bestRms = r;
+      best = lag;
+    }
+  }
+  return best;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void hover()
+{
+  Truth still = {[](double) { return 100.0; }, [](double) { return 0.0; }, [](double) { return 0.0; }};
+  Track k = fly(still, 60);
+  size_t from = (size_t)(10 * IMU_HZ);
+  double h = rms(k.estH, k.h, from), v = rms(k.estV, k.v, from), baro = rms(k.baroAt, k.h, from);
+  printf("  altitude noise %.3f m (raw baro %.3f m), climb rate noise %.3f m/s, bias learnt %.3f of %.3f m/s^2\n",
+         h, baro, v, k.bias, ACCEL_BIAS);
+  result("hover", h < 0.5 * baro && v < 0.1 && fabs(k.bias - ACCEL_BIAS) < 0.05);
+}
+
+static void lag()
+{
+  const double A = 2, W = 2 * M_PI / 4;
+  Truth bob = {[=](double t) { return 100 + A * sin(W * t); }, [=](double t) { return A * W * cos(W * t); },
+               [=](double t) { return -A * W * W * sin(W * t); }};
+  Track k = fly(bob, 60);
+  size_t from = (size_t)(10 * IMU_HZ);
+
+  // An eight sample moving average of the raw baro, held between samples
+  std::vector<double> average(k.baroAt.size());
+  std::vector<double> last;
+  for (size_t i = 0; i < k.baroAt.size(); i++) {
+    if (i == 0 || k.baroAt[i] != k.baroAt[i - 1]) {
+      last.push_back(k.baroAt[i]);
+      if (last.size() > 8) last.erase(last.begin());
+    }
+    double s = 0;
+    for (size_t j = 0; j < last.size(); j++) s += last[j];
+    average[i] = s / last.size();
+  }
+
+  size_t lagFilter = bestLag(k.estH, k.h, from), lagBaro = bestLag(k.baroAt, k.h, from),
+         lagAverage = bestLag(average, k.h, from);
+  double ms = 1000 / IMU_HZ;
+  printf("  lag: filter %.0f ms, %.3f m rms; raw baro %.0f ms, %.3f m rms; moving average %.0f ms, %.3f m rms\n",
+         lagFilter * ms, rms(k.estH, k.h, from), lagBaro * ms, rms(k.baroAt, k.h, from), lagAverage * ms,
+         rms(average, k.h, from));
+  double v = rms(k.estV, k.v, from);
+  printf("  climb rate error %.3f m/s rms\n", v);
+  result("lag", lagFilter * ms < 20 && v < 0.15);
+}
+
+static void step()
+{
+  const double T0 = 20, RATE = 2;
+  Truth climb = {[=](double t) { return 100 + (t > T0 ? RATE * (t - T0) : 0.0); },
+                 [=](double t) { return t > T0 ? RATE : 0.0; },
+                 [=](double t) { return fabs(t - T0) < 0.5 / IMU_HZ ? RATE * IMU_HZ : 0.0; }};
+  Track k = fly(climb, 30);
+  double reached = -1;
+  for (size_t i = 0; i < k.t.size(); i++) {
+    if (k.t[i] > T0 && k.estV[i] >= 0.9 * RATE) {
+      reached = k.t[i] - T0;
+      break;
+    }
+  }
+  printf("  climb rate at 90 %% of a 2 m/s step after %.0f ms\n", reached * 1000);
+  result("step", reached >= 0 && reached < 0.05);
+}
+
+static volatile float sink;   // keeps the timed loops from being optimised away
+
+static void benchmark()
+{
+  VerticalFilter f;
+  f.correct(100);
+  const int N = 2000000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; i++) f.predict((float)(i & 15) * 0.01f, 1.0f / 208);
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < N; i++) f.correct(100.0f + (float)(i & 15) * 0.01f);
+  auto t2 = std::chrono::steady_clock::now();
+  sink = f.altitude;
+  printf("  ns per predict() %.1f, per correct() %.1f\n", std::chrono::duration<double>(t1 - t0).count() * 1e9 / N,
+         std::chrono::duration<double>(t2 - t1).count() * 1e9 / N);
+  result("benchmark", true);
+}
+
+int main()
+{
+  hover();
+  lag();
+  step();
+  benchmark();
+  return failures ? 1 : 0;
+}
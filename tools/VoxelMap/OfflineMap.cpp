@@ -0,0 +1,168 @@
+#include "OfflineMap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+OfflineMap::OfflineMap(float resolution_mm)
+{
+  resolution = resolution_mm;
+  _invResolution = 1.0f / resolution_mm;
+  raysInserted = 0;
+  voxelsUpdated = 0;
+}
+
+uint64_t OfflineMap::key(int32_t tx, int32_t ty, int32_t tz)
+{
+  return ((uint64_t)(uint16_t)tx << 32) | ((uint64_t)(uint16_t)ty << 16) | (uint16_t)tz;
+}
+
+unsigned OfflineMap::shardOf(uint64_t key)
+{
+  return (unsigned)((key * 0x9E3779B97F4A7C15ULL) >> 58);   // top 6 bits, OFFLINEMAP_SHARDS 64
+}
+
+// VoxelMap::castRay(), filing the updates instead of making them
+void OfflineMap::walk(const float * from, const float * to, bool hit, std::vector<Update> * out)
+{
+  float o[3], end[3];
+  for (uint8_t k = 0; k < 3; k++) {
+    o[k] = from[k] * _invResolution;
+    end[k] = to[k] * _invResolution;
+  }
+  VoxelRay ray;
+  ray.begin(o, end);
+
+  const int32_t m = VOXELMAP_TILE_DIM - 1;
+  for (uint32_t i = 0; i <= ray.steps; i++) {
+    const int32_t * v = i < ray.steps ? ray.v : ray.e;
+    Update u;
+    u.key = key(v[0] >> VOXELMAP_TILE_BITS, v[1] >> VOXELMAP_TILE_BITS, v[2] >> VOXELMAP_TILE_BITS);
+    u.voxel = (uint16_t)(((v[2] & m) << (2 * VOXELMAP_TILE_BITS)) | ((v[1] & m) << VOXELMAP_TILE_BITS) | (v[0] & m));
+    u.delta = i < ray.steps || !hit ? VOXELMAP_LOGODDS_MISS : VOXELMAP_LOGODDS_HIT;
+    out[shardOf(u.key)].push_back(u);
+    if (i < ray.steps) ray.step();
+  }
+}
+
+void OfflineMap::apply(Shard & shard, const std::vector<Update> & updates)
+{
+  for (size_t i = 0; i < updates.size(); i++) {
+    const Update & u = updates[i];
+    std::unordered_map<uint64_t, size_t>::iterator found = shard.index.find(u.key);
+    if (found == shard.index.end()) {
+      voxel_tile_t tile;
+      tile.tx = (int16_t)(u.key >> 32);
+      tile.ty = (int16_t)(u.key >> 16);
+      tile.tz = (int16_t)u.key;
+      memset(tile.logodds, 0, sizeof(tile.logodds));
+      found = shard.index.insert(std::make_pair(u.key, shard.tiles.size())).first;
+      shard.tiles.push_back(tile);
+    }
+    int8_t &cell = shard.tiles[found->second].logodds[u.voxel];
+    int16_t value = cell + u.delta;
+    if (value > VOXELMAP_LOGODDS_MAX) value = VOXELMAP_LOGODDS_MAX;
+    if (value < VOXELMAP_LOGODDS_MIN) value = VOXELMAP_LOGODDS_MIN;
+    cell = (int8_t)value;
+  }
+}
+
+void OfflineMap::insert(const std::vector<MapScan> & scans, float maxRange_mm, unsigned threads)
+{
+  if (!threads) threads = std::thread::hardware_concurrency();
+  if (threads < 1) threads = 1;
+
+  // Every ray in order, ended as VoxelMap::insertScan() ends them
+  struct Ray {
+    float from[3], to[3];
+    bool hit;
+  };
+  std::vector<Ray> rays;
+  float maxRange2 = maxRange_mm * maxRange_mm;
+  for (size_t s = 0; s < scans.size(); s++) {
+    const MapScan & scan = scans[s];
+    for (size_t i = 0; i < scan.x.size(); i++) {
+      Ray ray;
+      float * end = ray.to;
+      end[0] = scan.x[i]; end[1] = scan.y[i]; end[2] = scan.z[i];
+      float r2 = scan.x[i] * scan.x[i] + scan.y[i] * scan.y[i] + scan.z[i] * scan.z[i];
+      if (r2 == 0.0f) continue;
+      ray.hit = true;
+      if (r2 > maxRange2) {
+        float scale = maxRange_mm / sqrtf(r2);
+        end[0] *= scale; end[1] *= scale; end[2] *= scale;
+        ray.hit = false;
+      }
+      end[0] += scan.origin[0]; end[1] += scan.origin[1]; end[2] += scan.origin[2];
+      memcpy(ray.from, scan.origin, sizeof(ray.from));
+      rays.push_back(ray);
+    }
+  }
+
+  std::vector<std::vector<Update> > filed(threads * OFFLINEMAP_SHARDS);
+  for (size_t first = 0; first < rays.size(); first += OFFLINEMAP_BLOCK) {
+    size_t last = std::min(rays.size(), first + OFFLINEMAP_BLOCK);
+    for (size_t i = 0; i < filed.size(); i++) filed[i].clear();
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+      workers.push_back(std::thread([&, t]() {
+        size_t from = first + (last - first) * t / threads, to = first + (last - first) * (t + 1) / threads;
+        for (size_t r = from; r < to; r++) walk(rays[r].from, rays[r].to, rays[r].hit, &filed[t * OFFLINEMAP_SHARDS]);
+      }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    workers.clear();
+
+    std::atomic<unsigned> next(0);
+    for (unsigned t = 0; t < threads; t++) {
+      workers.push_back(std::thread([&]() {
+        for (unsigned s; (s = next++) < OFFLINEMAP_SHARDS; ) {
+          for (unsigned run = 0; run < threads; run++) apply(_shards[s], filed[run * OFFLINEMAP_SHARDS + s]);
+        }
+      }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+    for (size_t i = 0; i < filed.size(); i++) voxelsUpdated += filed[i].size();
+  }
+  raysInserted += rays.size();
+}
+
+int8_t OfflineMap::getLogOdds(int32_t vx, int32_t vy, int32_t vz)
+{
+  uint64_t k = key(vx >> VOXELMAP_TILE_BITS, vy >> VOXELMAP_TILE_BITS, vz >> VOXELMAP_TILE_BITS);
+  Shard & shard = _shards[shardOf(k)];
+  std::unordered_map<uint64_t, size_t>::iterator found = shard.index.find(k);
+  if (found == shard.index.end()) return 0;
+  const int32_t m = VOXELMAP_TILE_DIM - 1;
+  return shard.tiles[found->second].logodds[((vz & m) << (2 * VOXELMAP_TILE_BITS)) | ((vy & m) << VOXELMAP_TILE_BITS) | (vx & m)];
+}
+
+void OfflineMap::tileCoordinates(std::vector<int16_t> & txyz)
+{
+  txyz.clear();
+  for (unsigned s = 0; s < OFFLINEMAP_SHARDS; s++) {
+    for (size_t i = 0; i < _shards[s].tiles.size(); i++) {
+      txyz.push_back(_shards[s].tiles[i].tx);
+      txyz.push_back(_shards[s].tiles[i].ty);
+      txyz.push_back(_shards[s].tiles[i].tz);
+    }
+  }
+}
+
+size_t OfflineMap::tilesUsed()
+{
+  size_t n = 0;
+  for (unsigned s = 0; s < OFFLINEMAP_SHARDS; s++) n += _shards[s].tiles.size();
+  return n;
+}
+
+// Tile storage only; the hash maps add about as much again on a typical standard library
+float OfflineMap::bytesPerCubicMetre()
+{
+  size_t n = tilesUsed();
+  if (!n) return 0.0f;
+  float tileEdge_m = resolution * VOXELMAP_TILE_DIM * 0.001f;
+  return (float)(n * sizeof(voxel_tile_t)) / ((float)n * tileEdge_m * tileEdge_m * tileEdge_m);
+}
@@ -0,0 +1,70 @@
+/* Offline voxel map building on the PC side
+
+  The same log-odds map as VoxelMap, with the same rays and the same updates, but with tiles allocated as
+  needed and insertion spread over threads. The tiles are shared out between OFFLINEMAP_SHARDS shards by
+  their coordinates. A block of rays is inserted in two passes:
+
+      walk       each thread casts a contiguous run of the rays and files every voxel update under the shard
+                 of its tile
+      apply      each thread takes whole shards and applies their updates, run by run in ray order
+
+  No tile is touched by two threads, and every voxel sees its updates in the order a single VoxelMap would,
+  so the saturating log-odds come out identical to it whatever the thread count.
+*/
+
+#ifndef OfflineMap_h
+#define OfflineMap_h
+
+#include "VoxelMap.h"
+
+#include <unordered_map>
+#include <vector>
+
+#define OFFLINEMAP_SHARDS  64
+#define OFFLINEMAP_BLOCK   16384   // rays per pass, bounds the update lists
+
+struct MapScan {
+  std::vector<float> x, y, z;   // mm, platform frame, as PointCloud gives them
+  float origin[3];              // mm
+};
+
+class OfflineMap
+{
+  public:
+    OfflineMap(float resolution_mm);
+
+    // All points of the scans in order, as VoxelMap::insertScan() would take them one scan at a time.
+    // threads 0 means one per CPU.
+    void insert(const std::vector<MapScan> & scans, float maxRange_mm, unsigned threads);
+
+    int8_t getLogOdds(int32_t vx, int32_t vy, int32_t vz);   // voxel coordinates
+    void tileCoordinates(std::vector<int16_t> & txyz);       // three per tile
+
+    size_t tilesUsed();
+    float bytesPerCubicMetre();
+
+    float resolution;
+    uint64_t raysInserted;
+    uint64_t voxelsUpdated;
+
+  private:
+    struct Update {
+      uint64_t key;
+      uint16_t voxel;
+      int8_t delta;
+    };
+    struct Shard {
+      std::unordered_map<uint64_t, size_t> index;
+      std::vector<voxel_tile_t> tiles;
+    };
+
+    Shard _shards[OFFLINEMAP_SHARDS];
+    float _invResolution;
+
+    static uint64_t key(int32_t tx, int32_t ty, int32_t tz);
+    static unsigned shardOf(uint64_t key);
+    void walk(const float * from, const float * to, bool hit, std::vector<Update> * out);
+    void apply(Shard & shard, const std::vector<Update> & updates);
+};
+
+#endif
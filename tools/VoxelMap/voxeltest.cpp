@@ -0,0 +1,221 @@
+/* voxeltest: host tests and benchmark of the EM7180_MPU9250_BMP280 voxel map
+
+  Build and run, from this directory:
+
+    g++ -O2 -std=c++11 -pthread -Ihost -I../../EM7180_MPU9250_BMP280 voxeltest.cpp OfflineMap.cpp ../../EM7180_MPU9250_BMP280/VoxelMap.cpp ../../EM7180_MPU9250_BMP280/PointCloud.cpp -o voxeltest
+    ./voxeltest
+
+  The sweeps come from PointCloud, fed EM7180 quaternions of a platform rolling at 63 degrees per second in a
+  3.5 x 3.0 x 2.2 m room, with the lidar in the middle at 10 Hz and 4000 returns per second, the way the
+  sketch feeds it. The roll is slow enough, and out of step with the sweeps, for the scan planes to cover the
+  walls at the voxel size within 10 s. The map is the sketch's: 150 mm voxels and the default pool of 48 tiles, which just covers
+  the room.
+
+    occupancy    after 10 s, the voxels on the walls must be occupied (at least 90 %, rays grazing a wall clear
+                 some) and no voxel 300 mm or more inside the room may be
+    throughput   rays and voxel updates per second through VoxelMap::insertScan() on one core, and the memory
+                 per mapped cubic metre
+    parallel     OfflineMap on 1, 2, 4 and 8 threads must give every voxel of the VoxelMap, bit for bit; the
+                 time for each is printed
+
+  Exit status 1 if any test fails.
+*/
+
+#include "OfflineMap.h"
+#include "PointCloud.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+static const uint32_t LOOP_US = 1000;
+static const uint32_t POSE_US = 5000;
+static const uint32_t NODE_US = 250;          // 4000 returns per second
+static const uint32_t TURN_US = 100000;       // 10 Hz
+static const int32_t  LATE_US = 6000;
+static const double   ROLL_RATE = 1.1;        // rad/s
+static const float    RESOLUTION = 150;       // mm
+static const float    MAX_RANGE = 8000;       // mm
+
+static const double lo[3] = {-1520, -1480, -980}, hi[3] = {1980, 1530, 1210};   // room walls, mm
+
+static double roll(double t_us) { return ROLL_RATE * t_us * 1e-6; }
+
+// The return measured at IMU time t: the distance to the wall along the lidar beam
+static rplidar_measurement_t node(uint32_t t)
+{
+  rplidar_measurement_t m;
+  uint32_t phase = t % TURN_US;
+  m.angle_q6 = (uint16_t)((uint64_t)phase * 360 * 64 / TURN_US);
+  m.quality = 47;
+  m.flags = phase == 0 ? RPLIDAR_FLAG_START : 0;
+  double a = m.angle_q6 / 64.0 * M_PI / 180, r = roll(t);
+  double u[3] = {cos(a), -sin(a) * cos(r), -sin(a) * sin(r)}, d = 1e9;
+  for (int k = 0; k < 3; k++) {
+    if (u[k] > 1e-9) d = std::min(d, hi[k] / u[k]);
+    if (u[k] < -1e-9) d = std::min(d, lo[k] / u[k]);
+  }
+  m.distance_q2 = (uint32_t)lrint(d * 4);
+  return m;
+}
+
+// Sweeps as the sketch's loop gets them out of PointCloud: a pose every 5 ms, a batch every millisecond
+static std::vector<MapScan> sweeps(uint32_t seconds)
+{
+  std::vector<MapScan> scans;
+  PointCloud * cloud = new PointCloud;
+  cloud->init();
+  cloud->lidarLate_us = LATE_US;
+  rplidar_measurement_t nodes[LOOP_US / NODE_US];
+  for (uint32_t now = LATE_US + LOOP_US; now <= seconds * 1000000u; now += LOOP_US) {
+    if (now % POSE_US == 0) {
+      double a = roll(now);
+      float quat[4] = {(float)sin(a / 2), 0, 0, (float)cos(a / 2)};
+      cloud->addPose(now, quat);
+    }
+    uint16_t n = 0;
+    for (uint32_t t = now - LOOP_US; t < now; t += NODE_US) nodes[n++] = node(t - LATE_US);
+    uint32_t dt = LOOP_US;
+    for (uint16_t done = 0; done < n; ) {
+      uint16_t used = cloud->addScan(&nodes[done], n - done, now - LOOP_US + dt * done / n, now);
+      if (cloud->sweepReady) {
+        MapScan s;
+        s.x.assign(cloud->x, cloud->x + cloud->count);
+        s.y.assign(cloud->y, cloud->y + cloud->count);
+        s.z.assign(cloud->z, cloud->z + cloud->count);
+        s.origin[0] = s.origin[1] = s.origin[2] = 0;
+        scans.push_back(s);
+        cloud->clear();
+      }
+      else if (!used) break;
+      done += used;
+    }
+  }
+  delete cloud;
+  return scans;
+}
+
+static void insert(VoxelMap & map, const std::vector<MapScan> & scans)
+{
+  for (size_t s = 0; s < scans.size(); s++)
+    map.insertScan(&scans[s].x[0], &scans[s].y[0], &scans[s].z[0], scans[s].x.size(), scans[s].origin, MAX_RANGE);
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+static void occupancy()
+{
+  std::vector<MapScan> scans = sweeps(10);
+  VoxelMap * map = new VoxelMap(RESOLUTION);
+  insert(*map, scans);
+
+  // Points 100 mm apart on each wall, 200 mm clear of its edges
+  int wall = 0, occupied = 0;
+  for (int k = 0; k < 3; k++) {
+    int a = (k + 1) % 3, b = (k + 2) % 3;
+    for (double p = lo[a] + 200; p <= hi[a] - 200; p += 100) {
+      for (double q = lo[b] + 200; q <= hi[b] - 200; q += 100) {
+        for (int side = 0; side < 2; side++) {
+          float v[3];
+          v[k] = side ? hi[k] : lo[k];
+          v[a] = p;
+          v[b] = q;
+          wall++;
+          occupied += map->isOccupied(v[0], v[1], v[2]);
+        }
+      }
+    }
+  }
+
+  // Every voxel whose centre is 300 mm inside the walls
+  int inside = 0, seen = 0, wrong = 0;
+  for (int32_t vx = (int32_t)floor(lo[0] / RESOLUTION); vx * RESOLUTION < hi[0]; vx++) {
+    for (int32_t vy = (int32_t)floor(lo[1] / RESOLUTION); vy * RESOLUTION < hi[1]; vy++) {
+      for (int32_t vz = (int32_t)floor(lo[2] / RESOLUTION); vz * RESOLUTION < hi[2]; vz++) {
+        float c[3] = {(vx + 0.5f) * RESOLUTION, (vy + 0.5f) * RESOLUTION, (vz + 0.5f) * RESOLUTION};
+        bool deep = true;
+        for (int k = 0; k < 3; k++) deep = deep && c[k] - lo[k] >= 300 && hi[k] - c[k] >= 300;
+        if (!deep) continue;
+        inside++;
+        int8_t l = map->getLogOdds(c[0], c[1], c[2]);
+        seen += l != 0;
+        wrong += l > VOXELMAP_OCCUPIED;
+      }
+    }
+  }
+  printf("  %zu sweeps, %u rays: %d of %d wall points occupied, %d of %d inner voxels seen, %d occupied, "
+         "%u tiles, %u updates dropped\n", scans.size(), map->raysInserted, occupied, wall, seen, inside, wrong,
+         map->tilesUsed(), map->droppedUpdates);
+  result("occupancy", occupied >= wall * 9 / 10 && wrong == 0 && seen > inside / 2 && !map->droppedUpdates);
+  delete map;
+}
+
+static void throughput()
+{
+  std::vector<MapScan> scans = sweeps(10);
+  VoxelMap * map = new VoxelMap(RESOLUTION);
+  auto t0 = std::chrono::steady_clock::now();
+  insert(*map, scans);
+  auto t1 = std::chrono::steady_clock::now();
+  double s = std::chrono::duration<double>(t1 - t0).count();
+  printf("  %u rays in %.1f ms: %.2f M rays/s, %.0f M voxel updates/s, %.1f voxels per ray\n", map->raysInserted,
+         s * 1e3, map->raysInserted / s * 1e-6, map->voxelsUpdated / s * 1e-6,
+         (double)map->voxelsUpdated / map->raysInserted);
+  printf("  %u tiles, %.0f bytes per mapped cubic metre, sizeof(VoxelMap) %zu bytes\n", map->tilesUsed(),
+         map->bytesPerCubicMetre(), sizeof(VoxelMap));
+  result("throughput", map->raysInserted > 0 && !map->droppedUpdates);
+  delete map;
+}
+
+static void parallel()
+{
+  std::vector<MapScan> scans = sweeps(10);
+  VoxelMap * map = new VoxelMap(RESOLUTION);
+  insert(*map, scans);
+
+  bool pass = true;
+  const unsigned threads[] = {1, 2, 4, 8};
+  for (unsigned k = 0; k < 4; k++) {
+    OfflineMap offline(RESOLUTION);
+    auto t0 = std::chrono::steady_clock::now();
+    offline.insert(scans, MAX_RANGE, threads[k]);
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::vector<int16_t> tiles;
+    offline.tileCoordinates(tiles);
+    bool ok = tiles.size() / 3 == map->tilesUsed() && offline.raysInserted == map->raysInserted &&
+              offline.voxelsUpdated == map->voxelsUpdated;
+    for (size_t i = 0; ok && i < tiles.size(); i += 3) {
+      for (int32_t v = 0; ok && v < VOXELMAP_TILE_VOXELS; v++) {
+        int32_t vx = tiles[i] * VOXELMAP_TILE_DIM + (v & 7), vy = tiles[i + 1] * VOXELMAP_TILE_DIM + ((v >> 3) & 7),
+                vz = tiles[i + 2] * VOXELMAP_TILE_DIM + (v >> 6);
+        ok = offline.getLogOdds(vx, vy, vz) ==
+             map->getLogOdds((vx + 0.5f) * RESOLUTION, (vy + 0.5f) * RESOLUTION, (vz + 0.5f) * RESOLUTION);
+      }
+    }
+    double s = std::chrono::duration<double>(t1 - t0).count();
+    printf("  %u thread%s: %.1f ms, %.2f M rays/s, %s\n", threads[k], threads[k] > 1 ? "s" : "", s * 1e3,
+           offline.raysInserted / s * 1e-6, ok ? "identical" : "DIFFERENT");
+    pass = pass && ok;
+  }
+  printf("  %u CPU%s on this machine\n", std::thread::hardware_concurrency(),
+         std::thread::hardware_concurrency() == 1 ? "" : "s");
+  result("parallel", pass);
+  delete map;
+}
+
+int main()
+{
+  occupancy();
+  throughput();
+  parallel();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,310 @@
+/* storetest: host tests of the warm start A/B store in WarmStartandAccelCal, and of the background checkpoint
+   that fills it
+
+  Build and run, from this directory:
+
+    sed -nE 's|^([A-Za-z_][^;=]*\)) *\{? *(//.*)?$|\1;|p' ../../WarmStartandAccelCal/*.ino > protos.h
+    sed -nE 's/^ *(void \w+QuaternionUpdate\(.*\)) *$/\1;/p' ../../WarmStartandAccelCal/quaternionFilters >> protos.h
+    g++ -O2 -std=gnu++11 -w -I../FlightRecorder/host -I../../WarmStartandAccelCal storetest.cpp -o storetest && ./storetest
+
+  The whole sketch is compiled against frtest's host models (tools/FlightRecorder/host): the M24512DFM with its
+  page writes and write cycle, reachable only in pass-through, which can lose power after any byte written and
+  leave the rest of that page part old, part garbage, and a SENtral giving a quaternion every 10 ms and
+  acknowledging each warm start parameter request 1 ms after it.
+
+    slots        commits alternate between the slots and the newest record loads, also after a reset; a
+                 commit of only the accelerometer sections keeps the warm start parameters
+    power loss   power cut after every byte of a commit, 20 times each with different garbage: after a reset
+                 WS_storeLoad() must give back the previous record or the new one, never nothing or a mix,
+                 the new one whenever the commit returned true, and the next commit must succeed
+    timing       bus time of a load, against the two reads with a delay(100) between them it replaced, of a
+                 commit, and the CRC of a record on this machine
+    checkpoint   loop() with a '1' typed: the longest gap between quaternion reads must stay under 50 ms,
+                 against the blocking save it replaced, reproduced here; a periodic check must write nothing
+                 when the parameters have not changed and the record's two pages when they have
+    fetch stall  a SENtral that stops acknowledging at parameter 11: the checkpoint must give up within
+                 WS_CP_TIMEOUT and leave ParamRequest and AlgorithmControl at 0
+
+  Exit status 1 if any test fails.
+*/
+
+#include "Arduino.h"
+#include "i2c_t3.h"
+#include "Global.h"
+#include "protos.h"
+
+#include "EM71280_MPU9250_BMP280_M24512DFC_WS_Acc_Cal.ino"
+#include "quaternionFilters"
+#include "AccelCal.cpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+uint64_t simNow_ns = 0;
+std::string frOut;
+bool frCapture = false;
+int serialIn = -1;
+HostSerial Serial;
+SimEeprom simEeprom;
+SimSentral simSentral;
+i2c_t3_ Wire;
+
+void simAdvance(uint64_t ns)
+{
+  simNow_ns += ns;
+}
+
+static int failures = 0;
+static void result(const char * test, bool pass)
+{
+  printf("%-12s %s\n", test, pass ? "PASS" : "FAIL");
+  if (!pass) failures++;
+}
+
+// Record contents numbered v, so a load can be told apart from its neighbours and from a mix of two
+static void fill(uint32_t v, Sentral_WS_params & p, acc_cal & c, acc_matrix & m)
+{
+  for (int i = 0; i < 140; i++) p.Sen_param[i / 4][i % 4] = v * 31 + i;
+  for (int i = 0; i < 3; i++) {
+    c.accZero_max[i] = 2000 + v + i;
+    c.accZero_min[i] = -2000 - v - i;
+    for (int j = 0; j < 3; j++) m.matrix[i][j] = v + 0.1f * i + 0.01f * j;
+    m.bias[i] = -0.001f * v * i;
+  }
+  m.sentralCal = 1;
+  memset(m.reserved, 0, sizeof(m.reserved));
+}
+
+static bool commit(uint32_t v)
+{
+  Sentral_WS_params p;
+  acc_cal c;
+  acc_matrix m;
+  fill(v, p, c, m);
+  return WS_storeCommit(&p, &c, &m);
+}
+
+static bool holds(const WS_record & r, uint32_t v)
+{
+  Sentral_WS_params p;
+  acc_cal c;
+  acc_matrix m;
+  fill(v, p, c, m);
+  return !memcmp(&r.params, &p, sizeof(p)) && !memcmp(&r.cal, &c, sizeof(c)) && !memcmp(&r.accMatrix, &m, sizeof(m));
+}
+
+// Power comes back: the sketch has forgotten the store, the EEPROM has finished whatever it was doing
+static void reset()
+{
+  WS_storeSlot = 0;
+  memset(&WS_storeCache, 0, sizeof(WS_storeCache));
+  simEeprom.busyUntil = 0;
+  simEeprom.cutAfter = -1;
+  simSentral.write(0xA0, 0x00);
+  WS_PassThroughMode();
+}
+
+static void slots()
+{
+  reset();
+  WS_record r;
+  bool pass = !WS_storeLoad(&r);
+  uint16_t last = 0;
+  for (uint32_t v = 1; v <= 5; v++) {
+    bool ok = commit(v);
+    reset();
+    uint16_t slot = WS_storeLoad(&r);
+    pass = pass && ok && slot && slot != last && holds(r, v);
+    last = slot;
+  }
+
+  Sentral_WS_params p;
+  acc_cal c;
+  acc_matrix m;
+  fill(9, p, c, m);
+  WS_storeCommit(NULL, &c, &m);
+  reset();
+  WS_storeLoad(&r);
+  Sentral_WS_params p5;
+  fill(5, p5, c, m);
+  bool kept = !memcmp(&r.params, &p5, sizeof(p5)) && r.cal.accZero_max[0] == 2009 && r.accMatrix.matrix[0][0] == 9;
+  printf("  5 commits alternate and load back, an accelerometer only commit %s the parameters\n",
+         kept ? "keeps" : "LOSES");
+  result("slots", pass && kept);
+}
+
+static void powerLoss()
+{
+  reset();
+  commit(10);
+  reset();
+  static uint8_t before[sizeof(simEeprom.mem)];
+  memcpy(before, simEeprom.mem, sizeof(before));
+
+  int trials = 0, previous = 0, fresh = 0, bad = 0, stuck = 0;
+  for (uint32_t cut = 0; cut <= sizeof(WS_record); cut++) {
+    for (int rep = 0; rep < 20; rep++) {
+      WS_record r;
+      WS_storeLoad(&r);
+      simEeprom.cutAfter = simEeprom.bytesWritten + cut;
+      bool returned = false, ok = false;
+      try {
+        ok = commit(11);
+        returned = true;
+      }
+      catch (int) {}
+      reset();
+      trials++;
+      if (!WS_storeLoad(&r)) bad++;
+      else if (holds(r, 11)) fresh++;
+      else if (holds(r, 10)) previous++;
+      else bad++;
+      if (returned && ok && !holds(r, 11)) bad++;
+      if (!commit(12)) stuck++;
+      reset();
+      if (!WS_storeLoad(&r) || !holds(r, 12)) stuck++;
+      memcpy(simEeprom.mem, before, sizeof(before));
+      reset();
+    }
+  }
+  printf("  %d cuts in a %zu byte record: previous loaded %d, new loaded %d, bad %d, next commit failed %d\n",
+         trials, sizeof(WS_record), previous, fresh, bad, stuck);
+  result("power loss", bad == 0 && stuck == 0 && previous > 0 && fresh > 0);
+}
+
+static void timing()
+{
+  reset();
+  commit(20);
+  reset();
+  uint8_t data[140];
+  uint64_t t0 = simNow_ns;
+  M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, 0x7F, 0x80, 12, &data[128]);
+  delay(100);
+  M24512DFMreadBytes(M24512DFM_DATA_ADDRESS, 0x7F, 0x00, 128, &data[0]);
+  double old_ms = (simNow_ns - t0) * 1e-6;
+  WS_record r;
+  t0 = simNow_ns;
+  WS_storeLoad(&r);
+  double load_ms = (simNow_ns - t0) * 1e-6;
+  t0 = simNow_ns;
+  bool ok = commit(21);
+  double commit_ms = (simNow_ns - t0) * 1e-6;
+
+  const int rounds = 100000;
+  volatile uint32_t sink = 0;
+  auto w0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) sink += WS_crc32((const uint8_t *)&r, offsetof(WS_record, crc));
+  double crc_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - w0).count() / rounds;
+  printf("  load %.1f ms (the old two reads %.1f ms), commit %.1f ms, CRC of a record %.2f us on this machine\n",
+         load_ms, old_ms, commit_ms, crc_us);
+  result("timing", ok && load_ms < old_ms);
+}
+
+// The save behind a '1' before the background checkpoint: each parameter waited for with a delay(10) and read a
+// byte at a time, then fixed delays around pass-through
+static void blockingSave()
+{
+  writeByte(EM7180_ADDRESS, EM7180_ParamRequest, 1);
+  delay(10);
+  writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x80);
+  delay(10);
+  for (uint8_t param = 1; param <= 35; param++) {
+    if (param > 1) {
+      writeByte(EM7180_ADDRESS, EM7180_ParamRequest, param);
+      delay(10);
+    }
+    while (readByte(EM7180_ADDRESS, EM7180_ParamAcknowledge) != param) {}
+    for (uint8_t k = 0; k < 4; k++) WS_params.Sen_param[param - 1][k] = readByte(EM7180_ADDRESS, EM7180_SavedParamByte0 + k);
+  }
+  writeByte(EM7180_ADDRESS, EM7180_ParamRequest, 0x00);
+  writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x00);
+  writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x01);
+  delay(5);
+  writeByte(EM7180_ADDRESS, EM7180_PassThruControl, 0x01);
+  delay(5);
+  while (!(readByte(EM7180_ADDRESS, EM7180_PassThruStatus) & 0x01)) delay(5);
+  WS_storeCommit(&WS_params, NULL, NULL);
+  writeByte(EM7180_ADDRESS, EM7180_PassThruControl, 0x00);
+  delay(5);
+  while (readByte(EM7180_ADDRESS, EM7180_PassThruStatus) & 0x01) delay(5);
+  writeByte(EM7180_ADDRESS, EM7180_AlgorithmControl, 0x00);
+  delay(5);
+}
+
+enum Save { NO_SAVE, TYPED, BLOCKING };
+
+// Runs loop() for ms, each pass also taking 50 us for the filter and prints; returns the longest gap between
+// quaternion reads in ms. A save, if any, is typed (or made the old way) at half time.
+static double runLoop(uint32_t ms, Save save)
+{
+  uint64_t end = simNow_ns + ms * 1000000ull, saveAt = simNow_ns + ms * 500000ull;
+  bool saved = save == NO_SAVE;
+  simSentral.quatReads.clear();
+  while (simNow_ns < end) {
+    if (!saved && simNow_ns >= saveAt) {
+      if (save == BLOCKING) blockingSave();
+      else serialIn = '1';
+      saved = true;
+    }
+    simAdvance(50000);
+    loop();
+  }
+  std::vector<uint64_t> & q = simSentral.quatReads;
+  uint64_t gap = 0;
+  for (size_t i = 1; i < q.size(); i++) gap = std::max(gap, q[i] - q[i - 1]);
+  return gap * 1e-6;
+}
+
+static void checkpoint()
+{
+  reset();
+  WS_Resume();
+  double blocking_ms = runLoop(2000, BLOCKING);
+  uint32_t writes = simEeprom.pageWrites;
+  double background_ms = runLoop(2000, TYPED);
+  bool saved = simEeprom.pageWrites - writes >= 2 && WS_cpState == WS_CP_IDLE;
+
+  writes = simEeprom.pageWrites;
+  WS_checkpointStart(false);
+  runLoop(200, NO_SAVE);
+  uint32_t unchanged = simEeprom.pageWrites - writes;
+  simSentral.paramSalt = 1;
+  writes = simEeprom.pageWrites;
+  WS_checkpointStart(false);
+  runLoop(200, NO_SAVE);
+  uint32_t changed = simEeprom.pageWrites - writes;
+  simSentral.paramSalt = 0;
+  printf("  longest quaternion gap around a save: %.1f ms blocking, %.1f ms in the background\n", blocking_ms,
+         background_ms);
+  printf("  periodic check, page writes: %u with the parameters unchanged, %u changed\n", unchanged, changed);
+  result("checkpoint", saved && background_ms < 50 && unchanged == 0 && changed == 2);
+}
+
+static void fetchStall()
+{
+  simSentral.silentFrom = 11;
+  WS_checkpointStart(false);
+  uint64_t t0 = simNow_ns;
+  while (WS_cpState != WS_CP_IDLE && simNow_ns - t0 < 5000000000ull) {
+    simAdvance(50000);
+    loop();
+  }
+  double idle_ms = (simNow_ns - t0) * 1e-6;
+  bool released = simSentral.reg[EM7180_ParamRequest] == 0 && simSentral.reg[EM7180_AlgorithmControl] == 0;
+  simSentral.silentFrom = 0;
+  printf("  idle again after %.0f ms, ParamRequest and AlgorithmControl %s\n", idle_ms, released ? "at 0" : "LEFT SET");
+  result("fetch stall", WS_cpState == WS_CP_IDLE && idle_ms < WS_CP_TIMEOUT + 50 && released);
+}
+
+int main()
+{
+  simNow_ns = 1000000000ull;
+  slots();
+  powerLoss();
+  timing();
+  checkpoint();
+  fetchStall();
+  return failures ? 1 : 0;
+}